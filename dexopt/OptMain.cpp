@@ -29,6 +29,9 @@
  * (3) On the host during a build for preoptimization. This behaves
  *     almost the same as (2), except it takes file names instead of
  *     file descriptors.
+ * (4) Incrementally, which behaves like (3) but also takes the output of
+ *     a previous run, and only verifies and optimizes the classes that
+ *     changed since.
  *
  * There are some fragile aspects around bootclasspath entries, owing
  * largely to the VM's history of working on whenever it thought it needed
@@ -43,12 +46,77 @@
 
 #include <fcntl.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <zlib.h>
 
 static const char* kClassesDex = "classes.dex";
 
+/*
+ * Checksum of a DEX file computed while it is extracted, so the optimizer
+ * does not have to read the whole file back to check it.
+ */
+struct ExtractChecksum {
+    size_t  length;                 // bytes seen so far
+    uLong   adler;                  // adler32 of the bytes past "nonSum"
+    u1      header[offsetof(DexHeader, headerSize)];    // through fileSize
+};
+
+/* the magic and the checksum itself are not part of the checksum */
+static const size_t kChecksumNonSum = offsetof(DexHeader, signature);
+
+/*
+ * ZipEntryDataFunc that adds the next piece of the DEX to the checksum.
+ */
+static void addToExtractChecksum(const u1* data, size_t len, void* arg)
+{
+    ExtractChecksum* pChecksum = (ExtractChecksum*) arg;
+    size_t skip = 0;
+    size_t i;
+
+    for (i = 0; i < len && pChecksum->length + i < sizeof(pChecksum->header);
+        i++)
+    {
+        pChecksum->header[pChecksum->length + i] = data[i];
+    }
+
+    if (pChecksum->length < kChecksumNonSum) {
+        skip = kChecksumNonSum - pChecksum->length;
+        if (skip > len)
+            skip = len;
+    }
+    pChecksum->adler = adler32(pChecksum->adler, data + skip, len - skip);
+    pChecksum->length += len;
+}
+
+/*
+ * Read a little-endian 32-bit value from the extracted header.
+ */
+static u4 getHeader4LE(const ExtractChecksum* pChecksum, size_t offset)
+{
+    const u1* ptr = pChecksum->header + offset;
+    return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((u4) ptr[3] << 24);
+}
+
+/*
+ * Returns "true" if the DEX file seen by addToExtractChecksum() is complete
+ * and matches the checksum in its header.
+ */
+static bool extractChecksumMatches(const ExtractChecksum* pChecksum)
+{
+    if (pChecksum->length < sizeof(pChecksum->header))
+        return false;
+    if (getHeader4LE(pChecksum, offsetof(DexHeader, fileSize)) !=
+        pChecksum->length)
+    {
+        return false;
+    }
+    return getHeader4LE(pChecksum, offsetof(DexHeader, checksum)) ==
+        pChecksum->adler;
+}
+
 
 /*
  * Extract "classes.dex" from zipFd into "cacheFd", leaving a little space
@@ -56,16 +124,18 @@ static const char* kClassesDex = "classes.dex";
  */
 static int extractAndProcessZip(int zipFd, int cacheFd,
     const char* debugFileName, bool isBootstrap, const char* bootClassPath,
-    const char* dexoptFlagStr)
+    const char* dexoptFlagStr, int prevFd)
 {
     ZipArchive zippy;
     ZipEntry zipEntry;
+    ExtractChecksum checksum;
     size_t uncompLen;
     long modWhen, crc32;
     off_t dexOffset;
     int err;
     int result = -1;
     int dexoptFlags = 0;        /* bit flags, from enum DexoptFlags */
+    int threadCount = 1;
     DexClassVerifyMode verifyMode = VERIFY_MODE_ALL;
     DexOptimizerMode dexOptMode = OPTIMIZE_MODE_VERIFIED;
 
@@ -121,12 +191,26 @@ static int extractAndProcessZip(int zipFd, int cacheFd,
 
     /*
      * Extract the DEX data into the cache file at the current offset.
+     * Stored entries are written straight from a mapping of the zip file.
+     * We compute the DEX checksum on each piece of data while it is still
+     * in the cache, so the optimizer can skip its own pass over the file.
      */
-    if (dexZipExtractEntryToFile(&zippy, zipEntry, cacheFd) != 0) {
+    memset(&checksum, 0, sizeof(checksum));
+    checksum.adler = adler32(0L, Z_NULL, 0);
+    if (dexZipExtractEntryToFileWithFunc(&zippy, zipEntry, cacheFd,
+            addToExtractChecksum, &checksum) != 0)
+    {
         ALOGW("DexOptZ: extraction of %s from %s failed",
             kClassesDex, debugFileName);
         goto bail;
     }
+    if (extractChecksumMatches(&checksum)) {
+        dexoptFlags |= DEXOPT_CHECKSUM_VERIFIED;
+    } else {
+        /* let the optimizer report it */
+        ALOGV("DexOptZ: checksum of %s not verified on extraction",
+            kClassesDex);
+    }
 
     /* Parse the options. */
     if (dexoptFlagStr[0] != '\0') {
@@ -167,6 +251,13 @@ static int extractAndProcessZip(int zipFd, int cacheFd,
             default:                                            break;
             }
         }
+
+        opc = strstr(dexoptFlagStr, "t=");      /* verify/opt threads */
+        if (opc != NULL) {
+            threadCount = strtol(opc+2, NULL, 10);
+            if (threadCount < 1)
+                threadCount = 1;
+        }
     }
 
     /*
@@ -174,7 +265,7 @@ static int extractAndProcessZip(int zipFd, int cacheFd,
      */
 
     if (dvmPrepForDexOpt(bootClassPath, dexOptMode, verifyMode,
-            dexoptFlags) != 0)
+            dexoptFlags, threadCount) != 0)
     {
         ALOGE("DexOptZ: VM init failed");
         goto bail;
@@ -184,7 +275,7 @@ static int extractAndProcessZip(int zipFd, int cacheFd,
 
     /* do the optimization */
     if (!dvmContinueOptimization(cacheFd, dexOffset, uncompLen, debugFileName,
-            modWhen, crc32, isBootstrap))
+            modWhen, crc32, isBootstrap, prevFd))
     {
         ALOGE("Optimization failed");
         goto bail;
@@ -201,10 +292,11 @@ bail:
 
 /*
  * Common functionality for normal device-side processing as well as
- * preoptimization.
+ * preoptimization.  "prevFd" is the output of a previous run to reuse
+ * results from, or -1.
  */
 static int processZipFile(int zipFd, int cacheFd, const char* zipName,
-        const char *dexoptFlags)
+        const char *dexoptFlags, int prevFd)
 {
     char* bcpCopy = NULL;
 
@@ -246,7 +338,7 @@ static int processZipFile(int zipFd, int cacheFd, const char* zipName,
     }
 
     int result = extractAndProcessZip(zipFd, cacheFd, zipName, isBootstrap,
-            bcp, dexoptFlags);
+            bcp, dexoptFlags, prevFd);
 
     free(bcpCopy);
     return result;
@@ -307,7 +399,7 @@ static int fromZip(int argc, char* const argv[])
     dexoptFlags = *++argv;
     --argc;
 
-    result = processZipFile(zipFd, cacheFd, zipName, dexoptFlags);
+    result = processZipFile(zipFd, cacheFd, zipName, dexoptFlags, -1);
 
 bail:
     return result;
@@ -370,13 +462,89 @@ static int preopt(int argc, char* const argv[])
         goto bail;
     }
 
-    result = processZipFile(zipFd, outFd, zipName, dexoptFlags);
+    result = processZipFile(zipFd, outFd, zipName, dexoptFlags, -1);
+
+bail:
+    if (zipFd >= 0) {
+        close(zipFd);
+    }
+
+    if (outFd >= 0) {
+        close(outFd);
+    }
+
+    return result;
+}
+
+/*
+ * Parse arguments for an incremental run.  This is a preoptimization run
+ * that reuses the verification and optimization results of the classes
+ * that did not change since a previous run, when they are still valid.
+ * We want:
+ *   0. (name of dexopt command -- ignored)
+ *   1. "--incremental"
+ *   2. zipfile name
+ *   3. output file name
+ *   4. previous output file name
+ *   5. dexopt flags
+ *
+ * The previous output may be missing or stale, in which case all of the
+ * classes are processed, as they would be by "--preopt".
+ */
+static int incremental(int argc, char* const argv[])
+{
+    int zipFd = -1;
+    int outFd = -1;
+    int prevFd = -1;
+    int result = -1;
+
+    if (argc != 6) {
+        fprintf(stderr, "Wrong number of args for --incremental (found %d)\n",
+                argc);
+        return -1;
+    }
+
+    const char* zipName = argv[2];
+    const char* outName = argv[3];
+    const char* prevName = argv[4];
+    const char* dexoptFlags = argv[5];
+
+    if (strstr(dexoptFlags, "u=y") == NULL &&
+        strstr(dexoptFlags, "u=n") == NULL)
+    {
+        fprintf(stderr, "Either 'u=y' or 'u=n' must be specified\n");
+        return -1;
+    }
+
+    zipFd = open(zipName, O_RDONLY);
+    if (zipFd < 0) {
+        perror(argv[0]);
+        return -1;
+    }
+
+    prevFd = open(prevName, O_RDONLY);
+    if (prevFd < 0) {
+        ALOGD("DexOptZ: no previous output '%s', processing all classes",
+            prevName);
+    }
+
+    outFd = open(outName, O_RDWR | O_EXCL | O_CREAT, 0666);
+    if (outFd < 0) {
+        perror(argv[0]);
+        goto bail;
+    }
+
+    result = processZipFile(zipFd, outFd, zipName, dexoptFlags, prevFd);
 
 bail:
     if (zipFd >= 0) {
         close(zipFd);
     }
 
+    if (prevFd >= 0) {
+        close(prevFd);
+    }
+
     if (outFd >= 0) {
         close(outFd);
     }
@@ -510,7 +678,7 @@ static int fromDex(int argc, char* const argv[])
         dexOptMode = OPTIMIZE_MODE_NONE;
     }
 
-    if (dvmPrepForDexOpt(bootClassPath, dexOptMode, verifyMode, flags) != 0) {
+    if (dvmPrepForDexOpt(bootClassPath, dexOptMode, verifyMode, flags, 1) != 0) {
         ALOGE("VM init failed");
         goto bail;
     }
@@ -519,7 +687,7 @@ static int fromDex(int argc, char* const argv[])
 
     /* do the optimization */
     if (!dvmContinueOptimization(fd, offset, length, debugFileName,
-            modWhen, crc, (flags & DEXOPT_IS_BOOTSTRAP) != 0))
+            modWhen, crc, (flags & DEXOPT_IS_BOOTSTRAP) != 0, -1))
     {
         ALOGE("Optimization failed");
         goto bail;
@@ -567,6 +735,8 @@ int main(int argc, char* const argv[])
             return fromDex(argc, argv);
         else if (strcmp(argv[1], "--preopt") == 0)
             return preopt(argc, argv);
+        else if (strcmp(argv[1], "--incremental") == 0)
+            return incremental(argc, argv);
     }
 
     fprintf(stderr,
@@ -19,6 +19,7 @@
  */
 
 #include "DexFile.h"
+#include "DexClass.h"
 #include "DexOptData.h"
 #include "DexProto.h"
 #include "DexCatch.h"
@@ -262,6 +263,142 @@ DexClassLookup* dexCreateClassLookup(DexFile* pDexFile)
 }
 
 
+/*
+ * Add a type list to a hash, by contents rather than by offset.
+ */
+static void hashTypeList(SHA1_CTX* pContext, const DexTypeList* pList)
+{
+    u4 size = (pList != NULL) ? pList->size : 0;
+
+    SHA1Update(pContext, (const unsigned char*) &size, sizeof(size));
+    if (size != 0) {
+        SHA1Update(pContext, (const unsigned char*) pList->list,
+            size * sizeof(pList->list[0]));
+    }
+}
+
+/*
+ * Add a class def and its class data to a hash.  File offsets are left out,
+ * as they move when other parts of the file change.  The code of the
+ * methods is only included if "withCode" is set, minus the debug info.
+ */
+static void hashClass(SHA1_CTX* pContext, const DexFile* pDexFile,
+    const DexClassDef* pClassDef, bool withCode)
+{
+    const u1* pEncodedData;
+    DexClassDataHeader header;
+    u4 i, lastIndex;
+
+    SHA1Update(pContext, (const unsigned char*) &pClassDef->classIdx,
+        sizeof(pClassDef->classIdx));
+    SHA1Update(pContext, (const unsigned char*) &pClassDef->accessFlags,
+        sizeof(pClassDef->accessFlags));
+    SHA1Update(pContext, (const unsigned char*) &pClassDef->superclassIdx,
+        sizeof(pClassDef->superclassIdx));
+    hashTypeList(pContext, dexGetInterfacesList(pDexFile, pClassDef));
+
+    pEncodedData = dexGetClassData(pDexFile, pClassDef);
+    if (pEncodedData == NULL)
+        return;
+
+    dexReadClassDataHeader(&pEncodedData, &header);
+    SHA1Update(pContext, (const unsigned char*) &header, sizeof(header));
+
+    lastIndex = 0;
+    for (i = 0; i < header.staticFieldsSize + header.instanceFieldsSize; i++) {
+        DexField field;
+
+        if (i == header.staticFieldsSize)
+            lastIndex = 0;
+        dexReadClassDataField(&pEncodedData, &field, &lastIndex);
+        SHA1Update(pContext, (const unsigned char*) &field, sizeof(field));
+    }
+
+    lastIndex = 0;
+    for (i = 0; i < header.directMethodsSize + header.virtualMethodsSize; i++) {
+        DexMethod method;
+        const DexCode* pCode;
+        u4 hasCode;
+
+        if (i == header.directMethodsSize)
+            lastIndex = 0;
+        dexReadClassDataMethod(&pEncodedData, &method, &lastIndex);
+        pCode = dexGetCode(pDexFile, &method);
+        hasCode = (pCode != NULL);
+        SHA1Update(pContext, (const unsigned char*) &method.methodIdx,
+            sizeof(method.methodIdx));
+        SHA1Update(pContext, (const unsigned char*) &method.accessFlags,
+            sizeof(method.accessFlags));
+        SHA1Update(pContext, (const unsigned char*) &hasCode, sizeof(hasCode));
+
+        if (withCode && pCode != NULL) {
+            const u1* pStart = (const u1*) pCode;
+
+            SHA1Update(pContext, pStart, offsetof(DexCode, debugInfoOff));
+            SHA1Update(pContext, pStart + offsetof(DexCode, insnsSize),
+                dexGetDexCodeSize(pCode) - offsetof(DexCode, insnsSize));
+        }
+    }
+}
+
+/*
+ * Create the per-class results table.  The declaration hash covers the
+ * string, type, proto, field and method ids, and all class declarations;
+ * instructions refer to these by index, so code only stays valid while
+ * they are unchanged.
+ *
+ * Returns newly-allocated storage.
+ */
+DexClassResults* dexCreateClassResults(const DexFile* pDexFile)
+{
+    const DexHeader* pHeader = pDexFile->pHeader;
+    DexClassResults* pResults;
+    SHA1_CTX context;
+    int allocSize;
+    u4 i;
+
+    allocSize = offsetof(DexClassResults, table)
+                    + pHeader->classDefsSize * sizeof(pResults->table[0]);
+
+    pResults = (DexClassResults*) calloc(1, allocSize);
+    if (pResults == NULL)
+        return NULL;
+    pResults->size = allocSize;
+    pResults->numEntries = pHeader->classDefsSize;
+
+    SHA1Init(&context);
+    for (i = 0; i < pHeader->stringIdsSize; i++) {
+        const char* str = dexStringById(pDexFile, i);
+        SHA1Update(&context, (const unsigned char*) str, strlen(str) + 1);
+    }
+    SHA1Update(&context, (const unsigned char*) pDexFile->pTypeIds,
+        pHeader->typeIdsSize * sizeof(DexTypeId));
+    for (i = 0; i < pHeader->protoIdsSize; i++) {
+        const DexProtoId* pProtoId = dexGetProtoId(pDexFile, i);
+        SHA1Update(&context, (const unsigned char*) &pProtoId->shortyIdx,
+            sizeof(pProtoId->shortyIdx));
+        SHA1Update(&context, (const unsigned char*) &pProtoId->returnTypeIdx,
+            sizeof(pProtoId->returnTypeIdx));
+        hashTypeList(&context, dexGetProtoParameters(pDexFile, pProtoId));
+    }
+    SHA1Update(&context, (const unsigned char*) pDexFile->pFieldIds,
+        pHeader->fieldIdsSize * sizeof(DexFieldId));
+    SHA1Update(&context, (const unsigned char*) pDexFile->pMethodIds,
+        pHeader->methodIdsSize * sizeof(DexMethodId));
+    for (i = 0; i < pHeader->classDefsSize; i++)
+        hashClass(&context, pDexFile, dexGetClassDef(pDexFile, i), false);
+    SHA1Final(pResults->declHash, &context);
+
+    for (i = 0; i < pHeader->classDefsSize; i++) {
+        SHA1Init(&context);
+        hashClass(&context, pDexFile, dexGetClassDef(pDexFile, i), true);
+        SHA1Final(pResults->table[i].classHash, &context);
+        pResults->table[i].accessFlags = kDexNoIndex;
+    }
+
+    return pResults;
+}
+
 /*
  * Set up the basic raw data pointers of a DexFile. This function isn't
  * meant for general use.
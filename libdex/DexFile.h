@@ -189,6 +189,7 @@ enum {
 enum {
     kDexChunkClassLookup            = 0x434c4b50,   /* CLKP */
     kDexChunkRegisterMaps           = 0x524d4150,   /* RMAP */
+    kDexChunkClassResults           = 0x43524553,   /* CRES */
 
     kDexChunkEnd                    = 0x41454e44,   /* AEND */
 };
@@ -463,6 +464,28 @@ struct DexClassLookup {
     } table[1];
 };
 
+/*
+ * Verification and optimization results of each class, used by incremental
+ * dexopt to carry the results of unchanged classes forward.
+ *
+ * A class is unchanged when the hash of its class def, class data and code
+ * is the same, and the results only apply if the hash of the declarations
+ * of the whole DEX file (everything but the code) and the options dexopt
+ * ran with are the same too.  The hashes are computed on the DEX file
+ * before it is verified or optimized.
+ */
+struct DexClassResults {
+    u4      size;                       // total size, including "size"
+    u4      optFlags;                   // dexopt options, set by dexopt
+    u1      declHash[kSHA1DigestLen];   // hash of the DEX declarations
+    u4      numEntries;                 // size of table[]; classDefsSize
+    struct {
+        u1      classHash[kSHA1DigestLen];  // hash of the class and its code
+        u4      accessFlags;            // flags set by dexopt in the class
+                                        //  def, kDexNoIndex if not processed
+    } table[1];
+};
+
 /*
  * Header added by DEX optimization pass.  Values are always written in
  * local byte and structure padding.  The first field (magic + version)
@@ -517,6 +540,7 @@ struct DexFile {
      */
     const DexClassLookup* pClassLookup;
     const void*         pRegisterMapPool;       // RegisterMapClassPool
+    const DexClassResults* pClassResults;
 
     /* points to start of DEX file data */
     const u1*           baseAddr;
@@ -556,6 +580,14 @@ enum {
  */
 int dexSwapAndVerify(u1* addr, int len);
 
+/*
+ * Same as dexSwapAndVerify(), but skips the checksum, for a DEX file whose
+ * checksum the caller already verified.
+ *
+ * Return 0 on success.
+ */
+int dexSwapAndVerifyChecksummed(u1* addr, int len);
+
 /*
  * Detect the file type of the given memory buffer via magic number.
  * Call dexSwapAndVerify() on an unoptimized DEX file, do nothing
@@ -588,6 +620,11 @@ void dexFileFree(DexFile* pDexFile);
  */
 DexClassLookup* dexCreateClassLookup(DexFile* pDexFile);
 
+/*
+ * Create the per-class results table, with no class processed yet.
+ */
+DexClassResults* dexCreateClassResults(const DexFile* pDexFile);
+
 /*
  * Find a class definition by descriptor.
  */
@@ -112,6 +112,10 @@ bool dexParseOptData(const u1* data, size_t length, DexFile* pDexFile)
             ALOGV("+++ found register maps, size=%u", size);
             pDexFile->pRegisterMapPool = pOptData;
             break;
+        case kDexChunkClassResults:
+            ALOGV("+++ found class results, size=%u", size);
+            pDexFile->pClassResults = (const DexClassResults*) pOptData;
+            break;
         default:
             ALOGI("Unknown chunk 0x%08x (%c%c%c%c), size=%d in opt data area",
                 *pOpt,
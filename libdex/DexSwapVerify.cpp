@@ -2821,12 +2821,12 @@ bool dexHasValidMagic(const DexHeader* pHeader)
 
 /*
  * Fix the byte ordering of all fields in the DEX file, and do
- * structural verification. This is only required for code that opens
- * "raw" DEX files, such as the DEX optimizer.
+ * structural verification, checking the adler32 checksum first if
+ * "verifyChecksum" is set.
  *
  * Returns 0 on success, nonzero on failure.
  */
-int dexSwapAndVerify(u1* addr, int len)
+static int swapAndVerify(u1* addr, int len, bool verifyChecksum)
 {
     DexHeader* pHeader;
     CheckState state;
@@ -2857,7 +2857,7 @@ int dexSwapAndVerify(u1* addr, int len)
         }
     }
 
-    if (okay) {
+    if (okay && verifyChecksum) {
         /*
          * Compute the adler32 checksum and compare it to what's stored in
          * the file.  This isn't free, but chances are good that we just
@@ -2944,6 +2944,29 @@ int dexSwapAndVerify(u1* addr, int len)
     return !okay;       // 0 == success
 }
 
+/*
+ * Fix the byte ordering of all fields in the DEX file, and do
+ * structural verification. This is only required for code that opens
+ * "raw" DEX files, such as the DEX optimizer.
+ *
+ * Returns 0 on success, nonzero on failure.
+ */
+int dexSwapAndVerify(u1* addr, int len)
+{
+    return swapAndVerify(addr, len, true);
+}
+
+/*
+ * Same as dexSwapAndVerify(), for a DEX file whose checksum was verified
+ * by the caller, typically while extracting it.
+ *
+ * Returns 0 on success, nonzero on failure.
+ */
+int dexSwapAndVerifyChecksummed(u1* addr, int len)
+{
+    return swapAndVerify(addr, len, false);
+}
+
 /*
  * Detect the file type of the given memory buffer via magic number.
  * Call dexSwapAndVerify() on an unoptimized DEX file, do nothing
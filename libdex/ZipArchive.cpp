@@ -661,11 +661,43 @@ int dexZipGetEntryInfo(const ZipArchive* pArchive, ZipEntry entry,
     return 0;
 }
 
+/*
+ * Write "stored" data from the archive's file to an open file descriptor.
+ *
+ * The data is written straight from a mapping of the archive, rather than
+ * copied through a buffer, and "func" sees it in the same pages.
+ */
+static int copyStoredToFile(int outFd, int inFd, off_t dataOffset,
+    size_t uncompLen, ZipEntryDataFunc func, void* arg)
+{
+    MemMapping map;
+    int result;
+
+    if (uncompLen == 0)
+        return 0;
+
+    if (sysMapFileSegmentInShmem(inFd, dataOffset, uncompLen, &map) != 0) {
+        ALOGW("Zip: unable to map stored data at %ld", (long) dataOffset);
+        return -1;
+    }
+
+    if (func != NULL)
+        (*func)((const u1*) map.addr, uncompLen, arg);
+    result = sysWriteFully(outFd, map.addr, uncompLen, "Zip stored");
+
+    sysReleaseShmem(&map);
+    return result;
+}
+
 /*
  * Uncompress "deflate" data from the archive's file to an open file
  * descriptor.
+ *
+ * Each buffer of uncompressed data is handed to "func", if set, right
+ * before it is written.
  */
-static int inflateToFile(int outFd, int inFd, size_t uncompLen, size_t compLen)
+static int inflateToFile(int outFd, int inFd, size_t uncompLen, size_t compLen,
+    ZipEntryDataFunc func, void* arg)
 {
     int result = -1;
     const size_t kBufSize = 32768;
@@ -740,6 +772,8 @@ static int inflateToFile(int outFd, int inFd, size_t uncompLen, size_t compLen)
             (zerr == Z_STREAM_END && zstream.avail_out != kBufSize))
         {
             size_t writeSize = zstream.next_out - writeBuf;
+            if (func != NULL)
+                (*func)(writeBuf, writeSize, arg);
             if (sysWriteFully(outFd, writeBuf, writeSize, "Zip inflate") != 0)
                 goto z_bail;
 
@@ -776,6 +810,16 @@ bail:
  */
 int dexZipExtractEntryToFile(const ZipArchive* pArchive,
     const ZipEntry entry, int fd)
+{
+    return dexZipExtractEntryToFileWithFunc(pArchive, entry, fd, NULL, NULL);
+}
+
+/*
+ * Uncompress an entry, in its entirety, to an open file descriptor, and
+ * hand the uncompressed data to "func" along the way.
+ */
+int dexZipExtractEntryToFileWithFunc(const ZipArchive* pArchive,
+    const ZipEntry entry, int fd, ZipEntryDataFunc func, void* arg)
 {
     int result = -1;
     int ent = entryToIndex(pArchive, entry);
@@ -799,11 +843,17 @@ int dexZipExtractEntryToFile(const ZipArchive* pArchive,
     }
 
     if (method == kCompressStored) {
-        if (sysCopyFileToFile(fd, pArchive->mFd, uncompLen) != 0)
+        if (copyStoredToFile(fd, pArchive->mFd, dataOffset, uncompLen,
+                func, arg) != 0)
+        {
             goto bail;
+        }
     } else {
-        if (inflateToFile(fd, pArchive->mFd, uncompLen, compLen) != 0)
+        if (inflateToFile(fd, pArchive->mFd, uncompLen, compLen,
+                func, arg) != 0)
+        {
             goto bail;
+        }
     }
 
     result = 0;
@@ -171,6 +171,22 @@ DEX_INLINE long dexGetZipEntryCrc32(const ZipArchive* pArchive,
 int dexZipExtractEntryToFile(const ZipArchive* pArchive,
     const ZipEntry entry, int fd);
 
+/*
+ * Function called on successive pieces of the uncompressed data of an
+ * entry, in order, as they are written out.
+ */
+typedef void (*ZipEntryDataFunc)(const u1* data, size_t len, void* arg);
+
+/*
+ * Uncompress and write an entry to a file descriptor, handing the data to
+ * "func" as it goes.  This lets the caller look at the data while it is
+ * still in the cache, instead of reading the whole file back afterward.
+ *
+ * Returns 0 on success.
+ */
+int dexZipExtractEntryToFileWithFunc(const ZipArchive* pArchive,
+    const ZipEntry entry, int fd, ZipEntryDataFunc func, void* arg);
+
 /*
  * Utility function to compute a CRC-32.
  */
@@ -15,19 +15,34 @@
  */
 
 /*
- * Allocation tracking and reporting.  We maintain a circular buffer with
- * the most recent allocations.  The data can be viewed through DDMS.
+ * Allocation tracking and reporting.  Each thread keeps a circular buffer
+ * with its most recent allocations; the data can be viewed through DDMS.
  *
- * There are two basic approaches: manage the buffer with atomic updates
- * and do a system-wide suspend when DDMS requests it, or protect all
- * accesses with a mutex.  The former is potentially more efficient, but
- * the latter is much simpler and more reliable.
+ * There are two basic approaches: manage the buffers without locks and do
+ * a system-wide suspend when DDMS requests them, or protect all accesses
+ * with a mutex.  We used to do the latter, with one global buffer, but
+ * then every allocating thread serializes on the lock and tracking can't
+ * be left on.  Now only the owning thread writes its buffer, and the
+ * reporting, enabling and disabling code suspends everybody before
+ * looking at or freeing the buffers.  "allocTrackerLock" just keeps those
+ * from running at the same time.
  *
- * Ideally we'd just use the object heap allocation mutex to guard this
- * structure, but at the point we grab that (under dvmMalloc()) we're just
- * allocating a collection of bytes and no longer have the class reference.
- * Because this is an optional feature it's best to leave the existing
- * code undisturbed and just use an additional lock.
+ * Identical call stacks are stored once per thread, in a hash table next
+ * to the records with a quarter as many slots.  Each stack counts the
+ * records that use it.  When the table fills up, unused stacks are dropped
+ * and the rest are rehashed in place; a thread allocating from more places
+ * than the table can hold loses its oldest records instead.
+ *
+ * If "dalvik.vm.allocTrackerSample" is set, we record one allocation per
+ * that many bytes on average rather than all of them.  The gaps are drawn
+ * from an exponential distribution, so big objects are proportionally more
+ * likely to be seen and regular allocation patterns don't alias with the
+ * sampling.
+ *
+ * Records of threads that exit are copied into a compact buffer and kept
+ * for the next report.  Since a report can't hold more than allocRecordMax
+ * records, we keep that many at most, dropping the oldest retired ones
+ * first; the report says how many were dropped.
  *
  * We don't currently track allocations of class objects.  We could, but
  * with the possible exception of Proxy objects they're not that interesting.
@@ -42,6 +57,12 @@
  * because we go from an array of fixed-size structs to variable-sized data.
  */
 #include "Dalvik.h"
+#ifdef WITH_TLA
+#include "alloc/ThreadLocalHeap.h"
+#endif
+
+#include <limits.h>
+#include <math.h>
 
 #ifdef HAVE_ANDROID_OS
 #include "cutils/properties.h"
@@ -52,13 +73,18 @@ static bool isPowerOfTwo(int x) { return (x & (x - 1)) == 0; }
 
 #define kDefaultNumAllocRecords 64*1024 /* MUST be power of 2 */
 
+#define kNumThreadAllocRecords  1024    /* per thread; MUST be power of 2 */
+#define kNumThreadAllocStacks   256     /* per thread; power of 2, max 256 */
+
 /*
- * Record the details of an allocation.
+ * A call stack some allocations were made from.
  */
-struct AllocRecord {
-    ClassObject*    clazz;      /* class allocated in this block */
-    u4              size;       /* total size requested */
-    u2              threadId;   /* simple thread ID; could be recycled */
+struct AllocStack {
+    u4              hash;
+    u2              refs;       /* #of records made from here */
+    u1              origin;     /* slot before compactStacks moved it */
+    bool            inUse;
+    u1              depth;
 
     /* stack trace elements; unused entries have method==NULL */
     struct {
@@ -67,6 +93,48 @@ struct AllocRecord {
     } stackElem[kMaxAllocRecordStackDepth];
 };
 
+/*
+ * Record the details of an allocation.
+ */
+struct AllocRecord {
+    ClassObject*    clazz;      /* class allocated in this block */
+    u4              size;       /* total size requested */
+    u4              serial;     /* orders records across threads */
+    u2              stackIdx;   /* index into the owner's "stacks" */
+};
+
+/*
+ * A thread's recent allocations.
+ */
+struct AllocTrackerBuffer {
+    u2              threadId;   /* simple thread ID; could be recycled */
+
+    int             recordHead;     /* most-recently-added entry */
+    int             recordCount;    /* #of valid entries */
+    AllocRecord     records[kNumThreadAllocRecords];
+
+    int             stacksUsed;     /* slots in use, referenced or not */
+    AllocStack      stacks[kNumThreadAllocStacks];
+    u1              stackRemap[kNumThreadAllocStacks];  /* compactStacks */
+
+    /* sampling state */
+    int             bytesUntilSample;
+    u4              randomState;
+};
+
+/*
+ * The allocations of a thread that exited, oldest first, and just the
+ * stacks they were made from.  One allocation holds it all.
+ */
+struct RetiredAllocBuffer {
+    RetiredAllocBuffer* next;   /* next older one */
+    u2              threadId;
+
+    int             recordCount;
+    AllocRecord*    records;
+    AllocStack*     stacks;
+};
+
 /*
  * Initialize a few things.  This gets called early, so keep activity to
  * a minimum.
@@ -77,17 +145,29 @@ bool dvmAllocTrackerStartup()
     dvmInitMutex(&gDvm.allocTrackerLock);
 
     /* initialized when enabled by DDMS */
-    assert(gDvm.allocRecords == NULL);
+    assert(!gDvm.allocTrackerEnabled);
 
     return true;
 }
 
+static void freeRetiredBuffers()
+{
+    while (gDvm.allocRetiredBuffers != NULL) {
+        RetiredAllocBuffer* next = gDvm.allocRetiredBuffers->next;
+        free(gDvm.allocRetiredBuffers);
+        gDvm.allocRetiredBuffers = next;
+    }
+    gDvm.allocRetiredRecords = 0;
+    gDvm.allocRetiredDropped = 0;
+}
+
 /*
  * Release anything we're holding on to.
  */
 void dvmAllocTrackerShutdown()
 {
-    free(gDvm.allocRecords);
+    gDvm.allocTrackerEnabled = false;
+    freeRetiredBuffers();
     dvmDestroyMutex(&gDvm.allocTrackerLock);
 }
 
@@ -120,6 +200,41 @@ static int getAllocRecordMax() {
     return kDefaultNumAllocRecords;
 }
 
+/*
+ * Get the mean number of bytes between sampled allocations, or 0 to track
+ * every allocation.
+ */
+static int getAllocSampleBytes() {
+#ifdef HAVE_ANDROID_OS
+    const char* propertyName = "dalvik.vm.allocTrackerSample";
+    char sampleBytesString[PROPERTY_VALUE_MAX];
+    if (property_get(propertyName, sampleBytesString, "") > 0) {
+        char* end;
+        long value = strtol(sampleBytesString, &end, 10);
+        if (*end != '\0' || value < 0 || value > INT_MAX / 16) {
+            ALOGE("Ignoring %s '%s' --- invalid", propertyName, sampleBytesString);
+            return 0;
+        }
+        return value;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Lock the tracker state.  The lock is held across a full suspension, so
+ * don't wait for it in the running state.
+ */
+static void lockAllocTracker(Thread* self)
+{
+    ThreadStatus oldStatus = THREAD_UNDEFINED;
+    if (self != NULL)
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    dvmLockMutex(&gDvm.allocTrackerLock);
+    if (self != NULL)
+        dvmChangeStatus(self, oldStatus);
+}
+
 /*
  * Enable allocation tracking.  Does nothing if tracking is already enabled.
  *
@@ -127,47 +242,214 @@ static int getAllocRecordMax() {
  */
 bool dvmEnableAllocTracker()
 {
-    bool result = true;
-    dvmLockMutex(&gDvm.allocTrackerLock);
+    lockAllocTracker(dvmThreadSelf());
 
-    if (gDvm.allocRecords == NULL) {
+    if (!gDvm.allocTrackerEnabled) {
         gDvm.allocRecordMax = getAllocRecordMax();
+        gDvm.allocTrackerSampleBytes = getAllocSampleBytes();
 
-        ALOGI("Enabling alloc tracker (%d entries, %d frames --> %d bytes)",
+        ALOGI("Enabling alloc tracker (%d entries, %d frames, %d bytes/thread, "
+              "sampling every %d bytes)",
               gDvm.allocRecordMax, kMaxAllocRecordStackDepth,
-              sizeof(AllocRecord) * gDvm.allocRecordMax);
-        gDvm.allocRecordHead = gDvm.allocRecordCount = 0;
-        gDvm.allocRecords = (AllocRecord*) malloc(sizeof(AllocRecord) * gDvm.allocRecordMax);
-
-        if (gDvm.allocRecords == NULL)
-            result = false;
+              sizeof(AllocTrackerBuffer), gDvm.allocTrackerSampleBytes);
+        gDvm.allocTrackerEnabled = true;
     }
 
     dvmUnlockMutex(&gDvm.allocTrackerLock);
-    return result;
+
+#ifdef WITH_TLA
+    /* compiled code allocates inline without recording */
+    dvmTLHeapDisableInlineAlloc();
+#endif
+    return true;
 }
 
 /*
  * Disable allocation tracking.  Does nothing if tracking is not enabled.
+ *
+ * Threads may be in the middle of recording an allocation until they
+ * reach a suspend point, so we free the buffers with everybody suspended.
  */
 void dvmDisableAllocTracker()
 {
-    dvmLockMutex(&gDvm.allocTrackerLock);
+    lockAllocTracker(dvmThreadSelf());
+
+    if (gDvm.allocTrackerEnabled) {
+        gDvm.allocTrackerEnabled = false;
+
+        dvmSuspendAllThreads(SUSPEND_FOR_ALLOC_PROF);
+        dvmLockThreadList(NULL);
+        for (Thread* thread = gDvm.threadList; thread != NULL;
+             thread = thread->next)
+        {
+            free(thread->allocTrackerBuffer);
+            thread->allocTrackerBuffer = NULL;
+        }
+        dvmUnlockThreadList();
+        dvmResumeAllThreads(SUSPEND_FOR_ALLOC_PROF);
 
-    if (gDvm.allocRecords != NULL) {
-        free(gDvm.allocRecords);
-        gDvm.allocRecords = NULL;
+        freeRetiredBuffers();
     }
 
     dvmUnlockMutex(&gDvm.allocTrackerLock);
 }
 
+/*
+ * Copy the records of a thread into a RetiredAllocBuffer, oldest first,
+ * keeping only the stacks they use.  Returns NULL on allocation failure.
+ */
+static RetiredAllocBuffer* retireBuffer(AllocTrackerBuffer* buf)
+{
+    int stackCount = 0;
+    for (int i = 0; i < kNumThreadAllocStacks; i++) {
+        if (buf->stacks[i].inUse && buf->stacks[i].refs != 0)
+            buf->stackRemap[i] = stackCount++;
+    }
+
+    RetiredAllocBuffer* retired = (RetiredAllocBuffer*) malloc(
+        sizeof(RetiredAllocBuffer) + buf->recordCount * sizeof(AllocRecord) +
+        stackCount * sizeof(AllocStack));
+    if (retired == NULL)
+        return NULL;
+    retired->next = NULL;
+    retired->threadId = buf->threadId;
+    retired->recordCount = buf->recordCount;
+    retired->records = (AllocRecord*) (retired + 1);
+    retired->stacks = (AllocStack*) (retired->records + buf->recordCount);
+
+    for (int i = 0; i < kNumThreadAllocStacks; i++) {
+        if (buf->stacks[i].inUse && buf->stacks[i].refs != 0)
+            retired->stacks[buf->stackRemap[i]] = buf->stacks[i];
+    }
+
+    int idx = buf->recordHead;
+    for (int i = buf->recordCount - 1; i >= 0; i--) {
+        retired->records[i] = buf->records[idx];
+        retired->records[i].stackIdx = buf->stackRemap[buf->records[idx].stackIdx];
+        idx = (idx - 1) & (kNumThreadAllocRecords - 1);
+    }
+    return retired;
+}
+
+/*
+ * Drop the oldest retired records until no more than allocRecordMax are
+ * left.  The buffers are ordered by exit time, so this goes by that.
+ * Call with allocTrackerLock held.
+ */
+static void trimRetiredBuffers()
+{
+    while (gDvm.allocRetiredRecords > gDvm.allocRecordMax) {
+        RetiredAllocBuffer** pOldest = &gDvm.allocRetiredBuffers;
+        while ((*pOldest)->next != NULL)
+            pOldest = &(*pOldest)->next;
+
+        RetiredAllocBuffer* oldest = *pOldest;
+        int excess = gDvm.allocRetiredRecords - gDvm.allocRecordMax;
+        if (excess < oldest->recordCount) {
+            oldest->records += excess;
+            oldest->recordCount -= excess;
+        } else {
+            excess = oldest->recordCount;
+            *pOldest = NULL;
+            free(oldest);
+        }
+        gDvm.allocRetiredRecords -= excess;
+        gDvm.allocRetiredDropped += excess;
+    }
+}
+
+/*
+ * Keep the records of a thread that is going away.  The thread has
+ * already been removed from the thread list.
+ */
+void dvmAllocTrackerFreeThread(Thread* thread)
+{
+    AllocTrackerBuffer* buf = thread->allocTrackerBuffer;
+    if (buf == NULL)
+        return;
+    thread->allocTrackerBuffer = NULL;
+
+    if (!gDvm.allocTrackerEnabled || buf->recordCount == 0) {
+        free(buf);
+        return;
+    }
+
+    RetiredAllocBuffer* retired = retireBuffer(buf);
+    int recordCount = buf->recordCount;
+    u2 threadId = buf->threadId;
+    free(buf);
+
+    dvmLockMutex(&gDvm.allocTrackerLock);
+    if (retired == NULL) {
+        ALOGW("alloc tracker: unable to keep %d records of threadid=%d",
+            recordCount, threadId);
+        gDvm.allocRetiredDropped += recordCount;
+    } else if (gDvm.allocTrackerEnabled) {
+        retired->next = gDvm.allocRetiredBuffers;
+        gDvm.allocRetiredBuffers = retired;
+        gDvm.allocRetiredRecords += retired->recordCount;
+        trimRetiredBuffers();
+        retired = NULL;
+    }
+    dvmUnlockMutex(&gDvm.allocTrackerLock);
+    free(retired);
+}
+
+/*
+ * Return a pseudo-random number in [1, 2^31 - 1].  This is a 32-bit
+ * xorshift generator; the state is never zero.
+ */
+static u4 nextRandom(AllocTrackerBuffer* buf)
+{
+    u4 x = buf->randomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    buf->randomState = x;
+    return (x >> 1) | 1;
+}
+
+/*
+ * Pick the number of bytes until the next sampled allocation.  The gaps
+ * are exponentially distributed, with a mean of allocTrackerSampleBytes.
+ */
+static int nextSampleInterval(AllocTrackerBuffer* buf)
+{
+    double u = (double) nextRandom(buf) / 2147483648.0;   /* (0, 1) */
+    double interval = -log(u) * gDvm.allocTrackerSampleBytes;
+
+    /* avoid pathological tails */
+    if (interval > (double) gDvm.allocTrackerSampleBytes * 16)
+        interval = (double) gDvm.allocTrackerSampleBytes * 16;
+    return (int) interval + 1;
+}
+
+static AllocTrackerBuffer* allocTrackerBuffer(Thread* self)
+{
+    AllocTrackerBuffer* buf =
+        (AllocTrackerBuffer*) calloc(1, sizeof(AllocTrackerBuffer));
+    if (buf == NULL) {
+        ALOGW("alloc tracker: unable to allocate buffer for threadid=%d",
+            self->threadId);
+        return NULL;
+    }
+    buf->threadId = self->threadId;
+    buf->recordHead = kNumThreadAllocRecords - 1;
+    buf->randomState = ((u4) self->threadId << 16) ^ (u4) dvmGetRelativeTimeNsec();
+    if (buf->randomState == 0)
+        buf->randomState = 1;
+    if (gDvm.allocTrackerSampleBytes != 0)
+        buf->bytesUntilSample = nextSampleInterval(buf);
+    return buf;
+}
+
 /*
  * Get the last few stack frames.
  */
-static void getStackFrames(Thread* self, AllocRecord* pRec)
+static void getStackFrames(Thread* self, AllocStack* pStack)
 {
     int stackDepth = 0;
+    u4 hash = 0;
     void* fp;
 
     fp = self->interpSave.curFrame;
@@ -177,16 +459,18 @@ static void getStackFrames(Thread* self, AllocRecord* pRec)
         const Method* method = saveArea->method;
 
         if (!dvmIsBreakFrame((u4*) fp)) {
-            pRec->stackElem[stackDepth].method = method;
+            int pc;
             if (dvmIsNativeMethod(method)) {
-                pRec->stackElem[stackDepth].pc = 0;
+                pc = 0;
             } else {
                 assert(saveArea->xtra.currentPc >= method->insns &&
                         saveArea->xtra.currentPc <
                         method->insns + dvmGetMethodInsnsSize(method));
-                pRec->stackElem[stackDepth].pc =
-                    (int) (saveArea->xtra.currentPc - method->insns);
+                pc = (int) (saveArea->xtra.currentPc - method->insns);
             }
+            pStack->stackElem[stackDepth].method = method;
+            pStack->stackElem[stackDepth].pc = pc;
+            hash = (hash * 31 + (u4) method) * 31 + (u4) pc;
             stackDepth++;
         }
 
@@ -195,15 +479,116 @@ static void getStackFrames(Thread* self, AllocRecord* pRec)
     }
 
     /* clear out the rest (normally there won't be any) */
+    pStack->hash = hash;
+    pStack->inUse = true;
+    pStack->depth = stackDepth;
     while (stackDepth < kMaxAllocRecordStackDepth) {
-        pRec->stackElem[stackDepth].method = NULL;
-        pRec->stackElem[stackDepth].pc = 0;
+        pStack->stackElem[stackDepth].method = NULL;
+        pStack->stackElem[stackDepth].pc = 0;
         stackDepth++;
     }
 }
 
+static bool stacksEqual(const AllocStack* a, const AllocStack* b)
+{
+    return a->hash == b->hash && a->depth == b->depth &&
+        memcmp(a->stackElem, b->stackElem,
+               a->depth * sizeof(a->stackElem[0])) == 0;
+}
+
+/*
+ * Find "pStack" in the table, adding it if it's new, and count one more
+ * record made from it.  Returns its index.
+ */
+static int findOrAddStack(AllocTrackerBuffer* buf, const AllocStack* pStack)
+{
+    int mask = kNumThreadAllocStacks - 1;
+    int idx = pStack->hash & mask;
+
+    while (buf->stacks[idx].inUse) {
+        if (stacksEqual(&buf->stacks[idx], pStack)) {
+            buf->stacks[idx].refs++;
+            return idx;
+        }
+        idx = (idx + 1) & mask;
+    }
+    buf->stacks[idx] = *pStack;
+    buf->stacks[idx].refs = 1;
+    buf->stacksUsed++;
+    return idx;
+}
+
+/*
+ * Make room in the stack table, in place.  Stacks no record uses any more
+ * are dropped.  If the ones left still fill half of the table, the oldest
+ * records go too, until enough stacks are unused.
+ *
+ * The survivors are then rehashed.  With linear probing, walking the table
+ * from an empty slot and moving each entry to the first free slot of its
+ * probe sequence keeps all of them reachable; an entry may move more than
+ * once, so each one remembers where it started, and the records are
+ * renumbered at the end.
+ */
+static void compactStacks(AllocTrackerBuffer* buf)
+{
+    const int mask = kNumThreadAllocStacks - 1;
+    AllocStack* stacks = buf->stacks;
+    int live = 0;
+
+    for (int i = 0; i < kNumThreadAllocStacks; i++) {
+        if (stacks[i].inUse && stacks[i].refs == 0)
+            stacks[i].inUse = false;
+        if (stacks[i].inUse) {
+            stacks[i].origin = i;
+            live++;
+        }
+    }
+
+    while (live >= kNumThreadAllocStacks / 2) {
+        int oldest = (buf->recordHead - buf->recordCount + 1) &
+                     (kNumThreadAllocRecords - 1);
+        AllocStack* pStack = &stacks[buf->records[oldest].stackIdx];
+        if (--pStack->refs == 0) {
+            pStack->inUse = false;
+            live--;
+        }
+        buf->recordCount--;
+    }
+    buf->stacksUsed = live;
+
+    int start = 0;
+    while (stacks[start].inUse)
+        start++;
+    for (int n = 1; n < kNumThreadAllocStacks; n++) {
+        int i = (start + n) & mask;
+        if (!stacks[i].inUse)
+            continue;
+        int j = stacks[i].hash & mask;
+        while (j != i && stacks[j].inUse)
+            j = (j + 1) & mask;
+        if (j != i) {
+            stacks[j] = stacks[i];
+            stacks[i].inUse = false;
+        }
+    }
+
+    for (int i = 0; i < kNumThreadAllocStacks; i++) {
+        if (stacks[i].inUse)
+            buf->stackRemap[stacks[i].origin] = i;
+    }
+    int idx = buf->recordHead;
+    for (int count = buf->recordCount; count > 0; count--) {
+        AllocRecord* pRec = &buf->records[idx];
+        pRec->stackIdx = buf->stackRemap[pRec->stackIdx];
+        idx = (idx - 1) & (kNumThreadAllocRecords - 1);
+    }
+}
+
 /*
  * Add a new allocation to the set.
+ *
+ * Only the current thread touches its buffer here, so we don't need any
+ * locks.
  */
 void dvmDoTrackAllocation(ClassObject* clazz, size_t size)
 {
@@ -213,27 +598,46 @@ void dvmDoTrackAllocation(ClassObject* clazz, size_t size)
         return;
     }
 
-    dvmLockMutex(&gDvm.allocTrackerLock);
-    if (gDvm.allocRecords == NULL) {
-        dvmUnlockMutex(&gDvm.allocTrackerLock);
-        return;
+    AllocTrackerBuffer* buf = self->allocTrackerBuffer;
+    if (buf == NULL) {
+        buf = allocTrackerBuffer(self);
+        if (buf == NULL)
+            return;
+        self->allocTrackerBuffer = buf;
+    }
+
+    if (gDvm.allocTrackerSampleBytes != 0) {
+        buf->bytesUntilSample -= (int) size;
+        if (buf->bytesUntilSample > 0)
+            return;
+        buf->bytesUntilSample = nextSampleInterval(buf);
     }
 
+    AllocStack stack;
+    getStackFrames(self, &stack);
+
+    if (buf->stacksUsed >= kNumThreadAllocStacks * 3 / 4)
+        compactStacks(buf);
+
     /* advance and clip */
-    if (++gDvm.allocRecordHead == gDvm.allocRecordMax)
-        gDvm.allocRecordHead = 0;
+    if (++buf->recordHead == kNumThreadAllocRecords)
+        buf->recordHead = 0;
 
-    AllocRecord* pRec = &gDvm.allocRecords[gDvm.allocRecordHead];
+    AllocRecord* pRec = &buf->records[buf->recordHead];
+
+    /* the record we overwrite no longer uses its stack */
+    if (buf->recordCount == kNumThreadAllocRecords)
+        buf->stacks[pRec->stackIdx].refs--;
+
+    int stackIdx = findOrAddStack(buf, &stack);
 
     pRec->clazz = clazz;
     pRec->size = size;
-    pRec->threadId = self->threadId;
-    getStackFrames(self, pRec);
-
-    if (gDvm.allocRecordCount < gDvm.allocRecordMax)
-        gDvm.allocRecordCount++;
+    pRec->serial = android_atomic_inc(&gDvm.allocRecordSerial);
+    pRec->stackIdx = stackIdx;
 
-    dvmUnlockMutex(&gDvm.allocTrackerLock);
+    if (buf->recordCount < kNumThreadAllocRecords)
+        buf->recordCount++;
 }
 
 
@@ -272,6 +676,10 @@ Message header (all values big-endian):
   As with other DDM traffic, strings are sent as a 4-byte length
   followed by UTF-16 data.
 
+Entries are sent oldest first.  The records of all threads are merged by
+the order they were made in, and only the newest gDvm.allocRecordMax are
+sent.
+
 We send up 16-bit unsigned indexes into string tables.  In theory there
 can be (kMaxAllocRecordStackDepth * gDvm.allocRecordMax) unique strings in
 each table, but in practice there should be far fewer.
@@ -290,19 +698,106 @@ const int kEntryHeaderLen = 9;
 const int kStackFrameLen = 8;
 
 /*
- * Return the index of the head element.
- *
- * We point at the most-recently-written record, so if allocRecordCount is 1
- * we want to use the current element.  Take "head+1" and subtract count
- * from it.
+ * One record of the merged set we report.  Points into the per-thread
+ * buffers, so it's only good while all threads are suspended.
+ */
+struct AllocRecordRef {
+    const AllocRecord*  pRec;
+    const AllocStack*   pStack;
+    u2                  threadId;
+};
+
+/*
+ * qsort comparator ordering records oldest first.  Serial numbers wrap,
+ * so compare the difference.
+ */
+static int compareAllocRecordRefs(const void* vref1, const void* vref2)
+{
+    const AllocRecordRef* ref1 = (const AllocRecordRef*) vref1;
+    const AllocRecordRef* ref2 = (const AllocRecordRef*) vref2;
+    s4 diff = (s4) (ref1->pRec->serial - ref2->pRec->serial);
+
+    return (diff > 0) - (diff < 0);
+}
+
+static int addRetiredRecords(AllocRecordRef* refs, int count,
+    const RetiredAllocBuffer* retired)
+{
+    for (int i = 0; i < retired->recordCount; i++) {
+        const AllocRecord* pRec = &retired->records[i];
+        refs[count].pRec = pRec;
+        refs[count].pStack = &retired->stacks[pRec->stackIdx];
+        refs[count].threadId = retired->threadId;
+        count++;
+    }
+    return count;
+}
+
+static int addBufferRecords(AllocRecordRef* refs, int count,
+    const AllocTrackerBuffer* buf)
+{
+    int idx = buf->recordHead;
+
+    for (int i = buf->recordCount; i > 0; i--) {
+        const AllocRecord* pRec = &buf->records[idx];
+        refs[count].pRec = pRec;
+        refs[count].pStack = &buf->stacks[pRec->stackIdx];
+        refs[count].threadId = buf->threadId;
+        count++;
+        idx = (idx - 1) & (kNumThreadAllocRecords - 1);
+    }
+    return count;
+}
+
+/*
+ * Merge the records of all threads, live and retired, and keep the newest
+ * gDvm.allocRecordMax of them, oldest first.  All threads must be
+ * suspended and the thread list locked.
  *
- * We need to handle underflow in our circular buffer, so we add
- * gDvm.allocRecordMax and then mask it back down.
+ * Returns NULL on failure.  The caller must free the result.
  */
-inline static int headIndex()
+static AllocRecordRef* gatherAllocRecords(int* pCount)
 {
-    return (gDvm.allocRecordHead+1 + gDvm.allocRecordMax - gDvm.allocRecordCount)
-            & (gDvm.allocRecordMax-1);
+    int total = gDvm.allocRetiredRecords;
+    Thread* thread;
+    const RetiredAllocBuffer* retired;
+
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        if (thread->allocTrackerBuffer != NULL)
+            total += thread->allocTrackerBuffer->recordCount;
+    }
+
+    AllocRecordRef* refs =
+        (AllocRecordRef*) malloc(sizeof(AllocRecordRef) * (total + 1));
+    if (refs == NULL)
+        return NULL;
+
+    int count = 0;
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        if (thread->allocTrackerBuffer != NULL)
+            count = addBufferRecords(refs, count, thread->allocTrackerBuffer);
+    }
+    for (retired = gDvm.allocRetiredBuffers; retired != NULL;
+         retired = retired->next)
+    {
+        count = addRetiredRecords(refs, count, retired);
+    }
+    assert(count == total);
+
+    if (gDvm.allocRetiredDropped != 0) {
+        ALOGI("alloc tracker: %d records of exited threads were dropped",
+            gDvm.allocRetiredDropped);
+    }
+
+    qsort(refs, count, sizeof(AllocRecordRef), compareAllocRecordRefs);
+    if (count > gDvm.allocRecordMax) {
+        memmove(refs, refs + (count - gDvm.allocRecordMax),
+                sizeof(AllocRecordRef) * gDvm.allocRecordMax);
+        count = gDvm.allocRecordMax;
+    }
+
+    *pCount = count;
+    return refs;
 }
 
 /*
@@ -340,27 +835,23 @@ static const char* getMethodSourceFile(const Method* method)
  * but in practice this shouldn't matter (and if it does, we can uniq-sort
  * the result in a second pass).
  */
-static bool populateStringTables(PointerSet* classNames,
-    PointerSet* methodNames, PointerSet* fileNames)
+static bool populateStringTables(const AllocRecordRef* refs, int count,
+    PointerSet* classNames, PointerSet* methodNames, PointerSet* fileNames)
 {
-    int count = gDvm.allocRecordCount;
-    int idx = headIndex();
     int classCount, methodCount, fileCount;         /* debug stats */
 
     classCount = methodCount = fileCount = 0;
 
-    while (count--) {
-        AllocRecord* pRec = &gDvm.allocRecords[idx];
+    for (int idx = 0; idx < count; idx++) {
+        const AllocRecord* pRec = refs[idx].pRec;
+        const AllocStack* pStack = refs[idx].pStack;
 
         dvmPointerSetAddEntry(classNames, pRec->clazz->descriptor);
         classCount++;
 
         int i;
-        for (i = 0; i < kMaxAllocRecordStackDepth; i++) {
-            if (pRec->stackElem[i].method == NULL)
-                break;
-
-            const Method* method = pRec->stackElem[i].method;
+        for (i = 0; i < pStack->depth; i++) {
+            const Method* method = pStack->stackElem[i].method;
             dvmPointerSetAddEntry(classNames, method->clazz->descriptor);
             classCount++;
             dvmPointerSetAddEntry(methodNames, method->name);
@@ -368,8 +859,6 @@ static bool populateStringTables(PointerSet* classNames,
             dvmPointerSetAddEntry(fileNames, getMethodSourceFile(method));
             fileCount++;
         }
-
-        idx = (idx + 1) & (gDvm.allocRecordMax-1);
     }
 
     ALOGI("class %d/%d, method %d/%d, file %d/%d",
@@ -391,12 +880,11 @@ static bool populateStringTables(PointerSet* classNames,
  * The size of the output data is returned.
  */
 static size_t generateBaseOutput(u1* ptr, size_t baseLen,
+    const AllocRecordRef* refs, int count,
     const PointerSet* classNames, const PointerSet* methodNames,
     const PointerSet* fileNames)
 {
     u1* origPtr = ptr;
-    int count = gDvm.allocRecordCount;
-    int idx = headIndex();
 
     if (origPtr != NULL) {
         set1(&ptr[0], kMessageHeaderLen);
@@ -410,20 +898,15 @@ static size_t generateBaseOutput(u1* ptr, size_t baseLen,
     }
     ptr += kMessageHeaderLen;
 
-    while (count--) {
-        AllocRecord* pRec = &gDvm.allocRecords[idx];
-
-        /* compute depth */
-        int  depth;
-        for (depth = 0; depth < kMaxAllocRecordStackDepth; depth++) {
-            if (pRec->stackElem[depth].method == NULL)
-                break;
-        }
+    for (int idx = 0; idx < count; idx++) {
+        const AllocRecord* pRec = refs[idx].pRec;
+        const AllocStack* pStack = refs[idx].pStack;
+        int depth = pStack->depth;
 
         /* output header */
         if (origPtr != NULL) {
             set4BE(&ptr[0], pRec->size);
-            set2BE(&ptr[4], pRec->threadId);
+            set2BE(&ptr[4], refs[idx].threadId);
             set2BE(&ptr[6],
                 dvmPointerSetFind(classNames, pRec->clazz->descriptor));
             set1(&ptr[8], depth);
@@ -434,10 +917,10 @@ static size_t generateBaseOutput(u1* ptr, size_t baseLen,
         int i;
         for (i = 0; i < depth; i++) {
             if (origPtr != NULL) {
-                const Method* method = pRec->stackElem[i].method;
+                const Method* method = pStack->stackElem[i].method;
                 int lineNum;
 
-                lineNum = dvmLineNumFromPC(method, pRec->stackElem[i].pc);
+                lineNum = dvmLineNumFromPC(method, pStack->stackElem[i].pc);
                 if (lineNum > 32767)
                     lineNum = 32767;
 
@@ -451,8 +934,6 @@ static size_t generateBaseOutput(u1* ptr, size_t baseLen,
             }
             ptr += kStackFrameLen;
         }
-
-        idx = (idx + 1) & (gDvm.allocRecordMax-1);
     }
 
     return ptr - origPtr;
@@ -528,16 +1009,29 @@ bool dvmGenerateTrackedAllocationReport(u1** pData, size_t* pDataLen)
 {
     bool result = false;
     u1* buffer = NULL;
+    AllocRecordRef* refs = NULL;
+    int count = 0;
 
-    dvmLockMutex(&gDvm.allocTrackerLock);
+    /*
+     * Keep everybody still while we look at their buffers.
+     */
+    lockAllocTracker(dvmThreadSelf());
+    dvmSuspendAllThreads(SUSPEND_FOR_ALLOC_PROF);
+    dvmLockThreadList(dvmThreadSelf());
 
     /*
-     * Part 1: generate string tables.
+     * Part 1: merge the records and generate string tables.
      */
     PointerSet* classNames = NULL;
     PointerSet* methodNames = NULL;
     PointerSet* fileNames = NULL;
 
+    refs = gatherAllocRecords(&count);
+    if (refs == NULL) {
+        ALOGE("Failed allocating alloc record list");
+        goto bail;
+    }
+
     /*
      * Allocate storage.  Usually there's 60-120 of each thing (sampled
      * when max=512), but it varies widely and isn't closely bound to
@@ -552,7 +1046,7 @@ bool dvmGenerateTrackedAllocationReport(u1** pData, size_t* pDataLen)
         goto bail;
     }
 
-    if (!populateStringTables(classNames, methodNames, fileNames))
+    if (!populateStringTables(refs, count, classNames, methodNames, fileNames))
         goto bail;
 
     if (false) {
@@ -570,7 +1064,8 @@ bool dvmGenerateTrackedAllocationReport(u1** pData, size_t* pDataLen)
      * (Could also just write to an expanding buffer.)
      */
     size_t baseSize, totalSize;
-    baseSize = generateBaseOutput(NULL, 0, classNames, methodNames, fileNames);
+    baseSize = generateBaseOutput(NULL, 0, refs, count, classNames,
+                                  methodNames, fileNames);
     assert(baseSize > 0);
     totalSize = baseSize;
     totalSize += computeStringTableSize(classNames);
@@ -585,7 +1080,8 @@ bool dvmGenerateTrackedAllocationReport(u1** pData, size_t* pDataLen)
 
     buffer = (u1*) malloc(totalSize);
     strPtr = buffer + baseSize;
-    generateBaseOutput(buffer, baseSize, classNames, methodNames, fileNames);
+    generateBaseOutput(buffer, baseSize, refs, count, classNames, methodNames,
+                       fileNames);
     strPtr += outputStringTable(classNames, strPtr);
     strPtr += outputStringTable(methodNames, strPtr);
     strPtr += outputStringTable(fileNames, strPtr);
@@ -605,6 +1101,9 @@ bail:
     dvmPointerSetFree(methodNames);
     dvmPointerSetFree(fileNames);
     free(buffer);
+    free(refs);
+    dvmUnlockThreadList();
+    dvmResumeAllThreads(SUSPEND_FOR_ALLOC_PROF);
     dvmUnlockMutex(&gDvm.allocTrackerLock);
     //dvmDumpTrackedAllocations(false);
     return result;
@@ -615,56 +1114,54 @@ bail:
  *
  * If "enable" is set, we try to enable the feature if it's not already
  * active.
+ *
+ * Threads are suspended until we're done, so this doesn't pause to let
+ * logcat catch up.
  */
 void dvmDumpTrackedAllocations(bool enable)
 {
     if (enable)
         dvmEnableAllocTracker();
 
-    dvmLockMutex(&gDvm.allocTrackerLock);
-    if (gDvm.allocRecords == NULL) {
+    lockAllocTracker(dvmThreadSelf());
+    if (!gDvm.allocTrackerEnabled) {
         dvmUnlockMutex(&gDvm.allocTrackerLock);
         return;
     }
 
-    /*
-     * "idx" is the head of the list.  We want to start at the end of the
-     * list and move forward to the tail.
-     */
-    int idx = headIndex();
-    int count = gDvm.allocRecordCount;
+    dvmSuspendAllThreads(SUSPEND_FOR_ALLOC_PROF);
+    dvmLockThreadList(dvmThreadSelf());
+
+    int count = 0;
+    AllocRecordRef* refs = gatherAllocRecords(&count);
+    if (refs == NULL)
+        count = 0;
 
-    ALOGI("Tracked allocations, (head=%d count=%d)",
-        gDvm.allocRecordHead, count);
-    while (count--) {
-        AllocRecord* pRec = &gDvm.allocRecords[idx];
+    ALOGI("Tracked allocations, (count=%d)", count);
+    for (int idx = 0; idx < count; idx++) {
+        const AllocRecord* pRec = refs[idx].pRec;
+        const AllocStack* pStack = refs[idx].pStack;
         ALOGI(" T=%-2d %6d %s",
-            pRec->threadId, pRec->size, pRec->clazz->descriptor);
+            refs[idx].threadId, pRec->size, pRec->clazz->descriptor);
 
         if (true) {
-            for (int i = 0; i < kMaxAllocRecordStackDepth; i++) {
-                if (pRec->stackElem[i].method == NULL)
-                    break;
-
-                const Method* method = pRec->stackElem[i].method;
+            for (int i = 0; i < pStack->depth; i++) {
+                const Method* method = pStack->stackElem[i].method;
                 if (dvmIsNativeMethod(method)) {
                     ALOGI("    %s.%s (Native)",
                         method->clazz->descriptor, method->name);
                 } else {
                     ALOGI("    %s.%s +%d",
                         method->clazz->descriptor, method->name,
-                        pRec->stackElem[i].pc);
+                        pStack->stackElem[i].pc);
                 }
             }
         }
-
-        /* pause periodically to help logcat catch up */
-        if ((count % 5) == 0)
-            usleep(40000);
-
-        idx = (idx + 1) & (gDvm.allocRecordMax-1);
     }
+    free(refs);
 
+    dvmUnlockThreadList();
+    dvmResumeAllThreads(SUSPEND_FOR_ALLOC_PROF);
     dvmUnlockMutex(&gDvm.allocTrackerLock);
     if (false) {
         u1* data;
@@ -23,7 +23,8 @@
 bool dvmAllocTrackerStartup(void);
 void dvmAllocTrackerShutdown(void);
 
-struct AllocRecord;
+struct AllocTrackerBuffer;
+struct RetiredAllocBuffer;
 
 /*
  * Enable allocation tracking.  Does nothing if tracking is already enabled.
@@ -40,11 +41,17 @@ void dvmDisableAllocTracker(void);
  */
 #define dvmTrackAllocation(_clazz, _size)                                   \
     {                                                                       \
-        if (gDvm.allocRecords != NULL)                                      \
+        if (gDvm.allocTrackerEnabled)                                       \
             dvmDoTrackAllocation(_clazz, _size);                            \
     }
 void dvmDoTrackAllocation(ClassObject* clazz, size_t size);
 
+/*
+ * Hold on to the allocations of a thread that is being freed, so they
+ * still show up in the next report.
+ */
+void dvmAllocTrackerFreeThread(Thread* thread);
+
 /*
  * Generate a DDM packet with all of the tracked allocation data.
  *
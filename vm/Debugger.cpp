@@ -561,16 +561,59 @@ bool dvmDbgIsInterface(RefTypeId id)
 }
 
 /*
- * dvmHashForeach callback
+ * Classes collected by dvmClassTableForeach, optionally only those visible
+ * to one class loader.
+ */
+struct RefTypeList {
+    RefTypeId*  refTypes;
+    int         count;
+    int         max;
+    bool        visibleOnly;
+    Object*     classLoader;
+};
+
+/*
+ * dvmClassTableForeach callback.  Returns nonzero if the list is full,
+ * which can happen if classes were loaded after it was sized.
  */
 static int copyRefType(void* vclazz, void* varg)
 {
-    RefTypeId** pRefType = (RefTypeId**)varg;
-    **pRefType = classObjectToRefTypeId((ClassObject*) vclazz);
-    (*pRefType)++;
+    ClassObject* clazz = (ClassObject*) vclazz;
+    RefTypeList* list = (RefTypeList*) varg;
+
+    /*
+     * The table lock is held, so we can look at the initiating loader
+     * list.
+     */
+    if (list->visibleOnly && clazz->classLoader != list->classLoader &&
+        !dvmLoaderInInitiatingList(clazz, list->classLoader))
+    {
+        return 0;
+    }
+    if (list->count == list->max)
+        return 1;
+    LOGVV("  match '%s'", clazz->descriptor);
+    list->refTypes[list->count++] = classObjectToRefTypeId(clazz);
     return 0;
 }
 
+/*
+ * Fill out "list" with a newly-allocated buffer.  The class table can grow
+ * between sizing the buffer and walking the table, so leave some slack and
+ * start over if it wasn't enough.
+ */
+static void collectRefTypes(RefTypeList* list)
+{
+    for (;;) {
+        list->count = 0;
+        list->max = dvmGetNumLoadedClasses() + 64;
+        list->refTypes = (RefTypeId*)malloc(sizeof(RefTypeId) * list->max);
+        if (dvmClassTableForeach(copyRefType, list) == 0)
+            return;
+        free(list->refTypes);
+    }
+}
+
 /*
  * Get the complete list of reference classes (i.e. all classes except
  * the primitive types).
@@ -579,21 +622,14 @@ static int copyRefType(void* vclazz, void* varg)
  */
 void dvmDbgGetClassList(u4* pNumClasses, RefTypeId** pClassRefBuf)
 {
-    RefTypeId* pRefType;
+    RefTypeList list;
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    *pNumClasses = dvmHashTableNumEntries(gDvm.loadedClasses);
-    pRefType = *pClassRefBuf =
-        (RefTypeId*)malloc(sizeof(RefTypeId) * *pNumClasses);
+    list.visibleOnly = false;
+    list.classLoader = NULL;
+    collectRefTypes(&list);
 
-    if (dvmHashForeach(gDvm.loadedClasses, copyRefType, &pRefType) != 0) {
-        ALOGW("Warning: problem getting class list");
-        /* not really expecting this to happen */
-    } else {
-        assert(pRefType - *pClassRefBuf == (int) *pNumClasses);
-    }
-
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    *pNumClasses = list.count;
+    *pClassRefBuf = list.refTypes;
 }
 
 /*
@@ -606,39 +642,18 @@ void dvmDbgGetClassList(u4* pNumClasses, RefTypeId** pClassRefBuf)
 void dvmDbgGetVisibleClassList(ObjectId classLoaderId, u4* pNumClasses,
     RefTypeId** pClassRefBuf)
 {
-    Object* classLoader;
-    int numClasses = 0, maxClasses;
+    RefTypeList list;
 
-    classLoader = objectIdToObject(classLoaderId);
+    list.visibleOnly = true;
+    list.classLoader = objectIdToObject(classLoaderId);
     // I don't think classLoader can be NULL, but the spec doesn't say
 
-    LOGVV("GetVisibleList: comparing to %p", classLoader);
-
-    dvmHashTableLock(gDvm.loadedClasses);
-
-    /* over-allocate the return buffer */
-    maxClasses = dvmHashTableNumEntries(gDvm.loadedClasses);
-    *pClassRefBuf = (RefTypeId*)malloc(sizeof(RefTypeId) * maxClasses);
+    LOGVV("GetVisibleList: comparing to %p", list.classLoader);
 
-    /*
-     * Run through the list, looking for matches.
-     */
-    HashIter iter;
-    for (dvmHashIterBegin(gDvm.loadedClasses, &iter); !dvmHashIterDone(&iter);
-        dvmHashIterNext(&iter))
-    {
-        ClassObject* clazz = (ClassObject*) dvmHashIterData(&iter);
-
-        if (clazz->classLoader == classLoader ||
-            dvmLoaderInInitiatingList(clazz, classLoader))
-        {
-            LOGVV("  match '%s'", clazz->descriptor);
-            (*pClassRefBuf)[numClasses++] = classObjectToRefTypeId(clazz);
-        }
-    }
-    *pNumClasses = numClasses;
+    collectRefTypes(&list);
 
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    *pNumClasses = list.count;
+    *pClassRefBuf = list.refTypes;
 }
 
 /*
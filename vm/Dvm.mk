@@ -146,6 +146,7 @@ LOCAL_SRC_FILES := \
 	UtfString.cpp \
 	alloc/Alloc.cpp \
 	alloc/CardTable.cpp \
+	alloc/GcWorkers.cpp \
 	alloc/HeapBitmap.cpp.arm \
 	alloc/HeapDebug.cpp \
 	alloc/Heap.cpp.arm \
@@ -267,6 +268,7 @@ ifeq ($(WITH_JIT),true)
   LOCAL_CFLAGS += -DWITH_JIT
   LOCAL_SRC_FILES += \
 	compiler/Compiler.cpp \
+	compiler/JitWarmCache.cpp \
 	compiler/vtune/JitProfiling.cpp \
 	compiler/VTuneSupport.cpp \
 	compiler/Frontend.cpp \
@@ -396,6 +398,10 @@ ifeq ($(dvm_arch),x86)
               compiler/AccumulationSinking.cpp \
               compiler/SinkCastOpt.cpp \
               compiler/Vectorization.cpp \
+              compiler/LoopUnrolling.cpp \
+              compiler/GlobalValueNumbering.cpp \
+              test/TestGlobalValueNumbering.cpp \
+              compiler/EscapeAnalysis.cpp \
               compiler/JitVerbose.cpp \
               compiler/MethodContext.cpp \
               compiler/MethodContextHandler.cpp
@@ -131,6 +131,12 @@ struct DvmGlobals {
      */
     u4          lockProfThreshold;
 
+    /*
+     * Bias thin locks to the first thread that acquires them, so that it
+     * can reacquire them without atomic operations.
+     */
+    bool        biasedLocking;
+
     int         (*vfprintfHook)(FILE*, const char*, va_list);
     void        (*exitHook)(int);
     void        (*abortHook)(void);
@@ -141,6 +147,7 @@ struct DvmGlobals {
     bool        noQuitHandler;
     bool        verifyDexChecksum;
     char*       stackTraceFile;     // for SIGQUIT-inspired output
+    char*       sampleStackFile;    // folded stacks from the sampling profiler
 
     bool        logStdio;
 
@@ -154,6 +161,9 @@ struct DvmGlobals {
 
     bool        dexOptForSmp;
 
+    /* number of threads dexopt verifies and optimizes classes with */
+    int         dexOptThreadCount;
+
     /*
      * GC option flags.
      */
@@ -162,6 +172,9 @@ struct DvmGlobals {
     bool        postVerify;
     bool        concurrentMarkSweep;
     bool        verifyCardTable;
+    bool        generationalGc;
+    bool        lazySweep;
+    size_t      gcThreads;
     bool        disableExplicitGc;
 
     int         assertionCtrlCount;
@@ -192,12 +205,16 @@ struct DvmGlobals {
     /* used by the DEX optimizer to load classes from an unfinished DEX */
     DvmDex*     bootClassPathOptExtra;
     bool        optimizingBootstrapClass;
+    /* the DEX checksum was verified while the DEX was extracted */
+    bool        optimizingChecksumVerified;
 
     /*
-     * Loaded classes, hashed by class name.  Each entry is a ClassObject*,
-     * allocated in GC space.
+     * Loaded classes, hashed by class name and keyed on defining and
+     * initiating loaders.  Lookups don't lock; classTableLock serializes
+     * updates and guards the initiating loader lists.
      */
-    HashTable*  loadedClasses;
+    struct ClassTable* volatile classTable;
+    pthread_mutex_t classTableLock;
 
     /*
      * Value for the next class serial number to be assigned.  This is
@@ -219,14 +236,14 @@ struct DvmGlobals {
      * Interned strings.
      */
 
-    /* A mutex that guards access to the interned string tables. */
+    /* A mutex that serializes changes to the interned string table. */
     pthread_mutex_t internLock;
 
-    /* Hash table of strings interned by the user. */
-    HashTable*  internedStrings;
-
-    /* Hash table of strings interned by the class loader. */
-    HashTable*  literalStrings;
+    /*
+     * Strings interned by the class loader and by the user, see
+     * Intern.cpp.  Lookups read it without the lock.
+     */
+    struct InternTable* volatile internTable;
 
     /*
      * Classes constructed directly by the vm.
@@ -655,14 +672,17 @@ struct DvmGlobals {
 
     /*
      * Used for tracking allocations that we report to DDMS.  When the feature
-     * is enabled (through a DDMS request) the "allocRecords" pointer becomes
-     * non-NULL.
+     * is enabled (through a DDMS request) "allocTrackerEnabled" is set, and
+     * each thread records into its own "allocTrackerBuffer".
      */
     pthread_mutex_t allocTrackerLock;
-    AllocRecord*    allocRecords;
-    int             allocRecordHead;        /* most-recently-added entry */
-    int             allocRecordCount;       /* #of valid entries */
-    int             allocRecordMax;         /* Number of allocated entries. */
+    bool            allocTrackerEnabled;
+    int             allocRecordMax;         /* most entries in a report */
+    int             allocTrackerSampleBytes; /* mean bytes per sample; 0=all */
+    volatile int32_t allocRecordSerial;     /* orders records across threads */
+    RetiredAllocBuffer* allocRetiredBuffers; /* records of exited threads */
+    int             allocRetiredRecords;    /* #of records in them */
+    int             allocRetiredDropped;    /* #dropped to stay under max */
 
     /*
      * When a profiler is enabled, this is incremented.  Distinct profilers
@@ -954,12 +974,13 @@ struct DvmJitGlobals {
     pthread_cond_t     compilerQueueEmpty;
     volatile int       compilerQueueLength;
     int                compilerHighWater;
-    int                compilerWorkEnqueueIndex;
-    int                compilerWorkDequeueIndex;
+    unsigned int       compilerWorkSequence;
     int                compilerICPatchIndex;
 
     /* JIT internal stats */
     int                compilerMaxQueued;
+    int                compilerQueueDropped;
+    int                compilerQueueEvicted;
     int                translationChains;
 
     /* Compiled code cache */
@@ -1048,6 +1069,9 @@ struct DvmJitGlobals {
     /* Flag to dump all compiled code */
     bool printMe;
 
+    /* File recording selected traces across runs (-Xjitwarmcache) */
+    char *warmCachePath;
+
 #if defined(VTUNE_DALVIK)
     /* Flag to enable VTune support for Dalvik VM */
     VTuneInfo vtuneInfo;
@@ -1085,6 +1109,12 @@ struct DvmJitGlobals {
     /* Flag to control the number of the minimum vectorized iterations */
     unsigned char minVectorizedIterations;
 
+    /* Flag to control the maximum loop unrolling factor, 1 disables unrolling */
+    unsigned int maximumUnrollFactor;
+
+    /* Number of receiver classes held by each inline cache, 1 is monomorphic */
+    unsigned int polymorphicCacheSize;
+
     /* Integer to control the number of backend retries */
     int backEndRetries;
 
@@ -1206,12 +1236,17 @@ struct DvmJitGlobals {
     int                invokeMonoSetterInlined;
     int                invokePolyGetterInlined;
     int                invokePolySetterInlined;
+    int                valueNumberingReplaced;
+    int                valueNumberingReplacedLoads;
+    int                escapeAnalysisReplaced;
     int                returnOp;
     int                icPatchInit;
     int                icPatchLockFree;
     int                icPatchQueued;
     int                icPatchRejected;
     int                icPatchDropped;
+    int                icPatchPolymorphic;
+    int                icPatchMegamorphic;
     int                codeCachePatches;
     int                numCompilerThreadBlockGC;
     u8                 jitTime;
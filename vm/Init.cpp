@@ -39,6 +39,7 @@
 #endif
 
 #include "Dalvik.h"
+#include "alloc/GcWorkers.h"
 #include "test/Test.h"
 #include "mterp/Mterp.h"
 #include "Hash.h"
@@ -59,6 +60,7 @@
 #define kMinHeapStartSize   (1*1024*1024)
 #define kMinHeapSize        (2*1024*1024)
 #define kMaxHeapSize        (1*1024*1024*1024)
+#define kMaxDexOptThreads   16
 
 /*
  * Register VM-agnostic native methods for system classes.
@@ -138,13 +140,18 @@ static void usage(const char* progName)
     dvmFprintf(stderr, "  -Xjniopts:{warnonly,forcecopy}\n");
     dvmFprintf(stderr, "  -Xjnitrace:substring (eg NativeClass or nativeMethod)\n");
     dvmFprintf(stderr, "  -Xstacktracefile:<filename>\n");
+    dvmFprintf(stderr, "  -Xsamplestackfile:<filename>\n");
     dvmFprintf(stderr, "  -Xgc:[no]precise\n");
     dvmFprintf(stderr, "  -Xgc:[no]preverify\n");
     dvmFprintf(stderr, "  -Xgc:[no]postverify\n");
     dvmFprintf(stderr, "  -Xgc:[no]concurrent\n");
     dvmFprintf(stderr, "  -Xgc:[no]verifycardtable\n");
+    dvmFprintf(stderr, "  -Xgc:[no]generational\n");
+    dvmFprintf(stderr, "  -Xgc:[no]lazysweep\n");
+    dvmFprintf(stderr, "  -Xgcthreads:<value> (Number of marking and sweeping threads, at most %d)\n", GC_MAX_WORKERS);
     dvmFprintf(stderr, "  -XX:+DisableExplicitGC\n");
     dvmFprintf(stderr, "  -X[no]genregmap\n");
+    dvmFprintf(stderr, "  -X[no]biasedlocking\n");
     dvmFprintf(stderr, "  -Xverifyopt:[no]checkmon\n");
     dvmFprintf(stderr, "  -Xcheckdexsum\n");
 #if defined(WITH_JIT)
@@ -156,6 +163,7 @@ static void usage(const char* progName)
     dvmFprintf(stderr, "  -Xjitcodecachesize:decimalvalueofkbytes\n");
     dvmFprintf(stderr, "  -Xjitdatacachesize:<decimal value of KBytes requested (Default is: 128 KBytes)>\n");
     dvmFprintf(stderr, "  -Xjitblocking\n");
+    dvmFprintf(stderr, "  -Xjitwarmcache:<file> (Remember hot traces in <file> and compile them early on the next run)\n");
     dvmFprintf(stderr, "  -Xjitmethod:signature[,signature]* "
                        "(eg Ljava/lang/String\\;replace)\n");
     dvmFprintf(stderr, "  -Xjitclass:classname[,classname]*\n");
@@ -194,6 +202,8 @@ static void usage(const char* progName)
     dvmFprintf(stderr, "  -Xjitmaxmethodcontexts:<value> Set the maximum number of method context in the system\n");
     dvmFprintf(stderr, "  -Xjitmaxconstantspercontext:<value> Set the maximum number of constants to collect per method context\n");
     dvmFprintf(stderr, "  -Xjitmaxbasicblockspercontext:<value> Set the maximum number of basic blocks allowed in a method for method context\n");
+    dvmFprintf(stderr, "  -Xjitpolymorphiccache:<value> Set the number of receiver classes held by each inline cache (1 to %d)\n", POLYMORPHIC_CACHE_MAX_ENTRIES);
+    dvmFprintf(stderr, "  -Xjitunrollfactor:<value> Set the maximum loop unrolling factor, 1 disables unrolling (1 to %d)\n", MAX_UNROLL_FACTOR);
 #endif
 #if defined(VTUNE_DALVIK)
     dvmFprintf(stderr, "  -Xjitsepdalvik\n");
@@ -1435,6 +1445,10 @@ int processOptions(int argc, const char* const argv[], bool ignoreUnrecognized)
 
         } else if (strncmp(argv[i], "-Xlockprofthreshold:", 20) == 0) {
             gDvm.lockProfThreshold = atoi(argv[i] + 20);
+        } else if (strcmp(argv[i], "-Xbiasedlocking") == 0) {
+            gDvm.biasedLocking = true;
+        } else if (strcmp(argv[i], "-Xnobiasedlocking") == 0) {
+            gDvm.biasedLocking = false;
 
 #ifdef WITH_JIT
         } else if (strncmp(argv[i], "-Xjitop", 7) == 0) {
@@ -1449,6 +1463,9 @@ int processOptions(int argc, const char* const argv[], bool ignoreUnrecognized)
             processXjitconfig(argv[i] + strlen("-Xjitconfig:"));
         } else if (strncmp(argv[i], "-Xjitblocking", 13) == 0) {
             gDvmJit.blockingMode = true;
+        } else if (strncmp(argv[i], "-Xjitwarmcache:", 15) == 0) {
+            free(gDvmJit.warmCachePath);
+            gDvmJit.warmCachePath = strdup(argv[i] + 15);
         } else if (strncmp(argv[i], "-Xjitthreshold:", 15) == 0) {
             gDvmJit.threshold = atoi(argv[i] + 15);
         } else if (strncmp(argv[i], "-Xjittablesize:", 15) == 0) {
@@ -1614,6 +1631,36 @@ int processOptions(int argc, const char* const argv[], bool ignoreUnrecognized)
             {
                 dvmFprintf (stderr, "Refusing option for %s, it is not a valid number: must be only a strictly positive number\n", argv[i]);
             }
+        } else if (strncmp(argv[i], "-Xjitunrollfactor:", 18) == 0) {
+            char *endptr = NULL;
+            //Get requested factor
+            long res = strtol (argv[i] + 18, &endptr, 0);
+
+            //Error checking: basic ones first
+            if (endptr != NULL && *endptr == '\0' && res > 0 && res <= MAX_UNROLL_FACTOR)
+            {
+                dvmFprintf (stderr, "Setting maximum unroll factor to: %ld\n", res);
+                gDvmJit.maximumUnrollFactor = res;
+            }
+            else
+            {
+                dvmFprintf (stderr, "Refusing option for %s, it is not a valid number: must be between 1 and %d\n", argv[i], MAX_UNROLL_FACTOR);
+            }
+        } else if (strncmp(argv[i], "-Xjitpolymorphiccache:", 22) == 0) {
+            char *endptr = NULL;
+            //Get requested number of entries
+            long res = strtol (argv[i] + 22, &endptr, 0);
+
+            //Error checking: basic ones first
+            if (endptr != NULL && *endptr == '\0' && res > 0 && res <= POLYMORPHIC_CACHE_MAX_ENTRIES)
+            {
+                dvmFprintf (stderr, "Setting polymorphic inline cache size to: %ld\n", res);
+                gDvmJit.polymorphicCacheSize = res;
+            }
+            else
+            {
+                dvmFprintf (stderr, "Refusing option for %s, it is not a valid number: must be between 1 and %d\n", argv[i], POLYMORPHIC_CACHE_MAX_ENTRIES);
+            }
         } else if (strncmp(argv[i], "-XjitvectorRegisters:", 21) == 0) {
             char *endptr = NULL;
             //Get requested style
@@ -1900,6 +1947,8 @@ int processOptions(int argc, const char* const argv[], bool ignoreUnrecognized)
 #endif
         } else if (strncmp(argv[i], "-Xstacktracefile:", 17) == 0) {
             gDvm.stackTraceFile = strdup(argv[i]+17);
+        } else if (strncmp(argv[i], "-Xsamplestackfile:", 18) == 0) {
+            gDvm.sampleStackFile = strdup(argv[i]+18);
 
         } else if (strcmp(argv[i], "-Xgenregmap") == 0) {
             gDvm.generateRegisterMaps = true;
@@ -1932,11 +1981,29 @@ int processOptions(int argc, const char* const argv[], bool ignoreUnrecognized)
                 gDvm.verifyCardTable = true;
             else if (strcmp(argv[i] + 5, "noverifycardtable") == 0)
                 gDvm.verifyCardTable = false;
+            else if (strcmp(argv[i] + 5, "generational") == 0)
+                gDvm.generationalGc = true;
+            else if (strcmp(argv[i] + 5, "nogenerational") == 0)
+                gDvm.generationalGc = false;
+            else if (strcmp(argv[i] + 5, "lazysweep") == 0)
+                gDvm.lazySweep = true;
+            else if (strcmp(argv[i] + 5, "nolazysweep") == 0)
+                gDvm.lazySweep = false;
             else {
                 dvmFprintf(stderr, "Bad value for -Xgc");
                 return -1;
             }
             ALOGV("Precise GC configured %s", gDvm.preciseGc ? "ON" : "OFF");
+        } else if (strncmp(argv[i], "-Xgcthreads:", 12) == 0) {
+            char *endptr = NULL;
+            long res = strtol(argv[i] + 12, &endptr, 10);
+
+            if (*endptr == '\0' && res > 0 && res <= GC_MAX_WORKERS) {
+                gDvm.gcThreads = res;
+            } else {
+                dvmFprintf(stderr, "Refusing option for %s, the value must be between 1 and %d\n",
+                        argv[i], GC_MAX_WORKERS);
+            }
 
         } else if (strcmp(argv[i], "-Xcheckdexsum") == 0) {
             gDvm.verifyDexChecksum = true;
@@ -2037,6 +2104,9 @@ static void setCommandLineDefaults()
     gDvm.heapMinFree = gDvm.heapMaxFree / 4;
 
     gDvm.concurrentMarkSweep = true;
+    gDvm.generationalGc = false;
+    gDvm.lazySweep = false;
+    gDvm.gcThreads = 1;
 
     /* gDvm.jdwpSuspend = true; */
 
@@ -2049,6 +2119,7 @@ static void setCommandLineDefaults()
     gDvm.monitorVerification = false;
     gDvm.generateRegisterMaps = true;
     gDvm.registerMapMode = kRegisterMapModeTypePrecise;
+    gDvm.biasedLocking = true;
 
 #ifdef WITH_TLA
     gDvm.withTLA = true;
@@ -2071,6 +2142,7 @@ static void setCommandLineDefaults()
     gDvmJit.classTable = NULL;
     gDvmJit.codeCacheSize = DEFAULT_CODE_CACHE_SIZE;
     gDvmJit.dataCacheSize = UNINITIALIZED_DATA_CACHE_SIZE;
+    gDvmJit.warmCachePath = NULL;
 
     gDvm.constInit = false;
     gDvm.commonInit = false;
@@ -2087,6 +2159,10 @@ static void setCommandLineDefaults()
     gDvmJit.vectorRegisters = 8;
     //Minimum vectorized iterations or we won't vectorize
     gDvmJit.minVectorizedIterations = 3;
+    //Maximum loop unrolling factor, 1 disables unrolling
+    gDvmJit.maximumUnrollFactor = 4;
+    //Receiver classes per inline cache, 1 keeps monomorphic caches
+    gDvmJit.polymorphicCacheSize = POLYMORPHIC_CACHE_MAX_ENTRIES;
 
     //By default only inline methods that meet certain size requirements.
     //This is configurable via command line.
@@ -2136,6 +2212,7 @@ static void setCommandLineDefaults()
      * dexopt target a differently-configured device.
      */
     gDvm.dexOptForSmp = (ANDROID_SMP != 0);
+    gDvm.dexOptThreadCount = 1;
 
     /*
      * Default profiler configuration.
@@ -2320,6 +2397,12 @@ std::string dvmStartup(int argc, const char* const argv[],
     }
 #endif
 
+    /* A young GC needs the survivors in the mark bitmap right away */
+    if (gDvm.lazySweep && gDvm.generationalGc) {
+        ALOGW("-Xgc:lazysweep does not work with -Xgc:generational; ignored");
+        gDvm.lazySweep = false;
+    }
+
     /* Configure group scheduling capabilities */
     if (!access("/dev/cpuctl/tasks", F_OK)) {
         ALOGV("Using kernel group scheduling");
@@ -2532,6 +2615,10 @@ std::string dvmStartup(int argc, const char* const argv[],
         ALOGE("dvmTestHash FAILED");
     if (false /*noisy!*/ && !dvmTestIndirectRefTable())
         ALOGE("dvmTestIndirectRefTable FAILED");
+#if defined(WITH_JIT) && defined(ARCH_IA32)
+    if (!dvmTestGlobalValueNumbering())
+        ALOGE("dvmTestGlobalValueNumbering FAILED");
+#endif
 #endif
 
     if (dvmCheckException(dvmThreadSelf())) {
@@ -2841,7 +2928,7 @@ static bool initJdwp()
  * Returns 0 on success.
  */
 int dvmPrepForDexOpt(const char* bootClassPath, DexOptimizerMode dexOptMode,
-    DexClassVerifyMode verifyMode, int dexoptFlags)
+    DexClassVerifyMode verifyMode, int dexoptFlags, int threadCount)
 {
     gDvm.initializing = true;
     gDvm.optimizing = true;
@@ -2866,6 +2953,14 @@ int dvmPrepForDexOpt(const char* bootClassPath, DexOptimizerMode dexOptMode,
     } else {
         gDvm.dexOptForSmp = (ANDROID_SMP != 0);
     }
+    if (threadCount > kMaxDexOptThreads) {
+        ALOGW("DexOpt: limiting %d threads to %d", threadCount,
+            kMaxDexOptThreads);
+        threadCount = kMaxDexOptThreads;
+    }
+    gDvm.dexOptThreadCount = (threadCount > 1) ? threadCount : 1;
+    gDvm.optimizingChecksumVerified =
+        (dexoptFlags & DEXOPT_CHECKSUM_VERIFIED) != 0;
 
     /*
      * Initialize the heap, some basic thread control mutexes, and
@@ -2974,6 +3069,8 @@ void dvmShutdown()
     gDvm.jniTrace = NULL;
     free(gDvm.stackTraceFile);
     gDvm.stackTraceFile = NULL;
+    free(gDvm.sampleStackFile);
+    gDvm.sampleStackFile = NULL;
     free (gDvm.niceName), gDvm.niceName = 0;
     free (gDvm.extraOptionsFile), gDvm.extraOptionsFile = 0;
 
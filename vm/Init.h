@@ -38,7 +38,7 @@ void dvmLateEnableAssertions(void);
  * asked to optimize a DEX file holding fundamental classes.
  */
 int dvmPrepForDexOpt(const char* bootClassPath, DexOptimizerMode dexOptMode,
-    DexClassVerifyMode verifyMode, int dexoptFlags);
+    DexClassVerifyMode verifyMode, int dexoptFlags, int threadCount);
 
 /*
  * Look up the set of classes and members used directly by the VM,
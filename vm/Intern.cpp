@@ -15,111 +15,208 @@
  */
 /*
  * String interning.
+ *
+ * Strings interned by the class loader ("literals", which are roots) and
+ * strings interned by the user (weak) share one open addressing table.
+ * Lookups probe it without taking a lock; gDvm.internLock only serializes
+ * insertions, promotions of weak strings to literals, and growth.
+ *
+ * A slot is published by a release store of its string pointer after its
+ * hash and flags have been written, and a published slot never goes back
+ * to empty, so a probe sequence seen by a reader can only get longer.
+ * Dead weak strings are turned into tombstones by the GC while all
+ * threads are suspended.  Growth copies the live slots into a new array
+ * and publishes it; readers may still be probing the old arrays, so they
+ * are only freed by the next GC.
  */
 #include "Dalvik.h"
 
 #include <stddef.h>
 
+#define kInternInitialSize  512     /* must be a power of two */
+#define kInternTombstone    ((StringObject*) HASH_TOMBSTONE)
+
+struct InternEntry {
+    StringObject* volatile str;     /* NULL if never used */
+    u4              hash;           /* cached dvmComputeStringHash() */
+    volatile u4     weak;           /* interned by the user only */
+};
+
+struct InternTable {
+    size_t          mask;           /* number of slots - 1 */
+    size_t          used;           /* published slots, tombstones included */
+    size_t          live;           /* slots holding a string */
+    InternTable*    retired;        /* arrays replaced since the last GC */
+    InternEntry     entries[1];
+};
+
+static InternTable* allocTable(size_t size)
+{
+    assert((size & (size - 1)) == 0);
+    InternTable* table = (InternTable*) calloc(1,
+            offsetof(InternTable, entries) + size * sizeof(InternEntry));
+    if (table != NULL) {
+        table->mask = size - 1;
+    }
+    return table;
+}
+
+static void freeTables(InternTable* table)
+{
+    while (table != NULL) {
+        InternTable* next = table->retired;
+        free(table);
+        table = next;
+    }
+}
+
 /*
  * Prep string interning.
  */
 bool dvmStringInternStartup()
 {
     dvmInitMutex(&gDvm.internLock);
-    gDvm.internedStrings = dvmHashTableCreate(256, NULL);
-    if (gDvm.internedStrings == NULL)
-        return false;
-    gDvm.literalStrings = dvmHashTableCreate(256, NULL);
-    if (gDvm.literalStrings == NULL)
-        return false;
-    return true;
+    gDvm.internTable = allocTable(kInternInitialSize);
+    return gDvm.internTable != NULL;
 }
 
 /*
- * Chuck the intern list.
+ * Chuck the intern table.
  *
- * The contents of the list are StringObjects that live on the GC heap.
+ * The contents of the table are StringObjects that live on the GC heap.
  */
 void dvmStringInternShutdown()
 {
-    if (gDvm.internedStrings != NULL || gDvm.literalStrings != NULL) {
+    if (gDvm.internTable != NULL) {
         dvmDestroyMutex(&gDvm.internLock);
     }
-    dvmHashTableFree(gDvm.internedStrings);
-    gDvm.internedStrings = NULL;
-    dvmHashTableFree(gDvm.literalStrings);
-    gDvm.literalStrings = NULL;
+    freeTables(gDvm.internTable);
+    gDvm.internTable = NULL;
+}
+
+static InternTable* currentTable()
+{
+    return (InternTable*) android_atomic_acquire_load(
+            (volatile int32_t*) &gDvm.internTable);
 }
 
-static StringObject* lookupString(HashTable* table, u4 key, StringObject* value)
+/*
+ * Finds the slot holding a string equal to strObj.  Safe without the
+ * lock; the table always has empty slots, which end every probe.
+ */
+static InternEntry* findEntry(InternTable* table, u4 hash,
+    StringObject* strObj)
 {
-    void* entry = dvmHashTableLookup(table, key, (void*)value,
-                                     dvmHashcmpStrings, false);
-    return (StringObject*)entry;
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask) {
+        InternEntry* entry = &table->entries[i];
+        StringObject* str = (StringObject*) android_atomic_acquire_load(
+                (volatile int32_t*) &entry->str);
+        if (str == NULL) {
+            return NULL;
+        }
+        if (str != kInternTombstone && entry->hash == hash &&
+            dvmHashcmpStrings(str, strObj) == 0) {
+            return entry;
+        }
+    }
 }
 
-static StringObject* insertString(HashTable* table, u4 key, StringObject* value)
+/* Fills the first free slot; the caller holds the lock or owns the table. */
+static void putEntry(InternTable* table, u4 hash, StringObject* strObj,
+    bool weak)
 {
-    if (dvmIsNonMovingObject(value) == false) {
-        value = (StringObject*)dvmCloneObject(value, ALLOC_NON_MOVING);
+    InternEntry* entry;
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask) {
+        entry = &table->entries[i];
+        if (entry->str == NULL || entry->str == kInternTombstone) {
+            break;
+        }
+    }
+    if (entry->str == NULL) {
+        table->used++;
     }
-    void* entry = dvmHashTableLookup(table, key, (void*)value,
-                                     dvmHashcmpStrings, true);
-    return (StringObject*)entry;
+    table->live++;
+    entry->hash = hash;
+    entry->weak = weak;
+    android_atomic_release_store((int32_t) strObj,
+            (volatile int32_t*) &entry->str);
 }
 
-static StringObject* lookupInternedString(StringObject* strObj, bool isLiteral)
+/*
+ * Makes room for one more slot, keeping the load (tombstones included)
+ * under 3/4.  The new array drops the tombstones and is sized for the
+ * live strings.  Returns false on allocation failure.  Holds the lock.
+ */
+static bool ensureRoom(void)
 {
-    StringObject* found;
+    InternTable* table = gDvm.internTable;
+    size_t size = table->mask + 1;
+    if ((table->used + 1) * 4 < size * 3) {
+        return true;
+    }
 
+    size_t newSize = size;
+    while ((table->live + 1) * 2 >= newSize) {
+        newSize *= 2;
+    }
+    InternTable* newTable = allocTable(newSize);
+    if (newTable == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        InternEntry* entry = &table->entries[i];
+        if (entry->str != NULL && entry->str != kInternTombstone) {
+            putEntry(newTable, entry->hash, entry->str, entry->weak);
+        }
+    }
+    newTable->retired = table;
+    android_atomic_release_store((int32_t) newTable,
+            (volatile int32_t*) &gDvm.internTable);
+    return true;
+}
+
+static StringObject* lookupInternedString(StringObject* strObj, bool isLiteral)
+{
     assert(strObj != NULL);
     u4 key = dvmComputeStringHash(strObj);
+
+    /*
+     * Common case: the string is already there, and is a literal if one
+     * is asked for.
+     */
+    InternEntry* entry = findEntry(currentTable(), key, strObj);
+    if (entry != NULL && (!isLiteral || !entry->weak)) {
+        return entry->str;
+    }
+
+    /* The copy has to be made before locking, it may collect. */
+    if (dvmIsNonMovingObject(strObj) == false) {
+        strObj = (StringObject*)dvmCloneObject(strObj, ALLOC_NON_MOVING);
+    }
+
+    StringObject* found;
     dvmLockMutex(&gDvm.internLock);
-    if (isLiteral) {
-        /*
-         * Check the literal table for a match.
-         */
-        StringObject* literal = lookupString(gDvm.literalStrings, key, strObj);
-        if (literal != NULL) {
+    entry = findEntry(gDvm.internTable, key, strObj);
+    if (entry != NULL) {
+        if (isLiteral && entry->weak) {
             /*
-             * A match was found in the literal table, the easy case.
+             * A match was found among the user interned strings.  Make
+             * it a literal, which is a root from now on.
              */
-            found = literal;
-        } else {
-            /*
-             * There is no match in the literal table, check the
-             * interned string table.
-             */
-            StringObject* interned = lookupString(gDvm.internedStrings, key, strObj);
-            if (interned != NULL) {
-                /*
-                 * A match was found in the interned table.  Move the
-                 * matching string to the literal table.
-                 */
-                dvmHashTableRemove(gDvm.internedStrings, key, interned);
-                found = insertString(gDvm.literalStrings, key, interned);
-                assert(found == interned);
-            } else {
-                /*
-                 * No match in the literal table or the interned
-                 * table.  Insert into the literal table.
-                 */
-                found = insertString(gDvm.literalStrings, key, strObj);
-                assert(found == strObj);
-            }
+            entry->weak = 0;
         }
+        found = entry->str;
     } else {
         /*
-         * Check the literal table for a match.
+         * No match.  Insert a literal or a weak string.
          */
-        found = lookupString(gDvm.literalStrings, key, strObj);
-        if (found == NULL) {
-            /*
-             * No match was found in the literal table.  Insert into
-             * the intern table if it does not already exist.
-             */
-            found = insertString(gDvm.internedStrings, key, strObj);
+        if (!ensureRoom()) {
+            dvmUnlockMutex(&gDvm.internLock);
+            ALOGE("Unable to grow the interned string table");
+            dvmAbort();
         }
+        putEntry(gDvm.internTable, key, strObj, !isLiteral);
+        found = strObj;
     }
     assert(found != NULL);
     dvmUnlockMutex(&gDvm.internLock);
@@ -153,27 +250,56 @@ StringObject* dvmLookupImmortalInternedString(StringObject* strObj)
 bool dvmIsWeakInternedString(StringObject* strObj)
 {
     assert(strObj != NULL);
-    if (gDvm.internedStrings == NULL) {
+    if (gDvm.internTable == NULL) {
         return false;
     }
-    dvmLockMutex(&gDvm.internLock);
     u4 key = dvmComputeStringHash(strObj);
-    StringObject* found = lookupString(gDvm.internedStrings, key, strObj);
-    dvmUnlockMutex(&gDvm.internLock);
-    return found == strObj;
+    InternEntry* entry = findEntry(currentTable(), key, strObj);
+    return entry != NULL && entry->weak && entry->str == strObj;
+}
+
+/*
+ * Calls the visitor with the address of each literal string, or each
+ * string interned by the user if weak is set.  The caller must keep the
+ * table from changing, e.g. by holding the lock or suspending threads.
+ */
+void dvmVisitInternedStrings(bool weak, InternedStringVisitor* visitor,
+    void* arg)
+{
+    InternTable* table = gDvm.internTable;
+    if (table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i <= table->mask; i++) {
+        InternEntry* entry = &table->entries[i];
+        if (entry->str != NULL && entry->str != kInternTombstone &&
+            (entry->weak != 0) == weak) {
+            (*visitor)((StringObject**) &entry->str, arg);
+        }
+    }
 }
 
 /*
- * Clear white references from the intern table.
+ * Clear white references from the intern table.  Called with all threads
+ * suspended, which also makes it safe to free the retired arrays.
  */
 void dvmGcDetachDeadInternedStrings(int (*isUnmarkedObject)(void *))
 {
     /* It's possible for a GC to happen before dvmStringInternStartup()
      * is called.
      */
-    if (gDvm.internedStrings != NULL) {
-        dvmLockMutex(&gDvm.internLock);
-        dvmHashForeachRemove(gDvm.internedStrings, isUnmarkedObject);
-        dvmUnlockMutex(&gDvm.internLock);
+    InternTable* table = gDvm.internTable;
+    if (table != NULL) {
+        for (size_t i = 0; i <= table->mask; i++) {
+            InternEntry* entry = &table->entries[i];
+            if (entry->weak && entry->str != NULL &&
+                entry->str != kInternTombstone &&
+                isUnmarkedObject(entry->str)) {
+                entry->str = kInternTombstone;
+                table->live--;
+            }
+        }
+        freeTables(table->retired);
+        table->retired = NULL;
     }
 }
@@ -24,6 +24,10 @@ void dvmStringInternShutdown(void);
 StringObject* dvmLookupInternedString(StringObject* strObj);
 StringObject* dvmLookupImmortalInternedString(StringObject* strObj);
 bool dvmIsWeakInternedString(StringObject* strObj);
+
+typedef void InternedStringVisitor(StringObject** strPtr, void* arg);
+void dvmVisitInternedStrings(bool weak, InternedStringVisitor* visitor,
+    void* arg);
 void dvmGcDetachDeadInternedStrings(int (*isUnmarkedObject)(void *));
 
 #endif  // DALVIK_INTERN_H_
@@ -19,6 +19,9 @@
  */
 #include "Dalvik.h"
 #include <interp/InterpDefs.h>
+#ifdef WITH_TLA
+#include "alloc/ThreadLocalHeap.h"
+#endif
 
 #include <stdlib.h>
 #include <stddef.h>
@@ -29,9 +32,12 @@
 #include <sched.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 
 #include <cutils/open_memstream.h>
 
+#include <vector>
+
 #ifdef HAVE_ANDROID_OS
 # define UPDATE_MAGIC_PAGE      1
 #endif
@@ -76,7 +82,19 @@
 #define TRACE_MAGIC         0x574f4c53
 #define TRACE_HEADER_LEN    32
 
-#define FILL_PATTERN        0xeeeeeeee
+/*
+ * Each thread buffers this many records before the writer must drain
+ * them; the writer wakes up every TRACE_WRITER_PERIOD_MSEC, or earlier
+ * when a buffer gets half full.
+ */
+#define TRACE_THREAD_BUF_RECORDS    4096
+#define TRACE_WRITER_PERIOD_MSEC    100
+
+/*
+ * Limits on the call stacks the sampling profiler keeps per thread.
+ */
+#define SAMPLE_MAX_DEPTH            256
+#define SAMPLE_TRIE_MAX_NODES       65536
 
 
 /*
@@ -172,132 +190,231 @@ static inline void storeLongLE(u1* buf, u8 val)
 }
 
 /*
- * Gets a thread's stack trace as an array of method pointers of length pCount.
- * The returned array must be freed by the caller.
+ * Fill in one trace record at "ptr".  The clock fields present depend on
+ * the configured clock source.
  */
-static const Method** getStackTrace(Thread* thread, size_t* pCount)
+static void storeTraceRecord(u1* ptr, u2 threadId, u4 methodVal,
+                             u4 cpuClockDiff, u4 wallClockDiff)
 {
-    void* fp = thread->interpSave.curFrame;
-    assert(thread == dvmThreadSelf() || dvmIsSuspended(thread));
+    *ptr++ = (u1) threadId;
+    *ptr++ = (u1) (threadId >> 8);
+    *ptr++ = (u1) methodVal;
+    *ptr++ = (u1) (methodVal >> 8);
+    *ptr++ = (u1) (methodVal >> 16);
+    *ptr++ = (u1) (methodVal >> 24);
 
-    /* Compute the stack depth. */
-    size_t stackDepth = 0;
-    while (fp != NULL) {
-        const StackSaveArea* saveArea = SAVEAREA_FROM_FP(fp);
+#if defined(HAVE_POSIX_CLOCKS)
+    if (useThreadCpuClock()) {
+        *ptr++ = (u1) cpuClockDiff;
+        *ptr++ = (u1) (cpuClockDiff >> 8);
+        *ptr++ = (u1) (cpuClockDiff >> 16);
+        *ptr++ = (u1) (cpuClockDiff >> 24);
+    }
+#endif
 
-        if (!dvmIsBreakFrame((u4*) fp))
-            stackDepth++;
+    if (useWallClock()) {
+        *ptr++ = (u1) wallClockDiff;
+        *ptr++ = (u1) (wallClockDiff >> 8);
+        *ptr++ = (u1) (wallClockDiff >> 16);
+        *ptr++ = (u1) (wallClockDiff >> 24);
+    }
+}
 
-        assert(fp != saveArea->prevFrame);
-        fp = saveArea->prevFrame;
+/*
+ * One node of a thread's sampled call stack trie.  The path from the root
+ * to a node is a call stack, innermost method last; "count" is the number
+ * of samples taken with exactly that stack.
+ */
+struct SampleTrieNode {
+    const Method*   method;
+    u4              count;
+    SampleTrieNode* children;
+    SampleTrieNode* sibling;
+};
+
+/*
+ * Thread id and name the samples of exited threads are reported under.
+ * Real thread ids start at 1.
+ */
+#define RETIRED_SAMPLE_THREAD_ID    0
+#define RETIRED_SAMPLE_THREAD_NAME  "(exited threads)"
+
+/*
+ * Find the child of "parent" for "method", adding it if there is room in
+ * the trie, whose node count is "*pNodes".  Only the owning thread touches
+ * its trie while sampling is on.
+ */
+static SampleTrieNode* findSampleTrieChild(u4* pNodes, SampleTrieNode* parent,
+                                           const Method* method)
+{
+    SampleTrieNode* child;
+
+    for (child = parent->children; child != NULL; child = child->sibling) {
+        if (child->method == method)
+            return child;
     }
-    *pCount = stackDepth;
+    if (*pNodes >= SAMPLE_TRIE_MAX_NODES)
+        return NULL;
 
-    /*
-     * Allocate memory for stack trace. This must be freed later, either by
-     * freeThreadStackTraceSamples when tracing stops or by freeThread.
-     */
-    const Method** stackTrace = (const Method**) malloc(sizeof(Method*) *
-                                                        stackDepth);
-    if (stackTrace == NULL)
+    child = (SampleTrieNode*) calloc(1, sizeof(SampleTrieNode));
+    if (child == NULL)
         return NULL;
+    child->method = method;
+    child->sibling = parent->children;
+    parent->children = child;
+    (*pNodes)++;
+    return child;
+}
 
-    /* Walk the stack a second time, filling in the stack trace. */
-    const Method** ptr = stackTrace;
-    fp = thread->interpSave.curFrame;
-    while (fp != NULL) {
+/*
+ * Safe point callback: record the current call stack in the thread's trie.
+ * Stacks deeper than SAMPLE_MAX_DEPTH keep their innermost frames, and a
+ * full trie charges the sample to the deepest node it already has.
+ */
+static bool takeSample(Thread* self, void* arg)
+{
+    if (!gDvm.methodTrace.traceEnabled)
+        return false;
+
+    const Method* stack[SAMPLE_MAX_DEPTH];
+    size_t depth = 0;
+    void* fp = self->interpSave.curFrame;
+    while (fp != NULL && depth < SAMPLE_MAX_DEPTH) {
         const StackSaveArea* saveArea = SAVEAREA_FROM_FP(fp);
-        const Method* method = saveArea->method;
 
-        if (!dvmIsBreakFrame((u4*) fp)) {
-            *ptr++ = method;
-            stackDepth--;
-        }
+        if (!dvmIsBreakFrame((u4*) fp))
+            stack[depth++] = saveArea->method;
+
         assert(fp != saveArea->prevFrame);
         fp = saveArea->prevFrame;
     }
-    assert(stackDepth == 0);
 
-    return stackTrace;
-}
-/*
- * Get a sample of the stack trace for a thread.
- */
-static void getSample(Thread* thread)
-{
-    /* Get old and new stack trace for thread. */
-    size_t newLength = 0;
-    const Method** newStackTrace = getStackTrace(thread, &newLength);
-    size_t oldLength = thread->stackTraceSampleLength;
-    const Method** oldStackTrace = thread->stackTraceSample;
-
-    /* Read time clocks to use for all events in this trace. */
-    u4 cpuClockDiff = 0;
-    u4 wallClockDiff = 0;
-    dvmMethodTraceReadClocks(thread, &cpuClockDiff, &wallClockDiff);
-    if (oldStackTrace == NULL) {
-        /*
-         * If there's no previous stack trace sample, log an entry event for
-         * every method in the trace.
-         */
-        for (int i = newLength - 1; i >= 0; --i) {
-            dvmMethodTraceAdd(thread, newStackTrace[i], METHOD_TRACE_ENTER,
-                              cpuClockDiff, wallClockDiff);
-        }
-    } else {
-        /*
-         * If there's a previous stack trace, diff the traces and emit entry
-         * and exit events accordingly.
-         */
-        int diffIndexOld = oldLength - 1;
-        int diffIndexNew = newLength - 1;
-        /* Iterate bottom-up until there's a difference between traces. */
-        while (diffIndexOld >= 0 && diffIndexNew >= 0 &&
-               oldStackTrace[diffIndexOld] == newStackTrace[diffIndexNew]) {
-            diffIndexOld--;
-            diffIndexNew--;
-        }
-        /* Iterate top-down over old trace until diff, emitting exit events. */
-        for (int i = 0; i <= diffIndexOld; ++i) {
-            dvmMethodTraceAdd(thread, oldStackTrace[i], METHOD_TRACE_EXIT,
-                              cpuClockDiff, wallClockDiff);
-        }
-        /* Iterate bottom-up over new trace from diff, emitting entry events. */
-        for (int i = diffIndexNew; i >= 0; --i) {
-            dvmMethodTraceAdd(thread, newStackTrace[i], METHOD_TRACE_ENTER,
-                              cpuClockDiff, wallClockDiff);
-        }
+    SampleTrieNode* node = self->sampleTrie;
+    if (node == NULL) {
+        node = (SampleTrieNode*) calloc(1, sizeof(SampleTrieNode));
+        if (node == NULL)
+            return false;
+        self->sampleTrie = node;
     }
+    while (depth > 0) {
+        SampleTrieNode* child = findSampleTrieChild(&self->sampleTrieNodes,
+                                                    node, stack[--depth]);
+        if (child == NULL)
+            break;
+        node = child;
+    }
+    node->count++;
 
-    /* Free the old stack trace and update the thread's stack trace sample. */
-    free(oldStackTrace);
-    thread->stackTraceSample = newStackTrace;
-    thread->stackTraceSampleLength = newLength;
+    /* one sample per request */
+    return false;
 }
 
 /*
  * Entry point for sampling thread. The sampling interval in microseconds is
  * passed in as an argument.
+ *
+ * Rather than suspending everybody, we ask each thread to sample itself at
+ * its next safe point.  Threads that are blocked or in native code don't
+ * reach one, so they only record a sample once they run again.
  */
 static void* runSamplingThread(void* arg)
 {
     int intervalUs = (int) arg;
     while (gDvm.methodTrace.traceEnabled) {
-        dvmSuspendAllThreads(SUSPEND_FOR_SAMPLING);
-
-        dvmLockThreadList(dvmThreadSelf());
+        dvmLockThreadList(NULL);
         for (Thread *thread = gDvm.threadList; thread != NULL; thread = thread->next) {
-            getSample(thread);
+            dvmArmSafePointCallback(thread, takeSample, NULL);
         }
         dvmUnlockThreadList();
 
-        dvmResumeAllThreads(SUSPEND_FOR_SAMPLING);
-
         usleep(intervalUs);
     }
     return NULL;
 }
 
+static void freeSampleTrieNode(SampleTrieNode* node)
+{
+    while (node != NULL) {
+        SampleTrieNode* sibling = node->sibling;
+        freeSampleTrieNode(node->children);
+        free(node);
+        node = sibling;
+    }
+}
+
+/*
+ * Free a thread's sampled call stacks.
+ */
+void dvmFreeSampleTrie(Thread* thread)
+{
+    freeSampleTrieNode(thread->sampleTrie);
+    thread->sampleTrie = NULL;
+    thread->sampleTrieNodes = 0;
+}
+
+/*
+ * Return the number of samples in a subtree.
+ */
+static u4 countSamples(const SampleTrieNode* node)
+{
+    u4 count = node->count;
+
+    for (node = node->children; node != NULL; node = node->sibling)
+        count += countSamples(node);
+    return count;
+}
+
+/*
+ * Add the samples of "src" into "dst", whose trie has "*pNodes" nodes.
+ * Like takeSample, a full trie charges what doesn't fit to the deepest
+ * node it already has.
+ */
+static void mergeSampleTrieNode(SampleTrieNode* dst, const SampleTrieNode* src,
+                                u4* pNodes)
+{
+    dst->count += src->count;
+    for (src = src->children; src != NULL; src = src->sibling) {
+        SampleTrieNode* child = findSampleTrieChild(pNodes, dst, src->method);
+        if (child == NULL)
+            dst->count += countSamples(src);
+        else
+            mergeSampleTrieNode(child, src, pNodes);
+    }
+}
+
+/*
+ * Move the samples of an exiting thread into the retired trie, so that
+ * they are still reported when sampling stops.
+ */
+static void retireSampleTrie(Thread* self)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+
+    dvmLockMutex(&state->spillLock);
+    if (state->retiredSampleTrie == NULL) {
+        state->retiredSampleTrie =
+            (SampleTrieNode*) calloc(1, sizeof(SampleTrieNode));
+    }
+    if (state->retiredSampleTrie != NULL) {
+        mergeSampleTrieNode(state->retiredSampleTrie, self->sampleTrie,
+            &state->retiredSampleTrieNodes);
+    }
+    dvmFreeSampleTrie(self);
+    dvmUnlockMutex(&state->spillLock);
+}
+
+/*
+ * Free the samples of the threads that exited.  Caller holds "spillLock".
+ */
+static void freeRetiredSampleTrie()
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+
+    freeSampleTrieNode(state->retiredSampleTrie);
+    state->retiredSampleTrie = NULL;
+    state->retiredSampleTrieNodes = 0;
+}
+
 /*
  * Boot-time init.
  */
@@ -309,6 +426,9 @@ bool dvmProfilingStartup()
     memset(&gDvm.methodTrace, 0, sizeof(gDvm.methodTrace));
     dvmInitMutex(&gDvm.methodTrace.startStopLock);
     pthread_cond_init(&gDvm.methodTrace.threadExitCond, NULL);
+    dvmInitMutex(&gDvm.methodTrace.writerLock);
+    pthread_cond_init(&gDvm.methodTrace.writerCond, NULL);
+    dvmInitMutex(&gDvm.methodTrace.spillLock);
 
     assert(!dvmCheckException(dvmThreadSelf()));
 
@@ -410,18 +530,23 @@ static void resetCpuClockBase()
 }
 
 /*
- * Free and reset the "stackTraceSample" field in all threads.
+ * Free and reset the "sampleTrie" field in all threads, and the samples of
+ * the threads that exited.
  */
-static void freeThreadStackTraceSamples()
+static void freeThreadSampleTries()
 {
+    MethodTraceState* state = &gDvm.methodTrace;
     Thread* thread;
 
+    dvmLockMutex(&state->spillLock);
     dvmLockThreadList(NULL);
     for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
-        free(thread->stackTraceSample);
-        thread->stackTraceSample = NULL;
+        dvmFreeSampleTrie(thread);
     }
     dvmUnlockThreadList();
+    freeRetiredSampleTrie();
+    state->retiredSamplesExported = false;
+    dvmUnlockMutex(&state->spillLock);
 }
 
 /*
@@ -434,10 +559,14 @@ static void dumpThreadList(FILE* fp) {
         fprintf(fp, "%d\t%s\n", thread->threadId, threadName.c_str());
     }
     dvmUnlockThreadList();
+    if (gDvm.methodTrace.retiredSamplesExported) {
+        fprintf(fp, "%d\t%s\n", RETIRED_SAMPLE_THREAD_ID,
+            RETIRED_SAMPLE_THREAD_NAME);
+    }
 }
 
 /*
- * This is a dvmHashForeach callback.
+ * This is a dvmClassTableForeach callback.
  */
 static int dumpMarkedMethods(void* vclazz, void* vfp)
 {
@@ -486,9 +615,330 @@ static int dumpMarkedMethods(void* vclazz, void* vfp)
  */
 static void dumpMethodList(FILE* fp)
 {
-    dvmHashTableLock(gDvm.loadedClasses);
-    dvmHashForeach(gDvm.loadedClasses, dumpMarkedMethods, (void*) fp);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmClassTableForeach(dumpMarkedMethods, (void*) fp);
+}
+
+/*
+ * Mark the methods referenced by a run of records, so that we know which
+ * ones to output in the key.
+ */
+static void markTouchedMethods(const u1* ptr, const u1* end)
+{
+    size_t recordSize = gDvm.methodTrace.recordSize;
+    unsigned int methodVal;
+    Method* method;
+
+    while (ptr < end) {
+        methodVal = ptr[2] | (ptr[3] << 8) | (ptr[4] << 16)
+                    | (ptr[5] << 24);
+        method = (Method*) METHOD_ID(methodVal);
+
+        method->inProfile = true;
+        ptr += recordSize;
+    }
+}
+
+/*
+ * Append a run of records to the spill file.  The data we can hand to
+ * DDMS is capped at "bufferSize"; anything past that is dropped.
+ */
+static void writeTraceRecords(const u1* ptr, size_t len)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+
+    if (state->directToDdms &&
+        state->spillBytes + len > (size_t) state->bufferSize)
+    {
+        state->overflow = true;
+        return;
+    }
+    if (fwrite(ptr, len, 1, state->spillFile) != 1) {
+        if (!state->overflow) {
+            ALOGE("trace spill write(%d) failed: %s", (int) len,
+                strerror(errno));
+        }
+        state->overflow = true;
+        return;
+    }
+    markTouchedMethods(ptr, ptr + len);
+    state->spillBytes += len;
+    state->numRecords += len / state->recordSize;
+}
+
+/*
+ * Move everything a thread has recorded so far to the spill file.  Call
+ * with "spillLock" held.
+ */
+static void drainTraceBuffer(MethodTraceBuffer* traceBuf)
+{
+    int32_t tail = traceBuf->tail;
+    int32_t head = android_atomic_acquire_load(&traceBuf->head);
+
+    if (head == tail)
+        return;
+    if (head < tail) {
+        writeTraceRecords(traceBuf->data + tail, traceBuf->size - tail);
+        tail = 0;
+    }
+    writeTraceRecords(traceBuf->data + tail, head - tail);
+    android_atomic_release_store(head, &traceBuf->tail);
+}
+
+/*
+ * Append everything a thread has recorded so far to "out", and free the
+ * space in its buffer.
+ */
+static void copyTraceBuffer(MethodTraceBuffer* traceBuf, std::vector<u1>* out)
+{
+    int32_t tail = traceBuf->tail;
+    int32_t head = android_atomic_acquire_load(&traceBuf->head);
+
+    if (head == tail)
+        return;
+    if (head < tail) {
+        out->insert(out->end(), traceBuf->data + tail,
+            traceBuf->data + traceBuf->size);
+        tail = 0;
+    }
+    out->insert(out->end(), traceBuf->data + tail, traceBuf->data + head);
+    android_atomic_release_store(head, &traceBuf->tail);
+}
+
+/*
+ * Drain the buffers of all threads.  The thread list lock keeps the
+ * buffers from going away, but a suspend-all needs it too, so we only
+ * copy the records out while we hold it and write them afterwards.
+ * "spillLock" is held across both, so that a thread draining its own
+ * buffer can't get its later records in ahead of the ones we copied.
+ */
+static void drainAllTraceBuffers(std::vector<u1>* staging)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+
+    dvmLockMutex(&state->spillLock);
+    staging->clear();
+    dvmLockThreadList(NULL);
+    for (Thread* thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        MethodTraceBuffer* traceBuf = thread->methodTraceBuffer;
+        if (traceBuf != NULL)
+            copyTraceBuffer(traceBuf, staging);
+    }
+    dvmUnlockThreadList();
+
+    if (!staging->empty())
+        writeTraceRecords(&(*staging)[0], staging->size());
+    dvmUnlockMutex(&state->spillLock);
+}
+
+/*
+ * Drain the calling thread's buffer to the spill file.  We may have to
+ * wait for the writer, which can be waiting for a suspend-all, so we
+ * don't hold up the suspension while we do.  Tracing may have stopped
+ * and freed the buffer in the meantime.
+ *
+ * Returns the thread's buffer, or NULL if it's gone.
+ */
+static MethodTraceBuffer* drainOwnTraceBuffer(Thread* self)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    MethodTraceBuffer* traceBuf;
+
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    dvmLockMutex(&state->spillLock);
+    traceBuf = self->methodTraceBuffer;
+    if (traceBuf != NULL && state->spillFile != NULL)
+        drainTraceBuffer(traceBuf);
+    else
+        traceBuf = NULL;
+    dvmUnlockMutex(&state->spillLock);
+    dvmChangeStatus(self, oldStatus);
+
+    return traceBuf;
+}
+
+/*
+ * The thread is detaching: get its records out before the buffer goes
+ * away with it, and hand its samples over to the retired trie.
+ */
+void dvmMethodTraceDrainThread(Thread* self)
+{
+    if (self->methodTraceBuffer != NULL)
+        drainOwnTraceBuffer(self);
+    if (self->sampleTrie != NULL) {
+        ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+        retireSampleTrie(self);
+        dvmChangeStatus(self, oldStatus);
+    }
+}
+
+/*
+ * Free and reset the "methodTraceBuffer" field in all threads.  A thread
+ * may be draining its own buffer, so hold "spillLock" while we do it.
+ */
+static void freeThreadTraceBuffers()
+{
+    dvmLockMutex(&gDvm.methodTrace.spillLock);
+    dvmLockThreadList(NULL);
+    for (Thread* thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        free(thread->methodTraceBuffer);
+        thread->methodTraceBuffer = NULL;
+    }
+    dvmUnlockThreadList();
+    dvmUnlockMutex(&gDvm.methodTrace.spillLock);
+}
+
+/*
+ * Emit one subtree of a sample trie as a synthetic call sequence: each
+ * sample counts for one sampling interval of time in the innermost method.
+ * If "fp" is non-NULL, also write the stacks in "folded" form, one line
+ * per distinct stack: "thread;outer;...;inner count".
+ */
+static void exportSampleTrieNode(u4 threadId, const SampleTrieNode* node,
+    u4* pTime, FILE* fp, const std::string& prefix)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    u1 record[TRACE_REC_SIZE_DUAL_CLOCK];
+
+    for (; node != NULL; node = node->sibling) {
+        std::string path;
+        if (fp != NULL)
+            path = prefix + ";" + dvmHumanReadableMethod(node->method, false);
+
+        storeTraceRecord(record, threadId,
+            METHOD_COMBINE((u4) node->method, METHOD_TRACE_ENTER),
+            *pTime, *pTime);
+        writeTraceRecords(record, state->recordSize);
+
+        *pTime += node->count * state->samplingIntervalUs;
+        if (fp != NULL && node->count != 0)
+            fprintf(fp, "%s %u\n", path.c_str(), node->count);
+        exportSampleTrieNode(threadId, node->children, pTime, fp, path);
+
+        storeTraceRecord(record, threadId,
+            METHOD_COMBINE((u4) node->method, METHOD_TRACE_EXIT),
+            *pTime, *pTime);
+        writeTraceRecords(record, state->recordSize);
+    }
+}
+
+/*
+ * Turn the sample tries of all threads into trace records, and optionally
+ * into a folded stack file, then free them.  Threads are suspended so that
+ * none of them is in the middle of updating its trie.  The samples of the
+ * threads that exited come last, under RETIRED_SAMPLE_THREAD_ID.  Caller
+ * holds "spillLock".
+ */
+static void exportSampleTries()
+{
+    FILE* fp = NULL;
+
+    if (gDvm.sampleStackFile != NULL) {
+        fp = fopen(gDvm.sampleStackFile, "w");
+        if (fp == NULL) {
+            ALOGE("Unable to open sample stack file '%s': %s",
+                gDvm.sampleStackFile, strerror(errno));
+        }
+    }
+
+    dvmSuspendAllThreads(SUSPEND_FOR_SAMPLING);
+    dvmLockThreadList(dvmThreadSelf());
+    for (Thread* thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        /* the sampler is gone, so any callback still armed is ours */
+        if (thread->callback == takeSample)
+            dvmArmSafePointCallback(thread, NULL, NULL);
+
+        if (thread->sampleTrie != NULL) {
+            u4 time = 0;
+            std::string prefix;
+            if (fp != NULL)
+                prefix = dvmGetThreadName(thread);
+            exportSampleTrieNode(thread->threadId,
+                thread->sampleTrie->children, &time, fp, prefix);
+        }
+        dvmFreeSampleTrie(thread);
+    }
+    dvmUnlockThreadList();
+    dvmResumeAllThreads(SUSPEND_FOR_SAMPLING);
+
+    MethodTraceState* state = &gDvm.methodTrace;
+    if (state->retiredSampleTrie != NULL) {
+        u4 time = 0;
+        exportSampleTrieNode(RETIRED_SAMPLE_THREAD_ID,
+            state->retiredSampleTrie->children, &time, fp,
+            RETIRED_SAMPLE_THREAD_NAME);
+        state->retiredSamplesExported = true;
+        freeRetiredSampleTrie();
+    }
+
+    if (fp != NULL)
+        fclose(fp);
+}
+
+/*
+ * Entry point for the trace writer thread.  Streams the per-thread
+ * buffers to the spill file until tracing stops, then does a final pass.
+ */
+static void* runTraceWriterThread(void* arg)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    std::vector<u1> staging;
+
+    dvmLockMutex(&state->writerLock);
+    while (!state->writerStop) {
+        dvmRelativeCondWait(&state->writerCond, &state->writerLock,
+                            TRACE_WRITER_PERIOD_MSEC, 0);
+        dvmUnlockMutex(&state->writerLock);
+        drainAllTraceBuffers(&staging);
+        dvmLockMutex(&state->writerLock);
+    }
+    dvmUnlockMutex(&state->writerLock);
+
+    drainAllTraceBuffers(&staging);
+    return NULL;
+}
+
+/*
+ * Create the file the records are streamed to until tracing stops.  The
+ * key has to come first in the trace file, so the records can't go there
+ * directly.  We put the spill file next to the trace file and unlink it
+ * right away.
+ */
+static FILE* createSpillFile(const char* traceFileName)
+{
+    char path[PATH_MAX];
+
+    if (snprintf(path, sizeof(path), "%s.XXXXXX", traceFileName) >=
+        (int) sizeof(path))
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return NULL;
+    unlink(path);
+
+    FILE* fp = fdopen(fd, "w+");
+    if (fp == NULL)
+        close(fd);
+    return fp;
+}
+
+/*
+ * Append the spill file to the trace file.
+ */
+static bool copySpillFile(FILE* dst, FILE* src)
+{
+    char buf[8192];
+    size_t count;
+
+    if (fflush(src) != 0 || fseek(src, 0, SEEK_SET) != 0)
+        return false;
+    while ((count = fread(buf, 1, sizeof(buf), src)) > 0) {
+        if (fwrite(buf, 1, count, dst) != count)
+            return false;
+    }
+    return ferror(src) == 0;
 }
 
 /*
@@ -496,8 +946,13 @@ static void dumpMethodList(FILE* fp)
  * trace all threads).
  *
  * This opens the output file (if an already open fd has not been supplied,
- * and we're not going direct to DDMS) and allocates the data buffer.  This
- * takes ownership of the file descriptor, closing it on completion.
+ * and we're not going direct to DDMS) and the spill file, and starts the
+ * writer thread.  This takes ownership of the file descriptor, closing it
+ * on completion.
+ *
+ * Records are streamed out while tracing runs, so traces sent to a file
+ * are not limited by "bufferSize"; traces sent to DDMS are held in memory
+ * and stop growing once they reach it.
  *
  * On failure, we throw an exception and return.
  */
@@ -518,14 +973,21 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
     ALOGI("TRACE STARTED: '%s' %dKB", traceFileName, bufferSize / 1024);
 
     /*
-     * Allocate storage and open files.
-     *
-     * We don't need to initialize the buffer, but doing so might remove
-     * some fault overhead if the pages aren't mapped until touched.
+     * Open files.
      */
-    state->buf = (u1*) malloc(bufferSize);
-    if (state->buf == NULL) {
-        dvmThrowInternalError("buffer alloc failed");
+    if (directToDdms) {
+        state->spillFile = open_memstream(&state->spillMemPtr,
+                                          &state->spillMemSize);
+    } else {
+        state->spillFile = createSpillFile(traceFileName);
+    }
+    if (state->spillFile == NULL) {
+        int err = errno;
+        ALOGE("Unable to create trace spill file for '%s': %s",
+            traceFileName, strerror(err));
+        dvmThrowExceptionFmt(gDvm.exRuntimeException,
+            "Unable to create trace spill file for '%s': %s",
+            traceFileName, strerror(err));
         goto fail;
     }
     if (!directToDdms) {
@@ -545,11 +1007,11 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
         }
     }
     traceFd = -1;
-    memset(state->buf, (char)FILL_PATTERN, bufferSize);
 
     state->directToDdms = directToDdms;
     state->bufferSize = bufferSize;
     state->overflow = false;
+    state->numRecords = 0;
 
     /*
      * Enable alloc counts if we've been requested to do so.
@@ -561,6 +1023,9 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
     /* reset our notion of the start time for all CPU threads */
     resetCpuClockBase();
 
+    /* drop buffers a late sampling pass may have left behind */
+    freeThreadTraceBuffers();
+
     state->startWhen = getWallTimeInUsec();
 
     if (useThreadCpuClock() && useWallClock()) {
@@ -572,19 +1037,36 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
     }
 
     state->samplingEnabled = samplingEnabled;
+    state->samplingIntervalUs = intervalUs;
+    freeThreadSampleTries();
 
     /*
      * Output the header.
      */
-    memset(state->buf, 0, TRACE_HEADER_LEN);
-    storeIntLE(state->buf + 0, TRACE_MAGIC);
-    storeShortLE(state->buf + 4, state->traceVersion);
-    storeShortLE(state->buf + 6, TRACE_HEADER_LEN);
-    storeLongLE(state->buf + 8, state->startWhen);
+    u1 header[TRACE_HEADER_LEN];
+    memset(header, 0, TRACE_HEADER_LEN);
+    storeIntLE(header + 0, TRACE_MAGIC);
+    storeShortLE(header + 4, state->traceVersion);
+    storeShortLE(header + 6, TRACE_HEADER_LEN);
+    storeLongLE(header + 8, state->startWhen);
     if (state->traceVersion >= 3) {
-        storeShortLE(state->buf + 16, state->recordSize);
+        storeShortLE(header + 16, state->recordSize);
+    }
+    if (fwrite(header, TRACE_HEADER_LEN, 1, state->spillFile) != 1) {
+        dvmThrowInternalError("trace header write failed");
+        goto fail;
+    }
+    state->spillBytes = TRACE_HEADER_LEN;
+
+    /*
+     * Start the writer before any thread can record.
+     */
+    state->writerStop = false;
+    if (!dvmCreateInternalThread(&state->writerThreadHandle,
+            "Method Trace Writer", &runTraceWriterThread, NULL)) {
+        dvmThrowInternalError("failed to create trace writer thread");
+        goto fail;
     }
-    state->curOffset = TRACE_HEADER_LEN;
 
     /*
      * Set the "enabled" flag.  Once we do this, threads will wait to be
@@ -617,37 +1099,17 @@ fail:
         fclose(state->traceFile);
         state->traceFile = NULL;
     }
-    if (state->buf != NULL) {
-        free(state->buf);
-        state->buf = NULL;
+    if (state->spillFile != NULL) {
+        fclose(state->spillFile);
+        state->spillFile = NULL;
     }
+    free(state->spillMemPtr);
+    state->spillMemPtr = NULL;
     if (traceFd >= 0)
         close(traceFd);
     dvmUnlockMutex(&state->startStopLock);
 }
 
-/*
- * Run through the data buffer and pull out the methods that were visited.
- * Set a mark so that we know which ones to output.
- */
-static void markTouchedMethods(int endOffset)
-{
-    u1* ptr = gDvm.methodTrace.buf + TRACE_HEADER_LEN;
-    u1* end = gDvm.methodTrace.buf + endOffset;
-    size_t recordSize = gDvm.methodTrace.recordSize;
-    unsigned int methodVal;
-    Method* method;
-
-    while (ptr < end) {
-        methodVal = ptr[2] | (ptr[3] << 8) | (ptr[4] << 16)
-                    | (ptr[5] << 24);
-        method = (Method*) METHOD_ID(methodVal);
-
-        method->inProfile = true;
-        ptr += recordSize;
-    }
-}
-
 /*
  * Exercises the clocks in the same way they will be during profiling.
  */
@@ -706,8 +1168,8 @@ TracingMode dvmGetMethodTracingMode()
 }
 
 /*
- * Stop method tracing.  We write the buffer to disk and generate a key
- * file so we can interpret it.
+ * Stop method tracing.  We drain the per-thread buffers, generate a key
+ * file so we can interpret the records, and append the records to it.
  */
 void dvmMethodTraceStop()
 {
@@ -741,7 +1203,7 @@ void dvmMethodTraceStop()
      * Globally disable it, and allow other threads to notice.  We want
      * to stall here for at least as long as dvmMethodTraceAdd needs
      * to finish.  There's no real risk though -- it will take a while to
-     * write the data to disk, and we don't clear the buffer pointer until
+     * write the data to disk, and we don't free the thread buffers until
      * after that completes.
      */
     state->traceEnabled = false;
@@ -753,51 +1215,40 @@ void dvmMethodTraceStop()
         dvmStopAllocCounting();
 
     /*
-     * It's possible under some circumstances for a thread to have advanced
-     * the data pointer but not written the method value.  It's possible
-     * (though less likely) for the data pointer to be advanced, or partial
-     * data written, while we're doing work here.
-     *
-     * To avoid seeing partially-written data, we grab state->curOffset here,
-     * and use our local copy from here on.  We then scan through what's
-     * already written.  If we see the fill pattern in what should be the
-     * method pointer, we cut things off early.  (If we don't, we'll fail
-     * when we dereference the pointer.)
-     *
-     * There's a theoretical possibility of interrupting another thread
-     * after it has partially written the method pointer, in which case
-     * we'll likely crash when we dereference it.  The possibility of
-     * this actually happening should be at or near zero.  Fixing it
-     * completely could be done by writing the thread number last and
-     * using a sentinel value to indicate a partially-written record,
-     * but that requires memory barriers.
+     * Let the writer do its final pass and wait for it.  Records are only
+     * published once fully written, so everything it drains is complete.
+     * The writer takes the thread list lock, so don't hold up a suspend
+     * while we wait.
      */
-    int finalCurOffset = state->curOffset;
-
-    size_t recordSize = state->recordSize;
-    if (finalCurOffset > TRACE_HEADER_LEN) {
-        u4 fillVal = METHOD_ID(FILL_PATTERN);
-        u1* scanPtr = state->buf + TRACE_HEADER_LEN;
-
-        while (scanPtr < state->buf + finalCurOffset) {
-            u4 methodVal = scanPtr[2] | (scanPtr[3] << 8) | (scanPtr[4] << 16)
-                        | (scanPtr[5] << 24);
-            if (METHOD_ID(methodVal) == fillVal) {
-                u1* scanBase = state->buf + TRACE_HEADER_LEN;
-                ALOGW("Found unfilled record at %d (of %d)",
-                    (scanPtr - scanBase) / recordSize,
-                    (finalCurOffset - TRACE_HEADER_LEN) / recordSize);
-                finalCurOffset = scanPtr - state->buf;
-                break;
-            }
-
-            scanPtr += recordSize;
-        }
+    dvmLockMutex(&state->writerLock);
+    state->writerStop = true;
+    pthread_cond_signal(&state->writerCond);
+    dvmUnlockMutex(&state->writerLock);
+
+    Thread* self = dvmThreadSelf();
+    ThreadStatus oldStatus = THREAD_UNDEFINED;
+    if (self != NULL)
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    if (pthread_join(state->writerThreadHandle, NULL) != 0) {
+        ALOGW("Trace writer thread join failed");
+    }
+    if (samplingEnabled &&
+        pthread_join(state->samplingThreadHandle, NULL) != 0) {
+        ALOGW("Sampling thread join failed");
     }
+    if (self != NULL)
+        dvmChangeStatus(self, oldStatus);
+
+    if (samplingEnabled) {
+        dvmLockMutex(&state->spillLock);
+        exportSampleTries();
+        dvmUnlockMutex(&state->spillLock);
+    }
+    freeThreadTraceBuffers();
 
     ALOGI("TRACE STOPPED%s: writing %d records",
         state->overflow ? " (NOTE: overflowed buffer)" : "",
-        (finalCurOffset - TRACE_HEADER_LEN) / recordSize);
+        state->numRecords);
     if (gDvm.debuggerActive) {
         ALOGW("WARNING: a debugger is active; method-tracing results "
              "will be skewed");
@@ -808,8 +1259,6 @@ void dvmMethodTraceStop()
      */
     u4 clockNsec = getClockOverhead();
 
-    markTouchedMethods(finalCurOffset);
-
     char* memStreamPtr;
     size_t memStreamSize;
     if (state->directToDdms) {
@@ -837,8 +1286,7 @@ void dvmMethodTraceStop()
         fprintf(state->traceFile, "clock=wall\n");
     }
     fprintf(state->traceFile, "elapsed-time-usec=%llu\n", elapsed);
-    fprintf(state->traceFile, "num-method-calls=%d\n",
-        (finalCurOffset - TRACE_HEADER_LEN) / state->recordSize);
+    fprintf(state->traceFile, "num-method-calls=%d\n", state->numRecords);
     fprintf(state->traceFile, "clock-call-overhead-nsec=%d\n", clockNsec);
     fprintf(state->traceFile, "vm=dalvik\n");
     if ((state->flags & TRACE_ALLOC_COUNTS) != 0) {
@@ -857,48 +1305,40 @@ void dvmMethodTraceStop()
 
     if (state->directToDdms) {
         /*
-         * Data is in two places: memStreamPtr and state->buf.  Send
+         * Data is in two memory streams: the key and the spill file.  Send
          * the whole thing to DDMS, wrapped in an MPSE packet.
          */
         fflush(state->traceFile);
+        fflush(state->spillFile);
 
         struct iovec iov[2];
         iov[0].iov_base = memStreamPtr;
         iov[0].iov_len = memStreamSize;
-        iov[1].iov_base = state->buf;
-        iov[1].iov_len = finalCurOffset;
+        iov[1].iov_base = state->spillMemPtr;
+        iov[1].iov_len = state->spillMemSize;
         dvmDbgDdmSendChunkV(CHUNK_TYPE("MPSE"), iov, 2);
     } else {
         /* append the profiling data */
-        if (fwrite(state->buf, finalCurOffset, 1, state->traceFile) != 1) {
+        if (!copySpillFile(state->traceFile, state->spillFile)) {
             int err = errno;
-            ALOGE("trace fwrite(%d) failed: %s",
-                finalCurOffset, strerror(err));
+            ALOGE("trace data copy (%d bytes) failed: %s",
+                (int) state->spillBytes, strerror(err));
             dvmThrowExceptionFmt(gDvm.exRuntimeException,
                 "Trace data write failed: %s", strerror(err));
         }
     }
 
     /* done! */
-    free(state->buf);
-    state->buf = NULL;
+    fclose(state->spillFile);
+    state->spillFile = NULL;
+    free(state->spillMemPtr);
+    state->spillMemPtr = NULL;
     fclose(state->traceFile);
     state->traceFile = NULL;
 
-    /* free and clear sampling traces held by all threads */
-    if (samplingEnabled) {
-        freeThreadStackTraceSamples();
-    }
-
     /* wake any threads that were waiting for profiling to complete */
     dvmBroadcastCond(&state->threadExitCond);
     dvmUnlockMutex(&state->startStopLock);
-
-    /* make sure the sampling thread has stopped */
-    if (samplingEnabled &&
-        pthread_join(state->samplingThreadHandle, NULL) != 0) {
-        ALOGW("Sampling thread join failed");
-    }
 }
 
 /*
@@ -923,65 +1363,92 @@ void dvmMethodTraceReadClocks(Thread* self, u4* cpuClockDiff,
     }
 }
 
+/*
+ * Allocate a thread's trace buffer, sized for TRACE_THREAD_BUF_RECORDS.
+ */
+static MethodTraceBuffer* allocTraceBuffer(size_t recordSize)
+{
+    int32_t size = recordSize * TRACE_THREAD_BUF_RECORDS;
+    MethodTraceBuffer* traceBuf =
+        (MethodTraceBuffer*) malloc(sizeof(MethodTraceBuffer) + size);
+    if (traceBuf == NULL)
+        return NULL;
+
+    traceBuf->data = (u1*) (traceBuf + 1);
+    traceBuf->size = size;
+    traceBuf->head = 0;
+    traceBuf->tail = 0;
+    return traceBuf;
+}
+
 /*
  * We just did something with a method.  Emit a record.
  *
- * Multiple threads may be banging on this all at once.  We use atomic ops
- * rather than mutexes for speed.
+ * Each thread appends to its own buffer, which the writer thread drains,
+ * so this normally takes no locks and shares no cache lines with other
+ * threads.  If the writer falls behind and the buffer is full, we drain
+ * it ourselves rather than drop the record.
  */
 void dvmMethodTraceAdd(Thread* self, const Method* method, int action,
                        u4 cpuClockDiff, u4 wallClockDiff)
 {
     MethodTraceState* state = &gDvm.methodTrace;
+    MethodTraceBuffer* traceBuf = self->methodTraceBuffer;
+    int32_t recordSize = state->recordSize;
     u4 methodVal;
-    int oldOffset, newOffset;
-    u1* ptr;
 
     assert(method != NULL);
 
-    /*
-     * Advance "curOffset" atomically.
-     */
-    do {
-        oldOffset = state->curOffset;
-        newOffset = oldOffset + state->recordSize;
-        if (newOffset > state->bufferSize) {
+    if (traceBuf == NULL) {
+        traceBuf = allocTraceBuffer(recordSize);
+        if (traceBuf == NULL) {
             state->overflow = true;
             return;
         }
-    } while (android_atomic_release_cas(oldOffset, newOffset,
-            &state->curOffset) != 0);
+        ANDROID_MEMBAR_STORE();
+        self->methodTraceBuffer = traceBuf;
+    }
+
+    /*
+     * Claim the slot at "head".
+     */
+    int32_t head = traceBuf->head;
+    int32_t tail = android_atomic_acquire_load(&traceBuf->tail);
+    int32_t newHead = head + recordSize;
+    if (newHead == traceBuf->size)
+        newHead = 0;
+    if (newHead == tail) {
+        traceBuf = drainOwnTraceBuffer(self);
+        if (traceBuf == NULL)
+            return;
+        head = traceBuf->head;
+        tail = traceBuf->tail;
+        newHead = head + recordSize;
+        if (newHead == traceBuf->size)
+            newHead = 0;
+    }
 
     //assert(METHOD_ACTION((u4) method) == 0);
 
     methodVal = METHOD_COMBINE((u4) method, action);
 
     /*
-     * Write data into "oldOffset".
+     * Write data into "head".
      */
-    ptr = state->buf + oldOffset;
-    *ptr++ = (u1) self->threadId;
-    *ptr++ = (u1) (self->threadId >> 8);
-    *ptr++ = (u1) methodVal;
-    *ptr++ = (u1) (methodVal >> 8);
-    *ptr++ = (u1) (methodVal >> 16);
-    *ptr++ = (u1) (methodVal >> 24);
+    storeTraceRecord(traceBuf->data + head, self->threadId, methodVal,
+                     cpuClockDiff, wallClockDiff);
 
-#if defined(HAVE_POSIX_CLOCKS)
-    if (useThreadCpuClock()) {
-        *ptr++ = (u1) cpuClockDiff;
-        *ptr++ = (u1) (cpuClockDiff >> 8);
-        *ptr++ = (u1) (cpuClockDiff >> 16);
-        *ptr++ = (u1) (cpuClockDiff >> 24);
-    }
-#endif
+    /*
+     * Publish the record, and wake the writer early when we cross the
+     * half-full mark.
+     */
+    android_atomic_release_store(newHead, &traceBuf->head);
 
-    if (useWallClock()) {
-        *ptr++ = (u1) wallClockDiff;
-        *ptr++ = (u1) (wallClockDiff >> 8);
-        *ptr++ = (u1) (wallClockDiff >> 16);
-        *ptr++ = (u1) (wallClockDiff >> 24);
-    }
+    int32_t used = newHead - tail;
+    if (used < 0)
+        used += traceBuf->size;
+    if (used >= traceBuf->size / 2 && used - recordSize < traceBuf->size / 2)
+        pthread_cond_signal(&state->writerCond);
 }
 
 
@@ -1190,6 +1657,9 @@ void dvmStopInstructionCounting()
 void dvmStartAllocCounting()
 {
     gDvm.allocProf.enabled = true;
+#ifdef WITH_TLA
+    dvmTLHeapDisableInlineAlloc();
+#endif
 }
 
 /*
@@ -25,6 +25,7 @@
 #include <stdio.h>
 
 struct Thread;      // extern
+struct SampleTrieNode;  // private to Profile.cpp
 
 
 /* boot init */
@@ -32,8 +33,22 @@ bool dvmProfilingStartup(void);
 void dvmProfilingShutdown(void);
 
 /*
- * Method trace state.  This is currently global.  In theory we could make
- * most of this per-thread.
+ * Per-thread method trace ring buffer.  Records are appended by a single
+ * producer (the owning thread, or the sampling thread while the owner is
+ * suspended) and drained by the trace writer thread, or by the owner when
+ * the buffer fills up or the thread detaches.  One record slot is always
+ * left free so a full buffer can be told from an empty one.
+ */
+struct MethodTraceBuffer {
+    u1*     data;
+    int32_t size;               // multiple of the record size
+    volatile int32_t head;      // next offset to write, owned by the producer
+    volatile int32_t tail;      // next offset to drain, owned by the writer
+};
+
+/*
+ * Method trace state.  Records are buffered per-thread and streamed by
+ * the writer thread to "spillFile"; the rest of this is global.
  */
 struct MethodTraceState {
     /* active state */
@@ -41,20 +56,45 @@ struct MethodTraceState {
     pthread_cond_t  threadExitCond;
     FILE*   traceFile;
     bool    directToDdms;
-    int     bufferSize;
+    int     bufferSize;         // cap on the data kept for DDMS
     int     flags;
 
     int     traceEnabled;
-    u1*     buf;
-    volatile int curOffset;
     u8      startWhen __attribute__ ((aligned (8)));
     int     overflow;
 
     int     traceVersion;
     size_t  recordSize;
 
+    /*
+     * Header and records drained so far; memory-backed for DDMS.
+     * "spillLock" serializes the drains, so each thread's records reach
+     * the file in order.
+     */
+    pthread_mutex_t spillLock;
+    FILE*   spillFile;
+    char*   spillMemPtr;
+    size_t  spillMemSize;
+    size_t  spillBytes;
+    int     numRecords;
+
+    /* trace writer thread */
+    pthread_mutex_t writerLock;
+    pthread_cond_t  writerCond;
+    bool            writerStop;
+    pthread_t       writerThreadHandle;
+
     bool    samplingEnabled;
+    int     samplingIntervalUs;
     pthread_t       samplingThreadHandle;
+
+    /*
+     * Samples of the threads that exited while sampling, merged into one
+     * trie.  Guarded by "spillLock".
+     */
+    struct SampleTrieNode* retiredSampleTrie;
+    u4      retiredSampleTrieNodes;
+    bool    retiredSamplesExported;
 };
 
 /*
@@ -100,6 +140,11 @@ enum TracingMode {
 };
 TracingMode dvmGetMethodTracingMode(void);
 
+/*
+ * Free the call stacks the sampling profiler has collected for a thread.
+ */
+void dvmFreeSampleTrie(struct Thread* thread);
+
 /*
  * Start/stop emulator tracing.
  */
@@ -164,6 +209,7 @@ void dvmMethodTraceReadClocks(Thread* self, u4* cpuClockDiff,
                               u4* wallClockDiff);
 void dvmMethodTraceAdd(struct Thread* self, const Method* method, int action,
                        u4 cpuClockDiff, u4 wallClockDiff);
+void dvmMethodTraceDrainThread(struct Thread* self);
 void dvmEmitEmulatorTrace(const Method* method, int action);
 
 void dvmMethodTraceGCBegin(void);
@@ -193,6 +193,7 @@ static void handleSigQuit()
     dvmSuspendAllThreads(SUSPEND_FOR_STACK_DUMP);
 
     dvmDumpLoaderStats("sig");
+    dvmCheckClassTablePerf();
 
     if (gDvm.stackTraceFile == NULL) {
         /* just dump to log */
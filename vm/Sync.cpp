@@ -43,8 +43,8 @@
  * lock encodes its state.  When cleared, the lock is in the "thin"
  * state and its bits are formatted as follows:
  *
- *    [31 ---- 19] [18 ---- 3] [2 ---- 1] [0]
- *     lock count   thread id  hash state  0
+ *    [31] [30 - 29] [28 ---- 19] [18 ---- 3] [2 ---- 1] [0]
+ *    bias  bias epoch  lock count   thread id  hash state  0
  *
  * When set, the lock is in the "fat" state and its bits are formatted
  * as follows:
@@ -54,6 +54,35 @@
  *
  * For an in-depth description of the mechanics of thin-vs-fat locking,
  * read the paper referred to above.
+ *
+ * Thin locks may also be biased, as in Kawachiya et al.'s "Lock
+ * reservation: Java locks can mostly do without atomic operations"
+ * (OOPSLA 2002).  The first acquire of an unlocked object installs the
+ * thread id with the bias bit set, and from then on the lock is reserved
+ * for that thread: the count field holds the number of times it is held,
+ * and the owner acquires and releases it with plain loads and stores.
+ * Any other thread that wants the lock has to revoke the bias, which it
+ * does with all threads suspended so that it can't race the owner's
+ * stores.  An unheld lock is handed over (rebiased) to the revoking
+ * thread; a held one becomes an ordinary thin lock that the owner still
+ * holds.
+ *
+ * Revocations are counted per class.  Every BIAS_REBIAS_THRESHOLD of them
+ * the revoker also performs a bulk rebias, as in Russell and Detlefs'
+ * "Eliminating synchronization-related atomic operations with biased
+ * locking and bulk rebiasing" (OOPSLA 2006): it advances the bias epoch of
+ * the class, which makes every bias on its instances stale at once.  A
+ * stale bias on an unheld lock is taken over by any thread with a CAS,
+ * without suspending anyone.  The hold count lives in the lock word, so
+ * unlike in that paper no stacks need to be walked: a held lock can't be
+ * taken over until its owner has released it.  A class that reaches
+ * BIAS_REVOKE_THRESHOLD revocations stops biasing new locks.
+ *
+ * The owner only uses plain stores while it is running, so that it can't
+ * be in the middle of one when a revoker suspends it.  In other states it
+ * drops its own bias with a CAS first.  It doesn't use them either to
+ * acquire a lock whose bias is stale, since another thread may be taking
+ * it over, and releases such a lock with a store barrier.
  */
 
 /*
@@ -155,6 +184,10 @@ static u4 lockOwner(Object* obj)
      */
     lock = obj->lock;
     if (LW_SHAPE(lock) == LW_SHAPE_THIN) {
+        if (LW_IS_BIASED(lock) && LW_LOCK_COUNT(lock) == 0) {
+            /* reserved, but not held */
+            return 0;
+        }
         return LW_LOCK_OWNER(lock);
     } else {
         owner = LW_MONITOR(lock)->owner;
@@ -847,6 +880,118 @@ static void inflateMonitor(Thread *self, Object *obj)
     android_atomic_release_store(thin, (int32_t *)&obj->lock);
 }
 
+/*
+ * Returns true if a lock on obj may be biased to the thread acquiring it.
+ */
+static bool biasAllowed(const Object* obj)
+{
+    return gDvm.biasedLocking && obj->clazz != NULL &&
+        obj->clazz->biasRevocations < BIAS_REVOKE_THRESHOLD;
+}
+
+/*
+ * Returns true if the biased lock word "thin" on obj was biased in the
+ * current epoch of its class, rather than before its last bulk rebias.
+ */
+static bool biasCurrent(const Object* obj, u4 thin)
+{
+    return obj->clazz != NULL &&
+        (thin & (LW_BIAS_EPOCH_MASK << LW_BIAS_EPOCH_SHIFT)) ==
+        obj->clazz->biasEpoch;
+}
+
+/*
+ * Returns the unbiased thin lock equivalent to a biased one: unlocked if
+ * it isn't held, or held by the same thread with one fewer recursive
+ * acquire, since a thin lock doesn't count the first.
+ */
+static u4 unbiasedLock(u4 thin)
+{
+    u4 hashState = thin & (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT);
+    u4 count = LW_LOCK_COUNT(thin);
+
+    assert(LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_BIASED(thin));
+    if (count == 0) {
+        return hashState;
+    }
+    return hashState | (LW_LOCK_OWNER(thin) << LW_LOCK_OWNER_SHIFT) |
+        ((count - 1) << LW_LOCK_COUNT_SHIFT);
+}
+
+/*
+ * Drops the calling thread's own bias on obj.  A revoking thread may get
+ * there first if the caller isn't running, and another thread may take
+ * over a stale bias, hence the CAS.
+ */
+static void unbiasOwnLock(Thread* self, Object* obj)
+{
+    volatile u4 *thinp = &obj->lock;
+    u4 thin;
+
+    do {
+        thin = *thinp;
+        if (LW_SHAPE(thin) != LW_SHAPE_THIN || !LW_IS_BIASED(thin) ||
+            LW_LOCK_OWNER(thin) != self->threadId) {
+            return;
+        }
+    } while (android_atomic_release_cas(thin, unbiasedLock(thin),
+                (int32_t*)thinp) != 0);
+}
+
+/*
+ * Revokes another thread's bias on obj with all threads suspended.  If
+ * "rebias" is set and the lock isn't held, it is biased to the calling
+ * thread instead, which can then acquire it without atomics.  Every
+ * BIAS_REBIAS_THRESHOLD revocations on a class, the epoch of the class
+ * is advanced while everyone is still suspended: that is the bulk rebias.
+ */
+static void revokeBias(Thread* self, Object* obj, bool rebias)
+{
+    volatile u4 *thinp = &obj->lock;
+    u4 thin, newThin;
+
+    dvmSuspendAllThreads(SUSPEND_FOR_BIAS_REVOKE);
+    for (;;) {
+        thin = *thinp;
+        if (LW_SHAPE(thin) != LW_SHAPE_THIN || !LW_IS_BIASED(thin) ||
+            LW_LOCK_OWNER(thin) == self->threadId) {
+            /* someone else revoked it while we were suspending */
+            break;
+        }
+        if (rebias && LW_LOCK_COUNT(thin) == 0 && biasAllowed(obj)) {
+            newThin = (thin & (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT)) |
+                (self->threadId << LW_LOCK_OWNER_SHIFT) | LW_BIASED |
+                obj->clazz->biasEpoch;
+        } else {
+            newThin = unbiasedLock(thin);
+        }
+        /*
+         * The owner is suspended, or isn't running and uses a CAS to
+         * unbias its own lock, so one of the two CASes wins.
+         */
+        if (android_atomic_release_cas(thin, newThin, (int32_t*)thinp) == 0) {
+            ClassObject* clazz = obj->clazz;
+            if (clazz == NULL) {
+                break;
+            }
+            clazz->biasRevocations++;
+            if (clazz->biasRevocations == BIAS_REVOKE_THRESHOLD) {
+                ALOGV("No more biased locking for %s", clazz->descriptor);
+            } else if (clazz->biasRevocations < BIAS_REVOKE_THRESHOLD &&
+                       clazz->biasRevocations % BIAS_REBIAS_THRESHOLD == 0) {
+                /*
+                 * The epoch can't wrap around: the class stops biasing
+                 * before it runs out of epochs.
+                 */
+                clazz->biasEpoch += 1 << LW_BIAS_EPOCH_SHIFT;
+                ALOGV("Bulk rebias of %s", clazz->descriptor);
+            }
+            break;
+        }
+    }
+    dvmResumeAllThreads(SUSPEND_FOR_BIAS_REVOKE);
+}
+
 /*
  * Implements monitorenter for "synchronized" stuff.
  *
@@ -869,7 +1014,43 @@ void dvmLockObject(Thread* self, Object *obj)
     thinp = &obj->lock;
 retry:
     thin = *thinp;
-    if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_BIASED(thin)) {
+        /*
+         * The lock is biased.  If it is reserved for the calling thread,
+         * bump the hold count with a plain store.  Stop short of the
+         * end of the count field; the ordinary thin lock it turns into
+         * inflates when it runs out.  A held lock stays ours even if
+         * its bias went stale.
+         */
+        if (LW_LOCK_OWNER(thin) == threadId &&
+            (LW_LOCK_COUNT(thin) != 0 || biasCurrent(obj, thin))) {
+            if (self->status == THREAD_RUNNING &&
+                LW_LOCK_COUNT(thin) < LW_LOCK_COUNT_MASK - 1) {
+                *thinp = thin + (1 << LW_LOCK_COUNT_SHIFT);
+                return;
+            }
+            unbiasOwnLock(self, obj);
+        } else if (LW_LOCK_COUNT(thin) == 0 && !biasCurrent(obj, thin) &&
+                   biasAllowed(obj)) {
+            /*
+             * The bias predates the last bulk rebias of the class and
+             * the lock isn't held.  Take it over with a CAS; nobody
+             * uses plain stores on it any more.
+             */
+            newThin = (thin & (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT)) |
+                (threadId << LW_LOCK_OWNER_SHIFT) | LW_BIASED |
+                obj->clazz->biasEpoch | (1 << LW_LOCK_COUNT_SHIFT);
+            if (android_atomic_acquire_cas(thin, newThin,
+                    (int32_t*)thinp) == 0) {
+                return;
+            }
+        } else if (LW_LOCK_OWNER(thin) == threadId) {
+            unbiasOwnLock(self, obj);
+        } else {
+            revokeBias(self, obj, true);
+        }
+        goto retry;
+    } else if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /*
          * The lock is a thin lock.  The owner field is used to
          * determine the acquire method, ordered by cost.
@@ -891,11 +1072,16 @@ retry:
         } else if (LW_LOCK_OWNER(thin) == 0) {
             /*
              * The lock is unowned.  Install the thread id of the
-             * calling thread into the owner field.  This is the
-             * common case.  In performance critical code the JIT
-             * will have tried this before calling out to the VM.
+             * calling thread into the owner field, biased to it if
+             * the class allows.  This is the common case.  In
+             * performance critical code the JIT will have tried this
+             * before calling out to the VM.
              */
             newThin = thin | (threadId << LW_LOCK_OWNER_SHIFT);
+            if (biasAllowed(obj)) {
+                newThin |= LW_BIASED | obj->clazz->biasEpoch |
+                    (1 << LW_LOCK_COUNT_SHIFT);
+            }
             if (android_atomic_acquire_cas(thin, newThin,
                     (int32_t*)thinp) != 0) {
                 /*
@@ -919,9 +1105,10 @@ retry:
                 thin = *thinp;
                 /*
                  * Check the shape of the lock word.  Another thread
-                 * may have inflated the lock while we were waiting.
+                 * may have inflated or biased the lock while we were
+                 * waiting.
                  */
-                if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
+                if (LW_SHAPE(thin) == LW_SHAPE_THIN && !LW_IS_BIASED(thin)) {
                     if (LW_LOCK_OWNER(thin) == 0) {
                         /*
                          * The lock has been released.  Install the
@@ -962,9 +1149,9 @@ retry:
                     }
                 } else {
                     /*
-                     * The thin lock was inflated by another thread.
-                     * Let the VM know we are no longer waiting and
-                     * try again.
+                     * The thin lock was inflated or biased by another
+                     * thread.  Let the VM know we are no longer waiting
+                     * and try again.
                      */
                     ALOGV("(%d) lock %p surprise-fattened",
                              threadId, &obj->lock);
@@ -1011,7 +1198,35 @@ bool dvmUnlockObject(Thread* self, Object *obj)
      * examining its state.
      */
     thin = *(volatile u4 *)&obj->lock;
-    if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_BIASED(thin) &&
+        self->status != THREAD_RUNNING) {
+        /*
+         * Plain stores are only safe while running, see dvmLockObject.
+         * Turn a lock biased to us into an ordinary thin lock first.
+         */
+        unbiasOwnLock(self, obj);
+        thin = *(volatile u4 *)&obj->lock;
+    }
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_BIASED(thin)) {
+        /*
+         * The lock is biased.  If we hold it, drop a hold with a plain
+         * store.  No other thread can acquire a current bias before it
+         * goes through a revocation, which suspends us first, so the
+         * store needs no barrier.  A stale one may be taken over as
+         * soon as it is released, so publish our stores first.
+         */
+        if (LW_LOCK_OWNER(thin) != self->threadId ||
+            LW_LOCK_COUNT(thin) == 0) {
+            dvmThrowIllegalMonitorStateException("unlock of unowned monitor");
+            return false;
+        }
+        if (biasCurrent(obj, thin)) {
+            *(volatile u4 *)&obj->lock = thin - (1 << LW_LOCK_COUNT_SHIFT);
+        } else {
+            android_atomic_release_store(thin - (1 << LW_LOCK_COUNT_SHIFT),
+                    (int32_t *)&obj->lock);
+        }
+    } else if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /*
          * The lock is thin.  We must ensure that the lock is owned
          * by the given thread before unlocking it.
@@ -1074,7 +1289,7 @@ void dvmObjectWait(Thread* self, Object *obj, s8 msec, s4 nsec,
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (lockOwner(obj) != self->threadId) {
             dvmThrowIllegalMonitorStateException(
                 "object not locked by thread before wait()");
             return;
@@ -1083,8 +1298,10 @@ void dvmObjectWait(Thread* self, Object *obj, s8 msec, s4 nsec,
         /* This thread holds the lock.  We need to fatten the lock
          * so 'self' can block on it.  Don't update the object lock
          * field yet, because 'self' needs to acquire the lock before
-         * any other thread gets a chance.
+         * any other thread gets a chance.  A biased lock has to turn
+         * into an ordinary thin lock first.
          */
+        unbiasOwnLock(self, obj);
         inflateMonitor(self, obj);
         ALOGV("(%d) lock %p fattened by wait()", self->threadId, &obj->lock);
     }
@@ -1105,7 +1322,7 @@ void dvmObjectNotify(Thread* self, Object *obj)
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (lockOwner(obj) != self->threadId) {
             dvmThrowIllegalMonitorStateException(
                 "object not locked by thread before notify()");
             return;
@@ -1133,7 +1350,7 @@ void dvmObjectNotifyAll(Thread* self, Object *obj)
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (lockOwner(obj) != self->threadId) {
             dvmThrowIllegalMonitorStateException(
                 "object not locked by thread before notifyAll()");
             return;
@@ -1272,6 +1489,25 @@ retry:
          * hashed and use the raw object address.
          */
         self = dvmThreadSelf();
+        lock = *lw;
+        if (LW_SHAPE(lock) == LW_SHAPE_THIN && LW_IS_BIASED(lock)) {
+            /*
+             * Only the thread a lock is biased to may change it without
+             * suspending others, and only while the bias is current or
+             * the lock is held.  Everyone else revokes the bias first.
+             */
+            if (LW_LOCK_OWNER(lock) == self->threadId &&
+                self->status == THREAD_RUNNING &&
+                (LW_LOCK_COUNT(lock) != 0 || biasCurrent(obj, lock))) {
+                *lw |= (LW_HASH_STATE_HASHED << LW_HASH_STATE_SHIFT);
+                return (u4)obj >> 3;
+            } else if (LW_LOCK_OWNER(lock) == self->threadId) {
+                unbiasOwnLock(self, obj);
+            } else {
+                revokeBias(self, obj, false);
+            }
+            goto retry;
+        }
         if (self->threadId == lockOwner(obj)) {
             /*
              * We already own the lock so we can update the hash state
@@ -1354,7 +1590,7 @@ retry:
          * Wait for the owning thread to suspend.
          */
         dvmSuspendThread(thread);
-        if (dvmHoldsLock(thread, obj)) {
+        if (!LW_IS_BIASED(*lw) && dvmHoldsLock(thread, obj)) {
             /*
              * The owning thread has been suspended.  We can safely
              * change the hash state to hashed.
@@ -1365,7 +1601,8 @@ retry:
             return (u4)obj >> 3;
         }
         /*
-         * The wrong thread has been suspended.  Try again.
+         * The wrong thread has been suspended, or the lock has been
+         * biased since.  Try again.
          */
         dvmResumeThread(thread);
         dvmUnlockThreadList();
@@ -57,12 +57,41 @@
 
 /*
  * Lock recursion count field.  Contains a count of the numer of times
- * a lock has been recursively acquired.
+ * a lock has been recursively acquired.  In a biased lock it counts every
+ * hold, so a biased lock with a count of zero is unheld.
  */
-#define LW_LOCK_COUNT_MASK 0x1fff
+#define LW_LOCK_COUNT_MASK 0x3ff
 #define LW_LOCK_COUNT_SHIFT 19
 #define LW_LOCK_COUNT(x) (((x) >> LW_LOCK_COUNT_SHIFT) & LW_LOCK_COUNT_MASK)
 
+/*
+ * Bias field.  A biased thin lock is reserved for the thread in the owner
+ * field, which acquires and releases it by adjusting the count without
+ * atomic operations.  Other threads revoke the bias with all threads
+ * suspended.
+ */
+#define LW_BIASED 0x80000000
+#define LW_IS_BIASED(x) (((x) & LW_BIASED) != 0)
+
+/*
+ * Bias epoch field.  A biased lock is only reserved while its epoch
+ * matches the biasEpoch of the object's class; a bulk rebias advances
+ * that, leaving the bias stale.  Always zero in an unbiased lock.
+ */
+#define LW_BIAS_EPOCH_MASK 0x3
+#define LW_BIAS_EPOCH_SHIFT 29
+#define LW_BIAS_EPOCH(x) (((x) >> LW_BIAS_EPOCH_SHIFT) & LW_BIAS_EPOCH_MASK)
+
+/*
+ * Every this many revocations on instances of a class, the class goes
+ * through a bulk rebias.  Once BIAS_REVOKE_THRESHOLD biases have been
+ * revoked, the class stops biasing new locks.  The latter must stay
+ * within (LW_BIAS_EPOCH_MASK + 1) times the former, so that the epoch
+ * never wraps around to that of a stale bias.
+ */
+#define BIAS_REBIAS_THRESHOLD 16
+#define BIAS_REVOKE_THRESHOLD 64
+
 struct Object;
 struct Monitor;
 struct Thread;
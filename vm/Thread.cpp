@@ -436,6 +436,8 @@ static const char* getSuspendCauseStr(SuspendCause why)
     case SUSPEND_FOR_STACK_DUMP:    return "stack-dump";
     case SUSPEND_FOR_VERIFY:        return "verify";
     case SUSPEND_FOR_HPROF:         return "hprof";
+    case SUSPEND_FOR_ALLOC_PROF:    return "alloc-prof";
+    case SUSPEND_FOR_BIAS_REVOKE:   return "bias-revoke";
 #if defined(WITH_JIT)
     case SUSPEND_FOR_TBL_RESIZE:    return "table-resize";
     case SUSPEND_FOR_IC_PATCH:      return "inline-cache-patch";
@@ -1013,7 +1015,9 @@ static void freeThread(Thread* thread)
 #if defined(WITH_SELF_VERIFICATION)
     dvmSelfVerificationShadowSpaceFree(thread);
 #endif
-    free(thread->stackTraceSample);
+    dvmFreeSampleTrie(thread);
+    free(thread->methodTraceBuffer);
+    dvmAllocTrackerFreeThread(thread);
     free(thread);
 }
 
@@ -2164,11 +2168,18 @@ void dvmDetachCurrentThread()
      */
     MethodTraceState* traceState = &gDvm.methodTrace;
 
+    /*
+     * Our buffer and samples go away with us, so get them out now.  The
+     * sampling profiler reports the samples of exited threads under one
+     * entry of its own, so it doesn't need to hold us back.
+     */
+    dvmMethodTraceDrainThread(self);
+
     dvmLockMutex(&traceState->startStopLock);
-    if (traceState->traceEnabled) {
+    if (traceState->traceEnabled && !traceState->samplingEnabled) {
         ALOGI("threadid=%d: waiting for method trace to finish",
             self->threadId);
-        while (traceState->traceEnabled) {
+        while (traceState->traceEnabled && !traceState->samplingEnabled) {
             dvmWaitCond(&traceState->threadExitCond,
                         &traceState->startStopLock);
         }
@@ -2218,6 +2229,91 @@ void dvmDetachCurrentThread()
     freeThread(self);
 }
 
+/*
+ * Attach the current thread to the VM as a dexopt worker.
+ *
+ * Unlike dvmAttachCurrentThread(), no Thread or VMThread objects are
+ * created, because dexopt cannot run the Thread constructor.  The thread
+ * gets a thread id, so it can lock monitors and hold an exception, and it
+ * is on the thread list, so the GC suspends it like any other.
+ *
+ * The thread is left in THREAD_VMWAIT; switch to THREAD_RUNNING before
+ * touching objects.
+ */
+bool dvmAttachOptimizerThread()
+{
+    Thread* self;
+    bool ok;
+
+    assert(gDvm.optimizing);
+
+    self = allocThread(gDvm.stackSize);
+    if (self == NULL)
+        return false;
+    setThreadSelf(self);
+
+    dvmLockThreadList(self);
+    ok = prepareThread(self);
+    if (ok) {
+        self->next = gDvm.threadList->next;
+        if (self->next != NULL)
+            self->next->prev = self;
+        self->prev = gDvm.threadList;
+        gDvm.threadList->next = self;
+#ifdef WITH_CONDMARK
+        self->cardImmuneLimit = gDvm.cardImmuneLimit;
+#endif
+        self->status = THREAD_VMWAIT;
+    } else {
+        releaseThreadId(self);
+    }
+    dvmUnlockThreadList();
+
+    if (!ok) {
+        setThreadSelf(NULL);
+        freeThread(self);
+        return false;
+    }
+
+#ifdef WITH_TLA
+    dvmTLHeapAtttach(self);
+#endif
+
+    /*
+     * A GC may have started before we were on the thread list; stall
+     * until it completes, as dvmAttachCurrentThread() does.
+     */
+    dvmLockMutex(&gDvm.gcHeapLock);
+    dvmUnlockMutex(&gDvm.gcHeapLock);
+
+    LOG_THREAD("threadid=%d: attached for dexopt", self->threadId);
+    return true;
+}
+
+/*
+ * Detach a thread attached with dvmAttachOptimizerThread().
+ */
+void dvmDetachOptimizerThread()
+{
+    Thread* self = dvmThreadSelf();
+
+    assert(self->threadObj == NULL);
+    dvmClearException(self);
+
+#ifdef WITH_TLA
+    dvmTLHeapDetach(self);
+#endif
+
+    dvmLockThreadList(self);
+    self->status = THREAD_ZOMBIE;
+    unlinkThread(self);
+    releaseThreadId(self);
+    dvmUnlockThreadList();
+
+    setThreadSelf(NULL);
+    freeThread(self);
+}
+
 
 /*
  * Suspend a single thread.  Do not use to suspend yourself.
@@ -256,6 +256,16 @@ struct Thread {
 #if WITH_TLA
     /* the ThreadLocalHeap associated with this Thread */
     struct TLHeap* tlh;
+
+    /*
+     * Bump allocation buffer, see ThreadLocalHeap.cpp.  Compiled code
+     * allocates inline while tlBufferTop stays below tlBufferLimit; the
+     * limit is NULL when inline allocation is not allowed.
+     */
+    u1*         tlBufferTop;
+    u1*         tlBufferLimit;
+    uintptr_t   tlBufferHeader;
+    u4          tlBufferCount;
 #endif
     /* internal reference tracking */
     ReferenceTable  internalLocalRefTable;
@@ -305,9 +315,18 @@ struct Thread {
     bool        cpuClockBaseSet;
     u8          cpuClockBase;
 
-    /* previous stack trace sample and length (used by sampling profiler) */
-    const Method** stackTraceSample;
-    size_t stackTraceSampleLength;
+    /* call stacks sampled so far, and the trie's node count (sampling profiler) */
+    SampleTrieNode* sampleTrie;
+    u4          sampleTrieNodes;
+
+    /* method trace records not yet drained by the trace writer */
+    MethodTraceBuffer* methodTraceBuffer;
+
+    /* recent allocations, when DDMS allocation tracking is on */
+    struct AllocTrackerBuffer* allocTrackerBuffer;
+
+    /* dexopt: class treated as having a foreign loader by access checks */
+    const ClassObject* dexOptForeignClass;
 
     /* memory allocation profiling state */
     AllocProfState allocProf;
@@ -381,6 +400,8 @@ enum SuspendCause {
     SUSPEND_FOR_VERIFY,
     SUSPEND_FOR_HPROF,
     SUSPEND_FOR_SAMPLING,
+    SUSPEND_FOR_ALLOC_PROF,  // switch compiled code to traced allocation
+    SUSPEND_FOR_BIAS_REVOKE, // revoke a biased lock held by another thread
 #if defined(WITH_JIT)
     SUSPEND_FOR_TBL_RESIZE,  // jit-table resize
     SUSPEND_FOR_IC_PATCH,    // polymorphic callsite inline-cache patch
@@ -527,6 +548,13 @@ bool dvmCreateInternalThread(pthread_t* pHandle, const char* name,
 bool dvmAttachCurrentThread(const JavaVMAttachArgs* pArgs, bool isDaemon);
 void dvmDetachCurrentThread(void);
 
+/*
+ * Attach or detach the current thread as a dexopt worker.  Such threads
+ * have no java.lang.Thread and must never run interpreted code.
+ */
+bool dvmAttachOptimizerThread(void);
+void dvmDetachOptimizerThread(void);
+
 /*
  * Get the "main" or "system" thread group.
  */
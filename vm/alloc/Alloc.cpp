@@ -21,6 +21,7 @@
 #include "alloc/Heap.h"
 #include "alloc/HeapInternal.h"
 #include "alloc/HeapSource.h"
+#include "alloc/MarkSweep.h"
 #include "cutils/atomic.h"
 #include "cutils/atomic-inline.h"
 
@@ -68,6 +69,9 @@ void dvmGcShutdown()
  */
 bool dvmGcPreZygoteFork()
 {
+    dvmLockHeap();
+    dvmHeapFinishLazySweep();
+    dvmUnlockHeap();
     return dvmHeapSourceStartupBeforeFork();
 }
 
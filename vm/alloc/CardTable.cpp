@@ -81,7 +81,8 @@ bool dvmCardTableStartup(size_t heapMaximumSize, size_t growthLimit)
     assert(((uintptr_t)biasedBase & 0xff) == GC_CARD_DIRTY);
     gDvm.biasedCardTableBase = biasedBase;
 #ifdef WITH_CONDMARK
-    gDvm.cardImmuneLimit  = 0;
+    /* Young collections need cards for every heap object. */
+    gDvm.cardImmuneLimit  = gDvm.generationalGc ? (u1*)ULONG_MAX : 0;
 #endif
 
     return true;
@@ -257,9 +258,11 @@ void dvmDisableCardImmuneLimit(void)
 void dvmEnableCardImmuneLimit(void)
 {
 #ifdef WITH_REGION_GC
-    u1* cardImmuneLimit = gDvm.disableCondmark ? (u1*)ULONG_MAX : (u1*)dvmGetActiveHeapBase();
+    u1* cardImmuneLimit = (gDvm.disableCondmark || gDvm.generationalGc) ?
+        (u1*)ULONG_MAX : (u1*)dvmGetActiveHeapBase();
 #else
-    u1* cardImmuneLimit = gDvm.disableCondmark ? (u1*)ULONG_MAX : 0;
+    u1* cardImmuneLimit = (gDvm.disableCondmark || gDvm.generationalGc) ?
+        (u1*)ULONG_MAX : 0;
 #endif
     dvmLockThreadList(NULL);
     gDvm.cardImmuneLimit = cardImmuneLimit;
@@ -271,6 +274,47 @@ void dvmEnableCardImmuneLimit(void)
 
 #endif
 
+/*
+ * Returns the range of cards covering addresses from base up to the
+ * heap source limit.  A NULL base means the whole heap.
+ */
+static void getCardRange(const void *base, u1 **start, u1 **end)
+{
+    GcHeap *h = gDvm.gcHeap;
+    if (base == NULL) {
+        *start = &h->cardTableBase[0];
+    } else {
+        *start = dvmCardFromAddr(base);
+    }
+    *end = dvmCardFromAddr((u1 *)dvmHeapSourceGetLimit() - GC_CARD_SIZE) + 1;
+}
+
+void dvmAgeCardTable(const void *base)
+{
+    u1 *card, *end;
+    getCardRange(base, &card, &end);
+    for (;;) {
+        card = (u1 *)memchr(card, GC_CARD_DIRTY, end - card);
+        if (card == NULL) {
+            break;
+        }
+        *card++ = GC_CARD_AGED;
+    }
+}
+
+void dvmCleanAgedCards(const void *base)
+{
+    u1 *card, *end;
+    getCardRange(base, &card, &end);
+    for (;;) {
+        card = (u1 *)memchr(card, GC_CARD_AGED, end - card);
+        if (card == NULL) {
+            break;
+        }
+        *card++ = GC_CARD_CLEAN;
+    }
+}
+
 /*
  * Returns true if the object is on a dirty card.
  */
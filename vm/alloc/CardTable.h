@@ -27,6 +27,7 @@
 #define GC_CARD_SIZE (1 << GC_CARD_SHIFT)
 #define GC_CARD_CLEAN 0
 #define GC_CARD_DIRTY 0x70
+#define GC_CARD_AGED 0x01
 
 /*
  * Initializes the card table; must be called before any other
@@ -87,6 +88,19 @@ void dvmDisableCardImmuneLimit(void);
 void dvmEnableCardImmuneLimit(void);
 #endif
 
+/*
+ * Turns the dirty cards covering addresses at or above base into aged
+ * cards.  Used by young collections to set the remembered set aside
+ * while the mutators resume dirtying cards.
+ */
+void dvmAgeCardTable(const void *base);
+
+/*
+ * Cleans the aged cards covering addresses at or above base.  Must be
+ * called with all mutator threads suspended.
+ */
+void dvmCleanAgedCards(const void *base);
+
 /*
  * Verifies that all gray objects are on a dirty card.
  */
@@ -1437,49 +1437,44 @@ static void pinPrimitiveClasses()
  * been pinned and are therefore ignored.  Non-permanent strings that
  * have been forwarded are snapped.  All other entries are removed.
  */
-static void scavengeInternedStrings()
+static void scavengeInternedString(StringObject **strPtr, void *arg)
 {
-    HashTable *table = gDvm.internedStrings;
-    if (table == NULL) {
-        return;
+    if (!isPermanentString(*strPtr)) {
+        LOG_SCAV(">>> string obj=%p", *strPtr);
+        /* TODO(cshapiro): detach white string objects */
+        scavengeReference((Object **)(void *)strPtr);
+        LOG_SCAV("<<< string obj=%p", *strPtr);
     }
-    dvmHashTableLock(table);
-    for (int i = 0; i < table->tableSize; ++i) {
-        HashEntry *entry = &table->pEntries[i];
-        Object *obj = (Object *)entry->data;
-        if (obj == NULL || obj == HASH_TOMBSTONE) {
-            continue;
-        } else if (!isPermanentString((StringObject *)obj)) {
-            // LOG_SCAV("entry->data=%p", entry->data);
-            LOG_SCAV(">>> string obj=%p", entry->data);
-            /* TODO(cshapiro): detach white string objects */
-            scavengeReference((Object **)(void *)&entry->data);
-            LOG_SCAV("<<< string obj=%p", entry->data);
-        }
+}
+
+static void scavengeInternedStrings()
+{
+    dvmVisitInternedStrings(true, scavengeInternedString, NULL);
+}
+
+static void pinInternedString(StringObject **strPtr, void *arg)
+{
+    if (isPermanentString(*strPtr)) {
+        Object *obj = (Object *)getPermanentString(*strPtr);
+        LOG_PROM(">>> pin string obj=%p", obj);
+        pinObject(obj);
+        LOG_PROM("<<< pin string obj=%p", obj);
     }
-    dvmHashTableUnlock(table);
+}
+
+static void pinLoadedClass(ClassObject **clazzPtr, void *arg)
+{
+    pinObject((Object *)*clazzPtr);
+}
+
+static void pinLoadedClasses()
+{
+    dvmVisitLoadedClasses(pinLoadedClass, NULL);
 }
 
 static void pinInternedStrings()
 {
-    HashTable *table = gDvm.internedStrings;
-    if (table == NULL) {
-        return;
-    }
-    dvmHashTableLock(table);
-    for (int i = 0; i < table->tableSize; ++i) {
-        HashEntry *entry = &table->pEntries[i];
-        Object *obj = (Object *)entry->data;
-        if (obj == NULL || obj == HASH_TOMBSTONE) {
-            continue;
-        } else if (isPermanentString((StringObject *)obj)) {
-            obj = (Object *)getPermanentString((StringObject*)obj);
-            LOG_PROM(">>> pin string obj=%p", obj);
-            pinObject(obj);
-            LOG_PROM("<<< pin string obj=%p", obj);
-        }
-     }
-    dvmHashTableUnlock(table);
+    dvmVisitInternedStrings(true, pinInternedString, NULL);
 }
 
 /*
@@ -2082,7 +2077,7 @@ void dvmScavengeRoots()  /* Needs a new name badly */
     pinThreadList();
     pinReferenceTable(&gDvm.jniGlobalRefTable);
     pinReferenceTable(&gDvm.jniPinRefTable);
-    pinHashTableEntries(gDvm.loadedClasses);
+    pinLoadedClasses();
     pinHashTableEntries(gDvm.dbgRegistry);
     pinPrimitiveClasses();
     pinInternedStrings();
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Dalvik.h"
+#include "alloc/GcWorkers.h"
+
+/*
+ * The helper threads sleep on startCond until the generation number
+ * changes, run the posted function, and the last one to finish signals
+ * doneCond.  They stay in THREAD_VMWAIT throughout, so they never hold
+ * up a thread suspension.
+ */
+struct GcWorkers {
+    pthread_mutex_t lock;
+    pthread_cond_t startCond;
+    pthread_cond_t doneCond;
+    pthread_t threads[GC_MAX_WORKERS];
+
+    /* Number of workers, including the thread running the GC. */
+    size_t numWorkers;
+
+    unsigned int generation;
+    size_t pending;
+    GcWorkerFunc func;
+    void *arg;
+    bool shutdown;
+};
+
+static GcWorkers gWorkers = { PTHREAD_MUTEX_INITIALIZER,
+                              PTHREAD_COND_INITIALIZER,
+                              PTHREAD_COND_INITIALIZER };
+
+static void *gcWorkerThread(void *arg)
+{
+    size_t id = (size_t)arg;
+    unsigned int seen = 0;
+
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+    dvmLockMutex(&gWorkers.lock);
+    for (;;) {
+        while (!gWorkers.shutdown && gWorkers.generation == seen) {
+            dvmWaitCond(&gWorkers.startCond, &gWorkers.lock);
+        }
+        if (gWorkers.shutdown) {
+            break;
+        }
+        seen = gWorkers.generation;
+        GcWorkerFunc func = gWorkers.func;
+        void *funcArg = gWorkers.arg;
+        dvmUnlockMutex(&gWorkers.lock);
+
+        (*func)(id, funcArg);
+
+        dvmLockMutex(&gWorkers.lock);
+        if (--gWorkers.pending == 0) {
+            dvmSignalCond(&gWorkers.doneCond);
+        }
+    }
+    dvmUnlockMutex(&gWorkers.lock);
+    dvmChangeStatus(NULL, THREAD_RUNNING);
+    return NULL;
+}
+
+bool dvmGcWorkersStartup()
+{
+    assert(gWorkers.numWorkers == 0);
+    gWorkers.numWorkers = 1;
+    gWorkers.shutdown = false;
+    for (size_t i = 1; i < gDvm.gcThreads; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "GC-%zd", i);
+        if (!dvmCreateInternalThread(&gWorkers.threads[i], name,
+                                     gcWorkerThread, (void *)i)) {
+            ALOGW("Unable to start GC worker %zd; marking with %zd threads",
+                  i, gWorkers.numWorkers);
+            break;
+        }
+        gWorkers.numWorkers++;
+    }
+    return true;
+}
+
+void dvmGcWorkersShutdown()
+{
+    if (gWorkers.numWorkers <= 1) {
+        return;
+    }
+    dvmLockMutex(&gWorkers.lock);
+    gWorkers.shutdown = true;
+    dvmBroadcastCond(&gWorkers.startCond);
+    dvmUnlockMutex(&gWorkers.lock);
+    for (size_t i = 1; i < gWorkers.numWorkers; i++) {
+        pthread_join(gWorkers.threads[i], NULL);
+    }
+    gWorkers.numWorkers = 0;
+}
+
+size_t dvmGcWorkerCount()
+{
+    return gWorkers.numWorkers > 1 ? gWorkers.numWorkers : 1;
+}
+
+void dvmGcRunWorkers(GcWorkerFunc func, void *arg)
+{
+    if (gWorkers.numWorkers <= 1) {
+        (*func)(0, arg);
+        return;
+    }
+
+    dvmLockMutex(&gWorkers.lock);
+    assert(gWorkers.pending == 0);
+    gWorkers.func = func;
+    gWorkers.arg = arg;
+    gWorkers.pending = gWorkers.numWorkers - 1;
+    gWorkers.generation++;
+    dvmBroadcastCond(&gWorkers.startCond);
+    dvmUnlockMutex(&gWorkers.lock);
+
+    (*func)(0, arg);
+
+    dvmLockMutex(&gWorkers.lock);
+    while (gWorkers.pending != 0) {
+        dvmWaitCond(&gWorkers.doneCond, &gWorkers.lock);
+    }
+    dvmUnlockMutex(&gWorkers.lock);
+}
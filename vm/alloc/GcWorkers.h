@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Helper threads for the parallel phases of a garbage collection.
+ */
+#ifndef DALVIK_ALLOC_GCWORKERS_H_
+#define DALVIK_ALLOC_GCWORKERS_H_
+
+/* Upper bound for -Xgcthreads, counting the collecting thread. */
+#define GC_MAX_WORKERS 32
+
+typedef void (*GcWorkerFunc)(size_t id, void *arg);
+
+/*
+ * Starts gDvm.gcThreads - 1 helper threads.  Must not be called before
+ * the zygote forks.
+ */
+bool dvmGcWorkersStartup(void);
+
+/*
+ * Stops the helper threads.
+ */
+void dvmGcWorkersShutdown(void);
+
+/*
+ * Returns the number of workers available to dvmGcRunWorkers(),
+ * including the calling thread.  Always at least one.
+ */
+size_t dvmGcWorkerCount(void);
+
+/*
+ * Runs func(id, arg) on every worker and returns once all of them are
+ * done.  The calling thread runs it with an id of zero.
+ */
+void dvmGcRunWorkers(GcWorkerFunc func, void *arg);
+
+#endif  // DALVIK_ALLOC_GCWORKERS_H_
@@ -28,6 +28,7 @@
 #include "alloc/HeapSource.h"
 #include "alloc/MarkSweep.h"
 #include "alloc/CardTable.h"
+#include "alloc/GcWorkers.h"
 #ifdef WITH_TLA
 #include "alloc/ThreadLocalHeap.h"
 #endif
@@ -78,6 +79,15 @@ static const GcSpec kGcBeforeOomSpec = {
 
 const GcSpec *GC_BEFORE_OOM = &kGcBeforeOomSpec;
 
+/*
+ * With -Xgc:generational, partial collections are normally young
+ * collections.  Every so often, or when a young collection frees less
+ * than a quarter of what was allocated since the previous GC, the
+ * whole active heap is traced again.
+ */
+#define GC_MAX_CONSECUTIVE_YOUNG 8
+#define GC_YOUNG_MIN_FREE_SHIFT 2
+
 /*
  * Initialize the GC heap.
  *
@@ -123,10 +133,15 @@ bool dvmHeapStartupAfterZygote()
 #ifdef WITH_TLA
     if (result == true)
     {
-        return dvmTLHeapSourceStartupAfterZygote();
+        result = dvmTLHeapSourceStartupAfterZygote();
     }
 #endif
 
+    if (result == true)
+    {
+        result = dvmGcWorkersStartup();
+    }
+
     return result;
 }
 
@@ -152,6 +167,7 @@ void dvmHeapShutdown()
 void dvmHeapThreadShutdown()
 {
     dvmHeapSourceThreadShutdown();
+    dvmGcWorkersShutdown();
 }
 
 /*
@@ -295,6 +311,17 @@ static void *tryMalloc(size_t size, bool clear = true)
         return ptr;
     }
 
+    /*
+     * Reclaim the garbage the last GC left unswept before anything
+     * more drastic.
+     */
+    while (dvmHeapSweepLazily(size)) {
+        ptr = dvmHeapSourceAlloc(size, clear);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+
     /*
      * The allocation failed.  If the GC is running, block until it
      * completes and retry.
@@ -358,6 +385,25 @@ static void *tryMalloc(size_t size, bool clear = true)
 }
 
 #ifdef WITH_TLA
+/* Bump allocate from the thread's buffer, taking a new one if it's
+ * worth it.  Returns NULL rather than collecting.
+ */
+static void *tryTLBufferMalloc(Thread* self, size_t size)
+{
+    void* ptr = dvmTLHeapBufferAlloc(self,size);
+
+    if (LIKELY(ptr != NULL)) {
+        return ptr;
+    }
+
+    /* Slow Path: retire the buffer and carve a new one from the heap */
+    dvmSpinAndLockHeap();
+    ptr = dvmTLHeapBufferRefill(self,size);
+    dvmUnlockHeap();
+
+    return ptr;
+}
+
 /* Try as hard as possible to allocate from local heap.
  */
 static void *tryTLHeapMalloc(TLHeap* tlh, size_t size)
@@ -486,10 +532,26 @@ void* dvmMalloc(size_t size, int flags)
     void *ptr;
 
 #ifdef WITH_TLA
-    TLHeap* tlh = dvmThreadSelf()->tlh;
+    Thread* self = dvmThreadSelf();
+    TLHeap* tlh = self->tlh;
+    ptr = NULL;
     if (    ( tlh != NULL)
-         && ( size <= TLALLOC_MAX_SIZE )
-         && ( size >= TLALLOC_MIN_SIZE ) ){
+         && ( size <= TLBUFFER_MAX_ALLOC_SIZE ) ){
+        /* Bump allocate if the thread's buffer has room.
+         */
+        ptr = tryTLBufferMalloc(self,size);
+    }
+
+    if (ptr != NULL) {
+        if (gDvm.allocProf.enabled) {
+            dvmLockHeap();
+            allocProf(ptr,size);
+            dvmUnlockHeap();
+        }
+
+    } else if (    ( tlh != NULL)
+                && ( size <= TLALLOC_MAX_SIZE )
+                && ( size >= TLALLOC_MIN_SIZE ) ){
         /* Try as hard as possible to allocate some local memory.
          */
         ptr = tryTLHeapMalloc(tlh,size);
@@ -618,6 +680,8 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
     bool isConcurrent = spec->isConcurrent;
     bool isPartial    = spec->isPartial;
     bool doPreserve   = spec->doPreserve;
+    bool isYoung      = false;
+    size_t youngBytes = 0;
 
     /* The heap lock must be held.
      */
@@ -640,6 +704,9 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
         ATRACE_BEGIN("GC (unknown)");
     }
 
+    /* The mark bitmap still holds the garbage of the last GC. */
+    dvmHeapFinishLazySweep();
+
     gcHeap->gcRunning = true;
 
     rootStart = dvmGetRelativeTimeMsec();
@@ -664,6 +731,33 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
         gcHeap->forceMajorGC = false;
     }
 
+    /*
+     * A young collection only traces the objects allocated since the
+     * last GC.  The survivors of that GC are already marked, and the
+     * dirty cards stand for the pointers they hold to younger objects.
+     */
+    if (   (isPartial == true)
+        && (gDvm.generationalGc == true)
+        && (gcHeap->hasOldGeneration == true)
+        && (gcHeap->skipYoungGC == false)
+        && (gcHeap->numConsecutiveYoungGC < GC_MAX_CONSECUTIVE_YOUNG))
+    {
+        size_t allocated = dvmHeapSourceGetValue(HS_BYTES_ALLOCATED, NULL, 0);
+        isYoung = true;
+        gcHeap->numConsecutiveYoungGC ++;
+        if (allocated > gcHeap->bytesAllocatedAfterGC) {
+            youngBytes = allocated - gcHeap->bytesAllocatedAfterGC;
+        }
+    }
+    else {
+        gcHeap->numConsecutiveYoungGC = 0;
+        gcHeap->skipYoungGC = false;
+        if (gcHeap->hasOldGeneration == true) {
+            /* Everything in the active heap is threatened again. */
+            dvmHeapSourceZeroMarkBitmap();
+        }
+    }
+
     /*
      * If we are not marking concurrently raise the priority of the
      * thread performing the garbage collection.
@@ -680,7 +774,7 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
 
     /* Set up the marking context.
      */
-    if (!dvmHeapBeginMarkStep(isPartial)) {
+    if (!dvmHeapBeginMarkStep(isPartial, isYoung)) {
         ATRACE_END(); // Suspend A
         ATRACE_END(); // Top-level GC
         LOGE_HEAP("dvmHeapBeginMarkStep failed; aborting");
@@ -706,12 +800,20 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
 #endif
 
     if (isConcurrent == true) {
+        if (isYoung == true) {
+            /*
+             * The dirty cards are the remembered set.  Age them so the
+             * mutators can dirty cards again while they are scanned.
+             */
+            dvmAgeCardTable(gcHeap->markContext.immuneLimit);
+        } else {
 #ifdef WITH_REGION_GC
-        /* Need to clear active heap if Partial */
-        dvmClearCardTable(isPartial);
+            /* Need to clear active heap if Partial */
+            dvmClearCardTable(isPartial);
 #else
-        dvmClearCardTable();
+            dvmClearCardTable();
 #endif
+        }
 
 #ifdef WITH_CONDMARK
         /*
@@ -735,11 +837,15 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
      * objects will also be marked.
      */
     LOGD_HEAP("Recursing...");
+    if (isYoung == true) {
+        dvmHeapScanYoungObjects();
+    } else {
 #ifdef WITH_REGION_GC
-    dvmHeapScanMarkedObjects(isPartial);
+        dvmHeapScanMarkedObjects(isPartial);
 #else
-    dvmHeapScanMarkedObjects();
+        dvmHeapScanMarkedObjects();
 #endif
+    }
 
     if (isConcurrent == true) {
         /*
@@ -775,10 +881,13 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
          * heap objects dirtied during the concurrent mark.
          */
         dvmHeapReScanMarkedObjects();
+        if (isYoung == true) {
+            dvmCleanAgedCards(gcHeap->markContext.immuneLimit);
+        }
     }
 
 #ifdef WITH_REGION_GC
-    else if (isPartial == true)
+    else if ((isPartial == true) && (isYoung == false))
     {
         /*
          * Region GC bypasses zygote heap scanning.
@@ -793,6 +902,14 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
         dvmHeapReScanMarkedObjects();
     }
 #endif
+    else if (isYoung == true) {
+        /* The whole remembered set has been traced. */
+#ifdef WITH_REGION_GC
+        dvmClearCardTable(true);
+#else
+        dvmClearCardTable();
+#endif
+    }
 
     /*
      * All strongly-reachable objects have now been marked.  Process
@@ -819,6 +936,7 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
     LOGD_HEAP("Sweeping...");
 
     dvmHeapSweepSystemWeaks();
+    dvmGcReleaseRetiredClassTables();
 
     /*
      * Live objects have a bit set in the mark bitmap, swap the mark
@@ -827,6 +945,18 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
      */
     dvmHeapSourceSwapBitmaps();
 
+    /*
+     * Objects allocated from here on are live in the bitmap that
+     * dvmHeapFinishMarkStep() keeps as the old generation.
+     */
+    if ((gDvm.generationalGc == true) && (isConcurrent == true)) {
+        gcHeap->dirtyNewAllocations = true;
+    }
+
+#ifdef WITH_TLA
+    dvmTLHeapSourceBitmapsSwapped();
+#endif
+
     if (gDvm.postVerify) {
         LOGV_HEAP("Verifying roots and heap after GC");
         verifyRootsAndHeap();
@@ -850,6 +980,10 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
     if (isPartial == false) {
         dvmTLHeapSourceReleaseFree(spec->isConcurrent);
     }
+    /* otherwise the lazy sweep trims once it is done */
+    if (!dvmHeapLazySweepPending()) {
+        dvmTLHeapSourceTrimBuffers();
+    }
 #endif
 
 
@@ -866,6 +1000,15 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
     currAllocated = dvmHeapSourceGetValue(HS_BYTES_ALLOCATED, NULL, 0);
     currFootprint = dvmHeapSourceGetValue(HS_FOOTPRINT, NULL, 0);
 
+    if (gDvm.generationalGc == true) {
+        if ((isYoung == true) &&
+            (numBytesFreed < (youngBytes >> GC_YOUNG_MIN_FREE_SHIFT))) {
+            /* The nursery mostly survived; trace everything next time. */
+            gcHeap->skipYoungGC = true;
+        }
+        gcHeap->bytesAllocatedAfterGC = currAllocated;
+    }
+
     if (isPartial == true) {
         /* Major collection is only required if some Zygote objects have been
          * deleted and keep some ref to the  the active Heap (floating garbage).
@@ -876,11 +1019,12 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
          * becomes too high, aka:
          * - last GC didn't free anything
          * - we are at max footprint while very low on free memory.
+         *   (Not known with a lazy sweep, which has freed nothing yet.)
          */
-        if (numBytesFreed == 0) {
+        if (numObjectsFreed == 0) {
             gDvm.gcHeap->forceMajorGC = true;
         }
-        else {
+        else if (gDvm.lazySweep == false) {
             /* check if free space is below minFree */
             if ((currFootprint - currAllocated) < gDvm.heapMinFree) {
                 /* have we reached max footprint yet ?*/
@@ -931,8 +1075,8 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
         u4 markSweepTime = dirtyEnd - rootStart;
         u4 gcTime = gcEnd - rootStart;
         bool isSmall = numBytesFreed > 0 && numBytesFreed < 1024;
-        ALOGD("%s freed %s%zdK, %d%% free %zdK/%zdK, paused %ums, total %ums",
-             spec->reason,
+        ALOGD("%s%s freed %s%zdK, %d%% free %zdK/%zdK, paused %ums, total %ums",
+             spec->reason, isYoung ? "_YOUNG" : "",
              isSmall ? "<" : "",
              numBytesFreed ? MAX(numBytesFreed / 1024, 1) : 0,
              percentFree,
@@ -943,8 +1087,8 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
         u4 dirtyTime = dirtyEnd - dirtyStart;
         u4 gcTime = gcEnd - rootStart;
         bool isSmall = numBytesFreed > 0 && numBytesFreed < 1024;
-        ALOGD("%s freed %s%zdK, %d%% free %zdK/%zdK, paused %ums+%ums, total %ums",
-             spec->reason,
+        ALOGD("%s%s freed %s%zdK, %d%% free %zdK/%zdK, paused %ums+%ums, total %ums",
+             spec->reason, isYoung ? "_YOUNG" : "",
              isSmall ? "<" : "",
              numBytesFreed ? MAX(numBytesFreed / 1024, 1) : 0,
              percentFree,
@@ -25,6 +25,7 @@ static void dvmHeapBitmapClearObjectBit(HeapBitmap *hb, const void *obj) __attri
 static unsigned long dvmHeapBitmapIsObjectBitSet(const HeapBitmap *hb,const void *obj) __attribute__((used));
 static void dvmHeapBitmapSetMax(HeapBitmap *hb, uintptr_t max) __attribute__((used));
 static void dvmHeapBitmapSetObjectBitCas(HeapBitmap *hb, const void *obj) __attribute__((used));
+static unsigned long dvmHeapBitmapSetAndReturnObjectBitCas(HeapBitmap *hb, const void *obj) __attribute__((used));
 
 /*
  * Internal function; do not call directly.
@@ -150,4 +151,41 @@ static void dvmHeapBitmapSetObjectBitCas(HeapBitmap *hb, const void *obj)
     }
 }
 
+/*
+ * Compare and Swap version of dvmHeapBitmapSetAndReturnObjectBit, for
+ * threads marking in parallel.  Exactly one of several threads racing
+ * to set the same bit sees it as previously clear.
+ */
+static unsigned long dvmHeapBitmapSetAndReturnObjectBitCas(HeapBitmap *hb,
+                                                           const void *obj)
+{
+    const uintptr_t offset = (uintptr_t)obj - hb->base;
+    const size_t index = HB_OFFSET_TO_INDEX(offset);
+    const int32_t mask = (int32_t) HB_OFFSET_TO_MASK(offset);
+
+    assert(hb->bits != NULL);
+    assert((uintptr_t)obj >= hb->base);
+    assert(index < hb->bitsLen / sizeof(*hb->bits));
+
+    volatile int32_t *p = (int32_t*)(hb->bits + index);
+    int32_t word;
+    do {
+        word = *p;
+        if ((word & mask) != 0) {
+            return (unsigned long)(word & mask);
+        }
+    } while (android_atomic_cas(word, word|mask, p) != 0);
+
+    /* update hb->max if required */
+    volatile int32_t*  pmax = (int32_t*)&hb->max;
+    int32_t max = *pmax;
+    while ((uintptr_t)obj > (uintptr_t)max) {
+        if (android_atomic_cas(max, (int32_t)obj, pmax) == 0) {
+            break;
+        }
+        max = *pmax;
+    }
+    return 0;
+}
+
 #endif  // DALVIK_HEAP_BITMAPINLINES_H_
@@ -71,6 +71,26 @@ struct GcHeap {
     /* Number of consecutive Partial GC */
     size_t mumConsecutivePartialGC;
 
+    /* Generational (-Xgc:generational) state.  When hasOldGeneration
+     * is set the mark bitmap holds the survivors of the previous
+     * collection, which a young collection treats as already marked.
+     */
+    bool hasOldGeneration;
+
+    /* Set between the bitmap swap and the copy of the survivors; new
+     * objects get their card dirtied so young collections scan them.
+     */
+    volatile bool dirtyNewAllocations;
+
+    /* Set when the last young collection freed too little. */
+    bool skipYoungGC;
+
+    /* Number of consecutive young GC */
+    size_t numConsecutiveYoungGC;
+
+    /* Bytes allocated in the active heap at the end of the last GC */
+    size_t bytesAllocatedAfterGC;
+
     /*
      * Debug control values
      */
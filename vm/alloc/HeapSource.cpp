@@ -910,6 +910,25 @@ void dvmHeapSourceZeroMarkBitmap()
     dvmHeapBitmapZero(&gHs->markBits);
 }
 
+void dvmHeapSourceMarkSurvivors()
+{
+    HS_BOILERPLATE();
+
+    HeapSource *hs = gHs;
+    uintptr_t base = (uintptr_t)hs->heaps[0].base;
+    /* Mutators may still be allocating; anything above max is young. */
+    uintptr_t max = hs->liveBits.max;
+    if (max < base) {
+        return;
+    }
+    assert(hs->liveBits.base == hs->markBits.base);
+    size_t index = HB_OFFSET_TO_INDEX(base - hs->liveBits.base);
+    size_t count = HB_OFFSET_TO_INDEX(max - base) + 1;
+    memcpy(hs->markBits.bits + index, hs->liveBits.bits + index,
+           count * sizeof(*hs->liveBits.bits));
+    dvmHeapBitmapSetMax(&hs->markBits, max);
+}
+
 void dvmMarkImmuneObjects(const char *immuneLimit)
 {
     /*
@@ -957,6 +976,13 @@ void dvmHeapSourceSetObjectBit(void* ptr)
     android_atomic_inc((int32_t*)&heap->objectsAllocated);
     HeapSource* hs = gDvm.gcHeap->heapSource;
     dvmHeapBitmapSetObjectBitCas(&hs->liveBits, ptr);
+    if (gDvm.gcHeap->dirtyNewAllocations) {
+        /*
+         * This object may end up in the old generation without ever
+         * having been traced; make the next young GC scan it.
+         */
+        dvmMarkCard(ptr);
+    }
 }
 
 /*
@@ -1127,6 +1153,15 @@ void dvmHeapSourceCountFree(size_t numObjs,void **ptrs)
     }
 }
 
+void dvmHeapSourceCountAllocated(size_t numObjs, const void *ptr)
+{
+    HS_BOILERPLATE();
+    Heap* heap = ptr2heap(gHs, ptr);
+    if (heap != NULL) {
+        android_atomic_add(numObjs, (int32_t*)&heap->objectsAllocated);
+    }
+}
+
 /*
  * Frees the first numPtrs objects in the ptrs list and returns the
  * amount of reclaimed storage. The list must contain addresses all in
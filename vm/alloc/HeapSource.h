@@ -153,6 +153,12 @@ size_t dvmHeapSourceClearObjectBits(size_t numPtrs, void **ptrs);
  */
 void dvmHeapSourceCountFree(size_t numObjs,void **ptrs);
 
+/*
+ * Count objects carved out of an allocation in the same heap as ptr,
+ * which did not go through dvmHeapSourceSetObjectBit().
+ */
+void dvmHeapSourceCountAllocated(size_t numObjs, const void *ptr);
+
 /*
  * Returns true iff <ptr> was allocated from the heap source.
  */
@@ -210,6 +216,13 @@ void dvmHeapSourceSwapBitmaps(void);
  */
 void dvmHeapSourceZeroMarkBitmap(void);
 
+/*
+ * Copies the live bits of the active heap into the zeroed mark bitmap,
+ * recording the survivors of the collection that just finished as the
+ * old generation for the next young collection.
+ */
+void dvmHeapSourceMarkSurvivors(void);
+
 /*
  * Marks all objects inside the immune region of the heap. Addresses
  * at or above this pointer are threatened, addresses below this
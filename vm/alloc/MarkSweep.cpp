@@ -16,6 +16,7 @@
 
 #include "Dalvik.h"
 #include "alloc/CardTable.h"
+#include "alloc/GcWorkers.h"
 #include "alloc/HeapBitmap.h"
 #include "alloc/HeapBitmapInlines.h"
 #include "alloc/HeapInternal.h"
@@ -27,6 +28,7 @@
 #endif
 
 #include <limits.h>     // for ULONG_MAX
+#include <sched.h>      // for sched_yield()
 #include <sys/mman.h>   // for madvise(), mmap()
 #include <errno.h>
 
@@ -90,15 +92,173 @@ static const Object *markStackPop(GcMarkStack *stack)
     return *stack->top;
 }
 
-bool dvmHeapBeginMarkStep(bool isPartial)
+/*
+ * Parallel marking.  Each worker owns a bounded work-stealing deque in
+ * the style of Chase and Lev: the owner pushes and pops at the bottom
+ * while idle workers steal from the top.  The mark stack of the shared
+ * context holds the roots and takes the overflow of full deques.  It
+ * is guarded by gParallelMark.lock, as are the pending reference lists.
+ */
+#define MARK_DEQUE_SIZE 4096
+#define MARK_DEQUE_MASK (MARK_DEQUE_SIZE - 1)
+
+/* Objects taken from the shared mark stack at a time. */
+#define MARK_TRANSFER_SIZE 64
+
+struct GcMarkWorker {
+    GcMarkContext ctx;
+    volatile int32_t top;
+    volatile int32_t bottom;
+    const Object *deque[MARK_DEQUE_SIZE];
+
+    /* Statistics for the current collection. */
+    u8 markTime;
+    u8 remarkTime;
+    size_t objectsScanned;
+    size_t steals;
+};
+
+struct GcParallelMark {
+    GcMarkWorker *workers;
+    size_t numWorkers;
+    pthread_mutex_t lock;
+    /* Workers that may still produce work; marking ends at zero. */
+    volatile int32_t numActive;
+};
+
+static GcParallelMark gParallelMark = { NULL, 0, PTHREAD_MUTEX_INITIALIZER, 0 };
+
+enum MarkPhase {
+    kMarkPhaseTrace,
+    kMarkPhaseYoung,
+    kMarkPhaseRescan
+};
+
+/*
+ * Pops an object from the bottom of the worker's own deque.  Returns
+ * NULL if the deque is empty or a thief won the race for the last
+ * object.
+ */
+static const Object *markDequePop(GcMarkWorker *w)
+{
+    int32_t b = w->bottom - 1;
+    w->bottom = b;
+    ANDROID_MEMBAR_FULL();
+    int32_t t = w->top;
+    if (t > b) {
+        w->bottom = t;
+        return NULL;
+    }
+    const Object *obj = w->deque[b & MARK_DEQUE_MASK];
+    if (t == b) {
+        if (android_atomic_cas(t, t + 1, &w->top) != 0) {
+            obj = NULL;
+        }
+        w->bottom = t + 1;
+    }
+    return obj;
+}
+
+/*
+ * Steals an object from the top of another worker's deque.
+ */
+static const Object *markDequeSteal(GcMarkWorker *w)
+{
+    int32_t t = android_atomic_acquire_load(&w->top);
+    ANDROID_MEMBAR_FULL();
+    int32_t b = android_atomic_acquire_load(&w->bottom);
+    if (t >= b) {
+        return NULL;
+    }
+    const Object *obj = w->deque[t & MARK_DEQUE_MASK];
+    if (android_atomic_cas(t, t + 1, &w->top) != 0) {
+        return NULL;
+    }
+    return obj;
+}
+
+/*
+ * Moves an object and the newer half of a full deque to the shared
+ * mark stack.
+ */
+static void spillMarkDeque(GcMarkWorker *w, const Object *obj)
+{
+    GcMarkStack *stack = &gDvm.gcHeap->markContext.stack;
+    dvmLockMutex(&gParallelMark.lock);
+    markStackPush(stack, obj);
+    for (size_t i = 0; i < MARK_DEQUE_SIZE / 2; ++i) {
+        const Object *spilled = markDequePop(w);
+        if (spilled == NULL) {
+            break;
+        }
+        markStackPush(stack, spilled);
+    }
+    dvmUnlockMutex(&gParallelMark.lock);
+}
+
+/*
+ * Pushes an object on the bottom of the worker's own deque.
+ */
+static void markDequePush(GcMarkWorker *w, const Object *obj)
+{
+    int32_t b = w->bottom;
+    if (b - android_atomic_acquire_load(&w->top) >= MARK_DEQUE_SIZE) {
+        spillMarkDeque(w, obj);
+        return;
+    }
+    w->deque[b & MARK_DEQUE_MASK] = obj;
+    android_atomic_release_store(b + 1, &w->bottom);
+}
+
+/*
+ * Sets up the per-worker contexts from the shared one.
+ */
+static bool beginParallelMark(const GcMarkContext *ctx)
+{
+    size_t numWorkers = dvmGcWorkerCount();
+    if (gParallelMark.workers == NULL) {
+        gParallelMark.workers =
+            (GcMarkWorker *)calloc(numWorkers, sizeof(GcMarkWorker));
+        if (gParallelMark.workers == NULL) {
+            ALOGE("Unable to allocate %zd mark workers", numWorkers);
+            return false;
+        }
+        gParallelMark.numWorkers = numWorkers;
+    }
+    assert(gParallelMark.numWorkers == numWorkers);
+    for (size_t i = 0; i < numWorkers; ++i) {
+        GcMarkWorker *w = &gParallelMark.workers[i];
+        w->ctx = *ctx;
+        w->ctx.finger = (void *)ULONG_MAX;
+        w->ctx.worker = w;
+        w->top = 0;
+        w->bottom = 0;
+        w->markTime = 0;
+        w->remarkTime = 0;
+        w->objectsScanned = 0;
+        w->steals = 0;
+    }
+    return true;
+}
+
+bool dvmHeapBeginMarkStep(bool isPartial, bool isYoung)
 {
     GcMarkContext *ctx = &gDvm.gcHeap->markContext;
 
     if (!createMarkStack(&ctx->stack)) {
         return false;
     }
-    ctx->finger = NULL;
+    /* Young and parallel collections never walk the bitmap with a
+     * finger, so every newly marked object has to go on a mark stack.
+     */
+    ctx->isYoung = isYoung;
+    ctx->isParallel = dvmGcWorkerCount() > 1;
+    ctx->worker = NULL;
+    ctx->finger = (isYoung || ctx->isParallel) ? (void *)ULONG_MAX : NULL;
     ctx->immuneLimit = (char*)dvmHeapSourceGetImmuneLimit(isPartial);
+    if (ctx->isParallel) {
+        return beginParallelMark(ctx);
+    }
     return true;
 }
 
@@ -117,6 +277,12 @@ static void markObjectNonNull(const Object *obj, GcMarkContext *ctx,
         assert(isMarked(obj, ctx));
         return;
     }
+    if (ctx->worker != NULL) {
+        if (!dvmHeapBitmapSetAndReturnObjectBitCas(ctx->bitmap, obj)) {
+            markDequePush(ctx->worker, obj);
+        }
+        return;
+    }
     if (!setAndReturnMarkBit(ctx, obj)) {
         /* This object was not previously marked.
          */
@@ -158,6 +324,22 @@ static void rootMarkObjectVisitor(void *addr, u4 thread, RootType type,
     }
 }
 
+/*
+ * Callback applied to root references during root remarking.  Marks
+ * white objects and pushes them on the mark stack.
+ */
+static void rootReMarkObjectVisitor(void *addr, u4 thread, RootType type,
+                                    void *arg)
+{
+    assert(addr != NULL);
+    assert(arg != NULL);
+    Object *obj = *(Object **)addr;
+    GcMarkContext *ctx = (GcMarkContext *)arg;
+    if (obj != NULL) {
+        markObjectNonNull(obj, ctx, true);
+    }
+}
+
 /* Mark the set of root objects.
  *
  * Things we need to scan:
@@ -184,24 +366,12 @@ static void rootMarkObjectVisitor(void *addr, u4 thread, RootType type,
  */
 void dvmHeapMarkRootSet()
 {
-    GcHeap *gcHeap = gDvm.gcHeap;
-    dvmMarkImmuneObjects(gcHeap->markContext.immuneLimit);
-    dvmVisitRoots(rootMarkObjectVisitor, &gcHeap->markContext);
-}
-
-/*
- * Callback applied to root references during root remarking.  Marks
- * white objects and pushes them on the mark stack.
- */
-static void rootReMarkObjectVisitor(void *addr, u4 thread, RootType type,
-                                    void *arg)
-{
-    assert(addr != NULL);
-    assert(arg != NULL);
-    Object *obj = *(Object **)addr;
-    GcMarkContext *ctx = (GcMarkContext *)arg;
-    if (obj != NULL) {
-        markObjectNonNull(obj, ctx, true);
+    GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+    dvmMarkImmuneObjects(ctx->immuneLimit);
+    if (ctx->isYoung || ctx->isParallel) {
+        dvmVisitRoots(rootReMarkObjectVisitor, ctx);
+    } else {
+        dvmVisitRoots(rootMarkObjectVisitor, ctx);
     }
 }
 
@@ -449,6 +619,9 @@ static void delayReferenceReferent(Object *obj, GcMarkContext *ctx)
     GcHeap *gcHeap = gDvm.gcHeap;
     size_t pendingNextOffset = gDvm.offJavaLangRefReference_pendingNext;
     size_t referentOffset = gDvm.offJavaLangRefReference_referent;
+    if (ctx->worker != NULL) {
+        dvmLockMutex(&gParallelMark.lock);
+    }
     Object *pending = dvmGetFieldObject(obj, pendingNextOffset);
     Object *referent = dvmGetFieldObject(obj, referentOffset);
     if (pending == NULL && referent != NULL && !isMarked(referent, ctx)) {
@@ -465,6 +638,9 @@ static void delayReferenceReferent(Object *obj, GcMarkContext *ctx)
         assert(list != NULL);
         enqueuePendingReference(obj, list);
     }
+    if (ctx->worker != NULL) {
+        dvmUnlockMutex(&gParallelMark.lock);
+    }
 }
 
 /*
@@ -587,25 +763,34 @@ const u1 *scanDirtyCards(const u1 *start, const u1 *end,
 }
 
 /*
- * Blackens gray objects found on dirty cards.
+ * Returns the range of cards covering the heap.
  */
-static void scanGrayObjects(GcMarkContext *ctx)
+static void getCardScanRange(const u1 **base, const u1 **limit)
 {
     GcHeap *h = gDvm.gcHeap;
-    const u1 *base, *limit, *ptr, *dirty;
 
-    base = &h->cardTableBase[0];
+    *base = &h->cardTableBase[0];
     // The limit is the card one after the last accessible card.
-    limit = dvmCardFromAddr((u1 *)dvmHeapSourceGetLimit() - GC_CARD_SIZE) + 1;
-    assert(limit <= &base[h->cardTableOffset + h->cardTableLength]);
+    *limit = dvmCardFromAddr((u1 *)dvmHeapSourceGetLimit() - GC_CARD_SIZE) + 1;
+    assert(*limit <= &(*base)[h->cardTableOffset + h->cardTableLength]);
+}
+
+/*
+ * Blackens gray objects found on the dirty cards between base and
+ * limit.
+ */
+static void scanGrayObjectRange(const u1 *base, const u1 *limit,
+                                GcMarkContext *ctx)
+{
+    const u1 *ptr, *dirty;
 
     ptr = base;
-    for (;;) {
+    while (ptr < limit) {
         dirty = (const u1 *)memchr(ptr, GC_CARD_DIRTY, limit - ptr);
         if (dirty == NULL) {
             break;
         }
-        assert((dirty > ptr) && (dirty < limit));
+        assert((dirty >= ptr) && (dirty < limit));
         ptr = scanDirtyCards(dirty, limit, ctx);
         if (ptr == NULL) {
             break;
@@ -614,6 +799,249 @@ static void scanGrayObjects(GcMarkContext *ctx)
     }
 }
 
+/*
+ * Blackens gray objects found on dirty cards.
+ */
+static void scanGrayObjects(GcMarkContext *ctx)
+{
+    const u1 *base, *limit;
+
+    getCardScanRange(&base, &limit);
+    scanGrayObjectRange(base, limit, ctx);
+}
+
+/*
+ * Blackens the marked objects on every card between card and limit
+ * that is not clean.  In a young collection these are the old objects
+ * that were written since the last collection, i.e. the remembered set.
+ */
+static void scanRememberedSetRange(const u1 *card, const u1 *limit,
+                                   GcMarkContext *ctx)
+{
+    while (card < limit) {
+        /* Skip clean cards a word at a time. */
+        if (((uintptr_t)card & (kWordSize - 1)) == 0 &&
+            card + kWordSize <= limit && *(const Word *)card == 0) {
+            card += kWordSize;
+            continue;
+        }
+        if (*card != GC_CARD_CLEAN) {
+            const u1 *ptr = (const u1 *)dvmAddrFromCard(card);
+            const u1 *end = ptr + GC_CARD_SIZE;
+            while (ptr < end) {
+                Object *obj = nextGrayObject(ptr, end, ctx->bitmap);
+                if (obj == NULL) {
+                    break;
+                }
+                scanObject(obj, ctx);
+                ptr = (u1*)obj + ALIGN_UP(objectSize(obj), HB_OBJECT_ALIGNMENT);
+            }
+        }
+        ++card;
+    }
+}
+
+/*
+ * Blackens the marked objects in the address range [base, limit).
+ */
+static void scanMarkedObjectRange(uintptr_t base, uintptr_t limit,
+                                  GcMarkContext *ctx)
+{
+    const HeapBitmap *bitmap = ctx->bitmap;
+    const uintptr_t bytesPerWord = HB_BITS_PER_WORD * HB_OBJECT_ALIGNMENT;
+
+    assert((base - bitmap->base) % bytesPerWord == 0);
+    if (limit > bitmap->max) {
+        limit = bitmap->max + 1;
+    }
+    for (uintptr_t ptrBase = base; ptrBase < limit; ptrBase += bytesPerWord) {
+        unsigned long word = bitmap->bits[HB_OFFSET_TO_INDEX(ptrBase - bitmap->base)];
+        unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
+        while (word != 0) {
+            const int shift = CLZ(word);
+            Object *obj = (Object *)(ptrBase + shift * HB_OBJECT_ALIGNMENT);
+            scanObject(obj, ctx);
+            word &= ~(highBit >> shift);
+        }
+    }
+}
+
+/*
+ * Returns the part of [base, limit) that worker id out of numWorkers
+ * handles.  Boundaries are multiples of align bytes from base.
+ */
+static void splitRange(uintptr_t base, uintptr_t limit, size_t align,
+                       size_t id, size_t numWorkers,
+                       uintptr_t *start, uintptr_t *end)
+{
+    size_t length = limit - base;
+    size_t chunk = ALIGN_UP((length + numWorkers - 1) / numWorkers, align);
+    *start = base + MIN(length, chunk * id);
+    *end = base + MIN(length, chunk * (id + 1));
+}
+
+/*
+ * Claims work from the shared mark stack once the worker's own deque
+ * has run dry.
+ */
+static bool takeSharedMarkWork(GcMarkWorker *w)
+{
+    GcMarkStack *stack = &gDvm.gcHeap->markContext.stack;
+    size_t count = 0;
+
+    if (stack->top == stack->base) {
+        return false;
+    }
+    dvmLockMutex(&gParallelMark.lock);
+    while (count < MARK_TRANSFER_SIZE && stack->top > stack->base) {
+        /* Cannot spill; the deque is empty. */
+        markDequePush(w, markStackPop(stack));
+        ++count;
+    }
+    dvmUnlockMutex(&gParallelMark.lock);
+    return count != 0;
+}
+
+static bool stealMarkWork(GcMarkWorker *w)
+{
+    size_t numWorkers = gParallelMark.numWorkers;
+    size_t self = w - gParallelMark.workers;
+
+    for (size_t i = 1; i < numWorkers; ++i) {
+        GcMarkWorker *victim = &gParallelMark.workers[(self + i) % numWorkers];
+        const Object *obj = markDequeSteal(victim);
+        if (obj != NULL) {
+            ++w->steals;
+            markDequePush(w, obj);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isMarkWorkAvailable()
+{
+    GcMarkStack *stack = &gDvm.gcHeap->markContext.stack;
+
+    if (stack->top != stack->base) {
+        return true;
+    }
+    for (size_t i = 0; i < gParallelMark.numWorkers; ++i) {
+        GcMarkWorker *w = &gParallelMark.workers[i];
+        if (android_atomic_acquire_load(&w->bottom) -
+            android_atomic_acquire_load(&w->top) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Scans objects until no worker has any left.  A worker that runs dry
+ * drops out of numActive and rejoins if it spots more work; once the
+ * count reaches zero no deque can be refilled.
+ */
+static void drainMarkWork(GcMarkWorker *w)
+{
+    for (;;) {
+        const Object *obj;
+        while ((obj = markDequePop(w)) != NULL) {
+            scanObject(obj, &w->ctx);
+            ++w->objectsScanned;
+        }
+        if (takeSharedMarkWork(w) || stealMarkWork(w)) {
+            continue;
+        }
+        android_atomic_dec(&gParallelMark.numActive);
+        for (;;) {
+            if (android_atomic_acquire_load(&gParallelMark.numActive) == 0) {
+                return;
+            }
+            if (isMarkWorkAvailable()) {
+                android_atomic_inc(&gParallelMark.numActive);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+static void parallelMarkWorker(size_t id, void *arg)
+{
+    MarkPhase phase = *(MarkPhase *)arg;
+    GcMarkWorker *w = &gParallelMark.workers[id];
+    size_t numWorkers = gParallelMark.numWorkers;
+    u8 start = dvmGetRelativeTimeUsec();
+    const u1 *base, *limit;
+    uintptr_t first, last;
+
+    switch (phase) {
+    case kMarkPhaseTrace:
+#ifndef WITH_REGION_GC
+        /* The roots are already on the shared stack, but the immune
+         * objects are only marked.  Region GC finds their pointers into
+         * the active heap through the card table instead.
+         */
+        if (w->ctx.immuneLimit != NULL) {
+            uintptr_t bitmapBase = w->ctx.bitmap->base;
+            splitRange(bitmapBase, (uintptr_t)w->ctx.immuneLimit,
+                       HB_BITS_PER_WORD * HB_OBJECT_ALIGNMENT,
+                       id, numWorkers, &first, &last);
+            scanMarkedObjectRange(first, last, &w->ctx);
+        }
+#endif
+        break;
+    case kMarkPhaseYoung:
+        getCardScanRange(&base, &limit);
+        splitRange((uintptr_t)base, (uintptr_t)limit, kWordSize,
+                   id, numWorkers, &first, &last);
+        scanRememberedSetRange((const u1 *)first, (const u1 *)last, &w->ctx);
+        break;
+    case kMarkPhaseRescan:
+        getCardScanRange(&base, &limit);
+        splitRange((uintptr_t)base, (uintptr_t)limit, kWordSize,
+                   id, numWorkers, &first, &last);
+        scanGrayObjectRange((const u1 *)first, (const u1 *)last, &w->ctx);
+        break;
+    }
+    drainMarkWork(w);
+
+    u8 elapsed = dvmGetRelativeTimeUsec() - start;
+    if (phase == kMarkPhaseRescan) {
+        w->remarkTime += elapsed;
+    } else {
+        w->markTime += elapsed;
+    }
+}
+
+/*
+ * Runs one marking phase on all of the GC workers.  When this returns
+ * every reachable object found by the phase is marked and all of the
+ * mark stacks are empty.
+ */
+static void runParallelMark(MarkPhase phase)
+{
+    GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+
+    assert(ctx->isParallel);
+    assert(ctx->finger == (void *)ULONG_MAX);
+    gParallelMark.numActive = gParallelMark.numWorkers;
+    dvmGcRunWorkers(parallelMarkWorker, &phase);
+    assert(ctx->stack.top == ctx->stack.base);
+}
+
+static void logParallelMark()
+{
+    for (size_t i = 0; i < gParallelMark.numWorkers; ++i) {
+        const GcMarkWorker *w = &gParallelMark.workers[i];
+        ALOGD("GC mark worker %zd: mark %lluus, remark %lluus, "
+              "%zd objects, %zd steals", i,
+              (unsigned long long)w->markTime,
+              (unsigned long long)w->remarkTime,
+              w->objectsScanned, w->steals);
+    }
+}
+
 /*
  * Callback for scanning each object in the bitmap.  The finger is set
  * to the address corresponding to the lowest address in the next word
@@ -638,6 +1066,11 @@ void dvmHeapScanMarkedObjects(void)
 {
     GcMarkContext *ctx = &gDvm.gcHeap->markContext;
 
+    if (ctx->isParallel) {
+        runParallelMark(kMarkPhaseTrace);
+        return;
+    }
+
     assert(ctx->finger == NULL);
 
 #ifdef WITH_REGION_GC
@@ -676,6 +1109,27 @@ void dvmHeapScanMarkedObjects(void)
     processMarkStack(ctx);
 }
 
+/*
+ * The young collection counterpart of dvmHeapScanMarkedObjects.  The
+ * mark bitmap is mostly old objects, so rather than walking it trace
+ * from the roots on the mark stack and from the remembered set.
+ */
+void dvmHeapScanYoungObjects()
+{
+    GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+
+    assert(ctx->isYoung);
+    assert(ctx->finger == (void *)ULONG_MAX);
+    if (ctx->isParallel) {
+        runParallelMark(kMarkPhaseYoung);
+        return;
+    }
+    const u1 *base, *limit;
+    getCardScanRange(&base, &limit);
+    scanRememberedSetRange(base, limit, ctx);
+    processMarkStack(ctx);
+}
+
 void dvmHeapReScanMarkedObjects()
 {
     GcMarkContext *ctx = &gDvm.gcHeap->markContext;
@@ -685,6 +1139,10 @@ void dvmHeapReScanMarkedObjects()
      * that gray objects will be pushed onto the mark stack.
      */
     assert(ctx->finger == (void *)ULONG_MAX);
+    if (ctx->isParallel) {
+        runParallelMark(kMarkPhaseRescan);
+        return;
+    }
     scanGrayObjects(ctx);
     processMarkStack(ctx);
 }
@@ -903,13 +1361,75 @@ void dvmEnqueueClearedReferences(Object **cleared)
     }
 }
 
+struct SweepContext {
+    size_t numObjects;
+    size_t numBytes;
+    /* The heap lock must be taken around each free */
+    bool isConcurrent;
+    /* Other threads may touch the local heap pools meanwhile */
+    bool lockPools;
+    /* Serializes the frees of parallel sweepers otherwise, or NULL */
+    pthread_mutex_t *freeLock;
+};
+
+/*
+ * A heap is swept in shards of SWEEP_SHARD_SIZE bytes.  The heaps are
+ * page aligned, so every shard starts on a bitmap word and no two
+ * sweepers ever look at the same word.
+ */
+#define SWEEP_SHARD_SIZE (256 * 1024)
+
+struct SweepRange {
+    const HeapBitmap *prevLive;
+    const HeapBitmap *prevMark;
+    uintptr_t base;
+    uintptr_t max;
+    size_t numShards;
+    volatile int32_t nextShard;
+};
+
+struct ParallelSweep {
+    SweepRange *range;
+    SweepContext ctx[GC_MAX_WORKERS];
+};
+
+static pthread_mutex_t gSweepFreeLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The active heap when it is left for the allocator to sweep.  The
+ * mark bitmap holds the previous live set until the last shard is done.
+ */
+static struct {
+    SweepRange range;
+    SweepContext ctx;
+    volatile int32_t pending;
+} gLazySweep;
+
 void dvmHeapFinishMarkStep()
 {
     GcMarkContext *ctx = &gDvm.gcHeap->markContext;
 
-    /* The mark bits are now not needed.
+    /* The mark bits are now not needed, unless they still describe
+     * the garbage left for the lazy sweep.
      */
-    dvmHeapSourceZeroMarkBitmap();
+    if (android_atomic_acquire_load(&gLazySweep.pending) == 0) {
+        dvmHeapSourceZeroMarkBitmap();
+    }
+
+    /* Unless the next young collection wants the survivors as its old
+     * generation.  The barrier orders the copy of the live bits before
+     * allocations stop dirtying their cards.
+     */
+    if (gDvm.generationalGc) {
+        dvmHeapSourceMarkSurvivors();
+        ANDROID_MEMBAR_FULL();
+        gDvm.gcHeap->dirtyNewAllocations = false;
+        gDvm.gcHeap->hasOldGeneration = true;
+    }
+
+    if (ctx->isParallel && gDvm.verboseGc) {
+        logParallelMark();
+    }
 
     /* Clean up everything else associated with the marking process.
      */
@@ -918,11 +1438,23 @@ void dvmHeapFinishMarkStep()
     ctx->finger = NULL;
 }
 
-struct SweepContext {
-    size_t numObjects;
-    size_t numBytes;
-    bool isConcurrent;
-};
+static void lockForFree(const SweepContext *ctx)
+{
+    if (ctx->isConcurrent) {
+        dvmLockHeap();
+    } else if (ctx->freeLock != NULL) {
+        dvmLockMutex(ctx->freeLock);
+    }
+}
+
+static void unlockForFree(const SweepContext *ctx)
+{
+    if (ctx->isConcurrent) {
+        dvmUnlockHeap();
+    } else if (ctx->freeLock != NULL) {
+        dvmUnlockMutex(ctx->freeLock);
+    }
+}
 
 static void sweepBitmapCallback(size_t numPtrs, void **ptrs, void *arg)
 {
@@ -935,28 +1467,138 @@ static void sweepBitmapCallback(size_t numPtrs, void **ptrs, void *arg)
 
 #if WITH_TLA
     /* sweep local objects from the list */
-    numPtrs = dvmTLHeapSourceFreeList(numPtrs, ptrs,ctx->isConcurrent);
+    numPtrs = dvmTLHeapSourceFreeList(numPtrs, ptrs, ctx->lockPools);
     if (numPtrs != 0){
-        if (ctx->isConcurrent == true) {
-            dvmLockHeap();
-        }
+        lockForFree(ctx);
         /* sweep global objects from the list */
         ctx->numBytes += dvmHeapSourceFreeList(numPtrs, ptrs);
-        if (ctx->isConcurrent  == true) {
-            dvmUnlockHeap();
-        }
+        unlockForFree(ctx);
     }
 #else
-    if (ctx->isConcurrent) {
-        dvmLockHeap();
-    }
+    lockForFree(ctx);
     ctx->numBytes += dvmHeapSourceFreeList(numPtrs, ptrs);
-    if (ctx->isConcurrent) {
-        dvmUnlockHeap();
+    unlockForFree(ctx);
+#endif
+}
+
+static void initSweepRange(SweepRange *range, uintptr_t base, uintptr_t max)
+{
+    /* Assumes the bitmaps have been swapped. */
+    range->prevLive = dvmHeapSourceGetMarkBits();
+    range->prevMark = dvmHeapSourceGetLiveBits();
+    range->base = base;
+    range->max = max;
+    if (max < base || range->prevLive->max < range->prevLive->base) {
+        range->numShards = 0;
+    } else {
+        range->numShards = (max - base) / SWEEP_SHARD_SIZE + 1;
     }
+    range->nextShard = 0;
+}
+
+/*
+ * Claims and sweeps shards until there are none left or the context
+ * has freed at least byteLimit bytes.  Returns false if there was
+ * nothing left to claim.
+ */
+static bool sweepShards(SweepRange *range, SweepContext *ctx,
+                        size_t byteLimit)
+{
+    bool swept = false;
+
+    while (ctx->numBytes < byteLimit) {
+        size_t shard = android_atomic_inc(&range->nextShard);
+        if (shard >= range->numShards) {
+            break;
+        }
+        uintptr_t start = range->base + shard * SWEEP_SHARD_SIZE;
+        uintptr_t end = MIN(start + (SWEEP_SHARD_SIZE - 1), range->max);
+        dvmHeapBitmapSweepWalk(range->prevLive, range->prevMark, start, end,
+                               sweepBitmapCallback, ctx);
+        swept = true;
+    }
+    return swept;
+}
+
+static void parallelSweepWorker(size_t id, void *arg)
+{
+    ParallelSweep *sweep = (ParallelSweep *)arg;
+
+    sweepShards(sweep->range, &sweep->ctx[id], SIZE_MAX);
+}
+
+/*
+ * Counts the garbage in a range without touching the heap itself.
+ */
+static size_t countGarbage(const SweepRange *range)
+{
+    if (range->numShards == 0) {
+        return 0;
+    }
+    const HeapBitmap *live = range->prevLive;
+    const HeapBitmap *mark = range->prevMark;
+    size_t start = HB_OFFSET_TO_INDEX(range->base - live->base);
+    size_t end = HB_OFFSET_TO_INDEX(range->max - live->base);
+    size_t count = 0;
+
+    for (size_t i = start; i <= end; i++) {
+        count += __builtin_popcountl(live->bits[i] & ~mark->bits[i]);
+    }
+    return count;
+}
+
+/*
+ * Called once the last shard of the lazy sweep is done, with the heap
+ * lock held.
+ */
+static void finishLazySweep(void)
+{
+    SweepContext *ctx = &gLazySweep.ctx;
+
+    LOGD_HEAP("Lazy sweep freed %zu objects, %zu bytes",
+              ctx->numObjects, ctx->numBytes);
+    if (gDvm.allocProf.enabled) {
+        gDvm.allocProf.freeCount += ctx->numObjects;
+        gDvm.allocProf.freeSize += ctx->numBytes;
+    }
+    android_atomic_release_store(0, &gLazySweep.pending);
+    dvmHeapSourceZeroMarkBitmap();
+#ifdef WITH_TLA
+    dvmTLHeapSourceTrimBuffers();
 #endif
 }
 
+bool dvmHeapSweepLazily(size_t numBytes)
+{
+    if (android_atomic_acquire_load(&gLazySweep.pending) == 0) {
+        return false;
+    }
+    SweepContext *ctx = &gLazySweep.ctx;
+    bool swept = sweepShards(&gLazySweep.range, ctx, ctx->numBytes + numBytes);
+    if (gLazySweep.range.nextShard >= (int32_t)gLazySweep.range.numShards) {
+        finishLazySweep();
+        /* The utilization is known now that the garbage is gone. */
+        if (!gDvm.gcHeap->gcRunning) {
+            dvmHeapSourceGrowForUtilization();
+        }
+    }
+    return swept;
+}
+
+bool dvmHeapLazySweepPending(void)
+{
+    return android_atomic_acquire_load(&gLazySweep.pending) != 0;
+}
+
+void dvmHeapFinishLazySweep(void)
+{
+    if (android_atomic_acquire_load(&gLazySweep.pending) == 0) {
+        return;
+    }
+    sweepShards(&gLazySweep.range, &gLazySweep.ctx, SIZE_MAX);
+    finishLazySweep();
+}
+
 /*
  * Returns true if the given object is unmarked.  This assumes that
  * the bitmaps have not yet been swapped.
@@ -1000,8 +1642,9 @@ void dvmHeapSweepUnmarkedObjects(bool isPartial, bool isConcurrent,
     uintptr_t base[HEAP_SOURCE_MAX_HEAP_COUNT];
     uintptr_t max[HEAP_SOURCE_MAX_HEAP_COUNT];
     SweepContext ctx;
-    HeapBitmap *prevLive, *prevMark;
-    size_t numHeaps, numSweepHeaps;
+    SweepRange range;
+    size_t numHeaps, numSweepHeaps, numWorkers;
+    size_t numLazyObjects = 0;
 
     numHeaps = dvmHeapSourceGetNumHeaps();
     dvmHeapSourceGetRegions(base, max, numHeaps);
@@ -1011,18 +1654,50 @@ void dvmHeapSweepUnmarkedObjects(bool isPartial, bool isConcurrent,
     } else {
         numSweepHeaps = numHeaps;
     }
+    numWorkers = dvmGcWorkerCount();
     ctx.numObjects = ctx.numBytes = 0;
     ctx.isConcurrent = isConcurrent;
-    prevLive = dvmHeapSourceGetMarkBits();
-    prevMark = dvmHeapSourceGetLiveBits();
-    for (size_t i = 0; i < numSweepHeaps; ++i) {
-        dvmHeapBitmapSweepWalk(prevLive, prevMark, base[i], max[i],
-                               sweepBitmapCallback, &ctx);
+    ctx.lockPools = isConcurrent || numWorkers > 1;
+    ctx.freeLock = numWorkers > 1 ? &gSweepFreeLock : NULL;
+    /* The older heaps are swept right away; heap 0 goes last. */
+    for (size_t i = numSweepHeaps; i-- > 0; ) {
+        initSweepRange(&range, base[i], max[i]);
+        if (i == 0 && gDvm.lazySweep) {
+            numLazyObjects = countGarbage(&range);
+            break;
+        }
+        if (numWorkers > 1) {
+            ParallelSweep sweep;
+            sweep.range = &range;
+            for (size_t j = 0; j < numWorkers; j++) {
+                sweep.ctx[j] = ctx;
+                sweep.ctx[j].numObjects = sweep.ctx[j].numBytes = 0;
+            }
+            dvmGcRunWorkers(parallelSweepWorker, &sweep);
+            for (size_t j = 0; j < numWorkers; j++) {
+                ctx.numObjects += sweep.ctx[j].numObjects;
+                ctx.numBytes += sweep.ctx[j].numBytes;
+            }
+        } else {
+            sweepShards(&range, &ctx, SIZE_MAX);
+        }
     }
-    *numObjects = ctx.numObjects;
+    *numObjects = ctx.numObjects + numLazyObjects;
     *numBytes = ctx.numBytes;
     if (gDvm.allocProf.enabled) {
         gDvm.allocProf.freeCount += ctx.numObjects;
         gDvm.allocProf.freeSize += ctx.numBytes;
     }
+    if (numLazyObjects != 0) {
+        /*
+         * Whoever holds the heap lock when an allocation fails sweeps
+         * from here on, without taking it again.
+         */
+        gLazySweep.range = range;
+        gLazySweep.ctx.numObjects = gLazySweep.ctx.numBytes = 0;
+        gLazySweep.ctx.isConcurrent = false;
+        gLazySweep.ctx.lockPools = true;
+        gLazySweep.ctx.freeLock = NULL;
+        android_atomic_release_store(1, &gLazySweep.pending);
+    }
 }
@@ -37,6 +37,8 @@ struct GcMarkStack {
     size_t length;
 };
 
+struct GcMarkWorker;
+
 /* This is declared publicly so that it can be included in gDvm.gcHeap.
  */
 struct GcMarkContext {
@@ -44,9 +46,12 @@ struct GcMarkContext {
     GcMarkStack stack;
     const char *immuneLimit;
     const void *finger;   // only used while scanning/recursing.
+    bool isYoung;         // survivors of the last GC are pre-marked.
+    bool isParallel;      // tracing is split across the GC workers.
+    GcMarkWorker *worker; // owner of this context when marking in parallel.
 };
 
-bool dvmHeapBeginMarkStep(bool isPartial);
+bool dvmHeapBeginMarkStep(bool isPartial, bool isYoung);
 void dvmHeapMarkRootSet(void);
 void dvmHeapReMarkRootSet(void);
 #ifdef WITH_REGION_GC
@@ -54,6 +59,7 @@ void dvmHeapScanMarkedObjects(bool isPartial);
 #else
 void dvmHeapScanMarkedObjects(void);
 #endif
+void dvmHeapScanYoungObjects(void);
 void dvmHeapReScanMarkedObjects(void);
 void dvmHeapProcessReferences(Object **softReferences, bool clearSoftRefs,
                               Object **weakReferences,
@@ -63,6 +69,16 @@ void dvmHeapFinishMarkStep(void);
 void dvmHeapSweepSystemWeaks(void);
 void dvmHeapSweepUnmarkedObjects(bool isPartial, bool isConcurrent,
                                  size_t *numObjects, size_t *numBytes);
+/*
+ * With -Xgc:lazysweep the active heap is not swept by the GC; the count
+ * returned above includes its garbage, the byte count does not.  These
+ * sweep it later and must be called with the heap lock held.
+ * dvmHeapSweepLazily() frees about numBytes and returns false once
+ * there is nothing left to sweep.
+ */
+bool dvmHeapSweepLazily(size_t numBytes);
+void dvmHeapFinishLazySweep(void);
+bool dvmHeapLazySweepPending(void);
 void dvmEnqueueClearedReferences(Object **references);
 #ifdef WITH_REGION_GC
 void dvmSetEnableCrossHeapPointerCheck(bool status);
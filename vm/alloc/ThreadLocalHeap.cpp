@@ -19,6 +19,7 @@
 #include "alloc/HeapSource.h"
 #include "alloc/HeapBitmap.h"
 #include "alloc/HeapBitmapInlines.h"
+#include "alloc/CardTable.h"
 #include "alloc/ThreadLocalHeap.h"
 
 #include <stdlib.h>
@@ -27,6 +28,7 @@
 #include <assert.h>
 #include <unistd.h>
 #include <malloc.h>
+#include <sys/mman.h>
 
 /*
  *  1) Overview.
@@ -184,6 +186,48 @@
  *  TODO : It may be worth to optimize the recycling loops which move a full
  *  local pool to the global pool.
  *
+ *
+ *  10) Bump allocation buffers.
+ *
+ *  Objects up to TLBUFFER_MAX_ALLOC_SIZE are first bump allocated from a
+ *  per thread buffer, a single cleared chunk of global memory. The buffer
+ *  size adapts to the thread allocation rate: it doubles every
+ *  TLBUFFER_GROW_REFILLS refills between two GCs and halves after a GC
+ *  interval with at most one refill.
+ *
+ *  buffer-> +-+-+-+-+-+-+-+-+-+-+-+
+ *           |   buffer head       |
+ *           +-+-+-+-+-+-+-+-+-+-+-+
+ *           :                     :
+ *   start-> +-+-+-+-+-+-+-+-+-+-+-+ <-- aligned on a live bitmap word
+ *           |  size  | buffer|00b |
+ *     obj-> +-+-+-+-+-+-+-+-+-+-+-+
+ *           :                     :
+ *     top-> +-+-+-+-+-+-+-+-+-+-+-+
+ *           :                     :
+ *     end-> +-+-+-+-+-+-+-+-+-+-+-+ <-- aligned on a live bitmap word
+ *
+ *  The buffer word in front of each object has a 00b marker, which neither
+ *  a local chunk nor dlmalloc ever uses. The object area covers whole live
+ *  bitmap words, so the owner thread is the only writer of these words and
+ *  compiled code sets live bits without atomics.
+ *
+ *  Objects are never freed one by one. The buffer head counts -1 for each
+ *  swept object. When the owner retires the buffer it adds the number of
+ *  objects it allocated; whoever brings the counter back to zero frees the
+ *  whole buffer, the GC by adding it to the "to be freed" array.
+ *
+ *  A retired buffer with live objects stays on the retired list until it
+ *  is freed. After each sweep, dvmTLHeapSourceTrimBuffers gives the pages
+ *  of these buffers that hold no live object back to the kernel, so a few
+ *  survivors don't pin a whole buffer in memory. While more than
+ *  TLBUFFER_RETAINED_MAX bytes of buffers are retained, threads refill with
+ *  the smallest buffer size.
+ *
+ *  The owner updates the top with plain stores. The live bitmap max covers
+ *  the whole buffer from the refill on, and dvmTLHeapSourceBitmapsSwapped
+ *  re-covers all buffers when the GC swaps the bitmaps.
+ *
  */
 
 #if (!defined(MALLOC_ALIGNMENT)||(MALLOC_ALIGNMENT>=16))
@@ -203,6 +247,9 @@
 #define TLSIZEID_NUM      (TLSIZEID(TLALLOC_MAX_SIZE)+1)
 #define TLMARKER          0x1
 #define TLALIGNUP(p,a)    (char*)(((uintptr_t)(p)+(a)-1UL)&~((a)-1UL))
+#define TLALIGNDOWN(p,a)  (char*)((uintptr_t)(p)&~((a)-1UL))
+#define TLBUFMARKER       0x0
+#define TLBUFALIGN        (HB_OBJECT_ALIGNMENT*HB_BITS_PER_WORD)
 #define TLINLINE          static inline __attribute__ ( (always_inline))
 
 /** free chunk structure */
@@ -235,11 +282,28 @@ struct TLPool
     TLBlock* free;                  /**< list of free tlbs (singly linked) */
 };
 
+/** bump allocation buffer */
+struct TLBuffer
+{
+    volatile int32_t live;   /**< allocated minus swept objects, once retired */
+    size_t           size;   /**< size of the buffer */
+    char*            start;  /**< start of the object area */
+    char*            end;    /**< end of the object area */
+    struct TLBuffer* next;   /**< next in the retired list */
+    struct TLBuffer* prev;   /**< prev in the retired list */
+    size_t           trimEpoch; /**< GC epoch of the last trim */
+};
+
 /** Thread Local Heap */
 struct TLHeap
 {
     TLBlock* tlb[TLSIZEID_NUM]; /**< current allocating block */
     TLPool   pool;              /**< local pool */
+    TLBuffer* buffer;           /**< current bump allocation buffer */
+    size_t   bufferSize;        /**< size of the next buffer */
+    size_t   refills;           /**< buffers taken since epoch */
+    size_t   epoch;             /**< GC epoch of the last refill */
+    u4       counted;           /**< objects added to the heap counts */
 };
 
 /** Thread Local Heap Source */
@@ -248,7 +312,10 @@ struct TLHeapSource
     bool    shutdown;           /**< global shutdown flag */
     bool    blockAllocEnabled;  /**< allow block allocation */
     size_t  blockAllocSize;     /**< block size */
+    size_t  epoch;              /**< number of bitmap swaps */
     TLPool  pool;               /**< global block pool */
+    TLBuffer* retired;          /**< retired buffers with live objects */
+    size_t  retiredBytes;       /**< total size of the retired buffers */
 };
 
 static TLBlock* initTLB(void* mem, size_t size);
@@ -760,6 +827,11 @@ size_t dvmTLHeapSourceChunkSize(void* ptr)
     TLChunk* chunk = (TLChunk*) ((uintptr_t*)ptr-1);
     assert (chunk != NULL);
 
+    if ((chunk->head & 0x3) == TLBUFMARKER) {
+        /* bump allocated, the size word precedes the buffer word */
+        return *((u4*)ptr - 2);
+    }
+
     if ((chunk->head & 0x3) == TLMARKER) {
         TLBlock* tlb = (TLBlock*)(chunk->head & ~0x3);
 
@@ -772,6 +844,325 @@ size_t dvmTLHeapSourceChunkSize(void* ptr)
     return 0;
 }
 
+/* compiled code bypasses allocation profiling, tracking and card marking */
+TLINLINE  bool inlineAllocAllowed(void)
+{
+    return (gDvm.allocProf.enabled == false)
+        && !gDvm.allocTrackerEnabled
+        && (gDvm.gcHeap->dirtyNewAllocations == false);
+}
+
+/* raise the live bitmap max so that it covers addr */
+static void coverLiveBits(uintptr_t addr)
+{
+    HeapBitmap* hb = dvmHeapSourceGetLiveBits();
+    uintptr_t max;
+
+    do {
+        max = hb->max;
+        if (addr <= max) {
+            return;
+        }
+    } while (android_atomic_cas(max, addr, (int32_t*)&hb->max) != 0);
+}
+
+/* add the objects allocated since last time to the heap counts */
+static void countBufferObjects(Thread* thread)
+{
+    TLHeap* tlh = thread->tlh;
+
+    if ((tlh->buffer != NULL) && (thread->tlBufferCount != tlh->counted)) {
+        dvmHeapSourceCountAllocated(thread->tlBufferCount - tlh->counted,
+                                    tlh->buffer);
+        tlh->counted = thread->tlBufferCount;
+    }
+}
+
+/* must be called with the global pool lock held */
+static void unlinkRetiredBuffer(TLHeapSource* hs, TLBuffer* buffer)
+{
+    if (buffer->prev != NULL) {
+        buffer->prev->next = buffer->next;
+    } else {
+        hs->retired = buffer->next;
+    }
+    if (buffer->next != NULL) {
+        buffer->next->prev = buffer->prev;
+    }
+    buffer->next = buffer->prev = NULL;
+    hs->retiredBytes -= buffer->size;
+}
+
+/* must be called with the heap lock held */
+static void retireBuffer(Thread* self)
+{
+    TLHeap* tlh = self->tlh;
+    TLBuffer* buffer = tlh->buffer;
+    TLHeapSource* hs = gDvm.gcHeap->tlhSource;
+
+    if (buffer == NULL) {
+        return;
+    }
+
+    countBufferObjects(self);
+    int32_t count = self->tlBufferCount;
+
+    tlh->buffer = NULL;
+    tlh->counted = 0;
+    self->tlBufferTop = NULL;
+    self->tlBufferLimit = NULL;
+    self->tlBufferHeader = 0;
+    self->tlBufferCount = 0;
+
+    /*
+     * Hand the buffer over to the GC, or free it if all objects are gone.
+     * It goes on the retired list first: a concurrent sweep may bring the
+     * count to zero as soon as we add ours, and unlinks it when it does.
+     */
+    poolLock(&hs->pool);
+    buffer->prev = NULL;
+    buffer->next = hs->retired;
+    if (hs->retired != NULL) {
+        hs->retired->prev = buffer;
+    }
+    hs->retired = buffer;
+    hs->retiredBytes += buffer->size;
+    buffer->trimEpoch = hs->epoch;
+    poolUnlock(&hs->pool);
+
+    if (android_atomic_add(count, &buffer->live) + count == 0) {
+        poolLock(&hs->pool);
+        unlinkRetiredBuffer(hs, buffer);
+        poolUnlock(&hs->pool);
+        dvmHeapSourceFree(buffer);
+    }
+}
+
+/* size of the next buffer, adapted to the thread allocation rate */
+static size_t nextBufferSize(TLHeap* tlh, size_t epoch)
+{
+    size_t maxSize = (gDvm.lowMemoryMode == false) ?
+            TLBUFFER_MAX_SIZE : TLBUFFER_LMMAX_SIZE;
+
+    if (tlh->bufferSize == 0) {
+        tlh->bufferSize = TLBUFFER_MIN_SIZE;
+    }
+
+    if (tlh->epoch != epoch) {
+        /* first refill since a GC, shrink if the last one was enough */
+        if ((tlh->refills <= 1) && (tlh->bufferSize > TLBUFFER_MIN_SIZE)) {
+            tlh->bufferSize /= 2;
+        }
+        tlh->refills = 0;
+        tlh->epoch = epoch;
+    }
+    else if (tlh->refills >= TLBUFFER_GROW_REFILLS) {
+        /* allocating fast, grow */
+        if (tlh->bufferSize < maxSize) {
+            tlh->bufferSize *= 2;
+        }
+        tlh->refills = 0;
+    }
+    tlh->refills++;
+
+    /* survivors already pin a lot of buffer space, don't add to it */
+    size_t retainedMax = (gDvm.lowMemoryMode == false) ?
+            TLBUFFER_RETAINED_MAX : TLBUFFER_LMRETAINED_MAX;
+    if (gDvm.gcHeap->tlhSource->retiredBytes > retainedMax) {
+        return TLBUFFER_MIN_SIZE;
+    }
+
+    /* don't let a buffer take a large share of the remaining space */
+    size_t size = tlh->bufferSize;
+    size_t available = dvmHeapSourceGetAvailableFree();
+    while ((size > TLBUFFER_MIN_SIZE) && (size * TLBUFFER_WASTE_DIV > available)) {
+        size /= 2;
+    }
+    return size;
+}
+
+/* Initialize a freshly allocated buffer and make it the current one */
+static void initBuffer(Thread* self, void* mem, size_t size)
+{
+    assert (mem != NULL);
+    assert (((uintptr_t)mem & 0x3) == 0);
+
+    TLHeap* tlh = self->tlh;
+    TLBuffer* buffer = (TLBuffer*) mem;
+
+    buffer->live = 0;
+    buffer->size = size;
+    buffer->start = TLALIGNUP((char*)mem + sizeof(TLBuffer), TLBUFALIGN);
+    buffer->end = TLALIGNDOWN((char*)mem + size, TLBUFALIGN);
+    buffer->next = buffer->prev = NULL;
+    assert (buffer->end > buffer->start);
+
+    tlh->buffer = buffer;
+    tlh->counted = 0;
+    self->tlBufferTop = (u1*)buffer->start;
+    self->tlBufferHeader = (uintptr_t)buffer | TLBUFMARKER;
+    self->tlBufferCount = 0;
+    self->tlBufferLimit = inlineAllocAllowed() ? (u1*)buffer->end : NULL;
+
+    coverLiveBits((uintptr_t)buffer->end - HB_OBJECT_ALIGNMENT);
+}
+
+/**
+ * @brief   Bump allocates a cleared object from the thread's buffer.
+ *
+ * @param   self        pointer to the thread
+ * @param   size        requested allocation size
+ * @return              pointer to allocated object or NULL if it doesn't fit
+ *
+ * note:    Lock free, the object's live bit is set.
+ */
+void* dvmTLHeapBufferAlloc(Thread* self, size_t size)
+{
+    TLHeap* tlh = self->tlh;
+    assert (tlh != NULL);
+
+    TLBuffer* buffer = tlh->buffer;
+    size_t need = TLBUFFER_CHUNKSIZE(size);
+    char* top = (char*)self->tlBufferTop;
+
+    if (UNLIKELY((buffer == NULL) || ((size_t)(buffer->end - top) < need))) {
+        return NULL;
+    }
+
+    self->tlBufferTop = (u1*)(top + need);
+    self->tlBufferCount++;
+
+    /* switch compiled code back to inline allocation when allowed again */
+    if (UNLIKELY(self->tlBufferLimit == NULL) && inlineAllocAllowed()) {
+        self->tlBufferLimit = (u1*)buffer->end;
+    }
+
+    ((u4*)top)[0] = need;
+    ((uintptr_t*)top)[1] = self->tlBufferHeader;
+    void* ptr = top + TLBUFFER_HEADER_SIZE;
+
+    /* no other thread writes to the buffer's bitmap words */
+    HeapBitmap* hb = dvmHeapSourceGetLiveBits();
+    const uintptr_t offset = (uintptr_t)ptr - hb->base;
+    hb->bits[HB_OFFSET_TO_INDEX(offset)] |= HB_OFFSET_TO_MASK(offset);
+
+    if (gDvm.gcHeap->dirtyNewAllocations) {
+        dvmMarkCard(ptr);
+    }
+
+    assert((((uintptr_t)ptr) & (HB_OBJECT_ALIGNMENT-1)) == 0 );
+    return ptr;
+}
+
+/**
+ * @brief   Retire the thread's buffer and allocate from a new one.
+ *
+ * @param   self        pointer to the thread
+ * @param   size        requested allocation size
+ * @return              pointer to allocated object or NULL
+ *
+ * warning: Must be called with the heap lock held. Returning NULL is not an
+ *          out of memory condition, the caller should use the other paths.
+ */
+void* dvmTLHeapBufferRefill(Thread* self, size_t size)
+{
+    TLHeap* tlh = self->tlh;
+    TLHeapSource* hs = gDvm.gcHeap->tlhSource;
+    assert (tlh != NULL);
+
+    if ((hs == NULL) || (hs->shutdown == true)) {
+        return NULL;
+    }
+
+    TLBuffer* buffer = tlh->buffer;
+    if (buffer != NULL) {
+        size_t left = buffer->end - (char*)self->tlBufferTop;
+        if (left > buffer->size / TLBUFFER_WASTE_DIV) {
+            /* too much room left to throw away for a single object */
+            return NULL;
+        }
+        retireBuffer(self);
+    }
+
+    if (dvmHeapSourceGetAvailableFree() <= TLPREALLOC_THRESHOLD) {
+        /* Memory pressure too high : leave it to tryMalloc.*/
+        return NULL;
+    }
+
+    size_t bufferSize = nextBufferSize(tlh, hs->epoch)
+            - HEAP_SOURCE_CHUNK_OVERHEAD;
+
+    /* No GC from here, tryMalloc will do it if really needed */
+    void* mem = dvmHeapSourceAlloc(bufferSize, true);
+    if (mem == NULL) {
+        return NULL;
+    }
+
+    initBuffer(self, mem, bufferSize);
+    return dvmTLHeapBufferAlloc(self, size);
+}
+
+/**
+ * @brief   Keep the thread buffers valid across a bitmap swap.
+ *
+ * The new live bitmap only covers the marked objects: count what was
+ * allocated so far so that the sweep can uncount it, and raise the bitmap
+ * max to cover the remaining room of each buffer.
+ *
+ * warning: Must be called from the GC with all threads suspended, right
+ *          after the live and mark bitmaps have been swapped.
+ */
+void dvmTLHeapSourceBitmapsSwapped(void)
+{
+    TLHeapSource* hs = gDvm.gcHeap->tlhSource;
+
+    if (hs == NULL) {
+        /* skip as TLA not activated */
+        return;
+    }
+
+    hs->epoch++;
+    bool inlineAlloc = inlineAllocAllowed();
+
+    dvmLockThreadList(NULL);
+
+    for (Thread* thread=gDvm.threadList; thread != NULL; thread=thread->next) {
+        TLHeap* tlh = thread->tlh;
+        if ((tlh != NULL) && (tlh->buffer != NULL)) {
+            countBufferObjects(thread);
+            coverLiveBits((uintptr_t)tlh->buffer->end - HB_OBJECT_ALIGNMENT);
+            if (inlineAlloc == false) {
+                thread->tlBufferLimit = NULL;
+            }
+        }
+    }
+
+    dvmUnlockThreadList();
+}
+
+/**
+ * @brief   Send compiled code allocations to the runtime.
+ *
+ * Threads are suspended so that none is in the middle of re-enabling
+ * inline allocation when the limits are cleared.
+ */
+void dvmTLHeapDisableInlineAlloc(void)
+{
+    if (gDvm.gcHeap->tlhSource == NULL) {
+        return;
+    }
+
+    dvmSuspendAllThreads(SUSPEND_FOR_ALLOC_PROF);
+    dvmLockThreadList(NULL);
+
+    for (Thread* thread=gDvm.threadList; thread != NULL; thread=thread->next) {
+        thread->tlBufferLimit = NULL;
+    }
+
+    dvmUnlockThreadList();
+    dvmResumeAllThreads(SUSPEND_FOR_ALLOC_PROF);
+}
+
 /**
  * @brief   Create a new local heap and attach it to the thread.
  *
@@ -831,6 +1222,10 @@ void dvmTLHeapDetach(Thread* self)
     TLPool* globalPool = &hs->pool;
 
     dvmLockHeap();        /* for dvmHeapSourceFree */
+
+    /* hand the bump allocation buffer over to the GC */
+    retireBuffer(self);
+
     poolLock(globalPool); /* for global pool AND tlb->tlh = NULL */
     poolLock(localPool);  /* for local pool */
 
@@ -926,7 +1321,18 @@ size_t dvmTLHeapSourceFreeList(size_t numPtrs, void **ptrs, bool isConcurrent)
         TLChunk* chunk = (TLChunk*) ((uintptr_t*)ptr-1);
         assert (chunk != NULL);
 
-        if ( (chunk->head & 0x3) == TLMARKER) {
+        if ( (chunk->head & 0x3) == TLBUFMARKER) {
+            /* bump allocated, the buffer is freed with its last object */
+            TLBuffer* buffer = (TLBuffer*)chunk->head;
+            assert ((char*)ptr > buffer->start);
+            assert ((char*)ptr < buffer->end);
+            if (android_atomic_dec(&buffer->live) == 1) {
+                /* only a retired buffer gets back to zero */
+                unlinkRetiredBuffer(hs, buffer);
+                ptrs[count++] = (void*)buffer;
+            }
+        }
+        else if ( (chunk->head & 0x3) == TLMARKER) {
 
             TLHeap* tlh; TLPool* pool; TLBlock* tlb; size_t sid;
 
@@ -1093,6 +1499,80 @@ void dvmTLHeapSourceReleaseFree(bool isConcurrent)
     }
 }
 
+/* release the whole pages of [begin, end) */
+static size_t trimRange(char* begin, char* end)
+{
+    char* first = TLALIGNUP(begin, SYSTEM_PAGE_SIZE);
+    char* last = TLALIGNDOWN(end, SYSTEM_PAGE_SIZE);
+
+    if (last <= first) {
+        return 0;
+    }
+    madvise(first, last - first, MADV_DONTNEED);
+    return last - first;
+}
+
+/* release the pages of a retired buffer that no live object overlaps */
+static size_t trimBuffer(TLBuffer* buffer)
+{
+    HeapBitmap* hb = dvmHeapSourceGetLiveBits();
+    uintptr_t offset = (uintptr_t)buffer->start - hb->base;
+    uintptr_t endOffset = (uintptr_t)buffer->end - hb->base;
+    char* gap = buffer->start;
+    size_t released = 0;
+
+    /* start and end are aligned on bitmap words */
+    for (size_t i = HB_OFFSET_TO_INDEX(offset);
+         i < HB_OFFSET_TO_INDEX(endOffset); i++) {
+        unsigned long word = hb->bits[i];
+        unsigned long highBit = 1 << (HB_BITS_PER_WORD - 1);
+        while (word != 0) {
+            const int shift = CLZ(word);
+            word &= ~(highBit >> shift);
+            char* obj = (char*)(HB_INDEX_TO_OFFSET(i) + hb->base)
+                    + shift * HB_OBJECT_ALIGNMENT;
+            char* chunk = obj - TLBUFFER_HEADER_SIZE;
+            released += trimRange(gap, chunk);
+            gap = chunk + ((u4*)chunk)[0];
+        }
+    }
+    released += trimRange(gap, buffer->end);
+    return released;
+}
+
+/**
+ * @brief   Release the memory of partly live retired buffers.
+ *
+ * warning: Must be called with the heap lock held, once the garbage of the
+ *          last GC is swept.
+ */
+void dvmTLHeapSourceTrimBuffers(void)
+{
+    TLHeapSource* hs = gDvm.gcHeap->tlhSource;
+
+    if (hs == NULL) {
+        /* skip as TLA not activated */
+        return;
+    }
+
+    size_t released = 0;
+    poolLock(&hs->pool);
+    for (TLBuffer* buffer = hs->retired; buffer != NULL; buffer = buffer->next) {
+        /* nothing died since the last time */
+        if (buffer->trimEpoch == hs->epoch) {
+            continue;
+        }
+        released += trimBuffer(buffer);
+        buffer->trimEpoch = hs->epoch;
+    }
+    poolUnlock(&hs->pool);
+
+    if (released != 0) {
+        LOGD_HEAP("TLA: released %zu bytes of retired buffers (%zu retained)",
+                  released, hs->retiredBytes);
+    }
+}
+
 /**
  * @brief   Post Zygote Initialization.
  */
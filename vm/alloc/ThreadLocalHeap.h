@@ -26,6 +26,19 @@
 #define TLPREALLOC_GLOBAL   4       /* number of global preallocated blocks */
 #define TLPREALLOC_THRESHOLD (128 << 10) /* Free Space pre-alloc threshold  */
 
+#define TLBUFFER_MAX_ALLOC_SIZE (4 << 10) /* MAX bump allocated object size */
+#define TLBUFFER_MIN_SIZE   (16 << 10)  /* first and smallest buffer size   */
+#define TLBUFFER_MAX_SIZE   (256 << 10) /* largest buffer size              */
+#define TLBUFFER_LMMAX_SIZE (32 << 10)  /* low mem largest buffer size      */
+#define TLBUFFER_GROW_REFILLS 4         /* refills per GC doubling the size */
+#define TLBUFFER_WASTE_DIV  8           /* keep buffer if more than 1/8 left */
+#define TLBUFFER_RETAINED_MAX (4 << 20) /* partly live buffers before shrinking */
+#define TLBUFFER_LMRETAINED_MAX (1 << 20) /* low mem retained maximum     */
+#define TLBUFFER_HEADER_SIZE 8          /* size and buffer words per object */
+
+/* bytes taken from a buffer by an object of size s */
+#define TLBUFFER_CHUNKSIZE(s) ((((s)+7)&~7)+TLBUFFER_HEADER_SIZE)
+
 
 struct TLHeapSource;
 struct TLHeap;
@@ -70,6 +83,14 @@ size_t dvmTLHeapSourceFreeList(size_t numPtrs, void **ptrs, bool isConcurrent);
  */
 void dvmTLHeapSourceReleaseFree(bool isConcurrent);
 
+/**
+ * @brief   Release the memory of partly live retired buffers.
+ *
+ * warning: Must be called with the heap lock held, once the garbage of the
+ *          last GC is swept.
+ */
+void dvmTLHeapSourceTrimBuffers(void);
+
 /**
  * @brief Get the Block Size
  *
@@ -107,6 +128,46 @@ void* dvmTLHeapAllocFromNewBlocks( TLHeap* tlh, size_t size, size_t numBlocks,
  */
 void* dvmTLHeapAlloc(TLHeap* tlh, size_t size);
 
+/**
+ * @brief   Bump allocates a cleared object from the thread's buffer.
+ *
+ * @param   self        pointer to the thread
+ * @param   size        requested allocation size
+ * @return              pointer to allocated object or NULL if it doesn't fit
+ *
+ * note:    Lock free, the object's live bit is set.
+ */
+void* dvmTLHeapBufferAlloc(Thread* self, size_t size);
+
+/**
+ * @brief   Retire the thread's buffer and allocate from a new one.
+ *
+ * @param   self        pointer to the thread
+ * @param   size        requested allocation size
+ * @return              pointer to allocated object or NULL
+ *
+ * warning: Must be called with the heap lock held. Returning NULL is not an
+ *          out of memory condition, the caller should use the other paths.
+ */
+void* dvmTLHeapBufferRefill(Thread* self, size_t size);
+
+/**
+ * @brief   Keep the thread buffers valid across a bitmap swap.
+ *
+ * warning: Must be called from the GC with all threads suspended, right
+ *          after the live and mark bitmaps have been swapped.
+ */
+void dvmTLHeapSourceBitmapsSwapped(void);
+
+/**
+ * @brief   Send compiled code allocations to the runtime.
+ *
+ * Compiled code bumps the thread buffers inline, without profiling, tracking
+ * or card marking. Called when any of those gets enabled; threads switch
+ * back to inline allocation on their own once it is disabled.
+ */
+void dvmTLHeapDisableInlineAlloc(void);
+
 /**
  * @brief   Create a new local heap and attach it to the thread.
  *
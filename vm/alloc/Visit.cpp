@@ -48,6 +48,29 @@ static void visitHashTable(RootVisitor *visitor, HashTable *table,
     dvmHashTableUnlock(table);
 }
 
+struct RootVisitorContext {
+    RootVisitor *visitor;
+    void *arg;
+};
+
+/*
+ * Visits a class in the class table.
+ */
+static void visitLoadedClass(ClassObject **clazzPtr, void *arg)
+{
+    RootVisitorContext *ctx = (RootVisitorContext *)arg;
+    (*ctx->visitor)(clazzPtr, 0, ROOT_STICKY_CLASS, ctx->arg);
+}
+
+/*
+ * Visits a literal string in the intern table.
+ */
+static void visitLiteralString(StringObject **strPtr, void *arg)
+{
+    RootVisitorContext *ctx = (RootVisitorContext *)arg;
+    (*ctx->visitor)(strPtr, 0, ROOT_INTERNED_STRING, ctx->arg);
+}
+
 /*
  * Visits all entries in the reference table.
  */
@@ -212,14 +235,14 @@ static void visitPrimitiveTypes(RootVisitor *visitor, void *arg)
 void dvmVisitRoots(RootVisitor *visitor, void *arg)
 {
     assert(visitor != NULL);
-    visitHashTable(visitor, gDvm.loadedClasses, ROOT_STICKY_CLASS, arg);
+    RootVisitorContext classContext = { visitor, arg };
+    dvmVisitLoadedClasses(visitLoadedClass, &classContext);
     visitPrimitiveTypes(visitor, arg);
     if (gDvm.dbgRegistry != NULL) {
         visitHashTable(visitor, gDvm.dbgRegistry, ROOT_DEBUGGER, arg);
     }
-    if (gDvm.literalStrings != NULL) {
-        visitHashTable(visitor, gDvm.literalStrings, ROOT_INTERNED_STRING, arg);
-    }
+    RootVisitorContext literalContext = { visitor, arg };
+    dvmVisitInternedStrings(false, visitLiteralString, &literalContext);
     dvmLockMutex(&gDvm.jniGlobalRefLock);
     visitIndirectRefTable(visitor, &gDvm.jniGlobalRefTable, 0, ROOT_JNI_GLOBAL, arg);
     dvmUnlockMutex(&gDvm.jniGlobalRefLock);
@@ -25,6 +25,7 @@
  * more rigorously structured.
  */
 #include "Dalvik.h"
+#include "libdex/DexClass.h"
 #include "libdex/OptInvocation.h"
 #include "analysis/RegisterMap.h"
 #include "analysis/Optimize.h"
@@ -45,18 +46,41 @@
 #include <unistd.h>
 #include <zlib.h>
 
+/*
+ * Options recorded with the class results, as they change the outcome
+ * of verification and optimization.
+ */
+enum {
+    kOptFlagVerify          = 0x01,
+    kOptFlagOpt             = 0x02,
+    kOptFlagSmp             = 0x04,
+    kOptFlagRegisterMaps    = 0x08,
+    kOptFlagModeShift       = 8,        // gDvm.dexOptMode
+};
+
 /* fwd */
 static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
-    DexClassLookup** ppClassLookup, DvmDex** ppDvmDex);
+    const DexFile* pPrevDexFile, DexClassLookup** ppClassLookup,
+    DexClassResults** ppClassResults, DvmDex** ppDvmDex);
 static bool loadAllClasses(DvmDex* pDvmDex);
-static void verifyAndOptimizeClasses(DexFile* pDexFile, bool doVerify,
-    bool doOpt);
-static void verifyAndOptimizeClass(DexFile* pDexFile, ClassObject* clazz,
+static void verifyAndOptimizeClasses(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, bool doVerify, bool doOpt);
+static void verifyAndOptimizeClassesInParallel(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, bool doVerify, bool doOpt);
+static void verifyAndOptimizeClassDef(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, u4 idx, bool doVerify, bool doOpt);
+static void verifyAndOptimizeClass(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, ClassObject* clazz,
     const DexClassDef* pClassDef, bool doVerify, bool doOpt);
+static bool copyPreviousClassResults(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, ClassObject* clazz,
+    const DexClassDef* pClassDef);
+static DexFile* openPreviousOptData(int prevFd, MemMapping* pMap);
 static void updateChecksum(u1* addr, int len, DexHeader* pHeader);
 static int writeDependencies(int fd, u4 modWhen, u4 crc);
 static bool writeOptData(int fd, const DexClassLookup* pClassLookup,\
-    const RegisterMapBuilder* pRegMapBuilder);
+    const RegisterMapBuilder* pRegMapBuilder,
+    const DexClassResults* pClassResults);
 static bool computeFileChecksum(int fd, off_t start, size_t length, u4* pSum);
 
 /*
@@ -522,13 +546,20 @@ bool dvmOptimizeDexFile(int fd, off_t dexOffset, long dexLength,
  * is currently correct for all platforms, and this isn't expected to
  * change, so we should be okay with having it already extracted.)
  *
+ * If "prevFd" is not -1, it is the output of a previous optimization of
+ * the same DEX file, and the results of the classes that did not change
+ * since are copied from it rather than computed again.
+ *
  * Returns "true" on success.
  */
 bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
-    const char* fileName, u4 modWhen, u4 crc, bool isBootstrap)
+    const char* fileName, u4 modWhen, u4 crc, bool isBootstrap, int prevFd)
 {
     DexClassLookup* pClassLookup = NULL;
+    DexClassResults* pClassResults = NULL;
     RegisterMapBuilder* pRegMapBuilder = NULL;
+    DexFile* pPrevDexFile = NULL;
+    MemMapping prevMap;
 
     assert(gDvm.optimizing);
 
@@ -588,6 +619,13 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
             doOpt = true;
         }
 
+        /*
+         * The previous output stays mapped until the register maps are
+         * generated, as those of the reused classes point into it.
+         */
+        if (prevFd >= 0)
+            pPrevDexFile = openPreviousOptData(prevFd, &prevMap);
+
         /*
          * Rewrite the file.  Byte reordering, structure realigning,
          * class verification, and bytecode optimization are all performed
@@ -597,10 +635,12 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
          * In practice this would be annoying to deal with, so the file
          * layout is designed so that it can always be rewritten in place.
          *
-         * This creates the class lookup table as part of doing the processing.
+         * This creates the class lookup table and the class results as part
+         * of doing the processing.
          */
         success = rewriteDex(((u1*) mapAddr) + dexOffset, dexLength,
-                    doVerify, doOpt, &pClassLookup, NULL);
+                    doVerify, doOpt, pPrevDexFile, &pClassLookup,
+                    &pClassResults, NULL);
 
         if (success) {
             DvmDex* pDvmDex = NULL;
@@ -630,6 +670,11 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
             }
         }
 
+        if (pPrevDexFile != NULL) {
+            dexFileFree(pPrevDexFile);
+            sysReleaseShmem(&prevMap);
+        }
+
         /* unmap the read-write version, forcing writes to disk */
         if (msync(mapAddr, dexOffset + dexLength, MS_SYNC) != 0) {
             ALOGW("msync failed: %s", strerror(errno));
@@ -693,7 +738,7 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
     /*
      * Append any optimized pre-computed data structures.
      */
-    if (!writeOptData(fd, pClassLookup, pRegMapBuilder)) {
+    if (!writeOptData(fd, pClassLookup, pRegMapBuilder, pClassResults)) {
         ALOGW("Failed writing opt data");
         goto bail;
     }
@@ -743,6 +788,7 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
 bail:
     dvmFreeRegisterMapBuilder(pRegMapBuilder);
     free(pClassLookup);
+    free(pClassResults);
     return result;
 }
 
@@ -768,7 +814,9 @@ bool dvmPrepareDexInMemory(u1* addr, size_t len, DvmDex** ppDvmDex)
      * also need to be changed, or we will try to verify the class twice,
      * and possibly reject it when optimized opcodes are encountered.)
      */
-    if (!rewriteDex(addr, len, false, false, &pClassLookup, ppDvmDex)) {
+    if (!rewriteDex(addr, len, false, false, NULL, &pClassLookup, NULL,
+            ppDvmDex))
+    {
         return false;
     }
 
@@ -788,21 +836,36 @@ bool dvmPrepareDexInMemory(u1* addr, size_t len, DvmDex** ppDvmDex)
  * If "ppClassLookup" is non-NULL, a pointer to a newly-allocated
  * DexClassLookup will be returned on success.
  *
+ * If "ppClassResults" is non-NULL, a pointer to a newly-allocated
+ * DexClassResults will be returned on success.  The results of the classes
+ * that did not change since "pPrevDexFile", if non-NULL, are copied from it.
+ *
  * If "ppDvmDex" is non-NULL, a newly-allocated DvmDex struct will be
  * returned on success.
  */
 static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
-    DexClassLookup** ppClassLookup, DvmDex** ppDvmDex)
+    const DexFile* pPrevDexFile, DexClassLookup** ppClassLookup,
+    DexClassResults** ppClassResults, DvmDex** ppDvmDex)
 {
     DexClassLookup* pClassLookup = NULL;
+    DexClassResults* pClassResults = NULL;
     u8 prepWhen, loadWhen, verifyOptWhen;
     DvmDex* pDvmDex = NULL;
     bool result = false;
     const char* msgStr = "???";
 
-    /* if the DEX is in the wrong byte order, swap it now */
-    if (dexSwapAndVerify(addr, len) != 0)
-        goto bail;
+    /*
+     * If the DEX is in the wrong byte order, swap it now.  Don't walk
+     * the whole file again for the checksum if dexopt already checked it
+     * as the DEX was extracted.
+     */
+    if (gDvm.optimizingChecksumVerified) {
+        if (dexSwapAndVerifyChecksummed(addr, len) != 0)
+            goto bail;
+    } else {
+        if (dexSwapAndVerify(addr, len) != 0)
+            goto bail;
+    }
 
     /*
      * Now that the DEX file can be read directly, create a DexFile struct
@@ -825,6 +888,40 @@ static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
         goto bail;
     pDvmDex->pDexFile->pClassLookup = pClassLookup;
 
+    /*
+     * Create the class results, hashing the classes before they are
+     * rewritten.  The results of the previous optimization can only be
+     * reused if they were made with the same declarations and options.
+     */
+    if (ppClassResults != NULL) {
+        pClassResults = dexCreateClassResults(pDvmDex->pDexFile);
+        if (pClassResults == NULL)
+            goto bail;
+        pClassResults->optFlags = (doVerify ? kOptFlagVerify : 0) |
+            (doOpt ? kOptFlagOpt : 0) |
+            (gDvm.dexOptForSmp ? kOptFlagSmp : 0) |
+            (gDvm.generateRegisterMaps ? kOptFlagRegisterMaps : 0) |
+            (gDvm.dexOptMode << kOptFlagModeShift);
+        pDvmDex->pDexFile->pClassResults = pClassResults;
+
+        if (pPrevDexFile != NULL) {
+            const DexClassResults* pPrevResults =
+                pPrevDexFile->pClassResults;
+
+            if (pPrevResults->optFlags != pClassResults->optFlags ||
+                pPrevResults->numEntries != pClassResults->numEntries ||
+                memcmp(pPrevResults->declHash, pClassResults->declHash,
+                    kSHA1DigestLen) != 0)
+            {
+                ALOGD("DexOpt: declarations or options changed,"
+                      " not reusing previous results");
+                pPrevDexFile = NULL;
+            }
+        }
+    } else {
+        pPrevDexFile = NULL;
+    }
+
     /*
      * If we're not going to attempt to verify or optimize the classes,
      * there's no value in loading them, so bail out early.
@@ -861,7 +958,8 @@ static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
      * This is best-effort, so there's really no way for dexopt to
      * fail at this point.
      */
-    verifyAndOptimizeClasses(pDvmDex->pDexFile, doVerify, doOpt);
+    verifyAndOptimizeClasses(pDvmDex->pDexFile, pPrevDexFile, doVerify,
+        doOpt);
     verifyOptWhen = dvmGetRelativeTimeUsec();
 
     if (doVerify && doOpt)
@@ -886,6 +984,7 @@ bail:
     if (pDvmDex != NULL) {
         /* break link between the two */
         pDvmDex->pDexFile->pClassLookup = NULL;
+        pDvmDex->pDexFile->pClassResults = NULL;
     }
 
     if (ppDvmDex == NULL || !result) {
@@ -900,6 +999,12 @@ bail:
         *ppClassLookup = pClassLookup;
     }
 
+    if (ppClassResults == NULL || !result) {
+        free(pClassResults);
+    } else {
+        *ppClassResults = pClassResults;
+    }
+
     return result;
 }
 
@@ -997,29 +1102,19 @@ static bool loadAllClasses(DvmDex* pDvmDex)
  * Verify and/or optimize all classes that were successfully loaded from
  * this DEX file.
  */
-static void verifyAndOptimizeClasses(DexFile* pDexFile, bool doVerify,
-    bool doOpt)
+static void verifyAndOptimizeClasses(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, bool doVerify, bool doOpt)
 {
     u4 count = pDexFile->pHeader->classDefsSize;
     u4 idx;
 
-    for (idx = 0; idx < count; idx++) {
-        const DexClassDef* pClassDef;
-        const char* classDescriptor;
-        ClassObject* clazz;
-
-        pClassDef = dexGetClassDef(pDexFile, idx);
-        classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
-
-        /* all classes are loaded into the bootstrap class loader */
-        clazz = dvmLookupClass(classDescriptor, NULL, false);
-        if (clazz != NULL) {
-            verifyAndOptimizeClass(pDexFile, clazz, pClassDef, doVerify, doOpt);
-
-        } else {
-            // TODO: log when in verbose mode
-            ALOGV("DexOpt: not optimizing unavailable class '%s'",
-                classDescriptor);
+    if (gDvm.dexOptThreadCount > 1 && count > 1) {
+        verifyAndOptimizeClassesInParallel(pDexFile, pPrevDexFile, doVerify,
+            doOpt);
+    } else {
+        for (idx = 0; idx < count; idx++) {
+            verifyAndOptimizeClassDef(pDexFile, pPrevDexFile, idx, doVerify,
+                doOpt);
         }
     }
 
@@ -1038,9 +1133,260 @@ static void verifyAndOptimizeClasses(DexFile* pDexFile, bool doVerify,
 }
 
 /*
- * Verify and/or optimize a specific class.
+ * Classes of a DEX file waiting to be verified and optimized by a pool of
+ * threads.
+ *
+ * Classes are handed out by increasing depth in the class hierarchy of
+ * the DEX file, and no class of a depth is handed out before every class
+ * of the previous depth is done.  Superclasses and superinterfaces defined
+ * in the same DEX file are thus processed before the classes extending
+ * them, as they are by the serial loop.  Each class only rewrites its own
+ * code and class def, so the output does not depend on the thread count.
+ */
+struct VerifyOptQueue {
+    DexFile*        pDexFile;
+    const DexFile*  pPrevDexFile;
+    bool            doVerify;
+    bool            doOpt;
+
+    /* class def indices, sorted by depth, then by index */
+    u4*             order;
+
+    /* end in "order" of each depth, indexed from 1 to maxDepth */
+    u4*             depthEnd;
+    u4              maxDepth;
+
+    /* guarded by "lock" */
+    u4              depth;      // depth being handed out
+    u4              next;       // next entry of "order" to hand out
+    u4              done;       // entries of "order" processed
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;       // signaled when a depth is complete
+};
+
+/*
+ * Compute the depth of "clazz" in the class hierarchy of "pDexFile": zero
+ * for classes defined elsewhere, otherwise one more than its deepest
+ * superclass or superinterface.  "depths" caches the depth of each class
+ * def, and holds zero for depths not yet computed.
+ */
+static u4 computeClassDepth(DexFile* pDexFile, const ClassObject* clazz,
+    u4* depths)
+{
+    const DexClassDef* pClassDef;
+    u4 idx;
+    int i;
+
+    if (clazz == NULL || clazz->pDvmDex == NULL ||
+        clazz->pDvmDex->pDexFile != pDexFile)
+    {
+        return 0;
+    }
+
+    pClassDef = dexFindClass(pDexFile, clazz->descriptor);
+    if (pClassDef == NULL)
+        return 0;
+    idx = pClassDef - dexGetClassDef(pDexFile, 0);
+
+    if (depths[idx] == 0) {
+        u4 depth = computeClassDepth(pDexFile, clazz->super, depths);
+
+        for (i = 0; i < clazz->interfaceCount; i++) {
+            u4 ifaceDepth =
+                computeClassDepth(pDexFile, clazz->interfaces[i], depths);
+            if (ifaceDepth > depth)
+                depth = ifaceDepth;
+        }
+        depths[idx] = depth + 1;
+    }
+    return depths[idx];
+}
+
+/*
+ * Verify and optimize classes from "pQueue" until it is empty.
+ *
+ * Called in THREAD_VMWAIT.  We only switch to THREAD_RUNNING while
+ * working on a class, so a GC never waits for more than one class per
+ * thread.
+ */
+static void processVerifyOptQueue(VerifyOptQueue* pQueue)
+{
+    Thread* self = dvmThreadSelf();
+    u4 idx;
+
+    dvmLockMutex(&pQueue->lock);
+    while (true) {
+        /* move to the next depth once the current one is complete */
+        while (pQueue->next == pQueue->depthEnd[pQueue->depth]) {
+            if (pQueue->done < pQueue->depthEnd[pQueue->depth]) {
+                dvmWaitCond(&pQueue->cond, &pQueue->lock);
+            } else if (pQueue->depth < pQueue->maxDepth) {
+                pQueue->depth++;
+            } else {
+                goto bail;
+            }
+        }
+        idx = pQueue->order[pQueue->next++];
+        dvmUnlockMutex(&pQueue->lock);
+
+        dvmChangeStatus(self, THREAD_RUNNING);
+        verifyAndOptimizeClassDef(pQueue->pDexFile, pQueue->pPrevDexFile, idx,
+            pQueue->doVerify, pQueue->doOpt);
+        dvmClearOptException(self);
+        dvmChangeStatus(self, THREAD_VMWAIT);
+
+        dvmLockMutex(&pQueue->lock);
+        pQueue->done++;
+        if (pQueue->done == pQueue->depthEnd[pQueue->depth])
+            pthread_cond_broadcast(&pQueue->cond);
+    }
+
+bail:
+    dvmUnlockMutex(&pQueue->lock);
+}
+
+/*
+ * pthread entry function for the dexopt worker threads.
+ */
+static void* verifyOptThreadStart(void* arg)
+{
+    VerifyOptQueue* pQueue = (VerifyOptQueue*) arg;
+
+    /* the other threads pick up the work if we cannot attach */
+    if (!dvmAttachOptimizerThread()) {
+        ALOGW("DexOpt: unable to attach worker thread");
+        return NULL;
+    }
+
+    processVerifyOptQueue(pQueue);
+
+    dvmDetachOptimizerThread();
+    return NULL;
+}
+
+/*
+ * Verify and/or optimize all classes of this DEX file with
+ * gDvm.dexOptThreadCount threads, the current one included.
+ */
+static void verifyAndOptimizeClassesInParallel(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, bool doVerify, bool doOpt)
+{
+    Thread* self = dvmThreadSelf();
+    u4 count = pDexFile->pHeader->classDefsSize;
+    VerifyOptQueue queue;
+    pthread_t* threads;
+    u4* depths;
+    u4* fill;
+    u4 idx, depth;
+    int threadCount, started, i;
+    ThreadStatus oldStatus;
+
+    memset(&queue, 0, sizeof(queue));
+    queue.pDexFile = pDexFile;
+    queue.pPrevDexFile = pPrevDexFile;
+    queue.doVerify = doVerify;
+    queue.doOpt = doOpt;
+
+    /*
+     * Sort the class defs by depth.  Class defs whose class is unavailable
+     * or comes from another DEX file are not processed, put them first.
+     */
+    depths = (u4*) calloc(count, sizeof(u4));
+    for (idx = 0; idx < count; idx++) {
+        const DexClassDef* pClassDef = dexGetClassDef(pDexFile, idx);
+        const char* classDescriptor =
+            dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+        ClassObject* clazz = dvmLookupClass(classDescriptor, NULL, false);
+
+        depth = computeClassDepth(pDexFile, clazz, depths);
+        if (depth == 0)
+            depths[idx] = depth = 1;
+        if (depth > queue.maxDepth)
+            queue.maxDepth = depth;
+    }
+
+    queue.depthEnd = (u4*) calloc(queue.maxDepth + 1, sizeof(u4));
+    fill = (u4*) calloc(queue.maxDepth + 1, sizeof(u4));
+    queue.order = (u4*) malloc(count * sizeof(u4));
+    for (idx = 0; idx < count; idx++)
+        queue.depthEnd[depths[idx]]++;
+    for (depth = 1; depth <= queue.maxDepth; depth++) {
+        fill[depth] = queue.depthEnd[depth - 1];
+        queue.depthEnd[depth] += queue.depthEnd[depth - 1];
+    }
+    for (idx = 0; idx < count; idx++)
+        queue.order[fill[depths[idx]]++] = idx;
+    free(fill);
+    free(depths);
+
+    queue.depth = 1;
+    dvmInitMutex(&queue.lock);
+    pthread_cond_init(&queue.cond, NULL);
+
+    /*
+     * Start the worker threads, and join in.
+     */
+    threadCount = gDvm.dexOptThreadCount;
+    threads = (pthread_t*) malloc((threadCount - 1) * sizeof(pthread_t));
+    started = 0;
+    for (i = 1; i < threadCount; i++) {
+        int cc = pthread_create(&threads[started], NULL, verifyOptThreadStart,
+                    &queue);
+        if (cc != 0) {
+            ALOGW("DexOpt: worker thread creation failed: %s", strerror(cc));
+            break;
+        }
+        started++;
+    }
+    ALOGV("DexOpt: verifying %u classes of depth up to %u with %d threads",
+        count, queue.maxDepth, started + 1);
+
+    oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    processVerifyOptQueue(&queue);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    dvmChangeStatus(self, oldStatus);
+
+    assert(queue.done == count);
+    pthread_cond_destroy(&queue.cond);
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+    free(queue.order);
+    free(queue.depthEnd);
+}
+
+/*
+ * Verify and/or optimize the class of a class def, if it was loaded.
  */
-static void verifyAndOptimizeClass(DexFile* pDexFile, ClassObject* clazz,
+static void verifyAndOptimizeClassDef(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, u4 idx, bool doVerify, bool doOpt)
+{
+    const DexClassDef* pClassDef;
+    const char* classDescriptor;
+    ClassObject* clazz;
+
+    pClassDef = dexGetClassDef(pDexFile, idx);
+    classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+
+    /* all classes are loaded into the bootstrap class loader */
+    clazz = dvmLookupClass(classDescriptor, NULL, false);
+    if (clazz != NULL) {
+        verifyAndOptimizeClass(pDexFile, pPrevDexFile, clazz, pClassDef,
+            doVerify, doOpt);
+
+    } else {
+        // TODO: log when in verbose mode
+        ALOGV("DexOpt: not optimizing unavailable class '%s'",
+            classDescriptor);
+    }
+}
+
+/*
+ * Verify and/or optimize a specific class, or copy the results of the
+ * previous optimization if it did not change since.
+ */
+static void verifyAndOptimizeClass(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, ClassObject* clazz,
     const DexClassDef* pClassDef, bool doVerify, bool doOpt)
 {
     const char* classDescriptor;
@@ -1061,6 +1407,13 @@ static void verifyAndOptimizeClass(DexFile* pDexFile, ClassObject* clazz,
 
     classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
 
+    if (pPrevDexFile != NULL &&
+        copyPreviousClassResults(pDexFile, pPrevDexFile, clazz, pClassDef))
+    {
+        ALOGV("DexOpt: reusing previous results for '%s'", classDescriptor);
+        goto done;
+    }
+
     /*
      * First, try to verify it.
      */
@@ -1094,6 +1447,177 @@ static void verifyAndOptimizeClass(DexFile* pDexFile, ClassObject* clazz,
             ((DexClassDef*)pClassDef)->accessFlags |= CLASS_ISOPTIMIZED;
         }
     }
+
+done:
+    /* record the outcome for the next incremental run */
+    if (pDexFile->pClassResults != NULL) {
+        DexClassResults* pClassResults =
+            (DexClassResults*) pDexFile->pClassResults;
+        u4 idx = dexGetIndexForClassDef(pDexFile, pClassDef);
+
+        pClassResults->table[idx].accessFlags = pClassDef->accessFlags &
+            (CLASS_ISPREVERIFIED | CLASS_ISOPTIMIZED);
+    }
+}
+
+/*
+ * Copy the instructions of "count" methods from the previous optimization
+ * of the DEX file over those of the same methods in this one.
+ */
+static void copyPreviousCode(DexFile* pDexFile, const DexMethod* pMethods,
+    const DexFile* pPrevDexFile, const DexMethod* pPrevMethods, u4 count)
+{
+    u4 i;
+
+    for (i = 0; i < count; i++) {
+        DexCode* pCode = (DexCode*) dexGetCode(pDexFile, &pMethods[i]);
+        const DexCode* pPrevCode = dexGetCode(pPrevDexFile, &pPrevMethods[i]);
+
+        if (pCode == NULL)
+            continue;
+        assert(pPrevCode != NULL && pPrevCode->insnsSize == pCode->insnsSize);
+        memcpy(pCode->insns, pPrevCode->insns,
+            pCode->insnsSize * sizeof(u2));
+    }
+}
+
+/*
+ * Set the register maps of "count" methods of "clazz", starting with
+ * "pMethods", from the data of the previous optimization.
+ */
+static void copyPreviousRegisterMaps(Method* pMethods, u4 count,
+    const void** pClassMapData)
+{
+    u4 i;
+
+    for (i = 0; i < count; i++) {
+        const RegisterMap* pMap = dvmRegisterMapGetNext(pClassMapData);
+        if (dvmRegisterMapGetFormat(pMap) != kRegMapFormatNone)
+            dvmSetRegisterMap(&pMethods[i], pMap);
+    }
+}
+
+/*
+ * If a class did not change since the previous optimization of the DEX
+ * file, copy its optimized instructions, register maps and class def
+ * flags from it.
+ *
+ * The declarations of the two DEX files are known to be the same, so the
+ * class defs and their methods are in the same order, and instructions
+ * refer to the same ids in both.
+ *
+ * Returns "true" if the results were copied.
+ */
+static bool copyPreviousClassResults(DexFile* pDexFile,
+    const DexFile* pPrevDexFile, ClassObject* clazz,
+    const DexClassDef* pClassDef)
+{
+    const DexClassResults* pClassResults = pDexFile->pClassResults;
+    const DexClassResults* pPrevResults = pPrevDexFile->pClassResults;
+    u4 idx = dexGetIndexForClassDef(pDexFile, pClassDef);
+    u4 prevFlags = pPrevResults->table[idx].accessFlags;
+    const DexClassDef* pPrevClassDef;
+    DexClassData* pClassData = NULL;
+    DexClassData* pPrevClassData = NULL;
+    const void* classMapData = NULL;
+    const u1* pEncodedData;
+    bool result = false;
+
+    if (prevFlags == kDexNoIndex ||
+        memcmp(pClassResults->table[idx].classHash,
+            pPrevResults->table[idx].classHash, kSHA1DigestLen) != 0)
+    {
+        return false;
+    }
+    pPrevClassDef = dexGetClassDef(pPrevDexFile, idx);
+
+    pEncodedData = dexGetClassData(pDexFile, pClassDef);
+    pClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+    pEncodedData = dexGetClassData(pPrevDexFile, pPrevClassDef);
+    pPrevClassData = dexReadAndVerifyClassData(&pEncodedData, NULL);
+    if (pClassData == NULL || pPrevClassData == NULL)
+        goto bail;
+    assert(pClassData->header.directMethodsSize ==
+           pPrevClassData->header.directMethodsSize &&
+           pClassData->header.virtualMethodsSize ==
+           pPrevClassData->header.virtualMethodsSize);
+
+    /*
+     * Find the register maps first, so we can still fall back to
+     * verifying the class if they are missing.
+     */
+    if (gDvm.generateRegisterMaps && (prevFlags & CLASS_ISPREVERIFIED) != 0) {
+        u4 numMaps;
+
+        classMapData = dvmRegisterMapGetClassData(pPrevDexFile, idx, &numMaps);
+        if (classMapData == NULL ||
+            numMaps != pClassData->header.directMethodsSize +
+                       pClassData->header.virtualMethodsSize)
+        {
+            ALOGW("DexOpt: no previous register maps for '%s'",
+                clazz->descriptor);
+            goto bail;
+        }
+    }
+
+    copyPreviousCode(pDexFile, pClassData->directMethods,
+        pPrevDexFile, pPrevClassData->directMethods,
+        pClassData->header.directMethodsSize);
+    copyPreviousCode(pDexFile, pClassData->virtualMethods,
+        pPrevDexFile, pPrevClassData->virtualMethods,
+        pClassData->header.virtualMethodsSize);
+
+    /* miranda methods come after those of the class data, and have no map */
+    if (classMapData != NULL) {
+        copyPreviousRegisterMaps(clazz->directMethods,
+            pClassData->header.directMethodsSize, &classMapData);
+        copyPreviousRegisterMaps(clazz->virtualMethods,
+            pClassData->header.virtualMethodsSize, &classMapData);
+    }
+
+    ((DexClassDef*)pClassDef)->accessFlags |= prevFlags;
+    result = true;
+
+bail:
+    free(pClassData);
+    free(pPrevClassData);
+    return result;
+}
+
+/*
+ * Map and parse the output of a previous optimization of the DEX file, for
+ * incremental dexopt.  Its class results are only usable if it was made
+ * against the current bootstrap class path.
+ *
+ * Returns NULL if there is nothing to reuse.
+ */
+static DexFile* openPreviousOptData(int prevFd, MemMapping* pMap)
+{
+    DexFile* pDexFile;
+
+    if (!dvmCheckOptHeaderAndDependencies(prevFd, false, 0, 0, false, false)) {
+        ALOGD("DexOpt: previous output is stale, not reusing it");
+        return NULL;
+    }
+
+    if (lseek(prevFd, 0, SEEK_SET) < 0 ||
+        sysMapFileInShmemWritableReadOnly(prevFd, pMap) != 0)
+    {
+        ALOGE("DexOpt: unable to map previous output");
+        return NULL;
+    }
+
+    pDexFile = dexFileParse((u1*) pMap->addr, pMap->length,
+                    kDexParseVerifyChecksum);
+    if (pDexFile == NULL || pDexFile->pClassResults == NULL) {
+        ALOGD("DexOpt: no class results in previous output");
+        if (pDexFile != NULL)
+            dexFileFree(pDexFile);
+        sysReleaseShmem(pMap);
+        return NULL;
+    }
+
+    return pDexFile;
 }
 
 
@@ -1480,7 +2004,8 @@ static bool writeChunk(int fd, u4 type, const void* data, size_t size)
  * so it can be used directly when the file is mapped for reading.
  */
 static bool writeOptData(int fd, const DexClassLookup* pClassLookup,
-    const RegisterMapBuilder* pRegMapBuilder)
+    const RegisterMapBuilder* pRegMapBuilder,
+    const DexClassResults* pClassResults)
 {
     /* pre-computed class lookup hash table */
     if (!writeChunk(fd, (u4) kDexChunkClassLookup,
@@ -1498,6 +2023,13 @@ static bool writeOptData(int fd, const DexClassLookup* pClassLookup,
         }
     }
 
+    /* per-class results, for incremental dexopt */
+    if (!writeChunk(fd, (u4) kDexChunkClassResults,
+            pClassResults, pClassResults->size))
+    {
+        return false;
+    }
+
     /* write the end marker */
     if (!writeChunk(fd, (u4) kDexChunkEnd, NULL, 0)) {
         return false;
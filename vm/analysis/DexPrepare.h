@@ -44,7 +44,8 @@ enum DexoptFlags {
     DEXOPT_IS_BOOTSTRAP      = 1 << 4,  /* is dex in bootstrap class path? */
     DEXOPT_GEN_REGISTER_MAPS = 1 << 5,  /* generate register maps during vfy */
     DEXOPT_UNIPROCESSOR      = 1 << 6,  /* specify uniprocessor target */
-    DEXOPT_SMP               = 1 << 7   /* specify SMP target */
+    DEXOPT_SMP               = 1 << 7,  /* specify SMP target */
+    DEXOPT_CHECKSUM_VERIFIED = 1 << 8   /* DEX checksum checked on extract */
 };
 
 /*
@@ -119,9 +120,12 @@ bool dvmOptimizeDexFile(int fd, off_t dexOffset, long dexLen,
 
 /*
  * Continue the optimization process on the other side of a fork/exec.
+ *
+ * "prevFd" is the output of a previous optimization of the same DEX file
+ * to reuse the results of unchanged classes from, or -1.
  */
 bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
-    const char* fileName, u4 modWhen, u4 crc, bool isBootstrap);
+    const char* fileName, u4 modWhen, u4 crc, bool isBootstrap, int prevFd);
 
 /*
  * Prepare DEX data that is only available to the VM as in-memory data.
@@ -393,7 +393,9 @@ static inline void updateOpcode(const Method* meth, u2* ptr, u2 opcode)
  * the DEX we're working on is not destined for the bootstrap class path,
  * tweak the class loader so package-access checks work correctly.
  *
- * Only do this if we're doing pre-verification or optimization.
+ * Only do this if we're doing pre-verification or optimization.  The
+ * classes are shared with the other dexopt worker threads, so the tweak
+ * only applies to access checks made by the current thread.
  */
 static void tweakLoader(ClassObject* referrer, ClassObject* resClass)
 {
@@ -407,7 +409,7 @@ static void tweakLoader(ClassObject* referrer, ClassObject* resClass)
         if (dvmIsArrayClass(resClass))
             resClass = resClass->elementClass;
         if (referrer->pDvmDex != resClass->pDvmDex)
-            resClass->classLoader = (Object*) 0xdead3333;
+            dvmThreadSelf()->dexOptForeignClass = resClass;
     }
 }
 
@@ -419,9 +421,7 @@ static void untweakLoader(ClassObject* referrer, ClassObject* resClass)
     if (!gDvm.optimizing || gDvm.optimizingBootstrapClass)
         return;
 
-    if (dvmIsArrayClass(resClass))
-        resClass = resClass->elementClass;
-    resClass->classLoader = NULL;
+    dvmThreadSelf()->dexOptForeignClass = NULL;
 }
 
 
@@ -1024,6 +1024,48 @@ bool dvmCompilerGenerateNullCheckHoist (BasicBlock *hoistToBB, int objectReg)
     return hoisted;
 }
 
+bool dvmCompilerGenerateBoundCheckHoist (BasicBlock *hoistToBB, int arrayReg, int index, bool isConstant)
+{
+    //Assume we will not hoist
+    bool hoisted = false;
+
+    //Check if we have a BB to hoist to
+    if (hoistToBB != 0)
+    {
+        //Now check if we can determine PC in case of exception
+        if (hoistToBB->fallThrough != 0 && hoistToBB->fallThrough->firstMIRInsn != 0)
+        {
+            const MIR *firstMir = hoistToBB->fallThrough->firstMIRInsn;
+
+            //Do a sanity check on the block offset before we hoist. It should match the offset of first instruction
+            if (hoistToBB->fallThrough->startOffset == firstMir->offset)
+            {
+                MIR *boundCheck = dvmCompilerNewMIR ();
+
+                //Create bound check
+                boundCheck->dalvikInsn.opcode = static_cast<Opcode> (kMirOpBoundCheck);
+                boundCheck->dalvikInsn.vA = arrayReg;
+                boundCheck->dalvikInsn.arg[0] = (isConstant == true) ? MIR_BOUND_CHECK_CST : MIR_BOUND_CHECK_REG;
+                boundCheck->dalvikInsn.arg[1] = index;
+
+                //For exception purpose, we set the offset to match the offset in the block following entry
+                boundCheck->offset = hoistToBB->fallThrough->startOffset;
+
+                //We also make sure that it has the same nesting information
+                boundCheck->nesting = firstMir->nesting;
+
+                //Now append the MIR to the BB
+                dvmCompilerAppendMIR (hoistToBB, boundCheck);
+
+                //Mark that hoisting was successful
+                hoisted = true;
+            }
+        }
+    }
+
+    return hoisted;
+}
+
 void handleNullCheckHoist (CompilationUnit *cUnit, SRemoveData *removeData, MIR *mir, int objectReg)
 {
     //Do we hoist ?
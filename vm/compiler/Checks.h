@@ -30,6 +30,16 @@ class Pass;
  */
 bool dvmCompilerGenerateNullCheckHoist (BasicBlock *hoistToBB, int objectReg);
 
+/**
+ * @brief Used to generate and add a hoisted bound check
+ * @param hoistToBB The basic block to which to append the hoisted bound check
+ * @param arrayReg The dalvik register holding the array
+ * @param index The dalvik register holding the index, or the index itself if isConstant
+ * @param isConstant Whether index is a constant rather than a dalvik register
+ * @return Returns if bound check was successfully generated
+ */
+bool dvmCompilerGenerateBoundCheckHoist (BasicBlock *hoistToBB, int arrayReg, int index, bool isConstant);
+
 /**
  * @brief Remove redundant checks start function
  * @param cUnit the CompilationUnit
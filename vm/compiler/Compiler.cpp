@@ -21,6 +21,7 @@
 #include "Dalvik.h"
 #include "interp/Jit.h"
 #include "CompilerInternals.h"
+#include "JitWarmCache.h"
 #include "Utility.h"
 #ifdef ARCH_IA32
 #include "MethodContextHandler.h"
@@ -39,17 +40,74 @@ static inline bool workQueueLength(void)
     return gDvmJit.compilerQueueLength;
 }
 
-static CompilerWorkOrder workDequeue(void)
+/*
+ * Work orders are kept unordered in compilerWorkQueue[0..compilerQueueLength).
+ * The order compiled next is the one with the highest effective priority:
+ * the base priority of its kind, boosted by the number of times its pc was
+ * requested again while it was waiting, and by how long it has been waiting
+ * so that cold orders are not starved.
+ */
+static int workOrderPriority(const CompilerWorkOrder *work)
+{
+    int age = (int) (gDvmJit.compilerWorkSequence - work->sequence);
+    return work->priority + work->hits * COMPILER_PRIORITY_HIT_BOOST +
+           (age >> COMPILER_PRIORITY_AGE_SHIFT);
+}
+
+static int workOrderBasePriority(WorkOrderKind kind)
 {
-    assert(gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex].kind
-           != kWorkOrderInvalid);
-    CompilerWorkOrder work =
-        gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex];
-    gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex++].kind =
-        kWorkOrderInvalid;
-    if (gDvmJit.compilerWorkDequeueIndex == COMPILER_WORK_QUEUE_SIZE) {
-        gDvmJit.compilerWorkDequeueIndex = 0;
+    switch (kind) {
+        case kWorkOrderProfileMode:
+            return COMPILER_PRIORITY_CONTROL;
+        case kWorkOrderTrace:
+            return COMPILER_PRIORITY_TRACE;
+        case kWorkOrderMethod:
+            return COMPILER_PRIORITY_METHOD;
+        default:
+            return COMPILER_PRIORITY_DEBUG;
     }
+}
+
+/*
+ * Return the index of the queued order with the highest effective priority,
+ * or the lowest one if "lowest" is set. Ties go to the oldest order when
+ * picking the highest and to the youngest when picking the lowest, which
+ * keeps orders of the same priority (e.g. profile mode changes) in FIFO order.
+ */
+static int workQueueSelect(bool lowest)
+{
+    int selected = 0;
+    int selectedPriority = workOrderPriority(&gDvmJit.compilerWorkQueue[0]);
+
+    for (int i = 1; i < gDvmJit.compilerQueueLength; i++) {
+        const CompilerWorkOrder *work = &gDvmJit.compilerWorkQueue[i];
+        int priority = workOrderPriority(work);
+        bool older = (int) (work->sequence -
+            gDvmJit.compilerWorkQueue[selected].sequence) < 0;
+        bool better = lowest ?
+            (priority < selectedPriority ||
+             (priority == selectedPriority && !older)) :
+            (priority > selectedPriority ||
+             (priority == selectedPriority && older));
+        if (better) {
+            selected = i;
+            selectedPriority = priority;
+        }
+    }
+    return selected;
+}
+
+static CompilerWorkOrder workDequeue(void)
+{
+    int last = gDvmJit.compilerQueueLength - 1;
+    int idx = workQueueSelect(false);
+
+    assert(gDvmJit.compilerWorkQueue[idx].kind != kWorkOrderInvalid);
+    CompilerWorkOrder work = gDvmJit.compilerWorkQueue[idx];
+
+    /* Fill the hole with the last order */
+    gDvmJit.compilerWorkQueue[idx] = gDvmJit.compilerWorkQueue[last];
+    gDvmJit.compilerWorkQueue[last].kind = kWorkOrderInvalid;
     gDvmJit.compilerQueueLength--;
     if (gDvmJit.compilerQueueLength == 0) {
         dvmSignalCond(&gDvmJit.compilerQueueEmpty);
@@ -94,6 +152,10 @@ void dvmCompilerForceWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
 /*
  * Attempt to enqueue a work order, returning true if successful.
  *
+ * A request for a pc that is already queued only raises the priority of the
+ * queued order; the redundant info is freed here. When the queue is full the
+ * coldest queued order is evicted if the new one has a higher priority.
+ *
  * NOTE: Make sure that the caller frees the info pointer if the return value
  * is false.
  */
@@ -101,39 +163,56 @@ bool dvmCompilerWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
 {
     int cc;
     int i;
-    int numWork;
-    bool result = true;
+    int priority = workOrderBasePriority(kind);
+    CompilerWorkOrder *newOrder;
 
     dvmLockMutex(&gDvmJit.compilerLock);
 
     /*
-     * Return if queue or code cache is full.
+     * Return if code cache is full.
      */
-    if (gDvmJit.compilerQueueLength == COMPILER_WORK_QUEUE_SIZE ||
-        gDvmJit.codeCacheFull == true) {
+    if (gDvmJit.codeCacheFull == true) {
         dvmUnlockMutex(&gDvmJit.compilerLock);
         return false;
     }
 
-    for (numWork = gDvmJit.compilerQueueLength,
-           i = gDvmJit.compilerWorkDequeueIndex;
-         numWork > 0;
-         numWork--) {
-        /* Already enqueued */
-        if (gDvmJit.compilerWorkQueue[i++].pc == pc) {
+    if (pc != NULL) {
+        for (i = 0; i < gDvmJit.compilerQueueLength; i++) {
+            CompilerWorkOrder *work = &gDvmJit.compilerWorkQueue[i];
+            /* Already enqueued */
+            if (work->pc == pc && work->kind == kind) {
+                work->hits++;
+                if (info != work->info) {
+                    free(info);
+                }
+                dvmUnlockMutex(&gDvmJit.compilerLock);
+                return true;
+            }
+        }
+    }
+
+    if (gDvmJit.compilerQueueLength == COMPILER_WORK_QUEUE_SIZE) {
+        CompilerWorkOrder *victim =
+            &gDvmJit.compilerWorkQueue[workQueueSelect(true)];
+        if (victim->kind == kWorkOrderProfileMode ||
+            workOrderPriority(victim) >= priority) {
+            gDvmJit.compilerQueueDropped++;
             dvmUnlockMutex(&gDvmJit.compilerLock);
-            return true;
+            return false;
         }
-        /* Wrap around */
-        if (i == COMPILER_WORK_QUEUE_SIZE)
-            i = 0;
+        gDvmJit.compilerQueueEvicted++;
+        free(victim->info);
+        newOrder = victim;
+    } else {
+        newOrder = &gDvmJit.compilerWorkQueue[gDvmJit.compilerQueueLength++];
     }
 
-    CompilerWorkOrder *newOrder =
-        &gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkEnqueueIndex];
     newOrder->pc = pc;
     newOrder->kind = kind;
     newOrder->info = info;
+    newOrder->priority = priority;
+    newOrder->hits = 0;
+    newOrder->sequence = gDvmJit.compilerWorkSequence++;
     newOrder->result.methodCompilationAborted = NULL;
     newOrder->result.codeAddress = NULL;
     newOrder->result.discardResult =
@@ -141,15 +220,32 @@ bool dvmCompilerWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
     newOrder->result.cacheVersion = gDvmJit.cacheVersion;
     newOrder->result.requestingThread = dvmThreadSelf();
 
-    gDvmJit.compilerWorkEnqueueIndex++;
-    if (gDvmJit.compilerWorkEnqueueIndex == COMPILER_WORK_QUEUE_SIZE)
-        gDvmJit.compilerWorkEnqueueIndex = 0;
-    gDvmJit.compilerQueueLength++;
     cc = pthread_cond_signal(&gDvmJit.compilerQueueActivity);
     assert(cc == 0);
 
     dvmUnlockMutex(&gDvmJit.compilerLock);
-    return result;
+    return true;
+}
+
+/*
+ * Note that the work order for pc and kind was requested again while it may
+ * still be waiting in the queue. Orders are matched the way enqueue dedups
+ * them, since a trace and a method order can share a pc. This is called from
+ * the interpreter, so give up rather than block if the compiler lock is busy.
+ */
+void dvmCompilerRaiseWorkPriority(const u2 *pc, WorkOrderKind kind)
+{
+    if (dvmTryLockMutex(&gDvmJit.compilerLock) != 0) {
+        return;
+    }
+    for (int i = 0; i < gDvmJit.compilerQueueLength; i++) {
+        CompilerWorkOrder *work = &gDvmJit.compilerWorkQueue[i];
+        if (work->pc == pc && work->kind == kind) {
+            work->hits++;
+            break;
+        }
+    }
+    dvmUnlockMutex(&gDvmJit.compilerLock);
 }
 
 /* Block until the queue length is 0, or there is a pending suspend request */
@@ -413,7 +509,6 @@ static void resetCodeAndDataCache(void)
     /* Reset the work queue */
     memset(gDvmJit.compilerWorkQueue, 0,
            sizeof(CompilerWorkOrder) * COMPILER_WORK_QUEUE_SIZE);
-    gDvmJit.compilerWorkEnqueueIndex = gDvmJit.compilerWorkDequeueIndex = 0;
     gDvmJit.compilerQueueLength = 0;
 
     /* Reset the IC patch work queue */
@@ -665,58 +760,11 @@ fail:
 
 }
 
-static void *compilerThreadStart(void *arg)
+/*
+ * Drain the work queue until the compiler is halted.
+ */
+static void compilerThreadLoop(void)
 {
-    dvmChangeStatus(NULL, THREAD_VMWAIT);
-
-    /*
-     * If we're not running stand-alone, wait a little before
-     * recieving translation requests on the assumption that process start
-     * up code isn't worth compiling.  We'll resume when the framework
-     * signals us that the first screen draw has happened, or the timer
-     * below expires (to catch daemons).
-     *
-     * There is a theoretical race between the callback to
-     * VMRuntime.startJitCompiation and when the compiler thread reaches this
-     * point. In case the callback happens earlier, in order not to permanently
-     * hold the system_server (which is not using the timed wait) in
-     * interpreter-only mode we bypass the delay here.
-     */
-    if (gDvmJit.runningInAndroidFramework &&
-        !gDvmJit.alreadyEnabledViaFramework) {
-        /*
-         * If the current VM instance is the system server (detected by having
-         * 0 in gDvm.systemServerPid), we will use the indefinite wait on the
-         * conditional variable to determine whether to start the JIT or not.
-         * If the system server detects that the whole system is booted in
-         * safe mode, the conditional variable will never be signaled and the
-         * system server will remain in the interpreter-only mode. All
-         * subsequent apps will be started with the --enable-safemode flag
-         * explicitly appended.
-         */
-        if (gDvm.systemServerPid == 0) {
-            dvmLockMutex(&gDvmJit.compilerLock);
-            pthread_cond_wait(&gDvmJit.compilerQueueActivity,
-                              &gDvmJit.compilerLock);
-            dvmUnlockMutex(&gDvmJit.compilerLock);
-            ALOGD("JIT started for system_server");
-        } else {
-            dvmLockMutex(&gDvmJit.compilerLock);
-            /*
-             * TUNING: experiment with the delay & perhaps make it
-             * target-specific
-             */
-            dvmRelativeCondWait(&gDvmJit.compilerQueueActivity,
-                                 &gDvmJit.compilerLock, 3000, 0);
-            dvmUnlockMutex(&gDvmJit.compilerLock);
-        }
-        if (gDvmJit.haltCompilerThread) {
-             return NULL;
-        }
-    }
-
-    compilerThreadStartup();
-
     dvmLockMutex(&gDvmJit.compilerLock);
     /*
      * Since the compiler thread will not touch any objects on the heap once
@@ -726,6 +774,13 @@ static void *compilerThreadStart(void *arg)
     while (!gDvmJit.haltCompilerThread) {
         if (workQueueLength() == 0) {
             int cc;
+            /* Warm-start traces resolved since the queue drained */
+            if (dvmJitWarmCacheHasPending()) {
+                dvmUnlockMutex(&gDvmJit.compilerLock);
+                dvmJitWarmCacheFeed();
+                dvmLockMutex(&gDvmJit.compilerLock);
+                continue;
+            }
             cc = pthread_cond_signal(&gDvmJit.compilerQueueEmpty);
             assert(cc == 0);
             pthread_cond_wait(&gDvmJit.compilerQueueActivity,
@@ -743,6 +798,7 @@ static void *compilerThreadStart(void *arg)
                  */
                 volatile u8 startTime = dvmGetRelativeTimeUsec();
 #endif
+                volatile bool installed = false;
                 /*
                  * Check whether there is a suspend request on me.  This
                  * is necessary to allow a clean shutdown.
@@ -792,12 +848,18 @@ static void *compilerThreadStart(void *arg)
                                               work.result.instructionSet,
                                               false, /* not method entry */
                                               work.result.profileCodeSize);
+                            installed = true;
                         }
                         dvmUnlockMutex(&gDvmJit.compilerLock);
                     }
                     dvmCompilerArenaReset();
                 }
+                if (installed && work.kind == kWorkOrderTrace) {
+                    dvmJitWarmCacheRecord(work.pc,
+                                          (JitTraceDescription *) work.info);
+                }
                 free(work.info);
+                dvmJitWarmCacheFeed();
 #if defined(WITH_JIT_TUNING)
                 gDvmJit.jitTime += dvmGetRelativeTimeUsec() - startTime;
 #endif
@@ -807,6 +869,63 @@ static void *compilerThreadStart(void *arg)
     }
     pthread_cond_signal(&gDvmJit.compilerQueueEmpty);
     dvmUnlockMutex(&gDvmJit.compilerLock);
+}
+
+static void *compilerThreadStart(void *arg)
+{
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+
+    /*
+     * If we're not running stand-alone, wait a little before
+     * recieving translation requests on the assumption that process start
+     * up code isn't worth compiling.  We'll resume when the framework
+     * signals us that the first screen draw has happened, or the timer
+     * below expires (to catch daemons).
+     *
+     * There is a theoretical race between the callback to
+     * VMRuntime.startJitCompiation and when the compiler thread reaches this
+     * point. In case the callback happens earlier, in order not to permanently
+     * hold the system_server (which is not using the timed wait) in
+     * interpreter-only mode we bypass the delay here.
+     */
+    if (gDvmJit.runningInAndroidFramework &&
+        !gDvmJit.alreadyEnabledViaFramework) {
+        /*
+         * If the current VM instance is the system server (detected by having
+         * 0 in gDvm.systemServerPid), we will use the indefinite wait on the
+         * conditional variable to determine whether to start the JIT or not.
+         * If the system server detects that the whole system is booted in
+         * safe mode, the conditional variable will never be signaled and the
+         * system server will remain in the interpreter-only mode. All
+         * subsequent apps will be started with the --enable-safemode flag
+         * explicitly appended.
+         */
+        if (gDvm.systemServerPid == 0) {
+            dvmLockMutex(&gDvmJit.compilerLock);
+            pthread_cond_wait(&gDvmJit.compilerQueueActivity,
+                              &gDvmJit.compilerLock);
+            dvmUnlockMutex(&gDvmJit.compilerLock);
+            ALOGD("JIT started for system_server");
+        } else {
+            dvmLockMutex(&gDvmJit.compilerLock);
+            /*
+             * TUNING: experiment with the delay & perhaps make it
+             * target-specific
+             */
+            dvmRelativeCondWait(&gDvmJit.compilerQueueActivity,
+                                 &gDvmJit.compilerLock, 3000, 0);
+            dvmUnlockMutex(&gDvmJit.compilerLock);
+        }
+        if (gDvmJit.haltCompilerThread) {
+             return NULL;
+        }
+    }
+
+    if (compilerThreadStartup()) {
+        dvmJitWarmCacheStartup();
+        dvmJitWarmCacheFeed();
+        compilerThreadLoop();
+    }
 
     /*
      * As part of detaching the thread we need to call into Java code to update
@@ -832,8 +951,10 @@ bool dvmCompilerStartup(void)
     pthread_cond_init(&gDvmJit.compilerQueueEmpty, NULL);
 
     /* Reset the work queue */
-    gDvmJit.compilerWorkEnqueueIndex = gDvmJit.compilerWorkDequeueIndex = 0;
     gDvmJit.compilerQueueLength = 0;
+    gDvmJit.compilerQueueDropped = 0;
+    gDvmJit.compilerQueueEvicted = 0;
+    gDvmJit.compilerWorkSequence = 0;
     dvmUnlockMutex(&gDvmJit.compilerLock);
 
     /*
@@ -876,7 +997,7 @@ void dvmCompilerShutdown(void)
         gDvmJit.haltCompilerThread = true;
 
         dvmLockMutex(&gDvmJit.compilerLock);
-        pthread_cond_signal(&gDvmJit.compilerQueueActivity);
+        pthread_cond_broadcast(&gDvmJit.compilerQueueActivity);
         dvmUnlockMutex(&gDvmJit.compilerLock);
 
         if (pthread_join(gDvmJit.compilerHandle, &threadReturn) != 0)
@@ -885,6 +1006,8 @@ void dvmCompilerShutdown(void)
             ALOGD("Compiler thread has shut down");
     }
 
+    dvmJitWarmCacheShutdown();
+
     /* Remove all the method contexts */
     MethodContextHandler::eraseMethodMap();
 
@@ -26,6 +26,16 @@
  */
 
 #define COMPILER_WORK_QUEUE_SIZE        100
+
+/* Base priorities of compiler work orders, see dvmCompilerWorkEnqueue */
+#define COMPILER_PRIORITY_CONTROL       10000   /* Profile mode changes */
+#define COMPILER_PRIORITY_TRACE         100
+#define COMPILER_PRIORITY_METHOD        80
+#define COMPILER_PRIORITY_DEBUG         0
+/* Boost for each repeated request of a queued pc */
+#define COMPILER_PRIORITY_HIT_BOOST     50
+/* A waiting order gains one point every (1 << shift) newer orders */
+#define COMPILER_PRIORITY_AGE_SHIFT     2
 #define COMPILER_IC_PATCH_QUEUE_SIZE    64
 #define COMPILER_PC_OFFSET_SIZE         100
 
@@ -39,6 +49,10 @@
 #define PREDICTED_CHAIN_COUNTER_AVOID    0x7fffffff
 /* Rechain after this many misses - shared globally and has to be positive */
 #define PREDICTED_CHAIN_COUNTER_RECHAIN  8192
+/* Maximum number of receiver classes held by a polymorphic inline cache */
+#define POLYMORPHIC_CACHE_MAX_ENTRIES    4
+/* Largest loop unrolling factor accepted by -Xjitunrollfactor */
+#define MAX_UNROLL_FACTOR                16
 
 #define COMPILER_TRACED(X)
 #define COMPILER_TRACEE(X)
@@ -124,6 +138,9 @@ typedef struct CompilerWorkOrder {
     const u2* pc;
     WorkOrderKind kind;
     void* info;
+    int priority;               // Base priority of the kind
+    int hits;                   // Repeated requests while queued
+    unsigned int sequence;      // Enqueue order, used for aging
     JitTranslationInfo result;
     jmp_buf *bailPtr;
 } CompilerWorkOrder;
@@ -231,6 +248,7 @@ bool dvmCompilerStartup(void);
 void dvmCompilerShutdown(void);
 void dvmCompilerForceWorkEnqueue(const u2* pc, WorkOrderKind kind, void* info);
 bool dvmCompilerWorkEnqueue(const u2* pc, WorkOrderKind kind, void* info);
+void dvmCompilerRaiseWorkPriority(const u2* pc, WorkOrderKind kind);
 void *dvmCheckCodeCache(void *method);
 CompilerMethodStats *dvmCompilerAnalyzeMethodBody(const Method *method,
                                                   bool isCallee);
@@ -244,6 +244,50 @@ enum ExtendedMIROpcode {
      */
     kMirOpPackedSet,
 
+    /** @brief Load 128 bits of consecutive array elements into a vector register
+       vA: destination 128-bit vector register
+       vB: array VR
+       vC: index VR of the first element loaded
+       arg[0]: element size (2 bytes, 4 bytes)
+     */
+    kMirOpPackedArrayGet,
+
+    /** @brief Store a vector register into 128 bits of consecutive array elements
+       vA: source 128-bit vector register
+       vB: array VR
+       vC: index VR of the first element stored
+       arg[0]: element size (2 bytes, 4 bytes)
+     */
+    kMirOpPackedArrayPut,
+
+    /** @brief Packed addition of single precision floats in two 128-bit vectorized registers: vA = vA .+ vB
+       vA: destination and source
+       vB: source
+       vC: operands' size (4 bytes)
+     */
+    kMirOpPackedFloatAddition,
+
+    /** @brief Packed subtraction of single precision floats in two 128-bit vectorized registers: vA = vA .- vB
+       vA: destination and source
+       vB: source
+       vC: operands' size (4 bytes)
+     */
+    kMirOpPackedFloatSubtract,
+
+    /** @brief Packed multiply of single precision floats in two 128-bit vectorized registers: vA = vA .* vB
+       vA: destination and source
+       vB: source
+       vC: operands' size (4 bytes)
+     */
+    kMirOpPackedFloatMultiply,
+
+    /** @brief Packed division of single precision floats in two 128-bit vectorized registers: vA = vA ./ vB
+       vA: destination and source
+       vB: source
+       vC: operands' size (4 bytes)
+     */
+    kMirOpPackedFloatDivide,
+
     /**
      * @brief Check if creating frame for target method will cause a stack overflow.
      * @details vB holds size of managed frame for target method.
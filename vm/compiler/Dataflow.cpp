@@ -881,6 +881,24 @@ long long dvmCompilerDataFlowAttributes[kMirOpLast] = {
     //kMirOpPackedSet,
     DF_UB,
 
+    //kMirOpPackedArrayGet,
+    DF_UB | DF_UC,
+
+    //kMirOpPackedArrayPut,
+    DF_UB | DF_UC,
+
+    //kMirOpPackedFloatAddition,
+    DF_NOP,
+
+    //kMirOpPackedFloatSubtract,
+    DF_NOP,
+
+    //kMirOpPackedFloatMultiply,
+    DF_NOP,
+
+    //kMirOpPackedFloatDivide,
+    DF_NOP,
+
     //kMirOpCheckStackOverflow
     DF_NOP,
 };
@@ -1309,6 +1327,35 @@ void dvmCompilerExtendedDisassembler (const CompilationUnit *cUnit,
                           insn->vC);
             }
             break;
+        case kMirOpPackedArrayGet:
+            if (cUnit != NULL && mir != NULL && mir->ssaRep != NULL)
+            {
+                snprintf (buffer, len, "kMirOpPackedArrayGet xmm%d = %s[%s], size %d",
+                          insn->vA,
+                          getSSAName (cUnit, mir->ssaRep->uses[0], operand0),
+                          getSSAName (cUnit, mir->ssaRep->uses[1], operand1),
+                          insn->arg[0]);
+            }
+            else
+            {
+                snprintf (buffer, len, "kMirOpPackedArrayGet xmm%d = v%d[v%d], size %d",
+                          insn->vA, insn->vB, insn->vC, insn->arg[0]);
+            }
+            break;
+        case kMirOpPackedArrayPut:
+            if (cUnit != NULL && mir != NULL && mir->ssaRep != NULL)
+            {
+                snprintf (buffer, len, "kMirOpPackedArrayPut %s[%s] = xmm%d, size %d",
+                          getSSAName (cUnit, mir->ssaRep->uses[0], operand0),
+                          getSSAName (cUnit, mir->ssaRep->uses[1], operand1),
+                          insn->vA, insn->arg[0]);
+            }
+            else
+            {
+                snprintf (buffer, len, "kMirOpPackedArrayPut v%d[v%d] = xmm%d, size %d",
+                          insn->vB, insn->vC, insn->vA, insn->arg[0]);
+            }
+            break;
         case kMirOpConst128b:
             snprintf (buffer, len, "kMirOpConst128DW xmm%d = %x, %x, %x, %x", insn->vA, insn->arg[0], insn->arg[1],
                     insn->arg[2], insn->arg[3]);
@@ -1325,6 +1372,22 @@ void dvmCompilerExtendedDisassembler (const CompilationUnit *cUnit,
             snprintf (buffer, len, "kMirOpPackedSubtract xmm%d = xmm%d - xmm%d, size %d", insn->vA, insn->vA, insn->vB,
                     insn->vC);
             break;
+        case kMirOpPackedFloatAddition:
+            snprintf (buffer, len, "kMirOpPackedFloatAddition xmm%d = xmm%d + xmm%d, size %d", insn->vA, insn->vA,
+                    insn->vB, insn->vC);
+            break;
+        case kMirOpPackedFloatSubtract:
+            snprintf (buffer, len, "kMirOpPackedFloatSubtract xmm%d = xmm%d - xmm%d, size %d", insn->vA, insn->vA,
+                    insn->vB, insn->vC);
+            break;
+        case kMirOpPackedFloatMultiply:
+            snprintf (buffer, len, "kMirOpPackedFloatMultiply xmm%d = xmm%d * xmm%d, size %d", insn->vA, insn->vA,
+                    insn->vB, insn->vC);
+            break;
+        case kMirOpPackedFloatDivide:
+            snprintf (buffer, len, "kMirOpPackedFloatDivide xmm%d = xmm%d / xmm%d, size %d", insn->vA, insn->vA,
+                    insn->vB, insn->vC);
+            break;
         case kMirOpPackedAnd:
             snprintf (buffer, len, "kMirOpPackedAnd xmm%d = xmm%d & xmm%d, size %d", insn->vA, insn->vA, insn->vB,
                     insn->vC);
@@ -0,0 +1,574 @@
+/*
+ * Copyright (C) 2013 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompilerIR.h"
+#include "Dalvik.h"
+#include "Dataflow.h"
+#include "EscapeAnalysis.h"
+#include "LoopInformation.h"
+#include "Pass.h"
+#include "PassDriver.h"
+#include "Utility.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+/**
+ * @class sScalarField
+ * @brief sScalarField describes a field of an allocation replaced by a virtual register
+ */
+typedef struct sScalarField
+{
+    /** @brief Is the field 64-bit wide? */
+    bool isWide;
+
+    /** @brief The scratch register holding the field */
+    int scratch;
+}SScalarField;
+
+/**
+ * @class sEscapeAnalysisData
+ * @brief sEscapeAnalysisData holds the statistics of the pass
+ */
+typedef struct sEscapeAnalysisData
+{
+    /** @brief How many allocations were removed */
+    unsigned int replaced;
+}SEscapeAnalysisData;
+
+/**
+ * @brief Report the decision taken for an allocation
+ * @param cUnit the CompilationUnit
+ * @param allocation the new-instance MIR
+ * @param message the decision or the reason for keeping the allocation
+ */
+static void reportDecision (const CompilationUnit *cUnit, const MIR *allocation, const char *message)
+{
+    if (cUnit->printMe == true || cUnit->printPass == true)
+    {
+        ALOGD ("JIT_INFO: Escape_Analysis for %s%s@0x%02x: %s", cUnit->method->clazz->descriptor,
+                cUnit->method->name, allocation->offset, message);
+    }
+}
+
+/**
+ * @brief Get the field accessed by an instance get or put
+ * @details References are not tracked: the GC would not see them once held by scratch registers only
+ * @param cUnit the CompilationUnit
+ * @param mir the MIR instruction
+ * @param offset updated with the byte offset of the field in the object
+ * @param isWide updated with whether the field is 64-bit wide
+ * @param isSetter updated with whether the instruction is a put
+ * @return whether mir is a non volatile access to a primitive field
+ */
+static bool getFieldAccess (const CompilationUnit *cUnit, const MIR *mir, unsigned int &offset, bool &isWide,
+        bool &isSetter)
+{
+    const DecodedInstruction &insn = mir->dalvikInsn;
+    bool isQuick = false;
+
+    switch (insn.opcode)
+    {
+        case OP_IGET:
+        case OP_IPUT:
+            isWide = false;
+            break;
+        case OP_IGET_WIDE:
+        case OP_IPUT_WIDE:
+            isWide = true;
+            break;
+        case OP_IGET_QUICK:
+        case OP_IPUT_QUICK:
+            isWide = false;
+            isQuick = true;
+            break;
+        case OP_IGET_WIDE_QUICK:
+        case OP_IPUT_WIDE_QUICK:
+            isWide = true;
+            isQuick = true;
+            break;
+        default:
+            return false;
+    }
+
+    isSetter = (dvmCompilerDataFlowAttributes[insn.opcode] & DF_IS_SETTER) != 0;
+
+    //The quick versions hold the offset itself
+    if (isQuick == true)
+    {
+        offset = insn.vC;
+        return true;
+    }
+
+    //The field index is relative to the dex file of the method the bytecode comes from
+    const Method *method = (mir->OptimizationFlags & MIR_CALLEE) != 0 ? mir->meta.calleeMethod : cUnit->method;
+    InstField *field = (InstField *) (method->clazz->pDvmDex->pResFields[insn.vC]);
+
+    if (field == 0 || dvmIsVolatileField (field) == true)
+    {
+        return false;
+    }
+
+    offset = field->byteOffset;
+    return true;
+}
+
+/**
+ * @brief Is the object used as the base of an access and only there?
+ * @param mir the get or put
+ * @param objectSSA the SSA register of the object
+ * @return whether the object is only the last use of mir
+ */
+static bool isAccessBase (const MIR *mir, int objectSSA)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    int last = ssaRep->numUses - 1;
+
+    if (last < 0 || ssaRep->uses[last] != objectSSA)
+    {
+        return false;
+    }
+
+    //Storing the object in itself would make it escape
+    for (int i = 0; i < last; i++)
+    {
+        if (ssaRep->uses[i] == objectSSA)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Can the instruction leave the trace, through an exception or a punt?
+ * @param mir the MIR instruction
+ * @return whether the interpreter or the GC could see the virtual registers at mir
+ */
+static bool mayLeaveTrace (const MIR *mir)
+{
+    int opcode = mir->dalvikInsn.opcode;
+
+    if (opcode == kMirOpPhi)
+    {
+        return false;
+    }
+
+    if (opcode >= kMirOpFirst)
+    {
+        return true;
+    }
+
+    return (dexGetFlagsFromOpcode (static_cast<Opcode> (opcode)) & kInstrCanThrow) != 0;
+}
+
+/**
+ * @brief Is the register of the allocation overwritten before anything can leave the trace?
+ * @details Once the allocation is removed, the register keeps its previous value until it is redefined:
+ * an exception, a punt or the end of the iteration would hand that value to the interpreter or the GC
+ * where an object is expected
+ * @param cUnit the CompilationUnit
+ * @param allocation the new-instance MIR
+ * @param accesses the gets and puts of the object, which become moves
+ * @param toRemove the instructions removed with the allocation
+ * @return the reason the register cannot be left stale, 0 if it can
+ */
+static const char *checkStaleRegister (const CompilationUnit *cUnit, const MIR *allocation,
+        const std::vector<MIR *> &accesses, const std::vector<MIR *> &toRemove)
+{
+    unsigned int vr = allocation->dalvikInsn.vA;
+
+    for (const MIR *mir = allocation->next; mir != 0; mir = mir->next)
+    {
+        bool replaced = std::find (accesses.begin (), accesses.end (), mir) != accesses.end ()
+                || std::find (toRemove.begin (), toRemove.end (), mir) != toRemove.end ();
+
+        if (replaced == false && mayLeaveTrace (mir) == true)
+        {
+            return "an instruction may leave the trace while the register holds no object";
+        }
+
+        SSARepresentation *ssaRep = mir->ssaRep;
+
+        if (ssaRep == 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < ssaRep->numDefs; i++)
+        {
+            if (dvmExtractSSARegister (cUnit, ssaRep->defs[i]) == vr)
+            {
+                return 0;
+            }
+        }
+    }
+
+    return "the register holds the object at the end of the loop body";
+}
+
+/**
+ * @brief Does the allocation have no side effect other than creating the object?
+ * @param cUnit the CompilationUnit
+ * @param allocation the new-instance MIR
+ * @return the reason the allocation must stay, 0 if it can be removed
+ */
+static const char *checkAllocatedClass (const CompilationUnit *cUnit, const MIR *allocation)
+{
+    //The backends look for the class in the cUnit's method
+    if ((allocation->OptimizationFlags & MIR_CALLEE) != 0)
+    {
+        return "the allocation comes from an inlined method";
+    }
+
+    ClassObject *clazz = dvmDexGetResolvedClass (cUnit->method->clazz->pDvmDex, allocation->dalvikInsn.vB);
+
+    if (clazz == 0 || dvmIsClassInitialized (clazz) == false)
+    {
+        return "the class is not initialized";
+    }
+
+    if (dvmIsInterfaceClass (clazz) == true || dvmIsAbstractClass (clazz) == true)
+    {
+        return "the class cannot be instantiated";
+    }
+
+    //The object-init call registers finalizable objects
+    if (IS_CLASS_FLAG_SET (clazz, CLASS_ISFINALIZABLE) == true)
+    {
+        return "the class is finalizable";
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Find the fields of an allocation and the instructions using it
+ * @param cUnit the CompilationUnit
+ * @param allocation the new-instance MIR
+ * @param fields updated with the fields accessed, by offset
+ * @param accesses updated with the gets and puts of the object
+ * @param toRemove updated with the instructions that are useless without the object
+ * @return the reason the object escapes, 0 if it does not
+ */
+static const char *findUses (const CompilationUnit *cUnit, const MIR *allocation,
+        std::map<unsigned int, SScalarField> &fields, std::vector<MIR *> &accesses, std::vector<MIR *> &toRemove)
+{
+    SSARepresentation *ssaRep = allocation->ssaRep;
+
+    //Paranoid
+    if (ssaRep == 0 || ssaRep->numDefs != 1 || ssaRep->usedNext == 0)
+    {
+        return "no def-use information";
+    }
+
+    int objectSSA = ssaRep->defs[0];
+
+    for (SUsedChain *chain = ssaRep->usedNext[0]; chain != 0; chain = chain->nextUse)
+    {
+        MIR *mir = chain->mir;
+
+        //Phi nodes take the object to the next iteration or out of the loop
+        if (mir == 0 || mir->bb != allocation->bb || mir->ssaRep == 0)
+        {
+            return "the object is used outside of its BasicBlock";
+        }
+
+        int opcode = mir->dalvikInsn.opcode;
+
+        //The object is known to be non null and the object-init is a no-op for it
+        if (opcode == kMirOpNullCheck || opcode == OP_INVOKE_OBJECT_INIT_RANGE)
+        {
+            if (mir->ssaRep->numUses != 1)
+            {
+                return "the object escapes through an initialization";
+            }
+
+            toRemove.push_back (mir);
+            continue;
+        }
+
+        unsigned int offset = 0;
+        bool isWide = false;
+        bool isSetter = false;
+
+        if (getFieldAccess (cUnit, mir, offset, isWide, isSetter) == false || isAccessBase (mir, objectSSA) == false)
+        {
+            return "the object escapes";
+        }
+
+        std::map<unsigned int, SScalarField>::iterator it = fields.find (offset);
+
+        if (it == fields.end ())
+        {
+            SScalarField field;
+            field.isWide = isWide;
+            field.scratch = -1;
+            fields[offset] = field;
+        }
+        else
+        {
+            //The same bits accessed in different ways
+            if (it->second.isWide != isWide)
+            {
+                return "a field is accessed with different widths";
+            }
+        }
+
+        accesses.push_back (mir);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Replace a get or a put of a removed object by a move from or to the scratch register of its field
+ * @param cUnit the CompilationUnit
+ * @param mir the get or put
+ * @param fields the fields of the object
+ */
+static void replaceAccess (const CompilationUnit *cUnit, MIR *mir, std::map<unsigned int, SScalarField> &fields)
+{
+    unsigned int offset = 0;
+    bool isWide = false;
+    bool isSetter = false;
+
+    //This was checked when looking at the uses
+    getFieldAccess (cUnit, mir, offset, isWide, isSetter);
+
+    const SScalarField &field = fields[offset];
+    DecodedInstruction &insn = mir->dalvikInsn;
+
+    insn.opcode = (isWide == true) ? OP_MOVE_WIDE : OP_MOVE;
+
+    if (isSetter == true)
+    {
+        insn.vB = insn.vA;
+        insn.vA = field.scratch;
+    }
+    else
+    {
+        insn.vB = field.scratch;
+    }
+
+    insn.vC = 0;
+}
+
+/**
+ * @brief Try to replace the fields of an allocation by scratch registers
+ * @details The object is never built: the register holding it must be overwritten before anything
+ * can leave the trace
+ * @param cUnit the CompilationUnit
+ * @param allocation the new-instance MIR
+ * @param data the statistics of the pass
+ */
+static void replaceAllocation (CompilationUnit *cUnit, MIR *allocation, SEscapeAnalysisData &data)
+{
+    const char *reason = checkAllocatedClass (cUnit, allocation);
+
+    if (reason != 0)
+    {
+        reportDecision (cUnit, allocation, reason);
+        return;
+    }
+
+    std::map<unsigned int, SScalarField> fields;
+    std::vector<MIR *> accesses;
+    std::vector<MIR *> toRemove;
+
+    reason = findUses (cUnit, allocation, fields, accesses, toRemove);
+
+    if (reason == 0)
+    {
+        reason = checkStaleRegister (cUnit, allocation, accesses, toRemove);
+    }
+
+    if (reason != 0)
+    {
+        reportDecision (cUnit, allocation, reason);
+        return;
+    }
+
+    //Check that all fields get their registers before changing anything
+    unsigned int needed = 0;
+
+    for (std::map<unsigned int, SScalarField>::const_iterator it = fields.begin (); it != fields.end (); it++)
+    {
+        needed += (it->second.isWide == true) ? 2 : 1;
+    }
+
+    if (cUnit->numUsedScratchRegisters + needed > dvmCompilerGetMaxScratchRegisters ())
+    {
+        reportDecision (cUnit, allocation, "not enough scratch registers");
+        return;
+    }
+
+    for (std::map<unsigned int, SScalarField>::iterator it = fields.begin (); it != fields.end (); it++)
+    {
+        SScalarField &field = it->second;
+        field.scratch = dvmCompilerGetFreeScratchRegister (cUnit, (field.isWide == true) ? 2 : 1);
+
+        if (field.scratch < 0)
+        {
+            reportDecision (cUnit, allocation, "not enough scratch registers");
+            return;
+        }
+    }
+
+    BasicBlock *bb = allocation->bb;
+
+    //The fields start with their default value, the copies keep the allocation's offset
+    for (std::map<unsigned int, SScalarField>::const_iterator it = fields.begin (); it != fields.end (); it++)
+    {
+        const SScalarField &field = it->second;
+
+        MIR *init = dvmCompilerCopyMIR (allocation);
+        init->dalvikInsn.opcode = (field.isWide == true) ? OP_CONST_WIDE : OP_CONST;
+        init->dalvikInsn.vA = field.scratch;
+        init->dalvikInsn.vB = 0;
+        init->dalvikInsn.vB_wide = 0;
+        dvmCompilerInsertMIRBefore (bb, allocation, init);
+    }
+
+    for (std::vector<MIR *>::const_iterator it = accesses.begin (); it != accesses.end (); it++)
+    {
+        replaceAccess (cUnit, *it, fields);
+    }
+
+    for (std::vector<MIR *>::const_iterator it = toRemove.begin (); it != toRemove.end (); it++)
+    {
+        dvmCompilerRemoveMIR (bb, *it);
+    }
+
+    dvmCompilerRemoveMIR (bb, allocation);
+
+    data.replaced++;
+    reportDecision (cUnit, allocation, "replaced");
+}
+
+/**
+ * @brief Replace the allocations of an innermost loop made of one BasicBlock
+ * @param cUnit the CompilationUnit
+ * @param loopInfo the LoopInformation
+ * @param data the SEscapeAnalysisData
+ * @return true to keep looking at the other loops
+ */
+static bool replaceAllocationsHelper (CompilationUnit *cUnit, LoopInformation *loopInfo, void *data)
+{
+    if (loopInfo->getNested () != 0 || dvmCountSetBits (loopInfo->getBasicBlocks ()) != 1)
+    {
+        return true;
+    }
+
+    BasicBlock *bb = loopInfo->getEntryBlock ();
+
+    //Paranoid
+    if (bb == 0)
+    {
+        return true;
+    }
+
+    //Gather them first, replacing an allocation changes the instruction list
+    std::vector<MIR *> allocations;
+
+    for (MIR *mir = bb->firstMIRInsn; mir != 0; mir = mir->next)
+    {
+        if (mir->dalvikInsn.opcode == OP_NEW_INSTANCE)
+        {
+            allocations.push_back (mir);
+        }
+    }
+
+    for (std::vector<MIR *>::const_iterator it = allocations.begin (); it != allocations.end (); it++)
+    {
+        replaceAllocation (cUnit, *it, *static_cast<SEscapeAnalysisData *> (data));
+    }
+
+    return true;
+}
+
+bool dvmCompilerEscapeAnalysisGate (const CompilationUnit *cUnit, Pass *curPass)
+{
+    return dvmCompilerTraceIsLoopNewSystem (cUnit, curPass) == true && cUnit->loopInformation != 0;
+}
+
+void dvmCompilerEscapeAnalysis (CompilationUnit *cUnit, Pass *pass)
+{
+    (void) pass;
+
+    LoopInformation *info = cUnit->loopInformation;
+
+    //Paranoid
+    if (info == 0)
+    {
+        return;
+    }
+
+    SEscapeAnalysisData data;
+    data.replaced = 0;
+
+    //An exception handler in the method could read the register of an object that was never allocated
+    const DexCode *code = dvmGetMethodCode (cUnit->method);
+
+    if (code != 0 && code->triesSize == 0)
+    {
+        info->iterate (cUnit, replaceAllocationsHelper, &data);
+    }
+
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.escapeAnalysisReplaced += data.replaced;
+#endif
+
+    if ((cUnit->printMe == true || cUnit->printPass == true) && data.replaced > 0)
+    {
+        ALOGD ("JIT_INFO: Escape_Analysis for %s%s@0x%02x: %u allocations replaced",
+                cUnit->method->clazz->descriptor, cUnit->method->name, cUnit->entryBlock->startOffset,
+                data.replaced);
+    }
+}
+
+bool dvmCompilerLoopHasNoAllocation (CompilationUnit *cUnit)
+{
+    GrowableListIterator iterator;
+    dvmGrowableListIteratorInit (&cUnit->blockList, &iterator);
+
+    while (true)
+    {
+        BasicBlock *bb = (BasicBlock *) dvmGrowableListIteratorNext (&iterator);
+
+        if (bb == 0)
+        {
+            break;
+        }
+
+        if (bb->hidden == true)
+        {
+            continue;
+        }
+
+        for (MIR *mir = bb->firstMIRInsn; mir != 0; mir = mir->next)
+        {
+            if (mir->dalvikInsn.opcode == OP_NEW_INSTANCE)
+            {
+                reportDecision (cUnit, mir, "the allocation stays in the loop, leaving loop mode");
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
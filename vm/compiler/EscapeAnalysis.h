@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2013 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DALVIK_VM_ESCAPEANALYSIS_H_
+#define DALVIK_VM_ESCAPEANALYSIS_H_
+
+//Forward declarations
+struct CompilationUnit;
+class Pass;
+
+/**
+ * @brief Gate for the escape analysis pass
+ * @param cUnit the CompilationUnit
+ * @param curPass the Pass
+ * @return whether the trace is a loop formed by the new loop system
+ */
+bool dvmCompilerEscapeAnalysisGate (const CompilationUnit *cUnit, Pass *curPass);
+
+/**
+ * @brief Escape analysis: replace the fields of allocations not escaping a loop by virtual registers
+ * @param cUnit the CompilationUnit
+ * @param pass the Pass
+ */
+void dvmCompilerEscapeAnalysis (CompilationUnit *cUnit, Pass *pass);
+
+/**
+ * @brief Check that a loop no longer allocates objects
+ * @details The loop formation accepts new-instance, the backends do not: this runs after the passes,
+ * whether or not the escape analysis was applied
+ * @param cUnit the CompilationUnit
+ * @return whether no allocation remains in the loop
+ */
+bool dvmCompilerLoopHasNoAllocation (CompilationUnit *cUnit);
+
+#endif
@@ -0,0 +1,771 @@
+/*
+ * Copyright (C) 2013 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompilerIR.h"
+#include "Dalvik.h"
+#include "Dataflow.h"
+#include "GlobalValueNumbering.h"
+#include "Pass.h"
+#include "PassDriver.h"
+#include "Utility.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+/**
+ * @class sValueNumberingKey
+ * @brief sValueNumberingKey represents the value computed by an instruction
+ */
+typedef struct sValueNumberingKey
+{
+    /** @brief The instruction's opcode */
+    int opcode;
+    /** @brief The value numbers of the instruction's uses */
+    std::vector<int> uses;
+    /** @brief The constant used in the instruction */
+    long long constant;
+
+    /**
+     * @brief Redefining the < operator for use in the maps
+     * @param b the other sValueNumberingKey
+     * @return whether a < b
+     */
+    bool operator< (const struct sValueNumberingKey &b) const
+    {
+        //Order of the tests: opcode first, constant second, uses third
+        if (opcode != b.opcode)
+        {
+            return opcode < b.opcode;
+        }
+
+        if (constant != b.constant)
+        {
+            return constant < b.constant;
+        }
+
+        return uses < b.uses;
+    }
+}SValueNumberingKey;
+
+/**
+ * @brief The different ways an instruction takes part in value numbering
+ */
+enum ValueNumberingKind
+{
+    kNotNumbered,       /**< @brief The instruction defines a new value */
+    kNumberedMove,      /**< @brief The instruction copies a value */
+    kNumberedConstant,  /**< @brief The instruction sets a constant: numbered but never replaced */
+    kNumberedPure,      /**< @brief The instruction computes a value from its uses only */
+    kNumberedLoad       /**< @brief The instruction loads a value from memory */
+};
+
+/**
+ * @class sValueNumberingData
+ * @brief sValueNumberingData holds the state of the pass during the walk of the dominator tree
+ */
+typedef struct sValueNumberingData
+{
+    /** @brief The value number of each SSA register */
+    std::vector<int> valueNumbers;
+
+    /** @brief The pure computations available in the dominators of the current BasicBlock */
+    std::map<SValueNumberingKey, MIR *> available;
+
+    /** @brief How many instructions were replaced */
+    unsigned int replaced;
+
+    /** @brief How many of the replaced instructions were loads */
+    unsigned int replacedLoads;
+}SValueNumberingData;
+
+/**
+ * @brief Is the opcode a volatile memory access?
+ * @param opcode the opcode
+ * @return whether the opcode is a volatile get or put
+ */
+static bool isVolatileAccess (int opcode)
+{
+    switch (opcode)
+    {
+        case OP_IGET_VOLATILE:
+        case OP_IPUT_VOLATILE:
+        case OP_SGET_VOLATILE:
+        case OP_SPUT_VOLATILE:
+        case OP_IGET_OBJECT_VOLATILE:
+        case OP_IGET_WIDE_VOLATILE:
+        case OP_IPUT_WIDE_VOLATILE:
+        case OP_SGET_WIDE_VOLATILE:
+        case OP_SPUT_WIDE_VOLATILE:
+        case OP_IPUT_OBJECT_VOLATILE:
+        case OP_SGET_OBJECT_VOLATILE:
+        case OP_SPUT_OBJECT_VOLATILE:
+            return true;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Get the field accessed by an instance or static get or put
+ * @param cUnit the CompilationUnit
+ * @param mir the MIR instruction
+ * @param isStatic whether the instruction is an sget or an sput
+ * @return the address of the static field or the byte offset of the instance field, 0 if unknown
+ */
+static uintptr_t getFieldKey (const CompilationUnit *cUnit, const MIR *mir, bool isStatic)
+{
+    const DecodedInstruction &insn = mir->dalvikInsn;
+
+    //The quick versions hold the offset itself
+    if (insn.opcode >= OP_IGET_QUICK && insn.opcode <= OP_IPUT_OBJECT_QUICK)
+    {
+        return insn.vC;
+    }
+
+    //The field index is relative to the dex file of the method the bytecode comes from
+    const Method *method = (mir->OptimizationFlags & MIR_CALLEE) != 0 ? mir->meta.calleeMethod : cUnit->method;
+    Field *field = method->clazz->pDvmDex->pResFields[(isStatic == true) ? insn.vB : insn.vC];
+
+    if (field == 0)
+    {
+        return 0;
+    }
+
+    //Two field indices can resolve to the same field
+    return (isStatic == true) ? reinterpret_cast<uintptr_t> (field)
+                              : static_cast<uintptr_t> (reinterpret_cast<InstField *> (field)->byteOffset);
+}
+
+/**
+ * @brief Get the SSA register of the constant an instruction uses, if its definition is known
+ * @param mir the MIR instruction
+ * @param useIndex the index of the use
+ * @param value updated with the constant
+ * @return whether the use is a 32-bit constant
+ */
+static bool getConstantUse (const MIR *mir, int useIndex, int &value)
+{
+    const SSARepresentation *ssaRep = mir->ssaRep;
+
+    if (ssaRep->defWhere == 0 || ssaRep->defWhere[useIndex] == 0)
+    {
+        return false;
+    }
+
+    int highConst = 0;
+    bool isWide = false;
+
+    return dexGetConstant (ssaRep->defWhere[useIndex]->dalvikInsn, value, highConst, isWide) == true
+        && isWide == false;
+}
+
+/**
+ * @brief Does the instruction invalidate every load we know about?
+ * @param mir the MIR instruction
+ * @return whether the instruction may write memory in a way the aliasing colors do not describe
+ */
+static bool isMemoryBarrier (const MIR *mir)
+{
+    int opcode = mir->dalvikInsn.opcode;
+
+    //Extended MIRs can do anything, except for the phi nodes
+    if (opcode >= static_cast<int> (kMirOpFirst))
+    {
+        return opcode != static_cast<int> (kMirOpPhi);
+    }
+
+    long long dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+
+    if ( (dfAttributes & (DF_IS_CALL | DF_CLOBBERS_MEMORY)) != 0)
+    {
+        return true;
+    }
+
+    if ( (dvmCompilerGetOpcodeFlags (opcode) & kInstrInvoke) != 0)
+    {
+        return true;
+    }
+
+    //Fill array data writes in an array without being a setter
+    return opcode == OP_FILL_ARRAY_DATA || isVolatileAccess (opcode) == true;
+}
+
+/**
+ * @brief May the setter write the memory read by the load?
+ * @details Objects and arrays are only known through SSA registers, and two registers may hold the same one:
+ * accesses are only told apart by their field, the type of the array or, for the same array, a different
+ * constant index
+ * @param cUnit the CompilationUnit
+ * @param setter the setter MIR
+ * @param load the load MIR
+ * @return whether the load must be forgotten
+ */
+static bool mayClobber (const CompilationUnit *cUnit, const MIR *setter, const MIR *load)
+{
+    int setterOpcode = setter->dalvikInsn.opcode;
+    int loadOpcode = load->dalvikInsn.opcode;
+
+    //Array accesses: the gets and puts are in the same order of element types
+    bool setterIsArray = (setterOpcode >= OP_APUT && setterOpcode <= OP_APUT_SHORT);
+    bool loadIsArray = (loadOpcode >= OP_AGET && loadOpcode <= OP_AGET_SHORT);
+
+    if (setterIsArray == true || loadIsArray == true)
+    {
+        if (setterIsArray != loadIsArray || setterOpcode - OP_APUT != loadOpcode - OP_AGET)
+        {
+            return false;
+        }
+
+        //The array and the index are the last two uses
+        const SSARepresentation *setterSSARep = setter->ssaRep;
+        const SSARepresentation *loadSSARep = load->ssaRep;
+        int setterArray = setterSSARep->numUses - 2;
+        int loadArray = loadSSARep->numUses - 2;
+
+        //Paranoid
+        if (setterArray < 0 || loadArray < 0)
+        {
+            return true;
+        }
+
+        if (setterSSARep->uses[setterArray] != loadSSARep->uses[loadArray])
+        {
+            return true;
+        }
+
+        int setterIndex = 0, loadIndex = 0;
+
+        if (getConstantUse (setter, setterArray + 1, setterIndex) == false
+                || getConstantUse (load, loadArray + 1, loadIndex) == false)
+        {
+            return true;
+        }
+
+        return setterIndex == loadIndex;
+    }
+
+    bool setterIsStatic = (setterOpcode >= OP_SGET && setterOpcode <= OP_SPUT_SHORT);
+    bool loadIsStatic = (loadOpcode >= OP_SGET && loadOpcode <= OP_SPUT_SHORT);
+
+    //An instance field and a static field are different memory
+    if (setterIsStatic != loadIsStatic)
+    {
+        return false;
+    }
+
+    uintptr_t setterField = getFieldKey (cUnit, setter, setterIsStatic);
+    uintptr_t loadField = getFieldKey (cUnit, load, loadIsStatic);
+
+    return setterField == 0 || loadField == 0 || setterField == loadField;
+}
+
+/**
+ * @brief Find how the instruction takes part in value numbering
+ * @param mir the MIR instruction
+ * @return the ValueNumberingKind of the instruction
+ */
+static ValueNumberingKind getValueNumberingKind (const MIR *mir)
+{
+    int opcode = mir->dalvikInsn.opcode;
+
+    if (mir->ssaRep == 0 || opcode >= static_cast<int> (kMirOpFirst))
+    {
+        return kNotNumbered;
+    }
+
+    long long dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+
+    //We only number instructions defining a value
+    if ( (dfAttributes & DF_HAS_DEFS) == 0 || mir->ssaRep->numDefs == 0)
+    {
+        return kNotNumbered;
+    }
+
+    if ( (dfAttributes & DF_IS_MOVE) != 0)
+    {
+        return kNumberedMove;
+    }
+
+    if ( (dfAttributes & DF_SETS_CONST) != 0)
+    {
+        return kNumberedConstant;
+    }
+
+    if ( (dfAttributes & DF_IS_GETTER) != 0)
+    {
+        return (isVolatileAccess (opcode) == true) ? kNotNumbered : kNumberedLoad;
+    }
+
+    //Comparisons, unary and binary operations only depend on their uses
+    if ( (opcode >= OP_CMPL_FLOAT && opcode <= OP_CMP_LONG) || (opcode >= OP_NEG_INT && opcode <= OP_USHR_INT_LIT8)
+            || opcode == OP_ARRAY_LENGTH)
+    {
+        return kNumberedPure;
+    }
+
+    return kNotNumbered;
+}
+
+/**
+ * @brief Build the key representing the value computed by an instruction
+ * @param mir the MIR instruction
+ * @param valueNumbers the value numbers of the SSA registers
+ * @param key the SValueNumberingKey to fill
+ */
+static void buildKey (const MIR *mir, const std::vector<int> &valueNumbers, SValueNumberingKey &key)
+{
+    const DecodedInstruction &insn = mir->dalvikInsn;
+    int opcode = insn.opcode;
+    long long dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+
+    key.opcode = opcode;
+    key.constant = 0;
+    key.uses.clear ();
+
+    //Constants are compared by value, whatever the size of their encoding
+    int lowConst = 0, highConst = 0;
+    bool isWide = false;
+
+    if (dexGetConstant (insn, lowConst, highConst, isWide) == true)
+    {
+        key.opcode = (isWide == true) ? OP_CONST_WIDE : OP_CONST;
+        key.constant = (static_cast<long long> (highConst) << 32) | static_cast<unsigned int> (lowConst);
+        return;
+    }
+
+    if ( (dfAttributes & DF_IS_GETTER) != 0)
+    {
+        //The field is vB for static fields and vC for instance fields
+        if ( (dfAttributes & DF_B_IS_REG) == 0)
+        {
+            key.constant = insn.vB;
+        }
+        else if ( (dfAttributes & DF_C_IS_REG) == 0)
+        {
+            key.constant = insn.vC;
+        }
+    }
+    else if ( (dfAttributes & DF_C_IS_CONST) != 0)
+    {
+        key.constant = insn.vC;
+    }
+
+    SSARepresentation *ssaRep = mir->ssaRep;
+
+    for (int i = 0; i < ssaRep->numUses; i++)
+    {
+        key.uses.push_back (valueNumbers[ssaRep->uses[i]]);
+    }
+
+    //Commutative integer operations get a canonical order of operands
+    switch (opcode)
+    {
+        case OP_ADD_INT:
+        case OP_MUL_INT:
+        case OP_AND_INT:
+        case OP_OR_INT:
+        case OP_XOR_INT:
+            if (key.uses[0] > key.uses[1])
+            {
+                std::swap (key.uses[0], key.uses[1]);
+            }
+            break;
+        case OP_ADD_LONG:
+        case OP_MUL_LONG:
+        case OP_AND_LONG:
+        case OP_OR_LONG:
+        case OP_XOR_LONG:
+            if (key.uses[0] > key.uses[2] || (key.uses[0] == key.uses[2] && key.uses[1] > key.uses[3]))
+            {
+                std::swap (key.uses[0], key.uses[2]);
+                std::swap (key.uses[1], key.uses[3]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Is a definition of the instruction merged by a phi node?
+ * @details Replacing such a definition would hide loop-carried values such as induction variables
+ * @param mir the MIR instruction
+ * @return whether one of the definitions is used by a phi node
+ */
+static bool feedsPhi (const MIR *mir)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+
+    if (ssaRep->usedNext == 0)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < ssaRep->numDefs; i++)
+    {
+        for (SUsedChain *chain = ssaRep->usedNext[i]; chain != 0; chain = chain->nextUse)
+        {
+            if (chain->mir != 0 && chain->mir->dalvikInsn.opcode == static_cast<Opcode> (kMirOpPhi))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Does a virtual register still hold the value defined by the leader when reaching mir?
+ * @details In the leader's BasicBlock, the instructions between both are checked. Otherwise the
+ * register must only be defined by the leader's BasicBlock, and last by the leader, for the value
+ * to survive until any instruction the leader dominates.
+ * @param cUnit the CompilationUnit
+ * @param leader the MIR defining the value
+ * @param mir the MIR which would use the value
+ * @param vr the virtual register
+ * @param ssaReg the SSA register the leader defines in vr
+ * @return whether vr holds ssaReg when executing mir
+ */
+static bool holdsValue (const CompilationUnit *cUnit, const MIR *leader, const MIR *mir, unsigned int vr, int ssaReg)
+{
+    BasicBlock *leaderBB = leader->bb;
+
+    if (leaderBB != mir->bb)
+    {
+        if (static_cast<int> (vr) >= cUnit->defBlockMatrixSize || cUnit->defBlockMatrix == 0)
+        {
+            return false;
+        }
+
+        //Only the leader's BasicBlock may define the register
+        BitVector *defBlocks = cUnit->defBlockMatrix[vr];
+
+        if (dvmCountSetBits (defBlocks) != 1 || dvmIsBitSet (defBlocks, leaderBB->id) == false)
+        {
+            return false;
+        }
+    }
+
+    //Now check the instructions after the leader: in its BasicBlock up to mir, or to the end
+    for (const MIR *current = leader->next; current != 0 && current != mir; current = current->next)
+    {
+        SSARepresentation *ssaRep = current->ssaRep;
+
+        if (ssaRep == 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < ssaRep->numDefs; i++)
+        {
+            if (ssaRep->defs[i] != ssaReg
+                    && dvmExtractSSARegister (cUnit, ssaRep->defs[i]) == vr)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Replace an instruction by a move from the register holding the same value
+ * @param cUnit the CompilationUnit
+ * @param bb the BasicBlock containing mir
+ * @param mir the redundant MIR instruction
+ * @param leader the MIR that computed the value first
+ * @return whether mir was replaced or removed
+ */
+static bool replaceRedundantInstruction (CompilationUnit *cUnit, BasicBlock *bb, MIR *mir, MIR *leader)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    SSARepresentation *leaderSSARep = leader->ssaRep;
+
+    //Paranoid
+    if (ssaRep->numDefs != leaderSSARep->numDefs || ssaRep->numDefs > 2)
+    {
+        return false;
+    }
+
+    //Hiding a loop-carried value would hinder the loop optimizations
+    if (feedsPhi (mir) == true)
+    {
+        return false;
+    }
+
+    bool isWide = (ssaRep->numDefs == 2);
+    unsigned int sourceVR = dvmExtractSSARegister (cUnit, leaderSSARep->defs[0]);
+    unsigned int destVR = mir->dalvikInsn.vA;
+
+    //Both halves of the value must still be available
+    for (int i = 0; i < leaderSSARep->numDefs; i++)
+    {
+        if (holdsValue (cUnit, leader, mir, sourceVR + i, leaderSSARep->defs[i]) == false)
+        {
+            return false;
+        }
+    }
+
+    //The register already holds the value: the instruction is useless
+    if (sourceVR == destVR)
+    {
+        return dvmCompilerRemoveMIR (bb, mir);
+    }
+
+    //Do not rely on the backend handling partially overlapping wide moves
+    if (isWide == true && (sourceVR + 1 == destVR || destVR + 1 == sourceVR))
+    {
+        return false;
+    }
+
+    DecodedInstruction &insn = mir->dalvikInsn;
+
+    switch (insn.opcode)
+    {
+        case OP_IGET_OBJECT:
+        case OP_IGET_OBJECT_QUICK:
+        case OP_AGET_OBJECT:
+        case OP_SGET_OBJECT:
+            insn.opcode = OP_MOVE_OBJECT;
+            break;
+        default:
+            insn.opcode = (isWide == true) ? OP_MOVE_WIDE : OP_MOVE;
+            break;
+    }
+
+    insn.vB = sourceVR;
+    insn.vC = 0;
+
+    return true;
+}
+
+/**
+ * @brief Apply value numbering to a BasicBlock
+ * @param cUnit the CompilationUnit
+ * @param bb the BasicBlock
+ * @param data the state of the pass
+ * @param undo updated with the previous entries of the available computations this BasicBlock changed
+ */
+static void handleBasicBlock (CompilationUnit *cUnit, BasicBlock *bb, SValueNumberingData &data,
+        std::vector<std::pair<SValueNumberingKey, MIR *> > &undo)
+{
+    //Loads are only known inside the BasicBlock
+    std::map<SValueNumberingKey, MIR *> loads;
+
+    SValueNumberingKey key;
+
+    MIR *next = 0;
+    for (MIR *mir = bb->firstMIRInsn; mir != 0; mir = next)
+    {
+        next = mir->next;
+
+        //First forget the loads the instruction may invalidate
+        if (isMemoryBarrier (mir) == true)
+        {
+            loads.clear ();
+        }
+        else if (mir->ssaRep != 0 && (dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode] & DF_IS_SETTER) != 0)
+        {
+            for (std::map<SValueNumberingKey, MIR *>::iterator it = loads.begin (); it != loads.end ();)
+            {
+                if (mayClobber (cUnit, mir, it->second) == true)
+                {
+                    loads.erase (it++);
+                }
+                else
+                {
+                    it++;
+                }
+            }
+        }
+
+        ValueNumberingKind kind = getValueNumberingKind (mir);
+
+        if (kind == kNotNumbered)
+        {
+            continue;
+        }
+
+        SSARepresentation *ssaRep = mir->ssaRep;
+
+        //A move just forwards the value numbers
+        if (kind == kNumberedMove)
+        {
+            for (int i = 0; i < ssaRep->numDefs && i < ssaRep->numUses; i++)
+            {
+                data.valueNumbers[ssaRep->defs[i]] = data.valueNumbers[ssaRep->uses[i]];
+            }
+            continue;
+        }
+
+        buildKey (mir, data.valueNumbers, key);
+
+        std::map<SValueNumberingKey, MIR *> &table = (kind == kNumberedLoad) ? loads : data.available;
+        std::map<SValueNumberingKey, MIR *>::iterator it = table.find (key);
+
+        if (it == table.end ())
+        {
+            //A new value: the instruction becomes its leader
+            table[key] = mir;
+
+            if (kind != kNumberedLoad)
+            {
+                undo.push_back (std::make_pair (key, static_cast<MIR *> (0)));
+            }
+            continue;
+        }
+
+        MIR *leader = it->second;
+        SSARepresentation *leaderSSARep = leader->ssaRep;
+
+        //Paranoid
+        if (leaderSSARep->numDefs != ssaRep->numDefs)
+        {
+            continue;
+        }
+
+        //Whatever we do, the instruction computes the same value as the leader
+        for (int i = 0; i < ssaRep->numDefs; i++)
+        {
+            data.valueNumbers[ssaRep->defs[i]] = data.valueNumbers[leaderSSARep->defs[i]];
+        }
+
+        //Constants are as cheap as moves
+        if (kind == kNumberedConstant)
+        {
+            continue;
+        }
+
+        if (replaceRedundantInstruction (cUnit, bb, mir, leader) == true)
+        {
+            data.replaced++;
+
+            if (kind == kNumberedLoad)
+            {
+                data.replacedLoads++;
+            }
+
+            PASS_LOG (ALOGD, cUnit, "Global_Value_Numbering: instruction at 0x%02x is redundant with 0x%02x",
+                    mir->offset, leader->offset);
+        }
+        else
+        {
+            //The leader's register is no longer usable: the instruction takes over
+            if (kind != kNumberedLoad)
+            {
+                undo.push_back (std::make_pair (key, leader));
+            }
+            it->second = mir;
+        }
+    }
+}
+
+/**
+ * @brief Walk the dominator tree: computations available in a BasicBlock are available in the ones it dominates
+ * @param cUnit the CompilationUnit
+ * @param bb the BasicBlock
+ * @param data the state of the pass
+ */
+static void walkDominatorTree (CompilationUnit *cUnit, BasicBlock *bb, SValueNumberingData &data)
+{
+    //Remember what we change in the available computations to restore them when leaving the BasicBlock
+    std::vector<std::pair<SValueNumberingKey, MIR *> > undo;
+
+    if (bb->blockType == kDalvikByteCode && bb->hidden == false)
+    {
+        handleBasicBlock (cUnit, bb, data, undo);
+    }
+
+    if (bb->iDominated != 0)
+    {
+        BitVectorIterator bvIterator;
+        dvmBitVectorIteratorInit (bb->iDominated, &bvIterator);
+
+        while (true)
+        {
+            int idx = dvmBitVectorIteratorNext (&bvIterator);
+
+            if (idx == -1)
+            {
+                break;
+            }
+
+            BasicBlock *dominated = (BasicBlock *) dvmGrowableListGetElement (&cUnit->blockList, idx);
+
+            if (dominated != 0 && dominated != bb)
+            {
+                walkDominatorTree (cUnit, dominated, data);
+            }
+        }
+    }
+
+    //Restore the available computations in reverse order
+    for (std::vector<std::pair<SValueNumberingKey, MIR *> >::reverse_iterator it = undo.rbegin ();
+            it != undo.rend (); it++)
+    {
+        if (it->second == 0)
+        {
+            data.available.erase (it->first);
+        }
+        else
+        {
+            data.available[it->first] = it->second;
+        }
+    }
+}
+
+bool dvmCompilerGlobalValueNumberingGate (const CompilationUnit *cUnit, Pass *curPass)
+{
+    (void) curPass;
+
+    //We need the dominator tree and the def-use chains
+    return cUnit->entryBlock != 0 && cUnit->entryBlock->iDominated != 0 && cUnit->numSSARegs > 0;
+}
+
+void dvmCompilerGlobalValueNumbering (CompilationUnit *cUnit, Pass *pass)
+{
+    (void) pass;
+
+    SValueNumberingData data;
+    data.replaced = 0;
+    data.replacedLoads = 0;
+
+    //Each SSA register starts as its own value
+    data.valueNumbers.resize (cUnit->numSSARegs);
+
+    for (int i = 0; i < cUnit->numSSARegs; i++)
+    {
+        data.valueNumbers[i] = i;
+    }
+
+    walkDominatorTree (cUnit, cUnit->entryBlock, data);
+
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.valueNumberingReplaced += data.replaced;
+    gDvmJit.valueNumberingReplacedLoads += data.replacedLoads;
+#endif
+
+    if (cUnit->printMe == true || cUnit->printPass == true)
+    {
+        ALOGD ("JIT_INFO: Global_Value_Numbering for %s%s@0x%02x: %u redundant instructions, %u of them loads",
+                cUnit->method->clazz->descriptor, cUnit->method->name, cUnit->entryBlock->startOffset,
+                data.replaced, data.replacedLoads);
+    }
+}
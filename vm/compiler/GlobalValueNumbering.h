@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2013 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DALVIK_VM_GLOBALVALUENUMBERING_H_
+#define DALVIK_VM_GLOBALVALUENUMBERING_H_
+
+//Forward declarations
+struct CompilationUnit;
+class Pass;
+
+/**
+ * @brief Gate for the global value numbering pass
+ * @param cUnit the CompilationUnit
+ * @param curPass the Pass
+ * @return whether the trace has the domination information the pass relies on
+ */
+bool dvmCompilerGlobalValueNumberingGate (const CompilationUnit *cUnit, Pass *curPass);
+
+/**
+ * @brief Global value numbering: replace redundant computations and loads by moves
+ * @param cUnit the CompilationUnit
+ * @param pass the Pass
+ */
+void dvmCompilerGlobalValueNumbering (CompilationUnit *cUnit, Pass *pass);
+
+#endif
@@ -1632,6 +1632,18 @@ const char* dvmCompilerGetOpcodeName (int opcode)
                 return "kMirOpPackedAddReduce";
             case kMirOpPackedSet:
                 return "kMirOpPackedSet";
+            case kMirOpPackedArrayGet:
+                return "kMirOpPackedArrayGet";
+            case kMirOpPackedArrayPut:
+                return "kMirOpPackedArrayPut";
+            case kMirOpPackedFloatAddition:
+                return "kMirOpPackedFloatAddition";
+            case kMirOpPackedFloatSubtract:
+                return "kMirOpPackedFloatSubtract";
+            case kMirOpPackedFloatMultiply:
+                return "kMirOpPackedFloatMultiply";
+            case kMirOpPackedFloatDivide:
+                return "kMirOpPackedFloatDivide";
             case kMirOpCheckStackOverflow:
                 return "kMirOpCheckStackOverflow";
             case kMirOpPackedSubtract:
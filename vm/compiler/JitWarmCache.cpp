@@ -0,0 +1,613 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * JIT warm-start cache.
+ *
+ * Translations cannot outlive the process: the code generators embed the
+ * absolute addresses of helpers, class objects and chaining cells without
+ * keeping relocation records for them. What does carry over is the result
+ * of trace selection. Every installed trace is recorded as the class,
+ * method and code runs it was built from, and the set is written to the
+ * file named by -Xjitwarmcache. On the next start the traces whose dex file
+ * checksum still matches are resolved and queued for compilation right away,
+ * instead of waiting for the profile table to rediscover them. Traces of
+ * classes that are initialized later are resolved when their class is.
+ *
+ * Only the compiler thread issues the resolved work orders. The file is
+ * written by a separate writer thread so that compilation never waits on
+ * the disk.
+ *
+ * File layout (native byte order):
+ *   header  magic "dvjw", format version, VM version, number of traces,
+ *           adler32 of everything following the header
+ *   trace   dex checksum (u4), class descriptor, method name and method
+ *           descriptor (each a u2 length followed by the bytes), number of
+ *           runs (u2), then per run: start offset (u2), length (u1), hint (u1)
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Dalvik.h"
+#include "interp/Jit.h"
+#include "CompilerInternals.h"
+#include "JitWarmCache.h"
+
+#define WARM_CACHE_MAGIC            "dvjw"
+#define WARM_CACHE_FORMAT_VERSION   1
+#define WARM_CACHE_VM_VERSION       ((DALVIK_MAJOR_VERSION << 16) | \
+                                     (DALVIK_MINOR_VERSION << 8) | \
+                                     DALVIK_BUG_VERSION)
+
+/* Rewrite the file once this many new traces have been recorded */
+#define WARM_CACHE_SAVE_INTERVAL    64
+
+struct WarmCacheHeader {
+    char magic[4];
+    u4 formatVersion;
+    u4 vmVersion;
+    u4 numTraces;
+    u4 checksum;
+};
+
+struct WarmTrace {
+    u4 dexChecksum;
+    std::string classDescriptor;
+    std::string methodName;
+    std::string methodDescriptor;
+    std::vector<JitCodeDesc> runs;
+};
+
+/* A resolved trace waiting for room in the compiler work queue */
+struct WarmOrder {
+    const u2* pc;
+    JitTraceDescription* desc;
+};
+
+typedef std::multimap<std::string, const WarmTrace*> WarmTracesByClass;
+
+static struct {
+    pthread_mutex_t lock;
+    bool enabled;
+    /* Known traces, keyed by method and start offset */
+    std::map<std::string, WarmTrace> traces;
+    /* Loaded traces whose class has not been initialized yet */
+    WarmTracesByClass unresolved;
+    int numUnsaved;
+    std::vector<WarmOrder> pending;
+    /* Sizes of the two above, for the checks made without the lock */
+    volatile int32_t numUnresolved;
+    volatile int32_t numPending;
+
+    /* Writer thread, woken when enough traces are unsaved or on shutdown */
+    bool hasWriter;
+    bool writerStop;
+    pthread_cond_t writerCond;
+    pthread_t writerHandle;
+} gWarmCache;
+
+static std::string traceKey(const WarmTrace& trace)
+{
+    char offset[16];
+    snprintf(offset, sizeof(offset), "@%u", trace.runs[0].startOffset);
+    return trace.classDescriptor + "." + trace.methodName +
+           trace.methodDescriptor + offset;
+}
+
+static void appendBytes(std::vector<u1>& buf, const void* data, size_t len)
+{
+    const u1* bytes = (const u1*) data;
+    buf.insert(buf.end(), bytes, bytes + len);
+}
+
+static void appendString(std::vector<u1>& buf, const std::string& str)
+{
+    u2 len = str.length();
+    appendBytes(buf, &len, sizeof(len));
+    appendBytes(buf, str.data(), len);
+}
+
+/*
+ * Bounds-checked reader over the body of the file.
+ */
+struct WarmCacheReader {
+    const u1* ptr;
+    const u1* end;
+
+    bool read(void* dst, size_t len) {
+        if ((size_t) (end - ptr) < len) {
+            return false;
+        }
+        memcpy(dst, ptr, len);
+        ptr += len;
+        return true;
+    }
+
+    bool readString(std::string* str) {
+        u2 len;
+        if (!read(&len, sizeof(len)) || (size_t) (end - ptr) < len) {
+            return false;
+        }
+        str->assign((const char*) ptr, len);
+        ptr += len;
+        return true;
+    }
+};
+
+/*
+ * Build the file image of all known traces.
+ * Must be called with gWarmCache.lock held.
+ */
+static void serializeWarmCache(std::vector<u1>* image)
+{
+    std::vector<u1> body;
+    std::map<std::string, WarmTrace>::const_iterator it;
+
+    for (it = gWarmCache.traces.begin(); it != gWarmCache.traces.end(); it++) {
+        const WarmTrace& trace = it->second;
+        u2 numRuns = trace.runs.size();
+
+        appendBytes(body, &trace.dexChecksum, sizeof(trace.dexChecksum));
+        appendString(body, trace.classDescriptor);
+        appendString(body, trace.methodName);
+        appendString(body, trace.methodDescriptor);
+        appendBytes(body, &numRuns, sizeof(numRuns));
+        for (size_t i = 0; i < trace.runs.size(); i++) {
+            u2 startOffset = trace.runs[i].startOffset;
+            u1 numInsts = trace.runs[i].numInsts;
+            u1 hint = trace.runs[i].hint;
+            appendBytes(body, &startOffset, sizeof(startOffset));
+            appendBytes(body, &numInsts, sizeof(numInsts));
+            appendBytes(body, &hint, sizeof(hint));
+        }
+    }
+
+    WarmCacheHeader header;
+    memcpy(header.magic, WARM_CACHE_MAGIC, sizeof(header.magic));
+    header.formatVersion = WARM_CACHE_FORMAT_VERSION;
+    header.vmVersion = WARM_CACHE_VM_VERSION;
+    header.numTraces = gWarmCache.traces.size();
+    header.checksum = adler32(adler32(0L, Z_NULL, 0),
+                              body.empty() ? NULL : &body[0], body.size());
+
+    image->clear();
+    appendBytes(*image, &header, sizeof(header));
+    image->insert(image->end(), body.begin(), body.end());
+}
+
+/*
+ * Write a file image to a temporary file and move it over the cache.
+ * Does file I/O, so it's called without gWarmCache.lock held.
+ */
+static bool writeWarmCache(const std::vector<u1>& image)
+{
+    std::string tmpPath = std::string(gDvmJit.warmCachePath) + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        ALOGW("Unable to create JIT warm cache '%s': %s", tmpPath.c_str(),
+              strerror(errno));
+        return false;
+    }
+    bool success =
+        sysWriteFully(fd, &image[0], image.size(), "JIT warm cache") == 0;
+    close(fd);
+
+    if (!success || rename(tmpPath.c_str(), gDvmJit.warmCachePath) != 0) {
+        ALOGW("Unable to update JIT warm cache '%s'", gDvmJit.warmCachePath);
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Entry point for the writer thread. Saves the cache whenever
+ * WARM_CACHE_SAVE_INTERVAL new traces have been recorded, and once more
+ * when asked to stop. The image is built under the lock and written
+ * outside it, so recording never waits on the disk.
+ */
+static void* warmCacheWriterThread(void* arg)
+{
+    std::vector<u1> image;
+
+    dvmLockMutex(&gWarmCache.lock);
+    while (true) {
+        while (!gWarmCache.writerStop &&
+               gWarmCache.numUnsaved < WARM_CACHE_SAVE_INTERVAL) {
+            pthread_cond_wait(&gWarmCache.writerCond, &gWarmCache.lock);
+        }
+        if (gWarmCache.numUnsaved == 0) {
+            break;
+        }
+        bool stopping = gWarmCache.writerStop;
+        int numSaved = gWarmCache.numUnsaved;
+        serializeWarmCache(&image);
+        dvmUnlockMutex(&gWarmCache.lock);
+
+        bool success = writeWarmCache(image);
+
+        dvmLockMutex(&gWarmCache.lock);
+        /* An unwritable path won't get any better; stop trying */
+        if (!success || stopping) {
+            break;
+        }
+        gWarmCache.numUnsaved -= numSaved;
+    }
+    dvmUnlockMutex(&gWarmCache.lock);
+    return NULL;
+}
+
+/*
+ * Read the cache file into gWarmCache.traces. A missing, stale or corrupt
+ * file is simply ignored and will be overwritten by the next save.
+ */
+static void loadWarmCache(void)
+{
+    int fd = open(gDvmJit.warmCachePath, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(WarmCacheHeader)) {
+        close(fd);
+        return;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    const WarmCacheHeader* header = (const WarmCacheHeader*) map;
+    const u1* body = (const u1*) map + sizeof(WarmCacheHeader);
+    size_t bodySize = st.st_size - sizeof(WarmCacheHeader);
+
+    if (memcmp(header->magic, WARM_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->formatVersion != WARM_CACHE_FORMAT_VERSION ||
+        header->vmVersion != WARM_CACHE_VM_VERSION) {
+        ALOGI("JIT warm cache '%s' is from another VM version, ignored",
+              gDvmJit.warmCachePath);
+        munmap(map, st.st_size);
+        return;
+    }
+    if (adler32(adler32(0L, Z_NULL, 0), body, bodySize) != header->checksum) {
+        ALOGW("JIT warm cache '%s' is corrupt, ignored", gDvmJit.warmCachePath);
+        munmap(map, st.st_size);
+        return;
+    }
+
+    WarmCacheReader reader = { body, body + bodySize };
+    for (u4 i = 0; i < header->numTraces; i++) {
+        WarmTrace trace;
+        u2 numRuns;
+
+        if (!reader.read(&trace.dexChecksum, sizeof(trace.dexChecksum)) ||
+            !reader.readString(&trace.classDescriptor) ||
+            !reader.readString(&trace.methodName) ||
+            !reader.readString(&trace.methodDescriptor) ||
+            !reader.read(&numRuns, sizeof(numRuns)) || numRuns == 0) {
+            break;
+        }
+        for (u2 j = 0; j < numRuns; j++) {
+            u2 startOffset;
+            u1 numInsts;
+            u1 hint;
+            if (!reader.read(&startOffset, sizeof(startOffset)) ||
+                !reader.read(&numInsts, sizeof(numInsts)) ||
+                !reader.read(&hint, sizeof(hint))) {
+                break;
+            }
+            JitCodeDesc run;
+            run.startOffset = startOffset;
+            run.numInsts = numInsts;
+            run.hint = (JitHint) hint;
+            run.runEnd = (j == numRuns - 1);
+            trace.runs.push_back(run);
+        }
+        if (trace.runs.size() != numRuns) {
+            break;
+        }
+        gWarmCache.traces[traceKey(trace)] = trace;
+    }
+    munmap(map, st.st_size);
+}
+
+/*
+ * Publish the container sizes after changing them.
+ * Must be called with gWarmCache.lock held.
+ */
+static void updateWarmCacheCounts(void)
+{
+    android_atomic_release_store(gWarmCache.unresolved.size(),
+                                 &gWarmCache.numUnresolved);
+    android_atomic_release_store(gWarmCache.pending.size(),
+                                 &gWarmCache.numPending);
+}
+
+/*
+ * Turn the unresolved traces recorded for an initialized class into pending
+ * compilation orders, provided the class comes from the same dex file that
+ * the traces were selected in. Returns the number of orders added.
+ * Must be called with gWarmCache.lock held.
+ */
+static int resolveClassTraces(const ClassObject* clazz)
+{
+    int numResolved = 0;
+
+    if (clazz->pDvmDex == NULL || !dvmIsClassInitialized(clazz)) {
+        return 0;
+    }
+
+    std::pair<WarmTracesByClass::iterator, WarmTracesByClass::iterator> range =
+        gWarmCache.unresolved.equal_range(clazz->descriptor);
+    WarmTracesByClass::iterator it = range.first;
+    while (it != range.second) {
+        const WarmTrace* trace = it->second;
+
+        /* Another loader may still define a class with the matching dex */
+        if (trace->dexChecksum != clazz->pDvmDex->pHeader->checksum) {
+            it++;
+            continue;
+        }
+        gWarmCache.unresolved.erase(it++);
+
+        const char* name = trace->methodName.c_str();
+        const char* descriptor = trace->methodDescriptor.c_str();
+        const Method* method =
+            dvmFindDirectMethodByDescriptor(clazz, name, descriptor);
+        if (method == NULL) {
+            method = dvmFindVirtualMethodByDescriptor(clazz, name, descriptor);
+        }
+        if (method == NULL || dvmIsNativeMethod(method) ||
+            dvmIsAbstractMethod(method)) {
+            continue;
+        }
+
+        size_t numRuns = trace->runs.size();
+        bool inBounds = true;
+        for (size_t i = 0; i < numRuns; i++) {
+            if (trace->runs[i].startOffset >= dvmGetMethodInsnsSize(method)) {
+                inBounds = false;
+            }
+        }
+        if (!inBounds) {
+            continue;
+        }
+
+        JitTraceDescription* desc = (JitTraceDescription*)
+            malloc(sizeof(JitTraceDescription) + sizeof(JitTraceRun) * numRuns);
+        if (desc == NULL) {
+            break;
+        }
+        desc->method = method;
+        for (size_t i = 0; i < numRuns; i++) {
+            desc->trace[i].info.frag = trace->runs[i];
+            desc->trace[i].isCode = true;
+            desc->trace[i].unused = 0;
+        }
+
+        WarmOrder order = { method->insns + trace->runs[0].startOffset, desc };
+        gWarmCache.pending.push_back(order);
+        numResolved++;
+    }
+    updateWarmCacheCounts();
+    return numResolved;
+}
+
+/* dvmClassTableForeach callback for the classes initialized before startup */
+static int resolveClassCallback(void* vclazz, void* arg)
+{
+    resolveClassTraces((const ClassObject*) vclazz);
+    return gWarmCache.unresolved.empty() ? 1 : 0;
+}
+
+void dvmJitWarmCacheStartup(void)
+{
+    if (gDvmJit.warmCachePath == NULL) {
+        return;
+    }
+
+    dvmInitMutex(&gWarmCache.lock);
+    pthread_cond_init(&gWarmCache.writerCond, NULL);
+    dvmLockMutex(&gWarmCache.lock);
+    loadWarmCache();
+
+    std::map<std::string, WarmTrace>::const_iterator it;
+    for (it = gWarmCache.traces.begin(); it != gWarmCache.traces.end(); it++) {
+        gWarmCache.unresolved.insert(
+            std::make_pair(it->second.classDescriptor, &it->second));
+    }
+    updateWarmCacheCounts();
+    /*
+     * Classes initialized from here on are resolved by
+     * dvmJitWarmCacheClassInitialized, the ones before by the walk.
+     */
+    gWarmCache.enabled = true;
+    if (!gWarmCache.unresolved.empty()) {
+        dvmClassTableForeach(resolveClassCallback, NULL);
+    }
+
+    ALOGD("JIT warm cache: %d known traces, %d resolved",
+          (int) gWarmCache.traces.size(), (int) gWarmCache.pending.size());
+    dvmUnlockMutex(&gWarmCache.lock);
+
+    gWarmCache.writerStop = false;
+    gWarmCache.hasWriter = dvmCreateInternalThread(&gWarmCache.writerHandle,
+        "JIT Warm Cache Writer", warmCacheWriterThread, NULL);
+    if (!gWarmCache.hasWriter) {
+        ALOGW("Unable to start the JIT warm cache writer; no traces are saved");
+    }
+}
+
+void dvmJitWarmCacheShutdown(void)
+{
+    if (!gWarmCache.enabled) {
+        return;
+    }
+    dvmLockMutex(&gWarmCache.lock);
+    gWarmCache.writerStop = true;
+    pthread_cond_signal(&gWarmCache.writerCond);
+    dvmUnlockMutex(&gWarmCache.lock);
+
+    /*
+     * The writer detaches from the VM when done, which needs the thread list
+     * lock, so don't hold up a suspend while we wait for it.
+     */
+    if (gWarmCache.hasWriter) {
+        Thread* self = dvmThreadSelf();
+        ThreadStatus oldStatus = THREAD_UNDEFINED;
+        if (self != NULL)
+            oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+        if (pthread_join(gWarmCache.writerHandle, NULL) != 0) {
+            ALOGW("JIT warm cache writer join failed");
+        }
+        if (self != NULL)
+            dvmChangeStatus(self, oldStatus);
+        gWarmCache.hasWriter = false;
+    }
+
+    dvmLockMutex(&gWarmCache.lock);
+    gWarmCache.unresolved.clear();
+    for (size_t i = 0; i < gWarmCache.pending.size(); i++) {
+        free(gWarmCache.pending[i].desc);
+    }
+    gWarmCache.pending.clear();
+    updateWarmCacheCounts();
+    dvmUnlockMutex(&gWarmCache.lock);
+}
+
+void dvmJitWarmCacheClassInitialized(const ClassObject* clazz)
+{
+    if (!gWarmCache.enabled ||
+        android_atomic_acquire_load(&gWarmCache.numUnresolved) == 0) {
+        return;
+    }
+
+    Thread* self = dvmThreadSelf();
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    dvmLockMutex(&gWarmCache.lock);
+    int numResolved = resolveClassTraces(clazz);
+    dvmUnlockMutex(&gWarmCache.lock);
+
+    /* The compiler thread may be idle; wake it up to issue the new orders */
+    if (numResolved != 0) {
+        dvmLockMutex(&gDvmJit.compilerLock);
+        pthread_cond_signal(&gDvmJit.compilerQueueActivity);
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+    }
+    dvmChangeStatus(self, oldStatus);
+}
+
+void dvmJitWarmCacheRecord(const u2* pc, const JitTraceDescription* desc)
+{
+    if (!gWarmCache.enabled) {
+        return;
+    }
+
+    const Method* method = desc->method;
+    if (method->clazz->pDvmDex == NULL) {
+        return;
+    }
+
+    WarmTrace trace;
+    trace.dexChecksum = method->clazz->pDvmDex->pHeader->checksum;
+    trace.classDescriptor = method->clazz->descriptor;
+    trace.methodName = method->name;
+    char* methodDescriptor = dexProtoCopyMethodDescriptor(&method->prototype);
+    trace.methodDescriptor = methodDescriptor;
+    free(methodDescriptor);
+
+    /* Only the code runs are kept; meta entries hold process addresses */
+    for (const JitTraceRun* run = desc->trace; ; run++) {
+        if (run->isCode) {
+            trace.runs.push_back(run->info.frag);
+            if (run->info.frag.runEnd) {
+                break;
+            }
+        }
+    }
+    assert(method->insns + trace.runs[0].startOffset == pc);
+
+    std::string key = traceKey(trace);
+    dvmLockMutex(&gWarmCache.lock);
+    if (gWarmCache.traces.find(key) == gWarmCache.traces.end()) {
+        gWarmCache.traces[key] = trace;
+        if (++gWarmCache.numUnsaved == WARM_CACHE_SAVE_INTERVAL) {
+            pthread_cond_signal(&gWarmCache.writerCond);
+        }
+    }
+    dvmUnlockMutex(&gWarmCache.lock);
+}
+
+/* Leave half of the work queue to the orders of the interpreter */
+static bool compilerQueueHasRoom(void)
+{
+    dvmLockMutex(&gDvmJit.compilerLock);
+    bool hasRoom =
+        gDvmJit.compilerQueueLength < gDvmJit.compilerHighWater / 2;
+    dvmUnlockMutex(&gDvmJit.compilerLock);
+    return hasRoom;
+}
+
+void dvmJitWarmCacheFeed(void)
+{
+    if (!dvmJitWarmCacheHasPending()) {
+        return;
+    }
+
+    dvmLockMutex(&gWarmCache.lock);
+    while (!gWarmCache.pending.empty() && compilerQueueHasRoom()) {
+        WarmOrder order = gWarmCache.pending.back();
+        gWarmCache.pending.pop_back();
+
+        /* Already compiled, or being selected by the interpreter */
+        if (dvmJitFindEntry(order.pc, false) != NULL) {
+            free(order.desc);
+            continue;
+        }
+        if (!dvmCompilerWorkEnqueue(order.pc, kWorkOrderTrace, order.desc)) {
+            free(order.desc);
+            continue;
+        }
+
+        /*
+         * Now claim the JitTable slot the way the interpreter does before it
+         * builds a trace, so that it won't select the same trace meanwhile.
+         * A claimed slot is never released, and one left without code would
+         * keep the interpreter from ever selecting the trace, so the claim
+         * waits until the order is queued. Only this thread compiles, so the
+         * order can't be installed before the slot exists.
+         */
+        dvmJitReserveTraceEntry(order.pc);
+    }
+    updateWarmCacheCounts();
+    dvmUnlockMutex(&gWarmCache.lock);
+}
+
+bool dvmJitWarmCacheHasPending(void)
+{
+    return gWarmCache.enabled &&
+           android_atomic_acquire_load(&gWarmCache.numPending) != 0;
+}
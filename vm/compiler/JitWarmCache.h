@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DALVIK_VM_COMPILER_JITWARMCACHE_H_
+#define DALVIK_VM_COMPILER_JITWARMCACHE_H_
+
+struct ClassObject;
+struct JitTraceDescription;
+
+/*
+ * Load the warm-start cache named by -Xjitwarmcache, resolve the traces it
+ * describes against the classes initialized so far and start the thread that
+ * saves it. Called by the compiler thread once the JIT tables are set up.
+ */
+void dvmJitWarmCacheStartup(void);
+
+/* Write out any unsaved traces and stop the writer thread. */
+void dvmJitWarmCacheShutdown(void);
+
+/* Resolve the cached traces of a class that has just been initialized. */
+void dvmJitWarmCacheClassInitialized(const ClassObject* clazz);
+
+/* Remember an installed trace so that later runs can compile it up-front. */
+void dvmJitWarmCacheRecord(const u2* pc, const JitTraceDescription* desc);
+
+/*
+ * Queue resolved warm-start traces for compilation while there is room in
+ * the compiler work queue. Only called by the compiler thread.
+ */
+void dvmJitWarmCacheFeed(void);
+
+/* Are resolved traces waiting for dvmJitWarmCacheFeed? */
+bool dvmJitWarmCacheHasPending(void);
+
+#endif  // DALVIK_VM_COMPILER_JITWARMCACHE_H_
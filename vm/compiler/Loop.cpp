@@ -22,6 +22,7 @@
 
 #ifdef ARCH_IA32
 #include "PassDriver.h"
+#include "EscapeAnalysis.h"
 #endif
 
 #ifdef DEBUG_LOOP_ON
@@ -1121,7 +1122,6 @@ static bool checkBBInstructionsForCFGLoop (CompilationUnit *cUnit, BasicBlock *b
             OP_RETURN_OBJECT,
             OP_MONITOR_ENTER,
             OP_MONITOR_EXIT,
-            OP_NEW_INSTANCE,
             OP_NEW_ARRAY,
             OP_THROW,
             OP_RETURN_VOID_BARRIER,
@@ -1136,6 +1136,8 @@ static bool checkBBInstructionsForCFGLoop (CompilationUnit *cUnit, BasicBlock *b
             OP_INVOKE_VIRTUAL_QUICK_RANGE,
             OP_INVOKE_INTERFACE,
             OP_INVOKE_INTERFACE_RANGE,
+
+            //OP_NEW_INSTANCE is accepted: the escape analysis may remove it, dvmCompilerLoopOpt leaves loop mode otherwise
     };
 
     //Go through each instruction
@@ -1765,6 +1767,13 @@ bool dvmCompilerLoopOpt(CompilationUnit *cUnit)
 {
     dvmCompilerLaunchPassDriver (cUnit);
 
+    //The backends do not expect allocations in loops, whether or not the escape analysis ran
+    if (cUnit->quitLoopMode == false && dvmCompilerTraceIsLoopNewSystem (cUnit, 0) == true
+            && dvmCompilerLoopHasNoAllocation (cUnit) == false)
+    {
+        cUnit->quitLoopMode = true;
+    }
+
     return true;
 }
 #else
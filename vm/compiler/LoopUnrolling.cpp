@@ -0,0 +1,641 @@
+/*
+ * Copyright (C) 2013 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <climits>
+
+#include "Dalvik.h"
+#include "Compiler.h"
+#include "CompilerIR.h"
+#include "Dataflow.h"
+#include "LoopInformation.h"
+#include "LoopUnrolling.h"
+#include "Pass.h"
+#include "PassDriver.h"
+#include "Utility.h"
+
+/** @brief Maximum number of instructions in the body of an unrolled loop */
+#define MAX_UNROLLED_INSTRUCTIONS 48
+
+/**
+ * @class UnrollingInfo
+ * @brief UnrollingInfo contains what the gate learned about a loop to unroll
+ */
+struct UnrollingInfo
+{
+    /** @brief How many copies of the body the unrolled loop holds */
+    unsigned int factor;
+
+    /** @brief Number of instructions in one copy of the body */
+    unsigned int bodySize;
+
+    /** @brief The constant compared to the IV by the loop's if */
+    int upperBound;
+
+    /** @brief The const bytecode defining the upper bound */
+    MIR *boundMIR;
+
+    /** @brief Is the IV the first operand of the loop's if? */
+    bool ivIsFirstOperand;
+
+    /** @brief The number of iterations if the IV is entering the loop with a constant, -1 otherwise */
+    long long tripCount;
+};
+
+/**
+ * @brief Report the unrolling decision for a loop
+ * @param cUnit The CompilationUnit of the loop
+ * @param loopInfo The LoopInformation of the loop
+ * @param message The decision or the reason for not unrolling
+ */
+static void reportDecision (const CompilationUnit *cUnit, const LoopInformation *loopInfo, const char *message)
+{
+    if (cUnit->printMe == true || cUnit->printPass == true)
+    {
+        ALOGD ("JIT_INFO: Loop_Unrolling for %s%s@0x%02x: %s", cUnit->method->clazz->descriptor,
+                cUnit->method->name, loopInfo->getEntryBlock ()->startOffset, message);
+    }
+}
+
+/**
+ * @brief Is the body of the loop made of instructions we can duplicate?
+ * @details Only the phi nodes and the final if may be other than plain bytecodes
+ * @param bb the unique BasicBlock of the loop
+ * @param bodySize updated with the number of instructions of the body
+ * @return whether the body can be unrolled
+ */
+static bool isUnrollableBody (const BasicBlock *bb, unsigned int &bodySize)
+{
+    bodySize = 0;
+
+    for (MIR *mir = bb->firstMIRInsn; mir != bb->lastMIRInsn; mir = mir->next)
+    {
+        int opcode = mir->dalvikInsn.opcode;
+
+        if (opcode == kMirOpPhi)
+        {
+            continue;
+        }
+
+        //Extended MIRs belong to other optimizations that expect a single copy
+        if (opcode >= kMirOpFirst)
+        {
+            return false;
+        }
+
+        //Control flow can only be done by the final if
+        int flags = dexGetFlagsFromOpcode (static_cast<Opcode> (opcode));
+
+        if ((flags & (kInstrCanBranch | kInstrCanSwitch | kInstrCanReturn | kInstrInvoke)) != 0)
+        {
+            return false;
+        }
+
+        bodySize++;
+    }
+
+    return bodySize > 0;
+}
+
+/**
+ * @brief Find the value of the IV when entering the loop
+ * @param cUnit the CompilationUnit
+ * @param loopInfo the LoopInformation
+ * @param phiIV the phi node of the IV
+ * @param isConstant updated with whether the IV enters the loop with a constant
+ * @param value updated with the constant if isConstant is true
+ * @return whether the IV enters the loop with a constant or with a value live-in of the trace
+ */
+static bool findInitialValue (const CompilationUnit *cUnit, LoopInformation *loopInfo, MIR *phiIV,
+        bool &isConstant, int &value)
+{
+    BasicBlock *bb = loopInfo->getEntryBlock ();
+    bool found = false;
+
+    for (int use = 0; use < phiIV->ssaRep->numUses; use++)
+    {
+        MIR *defMIR = phiIV->ssaRep->defWhere[use];
+
+        //Skip the increment of the IV
+        if (defMIR != 0 && defMIR->bb == bb)
+        {
+            continue;
+        }
+
+        //We do not handle a merge of several initial values
+        if (found == true)
+        {
+            return false;
+        }
+
+        if (defMIR == 0)
+        {
+            //A subscript of 0 means it is live-in of the trace
+            if (DECODE_SUB (dvmConvertSSARegToDalvik (cUnit, phiIV->ssaRep->uses[use])) != 0)
+            {
+                return false;
+            }
+
+            isConstant = false;
+        }
+        else
+        {
+            //Anything else is computed by other code of the trace, like another loop
+            bool isWide = false;
+            int constValueHighIgnored;
+
+            if (dexGetConstant (defMIR->dalvikInsn, value, constValueHighIgnored, isWide) == false
+                    || isWide == true)
+            {
+                return false;
+            }
+
+            isConstant = true;
+        }
+
+        found = true;
+    }
+
+    return found;
+}
+
+/**
+ * @brief Analyze the if ending the loop
+ * @details The if must compare the incremented IV to a constant and keep iterating while it is
+ * lower, or lower or equal, to it. Then any bound can be lowered to leave room for more iterations.
+ * @param cUnit the CompilationUnit
+ * @param loopInfo the LoopInformation
+ * @param info the UnrollingInfo to fill
+ * @param lastValue updated with the last value of the IV for which the body is executed
+ * @return whether the if is supported
+ */
+static bool analyzeLoopTest (const CompilationUnit *cUnit, LoopInformation *loopInfo, UnrollingInfo *info,
+        long long &lastValue)
+{
+    BasicBlock *bb = loopInfo->getEntryBlock ();
+    MIR *ifMIR = bb->lastMIRInsn;
+
+    if (ifMIR == 0 || ifMIR->ssaRep == 0)
+    {
+        return false;
+    }
+
+    Opcode opcode = ifMIR->dalvikInsn.opcode;
+
+    //We want two operands
+    if (opcode < OP_IF_EQ || opcode > OP_IF_LE || ifMIR->ssaRep->numUses != 2)
+    {
+        return false;
+    }
+
+    InductionVariableInfo *ivInfo = (InductionVariableInfo *) dvmGrowableListGetElement (& (loopInfo->getInductionVariableList ()), 0);
+
+    //Paranoid
+    if (ivInfo == 0)
+    {
+        return false;
+    }
+
+    //The if must test the IV once incremented, the test then tells whether one more iteration is done
+    SSARepresentation *ssaRep = ifMIR->ssaRep;
+    int ivUse = (ssaRep->uses[0] == ivInfo->ssaReg) ? 0 : 1;
+
+    if (ssaRep->uses[ivUse] != ivInfo->ssaReg)
+    {
+        return false;
+    }
+
+    //The other operand must be a constant
+    MIR *boundMIR = ssaRep->defWhere[1 - ivUse];
+
+    if (boundMIR == 0)
+    {
+        return false;
+    }
+
+    bool isWide = false;
+    int constValueHighIgnored;
+
+    if (dexGetConstant (boundMIR->dalvikInsn, info->upperBound, constValueHighIgnored, isWide) == false
+            || isWide == true)
+    {
+        return false;
+    }
+
+    info->boundMIR = boundMIR;
+    info->ivIsFirstOperand = (ivUse == 0);
+
+    //Get the condition in the form "IV op bound"
+    if (ivUse == 1)
+    {
+        switch (opcode)
+        {
+            case OP_IF_LT:
+                opcode = OP_IF_GT;
+                break;
+            case OP_IF_GT:
+                opcode = OP_IF_LT;
+                break;
+            case OP_IF_LE:
+                opcode = OP_IF_GE;
+                break;
+            case OP_IF_GE:
+                opcode = OP_IF_LE;
+                break;
+            default:
+                break;
+        }
+    }
+
+    //Now get the condition for which the loop keeps iterating
+    if (bb->fallThrough != 0 && bb->fallThrough->blockType == kChainingCellBackwardBranch)
+    {
+        switch (opcode)
+        {
+            case OP_IF_GE:
+                opcode = OP_IF_LT;
+                break;
+            case OP_IF_GT:
+                opcode = OP_IF_LE;
+                break;
+            default:
+                opcode = OP_NOP;
+                break;
+        }
+    }
+    else if (bb->taken == 0 || bb->taken->blockType != kChainingCellBackwardBranch)
+    {
+        return false;
+    }
+
+    //An equality test would let the unrolled loop step over its bound so we only take ordered tests
+    switch (opcode)
+    {
+        case OP_IF_LT:
+            lastValue = static_cast<long long> (info->upperBound) - 1;
+            break;
+        case OP_IF_LE:
+            lastValue = info->upperBound;
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Determine if and how much a loop should be unrolled
+ * @param cUnit the CompilationUnit
+ * @param loopInfo the LoopInformation
+ * @param info the UnrollingInfo to fill
+ * @return the reason for not unrolling, 0 if the loop should be unrolled
+ */
+static const char *unrollingGate (const CompilationUnit *cUnit, LoopInformation *loopInfo, UnrollingInfo *info)
+{
+    if (dvmCompilerVerySimpleLoopGateWithLoopInfo (cUnit, loopInfo) == false)
+    {
+        return "the loop is not very simple";
+    }
+
+    if (loopInfo->isUniqueIVIncrementingBy1 () == false || loopInfo->getCountUpLoop () == false)
+    {
+        return "not a count up loop incremented by 1";
+    }
+
+    BasicBlock *bb = loopInfo->getEntryBlock ();
+    BasicBlock *preHeader = loopInfo->getPreHeader ();
+
+    if (bb == 0 || preHeader == 0 || loopInfo->getExitBlock (cUnit) == 0
+            || loopInfo->getBackwardBranchBlock (cUnit) == 0)
+    {
+        return "the loop is not well formed";
+    }
+
+    if (preHeader->fallThrough != bb && preHeader->taken != bb)
+    {
+        return "the preheader does not go to the loop";
+    }
+
+    if (isUnrollableBody (bb, info->bodySize) == false)
+    {
+        return "the body contains instructions that cannot be duplicated";
+    }
+
+    long long lastValue = 0;
+
+    if (analyzeLoopTest (cUnit, loopInfo, info, lastValue) == false)
+    {
+        return "the loop test is not an ordered comparison with a constant";
+    }
+
+    unsigned int vrIV = dvmExtractSSARegister (cUnit, loopInfo->getSSABIV ());
+    MIR *phiIV = loopInfo->getPhiInstruction (cUnit, vrIV);
+
+    //Paranoid
+    if (phiIV == 0 || phiIV->ssaRep == 0 || phiIV->ssaRep->defWhere == 0)
+    {
+        return "no phi node for the IV";
+    }
+
+    bool isConstant = false;
+    int initialValue = 0;
+
+    if (findInitialValue (cUnit, loopInfo, phiIV, isConstant, initialValue) == false)
+    {
+        return "the initial value of the IV is unknown";
+    }
+
+    //The body is executed at least once, the loop being entered only when the test passes
+    info->tripCount = -1;
+
+    if (isConstant == true)
+    {
+        info->tripCount = lastValue - initialValue + 1;
+
+        if (info->tripCount < 1)
+        {
+            info->tripCount = 1;
+        }
+    }
+
+    //Choose the factor by the size of the body
+    unsigned int factor = gDvmJit.maximumUnrollFactor;
+
+    if (factor > MAX_UNROLL_FACTOR)
+    {
+        factor = MAX_UNROLL_FACTOR;
+    }
+
+    //Divide rather than multiply, the product could overflow for a large body
+    if (factor > 0 && info->bodySize > MAX_UNROLLED_INSTRUCTIONS / factor)
+    {
+        factor = MAX_UNROLLED_INSTRUCTIONS / info->bodySize;
+    }
+
+    //Do not bother if the unrolled loop would barely run
+    if (info->tripCount >= 0)
+    {
+        while (factor > 1 && info->tripCount < 2 * static_cast<long long> (factor))
+        {
+            factor--;
+        }
+    }
+
+    if (factor < 2)
+    {
+        return "the body is too large or the trip count too small";
+    }
+
+    //The bound of the unrolled loop is lowered by factor - 1
+    if (static_cast<long long> (info->upperBound) - (factor - 1) < INT_MIN)
+    {
+        return "the lowered bound would overflow";
+    }
+
+    info->factor = factor;
+
+    return 0;
+}
+
+/**
+ * @brief Create a block testing whether the IV allows entering a loop
+ * @details The block holds a copy of the loop's if comparing the IV to a scratch register set to bound
+ * @param cUnit the CompilationUnit
+ * @param ifMIR the if of the loop
+ * @param info the UnrollingInfo
+ * @param scratch the scratch register to hold the bound
+ * @param bound the bound to compare with
+ * @return the new BasicBlock, 0 if it could not be created
+ */
+static BasicBlock *createTest (CompilationUnit *cUnit, MIR *ifMIR, UnrollingInfo *info, int scratch, int bound)
+{
+    BasicBlock *test = dvmCompilerNewBBinCunit (cUnit, kDalvikByteCode);
+
+    if (test == 0)
+    {
+        return 0;
+    }
+
+    //Set the scratch register to the bound: a copy of the original const keeps its offset
+    MIR *constMIR = dvmCompilerCopyMIR (info->boundMIR);
+    constMIR->dalvikInsn.opcode = OP_CONST;
+    constMIR->dalvikInsn.vA = scratch;
+    constMIR->dalvikInsn.vB = bound;
+
+    MIR *copyIf = dvmCompilerCopyMIR (ifMIR);
+
+    if (info->ivIsFirstOperand == true)
+    {
+        copyIf->dalvikInsn.vB = scratch;
+    }
+    else
+    {
+        copyIf->dalvikInsn.vA = scratch;
+    }
+
+    dvmCompilerAppendMIR (test, constMIR);
+    dvmCompilerAppendMIR (test, copyIf);
+
+    return test;
+}
+
+/**
+ * @brief Link a test block to where it goes depending on the outcome
+ * @param test the test BasicBlock
+ * @param loopBB the loop BasicBlock the test was copied from
+ * @param iterate where to go if the loop would iterate
+ * @param leave where to go otherwise
+ */
+static void linkTest (BasicBlock *test, const BasicBlock *loopBB, BasicBlock *iterate, BasicBlock *leave)
+{
+    if (loopBB->taken->blockType == kChainingCellBackwardBranch)
+    {
+        test->taken = iterate;
+        test->fallThrough = leave;
+    }
+    else
+    {
+        test->fallThrough = iterate;
+        test->taken = leave;
+    }
+}
+
+/**
+ * @brief Unroll a loop
+ * @details The loop becomes two: the unrolled loop runs while factor iterations remain, then the
+ * original loop executes what is left. The unrolled loop is guarded by a test; when it fails the
+ * original loop is entered as before, otherwise the original loop is only entered after the unrolled
+ * one if its own test passes.
+ * @param cUnit the CompilationUnit
+ * @param loopInfo the LoopInformation
+ * @param info the UnrollingInfo filled by the gate
+ * @return whether the loop was unrolled
+ */
+static bool unrollLoop (CompilationUnit *cUnit, LoopInformation *loopInfo, UnrollingInfo *info)
+{
+    BasicBlock *bb = loopInfo->getEntryBlock ();
+    BasicBlock *preHeader = loopInfo->getPreHeader ();
+    BasicBlock *exit = loopInfo->getExitBlock (cUnit);
+    BasicBlock *bwcc = loopInfo->getBackwardBranchBlock (cUnit);
+    MIR *ifMIR = bb->lastMIRInsn;
+
+    //The tests and the unrolled loop compare the IV to a scratch register
+    int scratch = dvmCompilerGetFreeScratchRegister (cUnit, 1);
+
+    if (scratch == -1)
+    {
+        return false;
+    }
+
+    int unrolledBound = info->upperBound - static_cast<int> (info->factor - 1);
+
+    //The loop is entered without a test: only the unrolled one and what follows it need one
+    BasicBlock *unrolledTest = createTest (cUnit, ifMIR, info, scratch, unrolledBound);
+    BasicBlock *mainTest = createTest (cUnit, ifMIR, info, scratch, info->upperBound);
+    BasicBlock *unrolledPreHeader = dvmCompilerNewBBinCunit (cUnit, kDalvikByteCode);
+    BasicBlock *unrolledBB = dvmCompilerCopyBasicBlock (cUnit, bb);
+    BasicBlock *unrolledBWCC = dvmCompilerCopyBasicBlock (cUnit, bwcc);
+    BasicBlock *unrolledExit = dvmCompilerNewBBinCunit (cUnit, kDalvikByteCode);
+    BasicBlock *newPreHeader = dvmCompilerNewBBinCunit (cUnit, kDalvikByteCode);
+
+    if (unrolledTest == 0 || mainTest == 0 || unrolledPreHeader == 0 || unrolledBB == 0 || unrolledBWCC == 0
+            || unrolledExit == 0 || newPreHeader == 0)
+    {
+        return false;
+    }
+
+    //Append the other copies of the body before the if of the unrolled loop
+    MIR *unrolledIf = unrolledBB->lastMIRInsn;
+
+    for (unsigned int copy = 1; copy < info->factor; copy++)
+    {
+        for (MIR *mir = bb->firstMIRInsn; mir != ifMIR; mir = mir->next)
+        {
+            if (mir->dalvikInsn.opcode != static_cast<Opcode> (kMirOpPhi))
+            {
+                dvmCompilerInsertMIRBefore (unrolledBB, unrolledIf, dvmCompilerCopyMIR (mir));
+            }
+        }
+    }
+
+    //The unrolled loop only iterates while factor iterations remain
+    MIR *boundMIR = dvmCompilerCopyMIR (info->boundMIR);
+    boundMIR->dalvikInsn.opcode = OP_CONST;
+    boundMIR->dalvikInsn.vA = scratch;
+    boundMIR->dalvikInsn.vB = unrolledBound;
+    dvmCompilerInsertMIRBefore (unrolledBB, unrolledIf, boundMIR);
+
+    if (info->ivIsFirstOperand == true)
+    {
+        unrolledIf->dalvikInsn.vB = scratch;
+    }
+    else
+    {
+        unrolledIf->dalvikInsn.vA = scratch;
+    }
+
+    //Now link everything: preheader, unrolled test, unrolled loop, main test, original loop
+    if (preHeader->fallThrough == bb)
+    {
+        preHeader->fallThrough = unrolledTest;
+    }
+    else
+    {
+        preHeader->taken = unrolledTest;
+    }
+
+    linkTest (unrolledTest, bb, unrolledPreHeader, newPreHeader);
+    unrolledPreHeader->fallThrough = unrolledBB;
+
+    if (bb->taken == bwcc)
+    {
+        unrolledBB->taken = unrolledBWCC;
+        unrolledBB->fallThrough = unrolledExit;
+    }
+    else
+    {
+        unrolledBB->fallThrough = unrolledBWCC;
+        unrolledBB->taken = unrolledExit;
+    }
+
+    unrolledBWCC->fallThrough = unrolledBB;
+    unrolledExit->fallThrough = mainTest;
+
+    //The original loop takes the remaining iterations if any, its exit is the only way out
+    linkTest (mainTest, bb, newPreHeader, exit);
+    newPreHeader->fallThrough = bb;
+
+    return true;
+}
+
+/**
+ * @brief Try to unroll a loop
+ * @param cUnit the CompilationUnit
+ * @param loopInfo the LoopInformation
+ * @param data unused
+ * @return true to keep looking at the other loops
+ */
+static bool unrollHelper (CompilationUnit *cUnit, LoopInformation *loopInfo, void *data)
+{
+    (void) data;
+
+    UnrollingInfo info;
+    const char *reason = unrollingGate (cUnit, loopInfo, &info);
+
+    if (reason != 0)
+    {
+        reportDecision (cUnit, loopInfo, reason);
+        return true;
+    }
+
+    if (unrollLoop (cUnit, loopInfo, &info) == false)
+    {
+        reportDecision (cUnit, loopInfo, "could not create the unrolled loop");
+        return true;
+    }
+
+    if (cUnit->printMe == true || cUnit->printPass == true)
+    {
+        char buffer[128];
+        snprintf (buffer, sizeof (buffer), "unrolled by %u, body of %u instructions, trip count %lld",
+                info.factor, info.bodySize, info.tripCount);
+        reportDecision (cUnit, loopInfo, buffer);
+    }
+
+    return true;
+}
+
+bool dvmCompilerLoopUnrollingGate (const CompilationUnit *cUnit, Pass *curPass)
+{
+    //A factor of 1 disables unrolling
+    if (gDvmJit.maximumUnrollFactor < 2)
+    {
+        return false;
+    }
+
+    return dvmCompilerTraceIsLoopNewSystem (cUnit, curPass) == true && cUnit->loopInformation != 0;
+}
+
+void dvmCompilerLoopUnrolling (CompilationUnit *cUnit, Pass *pass)
+{
+    LoopInformation *info = cUnit->loopInformation;
+
+    //The gate ensured we have loops
+    if (info != 0)
+    {
+        info->iterate (cUnit, unrollHelper, pass);
+    }
+}
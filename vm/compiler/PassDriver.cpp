@@ -21,8 +21,11 @@
 #include "Checks.h"
 #include "Dalvik.h"
 #include "Dataflow.h"
+#include "EscapeAnalysis.h"
+#include "GlobalValueNumbering.h"
 #include "InvariantRemoval.h"
 #include "Loop.h"
+#include "LoopUnrolling.h"
 #include "PassDriver.h"
 #include "SinkCastOpt.h"
 #include "LoopRegisterUsage.h"
@@ -81,6 +84,12 @@ START_PASSES
     NEW_PASS ("Merge_Blocks", kAllNodes, 0, 0,
                 0, 0, dvmCompilerMergeBasicBlocks, 0,
                 kOptimizationBasicBlockChange | kLoopStructureChange | kOptimizationNeedIterative),
+    //Allocations must be gone before the loop passes: the field accesses become moves they can handle
+    NEW_PASS ("Escape_Analysis", kAllNodes, 0, dvmCompilerEscapeAnalysisGate,
+                dvmCompilerEscapeAnalysis, 0, 0, 0, kOptimizationBasicBlockChange | kOptimizationDefUsesChange),
+    //Redundancies are easier to find once the blocks are merged and before the loop passes hoist or sink code
+    NEW_PASS ("Global_Value_Numbering", kAllNodes, 0, dvmCompilerGlobalValueNumberingGate,
+                dvmCompilerGlobalValueNumbering, 0, 0, 0, kOptimizationBasicBlockChange | kLoopStructureChange),
     NEW_PASS ("Invariant_Removal", kAllNodes, 0, dvmCompilerInvariantRemovalGate,
               dvmCompilerInvariantRemoval, 0, 0, 0, kOptimizationBasicBlockChange),
     NEW_PASS ("Iget_Iput_Removal", kAllNodes, 0, dvmCompilerInvariantRemovalGate,
@@ -93,6 +102,8 @@ START_PASSES
             dvmCompilerVectorize, 0, 0, 0, kOptimizationBasicBlockChange | kLoopStructureChange),
     NEW_PASS ("Invariant_sinking", kAllNodes, 0, dvmCompilerInvariantSinkingGate,
             dvmCompilerInvariantSinking, 0, 0, 0, kOptimizationBasicBlockChange),
+    NEW_PASS ("Loop_Unrolling", kAllNodes, 0, dvmCompilerLoopUnrollingGate,
+            dvmCompilerLoopUnrolling, 0, 0, 0, kOptimizationBasicBlockChange | kLoopStructureChange),
     //Loop could be transformed at this point (e.g. loop peeling), so new opportunities're possible for Checks_Removal
     NEW_PASS ("Check_Removal", kPredecessorsFirstTraversal, 0, 0,
                 dvmCompilerStartCheckRemoval, dvmCompilerEndCheckRemoval, dvmCompilerCheckRemoval, 0, kOptimizationDefUsesChange),
@@ -611,6 +611,12 @@ static bool parseBlock (BasicBlock *bb, bool verbose)
             case kMirOpPackedAddReduce:
             case kMirOpPackedReduce:
             case kMirOpPackedSet:
+            case kMirOpPackedArrayGet:
+            case kMirOpPackedArrayPut:
+            case kMirOpPackedFloatAddition:
+            case kMirOpPackedFloatSubtract:
+            case kMirOpPackedFloatMultiply:
+            case kMirOpPackedFloatDivide:
             case kMirOpPackedSubtract:
             case kMirOpPackedXor:
             case kMirOpPackedOr:
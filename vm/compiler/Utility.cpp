@@ -205,6 +205,7 @@ void dvmCompilerArenaReset(void)
 
         cnt++;
     }
+    numArenaBlocks -= cnt;
 
     ARENA_LOG ("Arena: triming and only kept %d block(s), %d removed", keepHowMany, cnt);
 
@@ -460,10 +461,11 @@ void dvmCompilerDumpStats(void)
          gDvmJit.templateSize,
          gDvmJit.codeCacheByteUsed - gDvmJit.templateSize,
          gDvmJit.dataCacheByteUsed);
+    ALOGD("Compiler work queue length is %d/%d, %d requests dropped, "
+         "%d evicted", gDvmJit.compilerQueueLength, gDvmJit.compilerMaxQueued,
+         gDvmJit.compilerQueueDropped, gDvmJit.compilerQueueEvicted);
     ALOGD("Compiler arena uses %d blocks (%d bytes each)",
          numArenaBlocks, ARENA_DEFAULT_SIZE);
-    ALOGD("Compiler work queue length is %d/%d", gDvmJit.compilerQueueLength,
-         gDvmJit.compilerMaxQueued);
     dvmJitStats();
     dvmCompilerArchDump();
     if (gDvmJit.methodStatsTable) {
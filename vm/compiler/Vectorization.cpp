@@ -27,6 +27,7 @@
 #include "Vectorization.h"
 #include "Utility.h"
 #include "AccumulationSinking.h"
+#include "Checks.h"
 #include "Expression.h"
 
 #define VECTORIZATION_LOG(cUnit,data,function) \
@@ -36,6 +37,15 @@
         } \
     } while (false)
 
+/*
+ * Lanes hold 16 or 32-bit integers, or single precision floats for add, sub,
+ * mul and div. Values narrowed by int-to-byte are computed in 16-bit lanes,
+ * since SSE has no 8-bit multiply, and byte arrays are not accessed. Double
+ * and long lanes are not handled: RegisterAssociation maps one VR to a lane
+ * and has no notion of the wide VR pairs those types live in. Only lightcg
+ * lowers the packed MIRs; PCG rejects them and the trace falls back.
+ */
+
 //The elements must be ordered by size
 enum VectorizedType
 {
@@ -71,10 +81,13 @@ struct VectorizationInfo
      * @brief Constructor
      */
     VectorizationInfo (void) :
-            type (kVectorizedNoType), upperBound (0), scratchVrForTest (0)
+            type (kVectorizedNoType), upperBound (0), scratchVrForTest (0),
+            arrayType (kVectorizedNoType), firstIndex (0), firstIndexIsConstant (false), lastIndex (0),
+            hasFloatArithmetic (false)
     {
         registers.clear ();
         constants.clear ();
+        arrays.clear ();
     }
 
     /**
@@ -84,6 +97,7 @@ struct VectorizationInfo
     {
         registers.clear ();
         constants.clear ();
+        arrays.clear ();
     }
 
     /** @brief Register Map of VRs requiring vectorization */
@@ -104,6 +118,24 @@ struct VectorizationInfo
 
     /** @brief scratch register which can be used in generating main test and vectorized test */
     int scratchVrForTest;
+
+    /** @brief Type imposed by the element size of the arrays accessed in the loop */
+    VectorizedType arrayType;
+
+    /** @brief Array VRs accessed in the loop, all of them indexed by the IV */
+    std::set<int> arrays;
+
+    /** @brief First index accessed: the IV's VR when entering the loop or a constant */
+    int firstIndex;
+
+    /** @brief Is firstIndex a constant rather than a VR? */
+    bool firstIndexIsConstant;
+
+    /** @brief Last index accessed by the scalar loop, which bounds the vectorized one */
+    int lastIndex;
+
+    /** @brief Does the loop contain single precision float arithmetic? */
+    bool hasFloatArithmetic;
 };
 
 /**
@@ -209,6 +241,18 @@ static ExtendedMIROpcode getVectorizedOpcode (Opcode scalarOpcode)
        case OP_XOR_INT_LIT16:
            vectorizedOpcode = kMirOpPackedXor;
            break;
+       case OP_ADD_FLOAT:
+           vectorizedOpcode = kMirOpPackedFloatAddition;
+           break;
+       case OP_SUB_FLOAT:
+           vectorizedOpcode = kMirOpPackedFloatSubtract;
+           break;
+       case OP_MUL_FLOAT:
+           vectorizedOpcode = kMirOpPackedFloatMultiply;
+           break;
+       case OP_DIV_FLOAT:
+           vectorizedOpcode = kMirOpPackedFloatDivide;
+           break;
        default:
            // not supported yet
            break;
@@ -217,10 +261,31 @@ static ExtendedMIROpcode getVectorizedOpcode (Opcode scalarOpcode)
    return vectorizedOpcode;
 }
 
+/**
+ * @brief Is the vectorized opcode a single precision float operation?
+ * @param vectorizedOpcode the vectorized opcode
+ * @return whether the packed lanes hold floats
+ */
+static bool isPackedFloatOpcode (ExtendedMIROpcode vectorizedOpcode)
+{
+    switch (vectorizedOpcode)
+    {
+        case kMirOpPackedFloatAddition:
+        case kMirOpPackedFloatSubtract:
+        case kMirOpPackedFloatMultiply:
+        case kMirOpPackedFloatDivide:
+            return true;
+        default:
+            break;
+    }
+
+    return false;
+}
+
 /**
  * @brief Check whether this MIR can remain in vectorized loop
  * @details The acception process is a whitelist and only allows a few select bytecodes.
- * No memory operations are accepted.
+ * No memory operations are accepted: array accesses are checked by isVectorizableArrayAccess.
  * @param mir The MIR to check for
  * @return Whether this MIR can remain in the loop
  */
@@ -229,7 +294,8 @@ static bool isVectorizable (MIR *mir)
     ExtendedMIROpcode vectorizedOpcode = getVectorizedOpcode (mir->dalvikInsn.opcode);
 
     //First check if we can create a vectorized instruction for this opcode
-    if (vectorizedOpcode == kMirOpPackedSubtract)
+    if (vectorizedOpcode == kMirOpPackedSubtract || vectorizedOpcode == kMirOpPackedFloatSubtract
+            || vectorizedOpcode == kMirOpPackedFloatDivide)
     {
         //Get instruction
         DecodedInstruction &insn = mir->dalvikInsn;
@@ -295,6 +361,62 @@ static bool isVectorizableInstructionUseConstant (MIR *mir)
     return false;
 }
 
+/**
+ * @brief Get the vectorized type imposed by an array access
+ * @details Only element sizes matching a lane width are supported: byte arrays would
+ * need widening and narrowing that the 16-bit lanes used for bytes cannot provide
+ * @param opcode the opcode of the MIR
+ * @return the type for the array access or kVectorizedNoType if it is not a supported array access
+ */
+static VectorizedType getArrayAccessType (Opcode opcode)
+{
+    switch (opcode)
+    {
+        case OP_AGET:
+        case OP_APUT:
+            return kVectorizedInt;
+        case OP_AGET_CHAR:
+        case OP_AGET_SHORT:
+        case OP_APUT_CHAR:
+        case OP_APUT_SHORT:
+            return kVectorizedShort;
+        default:
+            break;
+    }
+
+    return kVectorizedNoType;
+}
+
+/**
+ * @brief Check whether an array access can become a packed load or store
+ * @details The array must be invariant and the index must be the IV at the loop head: each
+ * lane then touches its own element and the hoisted checks cover every access
+ * @param cUnit the CompilationUnit
+ * @param mir the aget or aput MIR
+ * @param ssaIV the SSA register defined by the phi node of the IV
+ * @return whether the array access can be vectorized
+ */
+static bool isVectorizableArrayAccess (const CompilationUnit * const cUnit, MIR *mir, int ssaIV)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+
+    //The array and index are the last two uses for both aget and aput
+    if (ssaRep == 0 || ssaRep->numUses < 2)
+    {
+        return false;
+    }
+
+    int ssaArray = ssaRep->uses[ssaRep->numUses - 2];
+    int ssaIndex = ssaRep->uses[ssaRep->numUses - 1];
+
+    //A subscript of 0 means the array is never assigned in the trace
+    if (DECODE_SUB (dvmConvertSSARegToDalvik (cUnit, ssaArray)) != 0)
+    {
+        return false;
+    }
+
+    return ssaIndex == ssaIV;
+}
 
 /**
  * @brief Find the upper bound
@@ -441,6 +563,73 @@ static void setOutputRegister (VectorizationInfo *info, int vr, bool value)
     }
 }
 
+/**
+ * @brief Fill the vectorization information for an array access
+ * @param cUnit the CompilationUnit
+ * @param mir the aget or aput MIR
+ * @param ssaIV the SSA register defined by the phi node of the IV
+ * @param phiVRs the VRs having a phi node in the loop
+ * @param vrIV the VR of the IV
+ * @param info the VectorizationInfo to fill
+ * @return whether the array access can be vectorized
+ */
+static bool fillArrayAccessInformation (const CompilationUnit * const cUnit, MIR *mir, int ssaIV,
+        const std::set<int> &phiVRs, unsigned int vrIV, VectorizationInfo *info)
+{
+    if (isVectorizableArrayAccess (cUnit, mir, ssaIV) == false)
+    {
+        VECTORIZATION_LOG (cUnit, "Array access is not indexed by the IV of an invariant array", reportFailure);
+        return false;
+    }
+
+    //All the array accesses must agree on the lane width
+    VectorizedType arrayType = getArrayAccessType (mir->dalvikInsn.opcode);
+
+    if (info->arrayType != kVectorizedNoType && info->arrayType != arrayType)
+    {
+        VECTORIZATION_LOG (cUnit, "Array accesses of different element sizes", reportFailure);
+        return false;
+    }
+
+    info->arrayType = arrayType;
+
+    SSARepresentation *ssaRep = mir->ssaRep;
+    info->arrays.insert (dvmExtractSSARegister (cUnit, ssaRep->uses[ssaRep->numUses - 2]));
+
+    if (ssaRep->numDefs > 0)
+    {
+        //An aget defines a value local to the iteration: it needs a vector register but no reduction
+        int vrDef = dvmExtractSSARegister (cUnit, ssaRep->defs[0]);
+
+        if (phiVRs.find (vrDef) != phiVRs.end ())
+        {
+            VECTORIZATION_LOG (cUnit, "Array load into a loop carried VR", reportFailure);
+            return false;
+        }
+
+        setOutputRegister (info, vrDef, false);
+    }
+    else
+    {
+        //An aput stores its first use: each lane must hold the value of its own iteration
+        int vrValue = dvmExtractSSARegister (cUnit, ssaRep->uses[0]);
+
+        if (phiVRs.find (vrValue) != phiVRs.end () && static_cast<unsigned int> (vrValue) != vrIV)
+        {
+            VECTORIZATION_LOG (cUnit, "Array store of a loop carried VR", reportFailure);
+            return false;
+        }
+
+        //Only a value coming from outside of the loop has to be set up
+        if (ssaRep->defWhere[0] == 0)
+        {
+            setInputRegister (info, vrValue, true);
+        }
+    }
+
+    return true;
+}
+
 /**
  * @brief Find type for the vectorization
  * @param cUnit the CompilationUnit
@@ -553,6 +742,25 @@ static VectorizedType findType (const CompilationUnit * const cUnit, LoopInforma
         }
     }
 
+    //Array elements are loaded and stored as is so the lanes must have their exact size
+    if (info->arrayType != kVectorizedNoType)
+    {
+        if (type != kVectorizedNoType && type != info->arrayType)
+        {
+            VECTORIZATION_LOG (cUnit, "Array element size does not match the output type", reportFailure);
+            return kVectorizedNoType;
+        }
+
+        type = info->arrayType;
+    }
+
+    //Floats are only packed in lanes of their own size
+    if (info->hasFloatArithmetic == true && type != kVectorizedInt)
+    {
+        VECTORIZATION_LOG (cUnit, "Float arithmetic needs 4-byte lanes", reportFailure);
+        return kVectorizedNoType;
+    }
+
     return type;
 }
 
@@ -636,6 +844,39 @@ static bool fillVectorizationInformation (const CompilationUnit * const cUnit, L
     //Add 0, the proper vectorized value will be filled up later
     info->constants[increment] = 0;
 
+    //Array accesses must be indexed by the value of the IV at the loop head
+    MIR *phiIV = loopInformation->getPhiInstruction (cUnit, vrIV);
+
+    //Paranoid
+    if (phiIV == 0 || phiIV->ssaRep == 0 || phiIV->ssaRep->defs == 0)
+    {
+        return false;
+    }
+
+    int ssaIV = phiIV->ssaRep->defs[0];
+
+    //Only VRs with a phi node are carried between iterations. Any other VR defined in the loop is local
+    //to an iteration: it needs a vector register but no reduction.
+    std::set<int> phiVRs;
+
+    //Accumulations are only reduced at the exit: no value local to an iteration can be computed from them
+    std::set<int> accumulatorVRs;
+
+    for (MIR *mir = bb->firstMIRInsn; mir != 0; mir = mir->next)
+    {
+        if (mir->dalvikInsn.opcode == static_cast<Opcode>(kMirOpPhi))
+        {
+            int vrPhi = static_cast<int> (mir->dalvikInsn.vA);
+
+            phiVRs.insert (vrPhi);
+
+            if (static_cast<unsigned int> (vrPhi) != vrIV)
+            {
+                accumulatorVRs.insert (vrPhi);
+            }
+        }
+    }
+
     //Go through the MIRs of the BB and fill up information
     for (MIR *mir = bb->firstMIRInsn; mir != 0; mir = mir->next)
     {
@@ -656,6 +897,17 @@ static bool fillVectorizationInformation (const CompilationUnit * const cUnit, L
             continue;
         }
 
+        //Array accesses indexed by the IV become packed loads and stores
+        if (getArrayAccessType (mir->dalvikInsn.opcode) != kVectorizedNoType)
+        {
+            if (fillArrayAccessInformation (cUnit, mir, ssaIV, phiVRs, vrIV, info) == false)
+            {
+                return false;
+            }
+
+            continue;
+        }
+
         //Now let's bail if we have any other bytecode which cannot be in a vectorized loop
         //We count on isVectorizable not allowing any memory operations.
         if (isVectorizable (mir) == false)
@@ -749,6 +1001,32 @@ static bool fillVectorizationInformation (const CompilationUnit * const cUnit, L
             continue;
         }
 
+        //See if we have uses
+        if (ssaRep->uses == 0)
+        {
+            return false;
+        }
+
+        //Is this float arithmetic?
+        bool isFloatArithmetic = isPackedFloatOpcode (getVectorizedOpcode (mir->dalvikInsn.opcode));
+
+        if (isFloatArithmetic == true)
+        {
+            info->hasFloatArithmetic = true;
+        }
+
+        //Does this MIR read an accumulation?
+        bool usesAccumulator = false;
+        for (int useIndex = 0; useIndex < ssaRep->numUses; useIndex++)
+        {
+            int vrUsed = dvmExtractSSARegister (cUnit, ssaRep->uses[useIndex]);
+
+            if (accumulatorVRs.find (vrUsed) != accumulatorVRs.end ())
+            {
+                usesAccumulator = true;
+            }
+        }
+
         //Explicitly go through the defines to add them as outputs
         if (ssaRep->defs != 0)
         {
@@ -757,17 +1035,41 @@ static bool fillVectorizationInformation (const CompilationUnit * const cUnit, L
                 //Get the defined dalvik reg
                 int defDalvikReg = dvmExtractSSARegister (cUnit, ssaRep->defs[defIndex]);
 
+                //Only loop carried VRs are outputs
+                bool isLoopCarried = phiVRs.find (defDalvikReg) != phiVRs.end ();
+
+                //Summing the lanes separately reassociates the additions, which changes the rounding.
+                //Float min/max are calls to Math.min/max rather than bytecodes, and MINPS/MAXPS
+                //would not follow their NaN and -0.0 rules anyway, so no float reduction is done
+                if (isLoopCarried == true && isFloatArithmetic == true)
+                {
+                    VECTORIZATION_LOG (cUnit, "Float accumulation cannot be reordered", reportFailure);
+                    return false;
+                }
+
+                if (isLoopCarried == false)
+                {
+                    //Each lane of an accumulation only holds a partial value until the reduction
+                    if (usesAccumulator == true)
+                    {
+                        VECTORIZATION_LOG (cUnit, "Value local to the iteration uses an accumulation", reportFailure);
+                        return false;
+                    }
+
+                    //Paranoid: an input redefined in the loop without phi node would be loop carried
+                    std::map<int, RegisterAssociation>::const_iterator it = info->registers.find (defDalvikReg);
+                    if (it != info->registers.end () && it->second.input == true)
+                    {
+                        VECTORIZATION_LOG (cUnit, "Input redefined in the loop without phi node", reportFailure);
+                        return false;
+                    }
+                }
+
                 //Now set it as output
-                setOutputRegister (info, defDalvikReg, true);
+                setOutputRegister (info, defDalvikReg, isLoopCarried);
             }
         }
 
-        //See if we have uses
-        if (ssaRep->uses == 0)
-        {
-            return false;
-        }
-
         //Go through all the uses
         int useIndex = ssaRep->numUses - 1;
 
@@ -789,9 +1091,10 @@ static bool fillVectorizationInformation (const CompilationUnit * const cUnit, L
             }
             else
             {
-                //Otherwise, set it as output, except if the VR is a constant
+                //Otherwise, set it as output if it is loop carried, except if the VR is a constant
                 bool isNotAConst = (dvmCompilerDataFlowAttributes[defMir->dalvikInsn.opcode] & DF_SETS_CONST) == 0;
-                setOutputRegister (info, vrUsed, isNotAConst);
+                bool isLoopCarried = phiVRs.find (vrUsed) != phiVRs.end ();
+                setOutputRegister (info, vrUsed, isNotAConst == true && isLoopCarried == true);
             }
 
             //Go to the next use
@@ -1044,7 +1347,7 @@ static void hoistSetup (CompilationUnit *cUnit, LoopInformation *loopInfo, Vecto
         if (info->type == kVectorizedByte || info->type == kVectorizedShort)
         {
             constValue = constValue << 16;
-            constValue |= ((it->first) & 0xFF);
+            constValue |= ((it->first) & 0xFFFF);
         }
 
         mir->dalvikInsn.arg[0] = constValue;
@@ -1304,6 +1607,154 @@ static bool haveSafeAccumulation (CompilationUnit *cUnit, LoopInformation *loopI
     return true;
 }
 
+/**
+ * @brief Find the range of indices accessed by the arrays of the loop
+ * @details Array accesses are indexed by the IV so the range goes from the value of the IV when entering
+ * the loop up to the last value for which the loop's if keeps iterating. The vectorized loop stops
+ * earlier than the scalar one so this range covers it as well.
+ * @param cUnit the CompilationUnit
+ * @param loopInfo the LoopInformation
+ * @param info the VectorizationInfo to fill the range in
+ * @return whether the range could be determined
+ */
+static bool findArrayAccessRange (const CompilationUnit * const cUnit, LoopInformation *loopInfo, VectorizationInfo *info)
+{
+    BasicBlock *bb = loopInfo->getEntryBlock ();
+
+    //findUpperBound already made sure we end with an if comparing two VRs, one of them a constant
+    MIR *ifMIR = bb->lastMIRInsn;
+    SSARepresentation *ssaRep = ifMIR->ssaRep;
+
+    unsigned int vrIV = dvmExtractSSARegister (cUnit, loopInfo->getSSABIV ());
+    MIR *phiIV = loopInfo->getPhiInstruction (cUnit, vrIV);
+
+    //Paranoid
+    if (phiIV == 0 || phiIV->ssaRep == 0 || phiIV->ssaRep->defWhere == 0)
+    {
+        return false;
+    }
+
+    //Get the condition in the form "IV op bound"
+    Opcode opcode = ifMIR->dalvikInsn.opcode;
+    int ivUse = 0;
+
+    if (dvmExtractSSARegister (cUnit, ssaRep->uses[0]) != vrIV)
+    {
+        ivUse = 1;
+
+        switch (opcode)
+        {
+            case OP_IF_LT:
+                opcode = OP_IF_GT;
+                break;
+            case OP_IF_GT:
+                opcode = OP_IF_LT;
+                break;
+            case OP_IF_LE:
+                opcode = OP_IF_GE;
+                break;
+            case OP_IF_GE:
+                opcode = OP_IF_LE;
+                break;
+            default:
+                break;
+        }
+    }
+
+    //Paranoid: the other operand must be the IV
+    if (dvmExtractSSARegister (cUnit, ssaRep->uses[ivUse]) != vrIV)
+    {
+        return false;
+    }
+
+    //Now get the condition for which the loop keeps iterating
+    if (bb->fallThrough != 0 && bb->fallThrough->blockType == kChainingCellBackwardBranch)
+    {
+        switch (opcode)
+        {
+            case OP_IF_GE:
+                opcode = OP_IF_LT;
+                break;
+            case OP_IF_GT:
+                opcode = OP_IF_LE;
+                break;
+            default:
+                opcode = OP_NOP;
+                break;
+        }
+    }
+
+    //A not equal test would let the vectorized loop step over its bound so we only take ordered tests
+    switch (opcode)
+    {
+        case OP_IF_LT:
+            info->lastIndex = info->upperBound - 1;
+            break;
+        case OP_IF_LE:
+            info->lastIndex = info->upperBound;
+            break;
+        default:
+            return false;
+    }
+
+    //If the if tests the IV before its increment, one more iteration is done
+    if (ssaRep->uses[ivUse] == phiIV->ssaRep->defs[0])
+    {
+        info->lastIndex++;
+    }
+
+    //Finally, find the value of the IV when entering the loop
+    bool foundFirstIndex = false;
+
+    for (int use = 0; use < phiIV->ssaRep->numUses; use++)
+    {
+        MIR *defMIR = phiIV->ssaRep->defWhere[use];
+
+        //Skip the increment of the IV
+        if (defMIR != 0 && defMIR->bb == bb)
+        {
+            continue;
+        }
+
+        //We do not handle a merge of several initial values
+        if (foundFirstIndex == true)
+        {
+            return false;
+        }
+
+        if (defMIR == 0)
+        {
+            //A subscript of 0 means it is live-in of the trace and can be checked from the entry
+            if (DECODE_SUB (dvmConvertSSARegToDalvik (cUnit, phiIV->ssaRep->uses[use])) != 0)
+            {
+                return false;
+            }
+
+            info->firstIndex = vrIV;
+            info->firstIndexIsConstant = false;
+        }
+        else
+        {
+            bool isWide = false;
+            int constValue;
+            int constValueHighIgnored;
+
+            if (dexGetConstant (defMIR->dalvikInsn, constValue, constValueHighIgnored, isWide) == false
+                    || isWide == true)
+            {
+                return false;
+            }
+
+            info->firstIndex = constValue;
+            info->firstIndexIsConstant = true;
+        }
+
+        foundFirstIndex = true;
+    }
+
+    return foundFirstIndex;
+}
+
 static bool vectorizationGate (const CompilationUnit * const cUnit, LoopInformation *loopInfo, VectorizationInfo *info)
 {
     //Check if we are looking at simple loop
@@ -1380,6 +1831,36 @@ static bool vectorizationGate (const CompilationUnit * const cUnit, LoopInformat
         return false;
     }
 
+    //Array accesses need the packed loads and stores, and a range we can check before the loop
+    if (info->arrays.empty () == false)
+    {
+        if (dvmCompilerArchSupportsExtendedOp (kMirOpPackedArrayGet) == false
+                || dvmCompilerArchSupportsExtendedOp (kMirOpPackedArrayPut) == false)
+        {
+            VECTORIZATION_LOG (cUnit, "No architecture support for packed array accesses", reportFailure);
+            return false;
+        }
+
+        if (findArrayAccessRange (cUnit, loopInfo, info) == false)
+        {
+            VECTORIZATION_LOG (cUnit, "Cannot find the range of the array accesses", reportFailure);
+            return false;
+        }
+    }
+
+    //Float arithmetic needs the packed single precision operations
+    if (info->hasFloatArithmetic == true)
+    {
+        if (dvmCompilerArchSupportsExtendedOp (kMirOpPackedFloatAddition) == false
+                || dvmCompilerArchSupportsExtendedOp (kMirOpPackedFloatSubtract) == false
+                || dvmCompilerArchSupportsExtendedOp (kMirOpPackedFloatMultiply) == false
+                || dvmCompilerArchSupportsExtendedOp (kMirOpPackedFloatDivide) == false)
+        {
+            VECTORIZATION_LOG (cUnit, "No architecture support for packed float operations", reportFailure);
+            return false;
+        }
+    }
+
     //Does the vectorization in the BE support the size
     if (dvmCompilerArchSupportsVectorizedPackedSize (convertTypeToSize (info->type)) == false )
     {
@@ -1725,7 +2206,7 @@ static void handleAluLiteral (CompilationUnit *cUnit, LoopInformation *loopInfor
 
 /**
  * @brief Handle the generation of vectorization instruction for alu operation
- * @details Generates a vectorized extended MIR equivalent to the int alu operation
+ * @details Generates a vectorized extended MIR equivalent to the int or float alu operation
  * @param cUnit the CompilationUnit
  * @param info the VectorizationInfo
  * @param vectorizedBB the BasicBlock which is getting vectorized
@@ -1933,6 +2414,61 @@ static void handleConstant (CompilationUnit *cUnit, LoopInformation *loopInforma
     }
 }
 
+/**
+ * @brief Handle the vectorization of an array access
+ * @details The aget or aput keeps its array and index VRs, only the value becomes a vectorized register
+ * @param info the VectorizationInfo
+ * @param mir the MIR instruction
+ * @param size of the vectorization in bytes
+ */
+static void handleArrayAccess (VectorizationInfo *info, MIR *mir, unsigned int size)
+{
+    DecodedInstruction &insn = mir->dalvikInsn;
+
+    //An aget defines vA while an aput uses it
+    bool isLoad = (dvmCompilerDataFlowAttributes[insn.opcode] & DF_DA) != 0;
+
+    insn.opcode = static_cast<Opcode> (isLoad == true ? kMirOpPackedArrayGet : kMirOpPackedArrayPut);
+    insn.vA = (info->registers.find (insn.vA)->second).vectorized;
+    insn.arg[0] = size;
+}
+
+/**
+ * @brief Hoist the null and bound checks of the arrays accessed in the loop
+ * @details The checks go in the entry block: the arrays and the first index are not assigned in the
+ * trace. A failing check punts to the interpreter at the start of the trace.
+ * @param cUnit the CompilationUnit
+ * @param info the VectorizationInfo
+ * @return whether all the checks were hoisted
+ */
+static bool hoistArrayChecks (CompilationUnit *cUnit, VectorizationInfo *info)
+{
+    BasicBlock *entry = cUnit->entryBlock;
+
+    for (std::set<int>::const_iterator it = info->arrays.begin (); it != info->arrays.end (); it++)
+    {
+        int vrArray = *it;
+
+        //The hoisting helpers all fail for the same reasons so either all checks get hoisted or none does
+        if (dvmCompilerGenerateNullCheckHoist (entry, vrArray) == false)
+        {
+            return false;
+        }
+
+        if (dvmCompilerGenerateBoundCheckHoist (entry, vrArray, info->firstIndex, info->firstIndexIsConstant) == false)
+        {
+            return false;
+        }
+
+        if (dvmCompilerGenerateBoundCheckHoist (entry, vrArray, info->lastIndex, true) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /**
   * @brief Transform mir in the vectorized loop
   * @param cUnit CompilationUnit
@@ -1975,6 +2511,10 @@ static void transformMirVectorized (CompilationUnit *cUnit,
         case OP_AND_INT:
         case OP_OR_INT:
         case OP_XOR_INT:
+        case OP_ADD_FLOAT:
+        case OP_SUB_FLOAT:
+        case OP_MUL_FLOAT:
+        case OP_DIV_FLOAT:
             handleAlu (cUnit, info, vectorizedBB, mir, size);
             break;
 
@@ -1983,6 +2523,15 @@ static void transformMirVectorized (CompilationUnit *cUnit,
         case OP_CONST_16:
             handleConstant (cUnit, loopInformation, info, mir);
             break;
+
+        case OP_AGET:
+        case OP_AGET_CHAR:
+        case OP_AGET_SHORT:
+        case OP_APUT:
+        case OP_APUT_CHAR:
+        case OP_APUT_SHORT:
+            handleArrayAccess (info, mir, size);
+            break;
         //For all the other opcodes, skipped it for now for vectorization transformation
         default:
             return;
@@ -2120,6 +2669,13 @@ static bool vectorizeHelper (CompilationUnit *cUnit, LoopInformation *loopInform
         return true;
     }
 
+    //The packed array accesses have no checks of their own so hoist them first
+    if (hoistArrayChecks (cUnit, &info) == false)
+    {
+        //We let it continue to the next loop
+        return true;
+    }
+
     //We want a copy of all of these
     BasicBlock *copyBasicBlock = dvmCompilerCopyBasicBlock (cUnit, bb);
     BasicBlock *copyPreHeader = dvmCompilerCopyBasicBlock (cUnit, preheader);
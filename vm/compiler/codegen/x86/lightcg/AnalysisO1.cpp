@@ -325,7 +325,7 @@ void initializeAllRegs() {
     memset (allRegs, PhysicalReg_Null, sizeof (allRegs));
 
     int k;
-    for(k = PhysicalReg_EAX; k <= PhysicalReg_EBP; k++) {
+    for(k = PhysicalReg_StartOfGPMarker; k <= PhysicalReg_EndOfGPMarker; k++) {
         allRegs[k].physicalReg = (PhysicalReg) k;
         if(k == PhysicalReg_EDI || k == PhysicalReg_ESP || k == PhysicalReg_EBP)
             allRegs[k].isUsed = true;
@@ -338,7 +338,7 @@ void initializeAllRegs() {
         else
             allRegs[k].isCalleeSaved = false;
     }
-    for(k = PhysicalReg_XMM0; k <= PhysicalReg_XMM7; k++) {
+    for(k = PhysicalReg_StartOfXmmMarker; k <= PhysicalReg_EndOfXmmMarker; k++) {
         allRegs[k].physicalReg = (PhysicalReg) k;
         allRegs[k].isUsed = false;
         allRegs[k].freeTimeStamp = -1;
@@ -348,13 +348,13 @@ void initializeAllRegs() {
 
 /** sync up allRegs (isUsed & freeTimeStamp) with compileTable
     global data: RegisterInfo allRegs[PhysicalReg_Null]
-    update allRegs[EAX to XMM7] except EDI,ESP,EBP
+    update all gp and xmm registers of allRegs except EDI,ESP,EBP
     update RegisterInfo.isUsed & RegisterInfo.freeTimeStamp
         if the physical register was used and is not used now
 */
 void syncAllRegs() {
     int k, k2;
-    for(k = PhysicalReg_EAX; k <= PhysicalReg_XMM7; k++) {
+    for(k = PhysicalReg_StartOfGPMarker; k <= PhysicalReg_EndOfXmmMarker; k++) {
         if(k == PhysicalReg_EDI || k == PhysicalReg_ESP || k == PhysicalReg_EBP)
             continue;
         //check whether the physical register is used by any logical register
@@ -1709,7 +1709,7 @@ int mergeEntry2 (BasicBlock_O1* bb, VirtualRegInfo &currentInfo)
             hasAlias = true;
             if(typeB == LowOpndRegType_gp) {
                 //merge allocConstraints
-                for(k = 0; k < 8; k++) {
+                for(k = 0; k < NUM_GP_REGS; k++) {
                     bb->infoBasicBlock[jj].allocConstraints[k].count += currentInfo.allocConstraints[k].count;
                 }
             }
@@ -1759,7 +1759,7 @@ int mergeEntry2 (BasicBlock_O1* bb, VirtualRegInfo &currentInfo)
         ALOGI("Update accessType in case 3: VR %d %d accessType %d", regB, typeB, info.accessType);
 #endif
         info.regNum = regB;
-        for(k = 0; k < 8; k++)
+        for(k = 0; k < NUM_GP_REGS; k++)
             info.allocConstraints[k] = currentInfo.allocConstraints[k];
 #ifdef DEBUG_MERGE_ENTRY
         ALOGI("isMerged is false, call updateDefUseTable");
@@ -3462,14 +3462,14 @@ int getFreeReg(int type, int reg, int indexToCompileTable) {
     int k;
     if(((type & MASK_FOR_TYPE) == LowOpndRegType_xmm) ||
        ((type & MASK_FOR_TYPE) == LowOpndRegType_ss)) {
-        for(k = PhysicalReg_XMM0; k <= PhysicalReg_XMM7; k++) {
+        for(k = PhysicalReg_StartOfXmmMarker; k <= PhysicalReg_EndOfXmmMarker; k++) {
             if(!allRegs[k].isUsed) return k;
         }
         return -1;
     }
 #ifdef DEBUG_REGALLOC
     ALOGI("USED registers: ");
-    for(k = 0; k < 8; k++)
+    for(k = 0; k < NUM_GP_REGS; k++)
         ALOGI("%d used: %d time freed: %d callee-saveld: %d", k, allRegs[k].isUsed,
              allRegs[k].freeTimeStamp, allRegs[k].isCalleeSaved);
     ALOGI("");
@@ -3488,7 +3488,7 @@ int getFreeReg(int type, int reg, int indexToCompileTable) {
 
         /* check allocConstraints for this VR,
            return an available physical register with the highest constraint > 0 */
-        for(k = 0; k < 8; k++) {
+        for(k = 0; k < NUM_GP_REGS; k++) {
             if(currentBB->infoBasicBlock[index].allocConstraintsSorted[k].count == 0) break;
             int regCandidateT = currentBB->infoBasicBlock[index].allocConstraintsSorted[k].physicalReg;
             assert(regCandidateT < PhysicalReg_Null);
@@ -3502,7 +3502,7 @@ int getFreeReg(int type, int reg, int indexToCompileTable) {
         int currentCount = -1;
         int index1 = -1;
         int smallestTime = -1;
-        for(k = 0; k < 8; k++) {
+        for(k = 0; k < NUM_GP_REGS; k++) {
             int regCandidateT = currentBB->allocConstraintsSorted[k].physicalReg;
             assert(regCandidateT < PhysicalReg_Null);
             if(index1 >= 0 && currentBB->allocConstraintsSorted[k].count > currentCount)
@@ -3553,7 +3553,7 @@ int getFreeReg(int type, int reg, int indexToCompileTable) {
                 /* check allocConstraints on the VR
                    return an available physical register with the highest constraint > 0
                 */
-                for(k = 0; k < 8; k++) {
+                for(k = 0; k < NUM_GP_REGS; k++) {
                     if(currentBB->infoBasicBlock[index2].allocConstraintsSorted[k].count == 0) break;
                     int regCandidateT = currentBB->infoBasicBlock[index2].allocConstraintsSorted[k].physicalReg;
 #ifdef DEBUG_REGALLOC
@@ -3580,13 +3580,13 @@ int getFreeReg(int type, int reg, int indexToCompileTable) {
                otherwise, return the one in A with smallest free time
            To ignore whether it is callee-saved, add all candidates to set A
         */
-        int setAIndex[8];
+        int setAIndex[NUM_GP_REGS];
         int num_A = 0;
-        int setBIndex[8];
+        int setBIndex[NUM_GP_REGS];
         int num_B = 0;
         int index1 = -1; //points to an available physical reg with lowest count
         int currentCount = -1;
-        for(k = 0; k < 8; k++) {
+        for(k = 0; k < NUM_GP_REGS; k++) {
             int regCandidateT = currentBB->allocConstraintsSorted[k].physicalReg;
             if(is8Bit && regCandidateT > PhysicalReg_EDX) continue;
 
@@ -3940,7 +3940,7 @@ int sortAllocConstraint(RegAllocConstraint* allocConstraints,
                         RegAllocConstraint* allocConstraintsSorted, bool fromHighToLow) {
     int ii, jj;
     int num_sorted = 0;
-    for(jj = 0; jj < 8; jj++) {
+    for(jj = 0; jj < NUM_GP_REGS; jj++) {
         //figure out where to insert allocConstraints[jj]
         int count = allocConstraints[jj].count;
         int regT = allocConstraints[jj].physicalReg;
@@ -3979,7 +3979,7 @@ int sortAllocConstraint(RegAllocConstraint* allocConstraints,
         }
     } //for jj
 #ifdef DEBUG_ALLOC_CONSTRAINT
-    for(jj = 0; jj < 8; jj++) {
+    for(jj = 0; jj < NUM_GP_REGS; jj++) {
         if(allocConstraintsSorted[jj].count > 0)
             ALOGI("%d: register %d has count %d", jj, allocConstraintsSorted[jj].physicalReg, allocConstraintsSorted[jj].count);
     }
@@ -4932,6 +4932,7 @@ int beforeCall(const char* target) { //spill all live registers
        (!strcmp(target, "moddi3")) || (!strcmp(target, "divdi3")) ||
        (!strcmp(target, "execute_inline"))
        || (!strcmp(target, "dvmJitToPatchPredictedChain"))
+       || (!strcmp(target, "dvmJitToPatchPolymorphicChain"))
        || (!strcmp(target, "dvmJitHandlePackedSwitch"))
        || (!strcmp(target, "dvmJitHandleSparseSwitch"))
 #if defined(WITH_SELF_VERIFICATION)
@@ -42,6 +42,10 @@
 #define MAX_TEMP_REG_PER_BYTECODE 30
 
 #define MAX_CONST_REG 150
+
+//! number of general purpose physical registers
+//! \note The backend only targets IA-32, so these are the eight 32-bit registers
+#define NUM_GP_REGS (PhysicalReg_EndOfGPMarker - PhysicalReg_StartOfGPMarker + 1)
 #define NUM_MEM_VR_ENTRY 140
 
 #define MASK_FOR_TYPE 7 //last 3 bits 111
@@ -1482,7 +1482,7 @@ int getVirtualRegInfo (VirtualRegInfo* infoArray, const MIR * currentMIR, bool u
     int num_regs_per_bytecode = 0;
     //update infoArray[xx].allocConstraints
     for(num = 0; num < MAX_REG_PER_BYTECODE; num++) {
-        for(kk = 0; kk < 8; kk++) {
+        for(kk = 0; kk < NUM_GP_REGS; kk++) {
             infoArray[num].allocConstraints[kk].physicalReg = (PhysicalReg)kk;
             infoArray[num].allocConstraints[kk].count = 0;
         }
@@ -1559,6 +1559,10 @@ int getVirtualRegInfo (VirtualRegInfo* infoArray, const MIR * currentMIR, bool u
             case kMirOpPackedShiftLeft:
             case kMirOpPackedSignedShiftRight:
             case kMirOpPackedUnsignedShiftRight:
+            case kMirOpPackedFloatAddition:
+            case kMirOpPackedFloatSubtract:
+            case kMirOpPackedFloatMultiply:
+            case kMirOpPackedFloatDivide:
                 //No virtual registers are being used
                 num_regs_per_bytecode = 0;
                 break;
@@ -1589,6 +1593,21 @@ int getVirtualRegInfo (VirtualRegInfo* infoArray, const MIR * currentMIR, bool u
 
                 num_regs_per_bytecode = 1;
                 break;
+            case kMirOpPackedArrayGet:
+            case kMirOpPackedArrayPut:
+                //The array and the index virtual registers are used to form the address
+                infoArray[0].regNum = currentMIR->dalvikInsn.vB;
+                infoArray[0].refCount = 1;
+                infoArray[0].accessType = REGACCESS_U;
+                infoArray[0].physicalType = LowOpndRegType_gp;
+
+                infoArray[1].regNum = currentMIR->dalvikInsn.vC;
+                infoArray[1].refCount = 1;
+                infoArray[1].accessType = REGACCESS_U;
+                infoArray[1].physicalType = LowOpndRegType_gp;
+
+                num_regs_per_bytecode = 2;
+                break;
             case kMirOpNullCheck:
                 if ((currentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK) == 0)
                 {
@@ -3590,7 +3609,11 @@ int updateInvokeRange(TempRegInfo* infoArray, int startIndex, const MIR * curren
 }
 
 /* update temporaries used by predicted INVOKE_VIRTUAL & INVOKE_INTERFACE */
-int updateGenPrediction(TempRegInfo* infoArray, bool isInterface) {
+int updateGenPrediction(TempRegInfo* infoArray, bool isInterface, const MIR * currentMIR) {
+    //each other entry of the polymorphic inline cache uses temp40 once,
+    //temp41 twice and defines then touches %ecx
+    int extraEntries = gDvmJit.polymorphicCacheSize - 1;
+
     infoArray[0].regNum = 40;
     infoArray[0].physicalType = LowOpndRegType_gp;
     infoArray[1].regNum = 41;
@@ -3600,8 +3623,8 @@ int updateGenPrediction(TempRegInfo* infoArray, bool isInterface) {
     infoArray[2].physicalType = LowOpndRegType_gp;
 
     if(isInterface) {
-        infoArray[0].refCount = 2+2;
-        infoArray[1].refCount = 3+2-1; //for temp41, -1 for gingerbread
+        infoArray[0].refCount = 2+2+extraEntries;
+        infoArray[1].refCount = 3+2-1+2*extraEntries; //for temp41, -1 for gingerbread
         infoArray[3].regNum = 33;
         infoArray[3].refCount = 4+1;
         infoArray[3].physicalType = LowOpndRegType_gp;
@@ -3609,7 +3632,7 @@ int updateGenPrediction(TempRegInfo* infoArray, bool isInterface) {
         infoArray[4].refCount = 5;
         infoArray[4].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
         infoArray[5].regNum = PhysicalReg_ECX;
-        infoArray[5].refCount = 1+1+2; //used in ArgsDone (twice)
+        infoArray[5].refCount = 1+1+2+2*extraEntries; //used in ArgsDone (twice)
         infoArray[5].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
         infoArray[6].regNum = 10;
         infoArray[6].refCount = 2;
@@ -3635,10 +3658,20 @@ int updateGenPrediction(TempRegInfo* infoArray, bool isInterface) {
         infoArray[13].regNum = 7;
         infoArray[13].refCount = 4;
         infoArray[13].physicalType = LowOpndRegType_scratch;
+        if(getImtProbeMethod(currentMIR->dalvikInsn.vB) != NULL) {
+            //the interface method table probe uses temp40 once, then
+            //defines temp46 used twice and defines %eax
+            infoArray[0].refCount++;
+            infoArray[4].refCount++;
+            infoArray[14].regNum = 46;
+            infoArray[14].refCount = 3;
+            infoArray[14].physicalType = LowOpndRegType_gp;
+            return 15;
+        }
         return 14;
     } else { //virtual or virtual_quick
-        infoArray[0].refCount = 2+2;
-        infoArray[1].refCount = 3+2-2; //for temp41, -2 for gingerbread
+        infoArray[0].refCount = 2+2+extraEntries;
+        infoArray[1].refCount = 3+2-2+2*extraEntries; //for temp41, -2 for gingerbread
         infoArray[2].refCount++; //for temp32 gingerbread
         infoArray[3].regNum = 33;
         infoArray[3].refCount = 4+1;
@@ -3650,7 +3683,7 @@ int updateGenPrediction(TempRegInfo* infoArray, bool isInterface) {
         infoArray[5].refCount = 2;
         infoArray[5].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
         infoArray[6].regNum = PhysicalReg_ECX;
-        infoArray[6].refCount = 1+3+2;
+        infoArray[6].refCount = 1+3+2+2*extraEntries;
         infoArray[6].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
         infoArray[7].regNum = 10;
         infoArray[7].refCount = 2;
@@ -3835,6 +3868,10 @@ int getTempRegInfo(TempRegInfo* infoArray, const MIR * currentMIR, const u2* dal
             case kMirOpPackedXor:
             case kMirOpPackedOr:
             case kMirOpPackedAnd:
+            case kMirOpPackedFloatAddition:
+            case kMirOpPackedFloatSubtract:
+            case kMirOpPackedFloatMultiply:
+            case kMirOpPackedFloatDivide:
             {
                 const int sourceXmm = PhysicalReg_StartOfXmmMarker + currentMIR->dalvikInsn.vB;
                 const int destXmm = PhysicalReg_StartOfXmmMarker + currentMIR->dalvikInsn.vA;
@@ -3958,6 +3995,27 @@ int getTempRegInfo(TempRegInfo* infoArray, const MIR * currentMIR, const u2* dal
 
                 return 2;
             }
+            case kMirOpPackedArrayGet:
+            case kMirOpPackedArrayPut:
+            {
+                //Temp1 holds the array reference and temp2 holds the index
+                //Each is defined when loading the VR and used when forming the address
+                infoArray[0].regNum = 1;
+                infoArray[0].refCount = 2;
+                infoArray[0].physicalType = LowOpndRegType_gp;
+
+                infoArray[1].regNum = 2;
+                infoArray[1].refCount = 2;
+                infoArray[1].physicalType = LowOpndRegType_gp;
+
+                //The xmm is either the destination of the load or the source of the store
+                const int xmm = PhysicalReg_StartOfXmmMarker + currentMIR->dalvikInsn.vA;
+                infoArray[2].regNum = xmm;
+                infoArray[2].refCount = 1;
+                infoArray[2].physicalType = LowOpndRegType_xmm | LowOpndRegType_hard;
+
+                return 3;
+            }
             case kMirOpNullCheck:
             {
                 unsigned int tempRegCount = 0;
@@ -4116,8 +4174,21 @@ int getTempRegInfo(TempRegInfo* infoArray, const MIR * currentMIR, const u2* dal
         infoArray[7].refCount = 2; //DU
         infoArray[7].physicalType = LowOpndRegType_gp;
         infoArray[8].regNum = PhysicalReg_EAX;
-        infoArray[8].refCount = 2; //DU
+        infoArray[8].refCount = 4; //DU
         infoArray[8].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
+        if (gDvm.biasedLocking == true) {
+            //the biased lock paths of monitor_enter_nohelper
+            infoArray[0].refCount = 8; //DU
+            infoArray[1].refCount = 10; //DU
+            infoArray[5].refCount = 6; //DU
+            infoArray[9].regNum = 6;
+            infoArray[9].refCount = 9; //DU
+            infoArray[9].physicalType = LowOpndRegType_gp;
+            infoArray[10].regNum = 7;
+            infoArray[10].refCount = 6; //DU
+            infoArray[10].physicalType = LowOpndRegType_gp;
+            return 11;
+        }
        return 9;
 
     case OP_MONITOR_EXIT:
@@ -4154,6 +4225,13 @@ int getTempRegInfo(TempRegInfo* infoArray, const MIR * currentMIR, const u2* dal
         infoArray[10].regNum = 7;
         infoArray[10].refCount = 3; //DU
         infoArray[10].physicalType = LowOpndRegType_gp;
+        if (gDvm.biasedLocking == true) {
+            //the biased lock path of op_monitor_exit
+            infoArray[7].refCount = 5; //DU
+            infoArray[8].refCount = 10; //DU
+            infoArray[9].refCount = 8; //DU
+            infoArray[10].refCount = 4; //DU
+        }
         return 11;
 
     case OP_CHECK_CAST:
@@ -4275,7 +4353,31 @@ int getTempRegInfo(TempRegInfo* infoArray, const MIR * currentMIR, const u2* dal
         infoArray[9].regNum = 4;
         infoArray[9].refCount = 2; //DU
         infoArray[9].physicalType = LowOpndRegType_scratch;
-        return 10;
+        if (isNewInstanceInlined(currentMIR) == false)
+            return 10;
+
+        //inline bump allocation from the thread's buffer
+        infoArray[0].refCount = 8; //also the allocated object
+        infoArray[1].refCount = 4; //also the bitmap shift
+        infoArray[10].regNum = 7; //self
+        infoArray[10].refCount = 6; //DU
+        infoArray[10].physicalType = LowOpndRegType_gp;
+        infoArray[11].regNum = 8; //buffer top
+        infoArray[11].refCount = 6; //DU
+        infoArray[11].physicalType = LowOpndRegType_gp;
+        infoArray[12].regNum = 9; //new buffer top
+        infoArray[12].refCount = 3; //DU
+        infoArray[12].physicalType = LowOpndRegType_gp;
+        infoArray[13].regNum = 10; //header, then bitmap word address
+        infoArray[13].refCount = 8; //DU
+        infoArray[13].physicalType = LowOpndRegType_gp;
+        infoArray[14].regNum = 11; //bitmap offset, then word index
+        infoArray[14].refCount = 4; //DU
+        infoArray[14].physicalType = LowOpndRegType_gp;
+        infoArray[15].regNum = 12; //bitmap mask
+        infoArray[15].refCount = 3; //DU
+        infoArray[15].physicalType = LowOpndRegType_gp;
+        return 16;
 
     case OP_NEW_ARRAY:
         infoArray[0].regNum = PhysicalReg_EAX;
@@ -5443,7 +5545,7 @@ int getTempRegInfo(TempRegInfo* infoArray, const MIR * currentMIR, const u2* dal
     case OP_INVOKE_VIRTUAL:
     case OP_INVOKE_VIRTUAL_RANGE:
 #ifdef PREDICTED_CHAINING
-        numTmps = updateGenPrediction(infoArray, false /*not interface*/);
+        numTmps = updateGenPrediction(infoArray, false /*not interface*/, currentMIR);
         infoArray[numTmps].regNum = 5;
         infoArray[numTmps].refCount = 3; //DU
         infoArray[numTmps].physicalType = LowOpndRegType_gp;
@@ -5598,7 +5700,7 @@ int getTempRegInfo(TempRegInfo* infoArray, const MIR * currentMIR, const u2* dal
     case OP_INVOKE_INTERFACE:
     case OP_INVOKE_INTERFACE_RANGE:
 #ifdef PREDICTED_CHAINING
-        numTmps = updateGenPrediction(infoArray, true /*interface*/);
+        numTmps = updateGenPrediction(infoArray, true /*interface*/, currentMIR);
         infoArray[numTmps].regNum = 1;
         infoArray[numTmps].refCount = 3; //DU
         infoArray[numTmps].physicalType = LowOpndRegType_gp;
@@ -6663,7 +6765,7 @@ int getTempRegInfo(TempRegInfo* infoArray, const MIR * currentMIR, const u2* dal
     case OP_INVOKE_VIRTUAL_QUICK:
     case OP_INVOKE_VIRTUAL_QUICK_RANGE:
 #ifdef PREDICTED_CHAINING
-        numTmps = updateGenPrediction(infoArray, false /*not interface*/);
+        numTmps = updateGenPrediction(infoArray, false /*not interface*/, currentMIR);
         infoArray[numTmps].regNum = 1;
         infoArray[numTmps].refCount = 3; //DU
         infoArray[numTmps].physicalType = LowOpndRegType_gp;
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <sys/mman.h>
+#include <limits.h>
 #include "CompilationErrorLCG.h"
 #include "CompilationUnit.h"
 #include "Dalvik.h"
@@ -447,6 +448,8 @@ bool dvmCompilerArchSupportsExtendedOp (int extendedOpcode)
         case kMirOpCheckInlinePrediction:
         case kMirOpRegisterize:
         case kMirOpPackedSet:
+        case kMirOpPackedArrayGet:
+        case kMirOpPackedArrayPut:
         case kMirOpConst128b:
         case kMirOpMove128b:
         case kMirOpPackedAddition:
@@ -458,6 +461,10 @@ bool dvmCompilerArchSupportsExtendedOp (int extendedOpcode)
         case kMirOpPackedAnd:
         case kMirOpPackedOr:
         case kMirOpPackedXor:
+        case kMirOpPackedFloatAddition:
+        case kMirOpPackedFloatSubtract:
+        case kMirOpPackedFloatMultiply:
+        case kMirOpPackedFloatDivide:
         case kMirOpPackedAddReduce:
         case kMirOpPackedReduce:
         case kMirOpCheckStackOverflow:
@@ -535,11 +542,89 @@ void dvmCompilerPatchInlineCache(void)
     dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
 }
 
+#if defined(WITH_JIT_TUNING)
+/* Number of call sites profiled for the polymorphic inline caches */
+#define POLYMORPHIC_CACHE_SITE_STATS 256
+
+/**
+ * @brief Profile of the polymorphic inline cache of a call site
+ * @details Only the misses reach the runtime: together with the entries in
+ * use, they tell whether a site would benefit from a different cache size
+ */
+struct PolymorphicCacheSiteStats
+{
+    PredictedChainingCell *cell;    //!< First entry of the inline cache, 0 if the slot is free
+    unsigned int misses;            //!< Number of misses handled by the runtime
+    unsigned int megamorphicMisses; //!< Number of misses while every entry was in use
+};
+
+/* Hashed on the address of the cells, sites beyond the table are not profiled */
+static PolymorphicCacheSiteStats polymorphicSiteStats[POLYMORPHIC_CACHE_SITE_STATS];
+
+/* Record an inline cache miss for the site of cell */
+static void recordPolymorphicCacheMiss(PredictedChainingCell *cell, bool megamorphic)
+{
+    unsigned int hash = (((unsigned int) cell) >> 2) % POLYMORPHIC_CACHE_SITE_STATS;
+
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+
+    for (unsigned int probe = 0; probe < POLYMORPHIC_CACHE_SITE_STATS; probe++) {
+        PolymorphicCacheSiteStats *stats =
+            &polymorphicSiteStats[(hash + probe) % POLYMORPHIC_CACHE_SITE_STATS];
+
+        if (stats->cell == NULL) {
+            stats->cell = cell;
+        }
+
+        if (stats->cell == cell) {
+            stats->misses++;
+            if (megamorphic == true) {
+                stats->megamorphicMisses++;
+            }
+            break;
+        }
+    }
+
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+}
+
+/* Dump the profile of every site of the polymorphic inline caches */
+static void dumpPolymorphicCacheStats(void)
+{
+    unsigned int entries = gDvmJit.polymorphicCacheSize;
+
+    for (unsigned int i = 0; i < POLYMORPHIC_CACHE_SITE_STATS; i++) {
+        const PolymorphicCacheSiteStats &stats = polymorphicSiteStats[i];
+
+        if (stats.cell == NULL) {
+            continue;
+        }
+
+        ALOGD("JIT: Polymorphic IC %p: %u misses, %u megamorphic",
+              stats.cell, stats.misses, stats.megamorphicMisses);
+
+        for (unsigned int entry = 0; entry < entries; entry++) {
+            const ClassObject *clazz = stats.cell[entry].clazz;
+
+            if (clazz != NULL && clazz != (ClassObject *) PREDICTED_CHAIN_FAKE_CLAZZ) {
+                ALOGD("JIT:     entry %u: %s -> %s", entry, clazz->descriptor,
+                      stats.cell[entry].method->name);
+            }
+        }
+    }
+}
+#endif
+
 /* Target-specific cache clearing */
 void dvmCompilerCacheClear(char *start, size_t size)
 {
     /* "0xFF 0xFF" is an invalid opcode for x86. */
     memset(start, 0xFF, size);
+
+#if defined(WITH_JIT_TUNING)
+    /* The profiled inline caches are gone with the code cache */
+    memset(polymorphicSiteStats, 0, sizeof(polymorphicSiteStats));
+#endif
 }
 
 /* for JIT debugging, to be implemented */
@@ -563,6 +648,9 @@ void dvmCompilerCodegenDump(CompilationUnit *cUnit) //in ArchUtility.c
 
 void dvmCompilerArchDump(void)
 {
+#if defined(WITH_JIT_TUNING)
+    dumpPolymorphicCacheStats();
+#endif
 }
 
 void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo* info)
@@ -797,6 +885,80 @@ done:
     return method;
 }
 
+/*
+ * Rechain after this many misses while a polymorphic inline cache still has
+ * free entries, the other receiver classes are expected shortly.
+ */
+#define POLYMORPHIC_CHAIN_COUNTER_FILL 64
+
+/*
+ * This method is called from the invoke code for virtual and interface
+ * methods when the class of the receiver matches none of the entries of the
+ * polymorphic inline cache starting at cell. The cache is made of
+ * gDvmJit.polymorphicCacheSize consecutive predicted chaining cells:
+ *   1) The class was chained meanwhile by another thread: nothing to do.
+ *   2) An entry is free: chain it like a monomorphic cell through
+ *      dvmJitToPatchPredictedChain.
+ *   3) Every entry is in use: the site is megamorphic, the callee found
+ *      through the vtable or itable is invoked without chaining and the
+ *      cache is left alone.
+ */
+extern "C" const Method *dvmJitToPatchPolymorphicChain(const Method *method,
+                                          Thread *self,
+                                          PredictedChainingCell *cell,
+                                          const ClassObject *clazz)
+{
+    unsigned int entries = gDvmJit.polymorphicCacheSize;
+    PredictedChainingCell *freeEntry = NULL;
+
+    for (unsigned int entry = 0; entry < entries; entry++) {
+        const ClassObject *entryClazz = cell[entry].clazz;
+
+        if (entryClazz == clazz) {
+            return method;
+        }
+
+        if (entryClazz == NULL && freeEntry == NULL) {
+            freeEntry = &cell[entry];
+        }
+    }
+
+#if defined(WITH_JIT_TUNING)
+    recordPolymorphicCacheMiss(cell, freeEntry == NULL);
+#endif
+
+    if (freeEntry == NULL) {
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.icPatchMegamorphic++;
+#endif
+        COMPILER_TRACE_CHAINING(
+            ALOGI("Jit Runtime: megamorphic chain %p misses %s",
+                  cell, clazz->descriptor));
+        self->icRechainCount = PREDICTED_CHAIN_COUNTER_RECHAIN;
+        return method;
+    }
+
+#if defined(WITH_JIT_TUNING)
+    if (freeEntry != cell) {
+        gDvmJit.icPatchPolymorphic++;
+    }
+#endif
+
+    dvmJitToPatchPredictedChain(method, self, freeEntry, clazz);
+
+    /* Come back soon if there is still room for another class */
+    for (PredictedChainingCell *entry = freeEntry + 1; entry < cell + entries; entry++) {
+        if (entry->clazz == NULL) {
+            if (self->icRechainCount > POLYMORPHIC_CHAIN_COUNTER_FILL) {
+                self->icRechainCount = POLYMORPHIC_CHAIN_COUNTER_FILL;
+            }
+            break;
+        }
+    }
+
+    return method;
+}
+
 /**
  * @class BackwardBranchChainingCellContents
  * @brief Defines the data structure of a Backward Branch Chaining Cell.
@@ -1430,16 +1592,22 @@ static bool handleInvokePredictedChainingCell (CompilationUnit *cUnit,
     PredictedChainingCell *predictedContents =
             reinterpret_cast<PredictedChainingCell *> (stream);
 
-    //Now initialize the data using the predefined macros for initialization
-    predictedContents->branch = PREDICTED_CHAIN_BX_PAIR_INIT1;
-    predictedContents->branch2 = PREDICTED_CHAIN_BX_PAIR_INIT2;
-    predictedContents->clazz = PREDICTED_CHAIN_CLAZZ_INIT;
-    predictedContents->method = PREDICTED_CHAIN_METHOD_INIT;
-    predictedContents->stagedClazz = PREDICTED_CHAIN_COUNTER_INIT;
+    //The polymorphic inline cache is made of consecutive cells, one per
+    //receiver class. Their size keeps each of them 4 byte aligned
+    for (unsigned int entry = 0; entry < gDvmJit.polymorphicCacheSize; entry++)
+    {
+        //Now initialize the data using the predefined macros for initialization
+        predictedContents->branch = PREDICTED_CHAIN_BX_PAIR_INIT1;
+        predictedContents->branch2 = PREDICTED_CHAIN_BX_PAIR_INIT2;
+        predictedContents->clazz = PREDICTED_CHAIN_CLAZZ_INIT;
+        predictedContents->method = PREDICTED_CHAIN_METHOD_INIT;
+        predictedContents->stagedClazz = PREDICTED_CHAIN_COUNTER_INIT;
+
+        predictedContents++;
+    }
 
     //Update stream pointer
-    stream = reinterpret_cast<char *> (predictedContents)
-            + sizeof(*predictedContents);
+    stream = reinterpret_cast<char *> (predictedContents);
 
 #else
     //assume rPC for callee->insns in %ebx
@@ -1560,6 +1728,18 @@ bool handleExtendedMIR (CompilationUnit *cUnit, BasicBlock_O1 *bb, MIR *mir)
         case kMirOpPackedUnsignedShiftRight:
             result = genPackedAlu (cUnit, mir, shr_opc);
             break;
+        case kMirOpPackedFloatAddition:
+            result = genPackedFloatAlu (cUnit, mir, add_opc);
+            break;
+        case kMirOpPackedFloatSubtract:
+            result = genPackedFloatAlu (cUnit, mir, sub_opc);
+            break;
+        case kMirOpPackedFloatMultiply:
+            result = genPackedFloatAlu (cUnit, mir, mul_opc);
+            break;
+        case kMirOpPackedFloatDivide:
+            result = genPackedFloatAlu (cUnit, mir, div_opc);
+            break;
         case kMirOpPackedAddReduce:
             result = genPackedHorizontalOperationWithReduce (cUnit, mir, add_opc);
             break;
@@ -1572,6 +1752,12 @@ bool handleExtendedMIR (CompilationUnit *cUnit, BasicBlock_O1 *bb, MIR *mir)
         case kMirOpPackedSet:
             result = genPackedSet (cUnit, mir);
             break;
+        case kMirOpPackedArrayGet:
+            result = genPackedArrayGet (cUnit, mir);
+            break;
+        case kMirOpPackedArrayPut:
+            result = genPackedArrayPut (cUnit, mir);
+            break;
         case kMirOpCheckStackOverflow:
             genCheckStackOverflow (cUnit, mir);
             break;
@@ -2264,6 +2450,23 @@ static void compileLCGMIR2LIR (CompilationUnit *cUnitME, JitTranslationInfo *inf
         size_t j;
         cUnit->numChainingCells[i] = chainingListByType[i].numUsed;
 
+#ifdef PREDICTED_CHAINING
+        //Unchaining walks every entry of the polymorphic inline caches as a cell
+        if (i == kChainingCellInvokePredicted)
+        {
+            cUnit->numChainingCells[i] *= gDvmJit.polymorphicCacheSize;
+
+            //The counts are recorded on a byte
+            if (cUnit->numChainingCells[i] > UCHAR_MAX)
+            {
+                ALOGI("JIT_INFO: Too many predicted chaining cells: %d", cUnit->numChainingCells[i]);
+                SET_JIT_ERROR(kJitErrorChainingCell);
+                endOfTrace (cUnit);
+                return;
+            }
+        }
+#endif
+
         /* No chaining cells of this type */
         if (cUnit->numChainingCells[i] == 0)
             continue;
@@ -29,6 +29,15 @@ class CompilationUnit_O1: public CompilationUnit
         /** @brief pointer to data structure for switch bytecode lowering*/
         struct SwitchInfo *switchInfo;
 
+        /** @brief Moves loading chaining cell addresses, patched at the end of the trace */
+        LabelMap *chainingWorklist;
+
+        /** @brief Forward jumps to basic blocks, patched at the end of the trace */
+        NCGWorklist *ncgWorklist;
+
+        /** @brief Switch and fill-array-data payloads, sorted by bytecode offset */
+        DataWorklist *dataWorklist;
+
     public:
 
        /**
@@ -36,6 +45,9 @@ class CompilationUnit_O1: public CompilationUnit
         */
         CompilationUnit_O1(void) {
             switchInfo = 0;
+            chainingWorklist = 0;
+            ncgWorklist = 0;
+            dataWorklist = 0;
         }
 
         /**
@@ -54,6 +66,54 @@ class CompilationUnit_O1: public CompilationUnit
             switchInfo = switchInformation;
         }
 
+        /**
+         * @brief Get the head of the chaining worklist
+         * @return the first entry, 0 if the worklist is empty
+         */
+        LabelMap *getChainingWorklist (void) const {
+            return chainingWorklist;
+        }
+
+        /**
+         * @brief Set the head of the chaining worklist
+         * @param head the new first entry
+         */
+        void setChainingWorklist (LabelMap *head) {
+            chainingWorklist = head;
+        }
+
+        /**
+         * @brief Get the head of the forward jump worklist
+         * @return the first entry, 0 if the worklist is empty
+         */
+        NCGWorklist *getNCGWorklist (void) const {
+            return ncgWorklist;
+        }
+
+        /**
+         * @brief Set the head of the forward jump worklist
+         * @param head the new first entry
+         */
+        void setNCGWorklist (NCGWorklist *head) {
+            ncgWorklist = head;
+        }
+
+        /**
+         * @brief Get the head of the data worklist
+         * @return the first entry, 0 if the worklist is empty
+         */
+        DataWorklist *getDataWorklist (void) const {
+            return dataWorklist;
+        }
+
+        /**
+         * @brief Set the head of the data worklist
+         * @param head the new first entry
+         */
+        void setDataWorklist (DataWorklist *head) {
+            dataWorklist = head;
+        }
+
         /**
          * @brief Can we spill a register?
          * @param reg the register we care about
@@ -407,6 +407,50 @@ bool genPackedSet (CompilationUnit *cUnit, MIR *mir)
     return success;
 }
 
+bool genPackedArrayGet (CompilationUnit *cUnit, MIR *mir)
+{
+    int destXMM = PhysicalReg_StartOfXmmMarker + mir->dalvikInsn.vA;
+    int vrArray = mir->dalvikInsn.vB;
+    int vrIndex = mir->dalvikInsn.vC;
+    int elementSize = mir->dalvikInsn.arg[0];
+
+    //We use temp1 for the array and temp2 for the index
+    const int temp1 = 1;
+    const int temp2 = 2;
+
+    //The null and bound checks have been hoisted ahead of the loop so we only need the operands
+    get_virtual_reg (vrArray, OpndSize_32, temp1, false);
+    get_virtual_reg (vrIndex, OpndSize_32, temp2, false);
+
+    //Array contents are only guaranteed to be 8-byte aligned so we use an unaligned load
+    dump_mem_scale_reg (Mnemonic_MOVDQU, OpndSize_128, temp1, false, OFFSETOF_MEMBER (ArrayObject, contents),
+            temp2, false, elementSize, destXMM, true, LowOpndRegType_xmm);
+
+    return true;
+}
+
+bool genPackedArrayPut (CompilationUnit *cUnit, MIR *mir)
+{
+    int srcXMM = PhysicalReg_StartOfXmmMarker + mir->dalvikInsn.vA;
+    int vrArray = mir->dalvikInsn.vB;
+    int vrIndex = mir->dalvikInsn.vC;
+    int elementSize = mir->dalvikInsn.arg[0];
+
+    //We use temp1 for the array and temp2 for the index
+    const int temp1 = 1;
+    const int temp2 = 2;
+
+    //The null and bound checks have been hoisted ahead of the loop so we only need the operands
+    get_virtual_reg (vrArray, OpndSize_32, temp1, false);
+    get_virtual_reg (vrIndex, OpndSize_32, temp2, false);
+
+    //Array contents are only guaranteed to be 8-byte aligned so we use an unaligned store
+    dump_reg_mem_scale (Mnemonic_MOVDQU, OpndSize_128, srcXMM, true, temp1, false,
+            OFFSETOF_MEMBER (ArrayObject, contents), temp2, false, elementSize, LowOpndRegType_xmm);
+
+    return true;
+}
+
 bool genMoveData128b (CompilationUnit *cUnit, MIR *mir)
 {
 
@@ -512,6 +556,22 @@ bool genPackedAlu (CompilationUnit *cUnit, MIR *mir, ALU_Opcode aluOperation)
     return success;
 }
 
+bool genPackedFloatAlu (CompilationUnit *cUnit, MIR *mir, ALU_Opcode aluOperation)
+{
+    int dstXmm = mir->dalvikInsn.vA + PhysicalReg_StartOfXmmMarker;
+    int srcXmm = mir->dalvikInsn.vB + PhysicalReg_StartOfXmmMarker;
+
+    //Only single precision lanes are packed
+    if (mir->dalvikInsn.vC != 4)
+    {
+        ALOGD ("JIT_INFO: Unsupported size %d for packed float generation.", mir->dalvikInsn.vC);
+        SET_JIT_ERROR (kJitErrorUnsupportedVectorization);
+        return false;
+    }
+
+    return vec_fp_alu_reg_reg (aluOperation, srcXmm, true, dstXmm, true);
+}
+
 bool genPackedHorizontalOperationWithReduce (CompilationUnit *cUnit, MIR *mir, ALU_Opcode horizontalOperation)
 {
     int dstVr = mir->dalvikInsn.vA;
@@ -116,6 +116,24 @@ bool genMove128b (CompilationUnit *cUnit, MIR *mir);
  */
 bool genPackedSet (CompilationUnit *cUnit, MIR *mir);
 
+/**
+ * @brief Generate a packed load of consecutive array elements into an XMM
+ * @details Loads 128 bits starting at element vC of array vB into vA
+ * @param cUnit The CompilationUnit
+ * @param mir The MIR containing the dest XMM, the array and index VRs, and the element size
+ * @return whether the operation was successful
+ */
+bool genPackedArrayGet (CompilationUnit *cUnit, MIR *mir);
+
+/**
+ * @brief Generate a packed store of an XMM into consecutive array elements
+ * @details Stores vA into the 128 bits starting at element vC of array vB
+ * @param cUnit The CompilationUnit
+ * @param mir The MIR containing the source XMM, the array and index VRs, and the element size
+ * @return whether the operation was successful
+ */
+bool genPackedArrayPut (CompilationUnit *cUnit, MIR *mir);
+
 /**
  * @brief Generate a constant load of double-quadword size to an XMM
  * @param cUnit The CompilationUnit
@@ -135,6 +153,16 @@ bool genMoveData128b (CompilationUnit *cUnit, MIR *mir);
  */
 bool genPackedAlu (CompilationUnit *cUnit, MIR *mir, ALU_Opcode aluOperation);
 
+/**
+ * @brief Used to generate a packed single-precision floating point operation
+ * @details The vectorized registers are mapped 1:1 to XMM registers
+ * @param cUnit The compilation unit
+ * @param mir The vectorized MIR
+ * @param aluOperation The operation to vectorize: add, sub, mul, or div
+ * @return Returns whether the generation was successful
+ */
+bool genPackedFloatAlu (CompilationUnit *cUnit, MIR *mir, ALU_Opcode aluOperation);
+
 /**
  * @brief Used to generate a horizontal operation whose result will be reduced to a VR
  * @param cUnit The compilation unit
@@ -57,7 +57,6 @@ char* streamCode = NULL; //start of the Pure CodeItem?, not include the global s
 char* streamMethodStart; //start of the method
 char* stream; //current stream pointer
 Method* currentMethod = NULL;
-int currentExceptionBlockIdx = -1;
 BasicBlock* traceCurrentBB = NULL;
 JitMode traceMode = kJitTrace;
 CompilationUnit_O1 *gCompilationUnit;
@@ -474,10 +473,10 @@ void startOfTrace(const Method* method, int exceptionBlockId,
         isScratchPhysical = false;
     }
     currentMethod = (Method*)method;
-    currentExceptionBlockIdx = exceptionBlockId;
-    methodDataWorklist = NULL;
+    cUnit->setDataWorklist (NULL);
     globalShortWorklist = NULL;
-    globalNCGWorklist = NULL;
+    cUnit->setNCGWorklist (NULL);
+    cUnit->setChainingWorklist (NULL);
     singletonPtr<ExceptionHandlingRestoreState>()->reset();
 
     streamMethodStart = stream;
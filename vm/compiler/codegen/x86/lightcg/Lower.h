@@ -550,8 +550,8 @@ typedef struct NCGWorklist {
 /*!
 \brief data structure to handle SWITCH & FILL_ARRAY_DATA
 
-two data worklist are defined: globalDataWorklist (used by code cache) & methodDataWorklist
-methodDataWorklist is accessed by insertDataWorklist & performDataWorklist
+two data worklist are defined: globalDataWorklist (used by code cache) & the data worklist of CompilationUnit_O1
+the latter is accessed by insertDataWorklist & performDataWorklist
 */
 typedef struct DataWorklist {
   s4 relativePC; //relative offset in bytecode to access the data
@@ -578,6 +578,17 @@ typedef struct MapWorklist {
 #define NATIVE_SIZE_FOR_VM_STUBS 100000
 #define MAX_HANDLER_OFFSET 1024 //maximal number of handler offsets
 
+/*
+ * The lowering state below is process wide, yet it all belongs to the trace
+ * being lowered. That covers the code stream pointers (stream, streamStart,
+ * streamCode, streamMethodStart), the current method state (currentMethod,
+ * traceCurrentBB, traceMode, rPC, offsetPC), scratchRegs, the LowOp buffer,
+ * mapFromBCtoNCG, the label maps and gCompilationUnit, as well as the
+ * allocator tables in AnalysisO1.cpp. Only the chaining, forward jump and
+ * data worklists live in CompilationUnit_O1 so far. The backend is therefore
+ * not reentrant: it relies on the single compiler thread and lowers one trace
+ * at a time.
+ */
 extern int LstrClassCastExceptionPtr, LstrInstantiationErrorPtr, LstrInternalError, LstrFilledNewArrayNotImpl;
 extern int LstrArithmeticException, LstrArrayIndexException, LstrArrayStoreException, LstrStringIndexOutOfBoundsException;
 extern int LstrDivideByZero, LstrNegativeArraySizeException, LstrNoSuchMethodError, LstrNullPointerException;
@@ -587,11 +598,6 @@ extern LabelMap* globalMap;
 extern LabelMap* globalShortMap;
 extern LabelMap* globalWorklist;
 extern LabelMap* globalShortWorklist;
-extern NCGWorklist* globalNCGWorklist;
-extern DataWorklist* methodDataWorklist;
-#ifdef ENABLE_TRACING
-extern MapWorklist* methodMapWorklist;
-#endif
 extern PhysicalReg scratchRegs[4];
 
 #define C_SCRATCH_1 scratchRegs[0]
@@ -612,23 +618,16 @@ extern char* streamMethodStart; //start of the method
 extern char* stream; //current stream pointer
 
 extern Method* currentMethod;
-extern int currentExceptionBlockIdx;
 
 extern int globalMapNum;
-extern int globalWorklistNum;
 extern int globalDataWorklistNum;
 extern int globalPCWorklistNum;
-extern int chainingWorklistNum;
 extern int VMAPIWorklistNum;
 
 extern LabelMap* globalDataWorklist;
 extern LabelMap* globalPCWorklist;
-extern LabelMap* chainingWorklist;
 extern LabelMap* VMAPIWorklist;
 
-extern int ncgClassNum;
-extern int ncgMethodNum;
-
 // Global pointer to the current CompilationUnit
 class CompilationUnit_O1;
 extern CompilationUnit_O1 *gCompilationUnit;
@@ -974,6 +973,7 @@ int call_dvmJitHandleSparseSwitch();
 void call_dvmJitLookUpBigSparseSwitch();
 int call_dvmJitToInterpTraceSelectNoChain();
 int call_dvmJitToPatchPredictedChain();
+int call_dvmJitToPatchPolymorphicChain();
 void call_dvmJitToInterpNormal();
 /** @brief helper function to call dvmJitToInterpBackwardBranch */
 void call_dvmJitToInterpBackwardBranch();
@@ -1025,9 +1025,9 @@ void performChainingWorklist();
 void freeNCGWorklist();
 void freeDataWorklist();
 void freeLabelWorklist();
-/** @brief search chainingWorklist to return instruction offset address in move instruction */
+/** @brief search the chaining worklist to return instruction offset address in move instruction */
 char* searchChainingWorklist(unsigned int blockId);
-/** @brief search globalNCGWorklist to find the jmp/jcc offset address */
+/** @brief search the forward jump worklist to find the jmp/jcc offset address */
 char* searchNCGWorklist(int blockId);
 /** @brief search globalWorklist to find the jmp/jcc offset address */
 char* searchLabelWorklist(char* label);
@@ -1088,6 +1088,7 @@ int op_instance_of(const MIR * mir);
 
 int op_array_length(const MIR * mir);
 int op_new_instance(const MIR * mir);
+bool isNewInstanceInlined(const MIR * mir);
 int op_new_array(const MIR * mir);
 int op_filled_new_array(const MIR * mir);
 int op_filled_new_array_range(const MIR * mir);
@@ -1150,6 +1151,7 @@ int op_invoke_super_range(const MIR * mir);
 int op_invoke_direct_range(const MIR * mir);
 int op_invoke_static_range(const MIR * mir);
 int op_invoke_interface_range(const MIR * mir);
+const Method *getImtProbeMethod(u2 methodIdx);
 int op_int_to_long(const MIR * mir);
 int op_add_long_2addr(const MIR * mir);
 int op_add_int_lit8(const MIR * mir);
@@ -1592,6 +1594,18 @@ bool vec_mul_reg_reg (int srcReg, bool isSrcPhysical, int destReg, bool isDestPh
 bool vec_sub_reg_reg (int subtrahend, bool isSubtrahendPhysical, int minuend, bool isMinuendPhysical,
         OpndSize vectorUnitSize);
 
+/**
+ * @brief Applies one of the packed single-precision ADDPS, SUBPS, MULPS or DIVPS operations
+ * @details Operation applied is dest = dest op src on each of the four floats
+ * @param opc The operation: add_opc, sub_opc, mul_opc or div_opc
+ * @param srcReg The 128-bit register containing the src value
+ * @param isSrcPhysical Whether srcReg is physical
+ * @param destReg The 128-bit register where the result is to be stored
+ * @param isDestPhysical whether destReg is physical
+ * @return Returns true if generating instruction was successful
+ */
+bool vec_fp_alu_reg_reg (ALU_Opcode opc, int srcReg, bool isSrcPhysical, int destReg, bool isDestPhysical);
+
 /**
  * @brief Applies one of the PHADDx operations depending on size
  * @param srcReg The 128-bit register containing the packed source values
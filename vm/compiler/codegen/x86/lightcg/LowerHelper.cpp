@@ -97,6 +97,16 @@ const  Mnemonic map_of_sse_opcode_2_mnemonic[] = {
     Mnemonic_Null,   Mnemonic_Null,  Mnemonic_Null,
     Mnemonic_Null
 };
+//!mnemonic for packed single-precision SSE
+const  Mnemonic map_of_ps_opcode_2_mnemonic[] = {
+    Mnemonic_ADDPS,  Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null,   Mnemonic_SUBPS, Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_MULPS,  Mnemonic_Null,  Mnemonic_DIVPS, Mnemonic_Null,
+    Mnemonic_Null,   Mnemonic_Null,
+    Mnemonic_Null,   Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null,   Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null
+};
 //!mnemonic for SSE 64-bit integer
 const  Mnemonic map_of_64_opcode_2_mnemonic[] = {
     Mnemonic_PADDQ, Mnemonic_POR,   Mnemonic_Null,  Mnemonic_Null,
@@ -3548,6 +3558,22 @@ int call_dvmJitToPatchPredictedChain() {
     return 0;
 }
 
+int call_dvmJitToPatchPolymorphicChain() {
+    typedef const Method * (*vmHelper)(const Method *method,
+                                       Thread *self,
+                                       PredictedChainingCell *cell,
+                                       const ClassObject *clazz);
+    vmHelper funcPtr = dvmJitToPatchPolymorphicChain;
+    if(gDvm.executionMode == kExecutionModeNcgO1) {
+        beforeCall("dvmJitToPatchPolymorphicChain");
+        callFuncPtr((int)funcPtr, "dvmJitToPatchPolymorphicChain");
+        afterCall("dvmJitToPatchPolymorphicChain");
+    } else {
+        callFuncPtr((int)funcPtr, "dvmJitToPatchPolymorphicChain");
+    }
+    return 0;
+}
+
 //!generate native code to call __moddi3
 
 //!
@@ -4667,6 +4693,23 @@ bool vec_mul_reg_reg (int srcReg, bool isSrcPhysical, int destReg, bool isDestPh
     return true;
 }
 
+bool vec_fp_alu_reg_reg (ALU_Opcode opc, int srcReg, bool isSrcPhysical, int destReg, bool isDestPhysical)
+{
+    Mnemonic op = map_of_ps_opcode_2_mnemonic[opc];
+
+    if (op == Mnemonic_Null)
+    {
+        ALOGD ("JIT_INFO: Cannot support vectorized float operation %d", opc);
+        SET_JIT_ERROR (kJitErrorUnsupportedVectorization);
+        return false;
+    }
+
+    dump_reg_reg (op, ATOM_NORMAL_ALU, OpndSize_128, srcReg, isSrcPhysical, destReg, isDestPhysical, LowOpndRegType_xmm);
+
+    //If we get here everything went well
+    return true;
+}
+
 bool vec_and_reg_reg (int srcReg, bool isSrcPhysical, int destReg, bool isDestPhysical)
 {
     Mnemonic op = Mnemonic_PAND;
@@ -33,8 +33,6 @@
 #include "compiler/codegen/x86/VTuneSupportX86.h"
 #endif
 
-char* streamMisPred = NULL;
-
 /* according to callee, decide the ArgsDoneType*/
 ArgsDoneType convertCalleeToType(const Method* calleeMethod) {
     if(calleeMethod == NULL)
@@ -714,7 +712,8 @@ int common_invokeMethodNoRange_noJmp(const DecodedInstruction &decodedInst) {
     return 0;
 }
 
-int common_invokeMethod_Jmp(ArgsDoneType form) {
+//cellOffset: offset of the entry of a polymorphic inline cache from the taken chaining cell
+int common_invokeMethod_Jmp(ArgsDoneType form, int cellOffset = 0) {
 #if defined VTUNE_DALVIK
     int startStreamPtr = (int)stream;
 #endif
@@ -737,6 +736,9 @@ int common_invokeMethod_Jmp(ArgsDoneType form) {
     }
     int takenId = traceCurrentBB->taken ? traceCurrentBB->taken->id : 0;
     move_chain_to_mem(OpndSize_32, takenId, 0, PhysicalReg_ESP, true);
+    if (cellOffset != 0) {
+        alu_binary_imm_mem(OpndSize_32, add_opc, cellOffset, 0, PhysicalReg_ESP, true);
+    }
 
     //keep ecx live, if ecx was spilled, it is loaded here
     touchEcx();
@@ -1836,9 +1838,30 @@ void predicted_chain_interface_O0(u2 tmp) {
     move_reg_to_reg(OpndSize_32, PhysicalReg_EAX, true, PhysicalReg_ECX, true);
 }
 
+//! \brief Get the interface method an invoke-interface probes the interface method table with
+//! \param methodIdx the index of the interface method in the dex file of the current method
+//! \return the resolved interface method, or NULL if it is not resolved at JIT time
+const Method *getImtProbeMethod(u2 methodIdx) {
+    return dvmDexGetResolvedMethod(currentMethod->clazz->pDvmDex, methodIdx);
+}
+
 // 2 inputs: ChainingCell in temp 41, current class object in temp 40
 void predicted_chain_interface_O1(u2 tmp) {
 
+    /* the interface method table of the class gives the callee without a call
+       when the interface method is resolved: the slot is a JIT time constant */
+    const Method *interfaceMethod = getImtProbeMethod(tmp);
+    if (interfaceMethod != NULL) {
+        int slotOffset = dvmGetImtSlot(interfaceMethod) * sizeof(InterfaceMethodTableEntry);
+        move_mem_to_reg(OpndSize_32, OFFSETOF_MEMBER(ClassObject, imtable), 40, false, 46, false);
+        compare_imm_mem(OpndSize_32, (int) interfaceMethod,
+                slotOffset + OFFSETOF_MEMBER(InterfaceMethodTableEntry, interfaceMethod), 46, false);
+        move_mem_to_reg(OpndSize_32, slotOffset + OFFSETOF_MEMBER(InterfaceMethodTableEntry, method),
+                46, false, PhysicalReg_EAX, true);
+        conditional_jump(Condition_E, ".imt_hit", true);
+        rememberState(2);
+    }
+
     /* set up arguments to dvmFindInterfaceMethodInCache */
     load_effective_addr(-16, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
     move_imm_to_mem(OpndSize_32, tmp, 4, PhysicalReg_ESP, true);
@@ -1861,6 +1884,11 @@ void predicted_chain_interface_O1(u2 tmp) {
     /* the interface method is found */
     if (insertLabel(".find_interface_done", true) == -1)
         return;
+    if (interfaceMethod != NULL) {
+        transferToState(2);
+        if (insertLabel(".imt_hit", true) == -1)
+            return;
+    }
 #if 1 //
     /* for gingerbread, counter is stored in glue structure
        if clazz is not initialized, set icRechainCount to 0, otherwise, reduce it by 1 */
@@ -1900,7 +1928,7 @@ void predicted_chain_interface_O1(u2 tmp) {
     move_chain_to_mem(OpndSize_32, traceCurrentBB->taken->id, 8, PhysicalReg_ESP, true); //predictedChainCell
     move_reg_to_mem(OpndSize_32, 40, false, 12, PhysicalReg_ESP, true);
     scratchRegs[0] = PhysicalReg_SCRATCH_8;
-    call_dvmJitToPatchPredictedChain(); //inputs: method, unused, predictedChainCell, clazz
+    call_dvmJitToPatchPolymorphicChain(); //inputs: method, unused, predictedChainCell, clazz
     load_effective_addr(16, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
     transferToState(4);
 
@@ -1981,7 +2009,7 @@ void predicted_chain_virtual_O1(u2 IMMC) {
     move_chain_to_mem(OpndSize_32, traceTakenId, 8, PhysicalReg_ESP, true); //predictedChainCell
     move_reg_to_mem(OpndSize_32, 40, false, 12, PhysicalReg_ESP, true);
     scratchRegs[0] = PhysicalReg_SCRATCH_10;
-    call_dvmJitToPatchPredictedChain(); //inputs: method, unused, predictedChainCell, clazz
+    call_dvmJitToPatchPolymorphicChain(); //inputs: method, unused, predictedChainCell, clazz
     load_effective_addr(16, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
 
     //callee method in %ecx for invoke virtual
@@ -1993,6 +2021,12 @@ void predicted_chain_virtual_O1(u2 IMMC) {
 }
 
 static int invokeChain_inst = 0;
+
+/* labels of the entries of a polymorphic inline cache, the first one is .invokeChain */
+static const char *polymorphicChainLabels[POLYMORPHIC_CACHE_MAX_ENTRIES] = {
+    ".invokeChain", ".invokeChain_1", ".invokeChain_2", ".invokeChain_3"
+};
+
 /* object "this" is in %ebx */
 void gen_predicted_chain_O0(bool isRange, u2 tmp, int IMMC, bool isInterface,
         int inputReg, const DecodedInstruction &decodedInst) {
@@ -2124,6 +2158,13 @@ void gen_predicted_chain_O1(bool isRange, u2 tmp, int IMMC, bool isInterface,
        if equal, prediction is still valid, jump to .invokeChain */
     compare_reg_reg(40, false, 32, false);
     conditional_jump(Condition_E, ".invokeChain", true);
+
+    /* compare it against the other entries of the polymorphic inline cache */
+    for (unsigned int entry = 1; entry < gDvmJit.polymorphicCacheSize; entry++) {
+        compare_mem_reg(OpndSize_32, entry * sizeof(PredictedChainingCell) + offChainingCell_clazz,
+                41, false, 40, false);
+        conditional_jump(Condition_E, polymorphicChainLabels[entry], true);
+    }
     rememberState(1);
     invokeChain_inst++;
 
@@ -2136,6 +2177,16 @@ void gen_predicted_chain_O1(bool isRange, u2 tmp, int IMMC, bool isInterface,
 
     common_invokeMethod_Jmp(ArgsDone_Full); //will touch %ecx
 
+    /* the entries other than the first one provide their own method and chain */
+    for (unsigned int entry = 1; entry < gDvmJit.polymorphicCacheSize; entry++) {
+        if (insertLabel(polymorphicChainLabels[entry], true) == -1)
+            return;
+        goToState(1);
+        move_mem_to_reg(OpndSize_32, entry * sizeof(PredictedChainingCell) + offChainingCell_method,
+                41, false, PhysicalReg_ECX, true);
+        common_invokeMethod_Jmp(ArgsDone_Normal, entry * sizeof(PredictedChainingCell));
+    }
+
     if (insertLabel(".invokeChain", true) == -1)
         return;
     goToState(1);
@@ -45,29 +45,14 @@ LabelMap* globalWorklist = NULL;
 LabelMap* globalShortWorklist;
 
 int globalMapNum;
-int globalWorklistNum;
 int globalDataWorklistNum;
 int VMAPIWorklistNum;
 int globalPCWorklistNum;
-int chainingWorklistNum;
 
 LabelMap* globalDataWorklist = NULL;
 LabelMap* globalPCWorklist = NULL;
-LabelMap* chainingWorklist = NULL;
 LabelMap* VMAPIWorklist = NULL;
 
-char* ncgClassData;
-char* ncgClassDataPtr;
-char* ncgMethodData;
-char* ncgMethodDataPtr;
-int   ncgClassNum;
-int   ncgMethodNum;
-
-NCGWorklist* globalNCGWorklist;
-DataWorklist* methodDataWorklist;
-#ifdef ENABLE_TRACING
-MapWorklist* methodMapWorklist;
-#endif
 /*!
 \brief search globalShortMap to find the entry for the given label
 
@@ -308,10 +293,10 @@ int insertGlobalPCWorklist(char * offset, char * codeStart)
 }
 
 /*
- * search chainingWorklist to return instruction offset address in move instruction
+ * search the chaining worklist of gCompilationUnit to return instruction offset address in move instruction
  */
 char* searchChainingWorklist(unsigned int blockId) {
-    LabelMap* ptr = chainingWorklist;
+    LabelMap* ptr = gCompilationUnit->getChainingWorklist ();
     unsigned instSize;
 
     while (ptr != NULL) {
@@ -339,8 +324,8 @@ int insertChainingWorklist(int bbId, char * codeStart)
     item->size = OpndSize_32;
     item->codePtr = codeStart; //points to the move instruction
     item->addend = bbId; //relative code pointer
-    item->nextItem = chainingWorklist;
-    chainingWorklist = item;
+    item->nextItem = gCompilationUnit->getChainingWorklist ();
+    gCompilationUnit->setChainingWorklist (item);
 
 #ifdef DEBUG_NCG
     ALOGI("InsertChainingWorklist: %p basic block %d", codeStart, bbId);
@@ -398,22 +383,22 @@ int insertVMAPIWorklist(char * offset, const char* label)
 int updateImmRMInst(char* moveInst, const char* label, int relativeNCG); //forward declaration
 //////////////////// performLabelWorklist is defined differently for code cache
 void performChainingWorklist() {
-    LabelMap* ptr = chainingWorklist;
+    LabelMap* ptr = gCompilationUnit->getChainingWorklist ();
     while(ptr != NULL) {
         int tmpNCG = getLabelOffset (ptr->addend);
         char* NCGaddr = streamMethodStart + tmpNCG;
         updateImmRMInst(ptr->codePtr, "", (int)NCGaddr);
-        chainingWorklist = ptr->nextItem;
+        gCompilationUnit->setChainingWorklist (ptr->nextItem);
         free(ptr);
-        ptr = chainingWorklist;
+        ptr = gCompilationUnit->getChainingWorklist ();
     }
 }
 void freeChainingWorklist() {
-    LabelMap* ptr = chainingWorklist;
+    LabelMap* ptr = gCompilationUnit->getChainingWorklist ();
     while(ptr != NULL) {
-        chainingWorklist = ptr->nextItem;
+        gCompilationUnit->setChainingWorklist (ptr->nextItem);
         free(ptr);
-        ptr = chainingWorklist;
+        ptr = gCompilationUnit->getChainingWorklist ();
     }
 }
 
@@ -669,8 +654,8 @@ int getRelativeOffset(const char* target, bool isShortTerm, JmpCall_type type, b
 
 */
 void conditional_jump(ConditionCode cc, const char* target, bool isShortTerm) {
-    if(jumpToException(target) && currentExceptionBlockIdx >= 0) { //jump to the exceptionThrow block
-        condJumpToBasicBlock (cc, currentExceptionBlockIdx);
+    if(jumpToException(target) && gCompilationUnit != 0 && gCompilationUnit->exceptionBlockId >= 0) { //jump to the exceptionThrow block
+        condJumpToBasicBlock (cc, gCompilationUnit->exceptionBlockId);
         return;
     }
     Mnemonic m = (Mnemonic)(Mnemonic_Jcc + cc);
@@ -688,8 +673,8 @@ void conditional_jump(ConditionCode cc, const char* target, bool isShortTerm) {
 If the target is ".invokeArgsDone" and mode is NCG O1, extra work is performed to dump content of virtual registers to memory.
 */
 void unconditional_jump(const char* target, bool isShortTerm) {
-    if(jumpToException(target) && currentExceptionBlockIdx >= 0) { //jump to the exceptionThrow block
-        jumpToBasicBlock (currentExceptionBlockIdx);
+    if(jumpToException(target) && gCompilationUnit != 0 && gCompilationUnit->exceptionBlockId >= 0) { //jump to the exceptionThrow block
+        jumpToBasicBlock (gCompilationUnit->exceptionBlockId);
         return;
     }
     Mnemonic m = Mnemonic_JMP;
@@ -881,7 +866,7 @@ void call_mem(int disp, int reg, bool isPhysical) {
 }
 
 /*!
-\brief insert an entry to globalNCGWorklist
+\brief insert an entry to the forward jump worklist of gCompilationUnit
 
 */
 int insertNCGWorklist(s4 relativePC, OpndSize immSize) {
@@ -900,17 +885,17 @@ int insertNCGWorklist(s4 relativePC, OpndSize immSize) {
     item->offsetNCG = offsetNCG2;
     item->codePtr = stream;
     item->size = immSize;
-    item->nextItem = globalNCGWorklist;
-    globalNCGWorklist = item;
+    item->nextItem = gCompilationUnit->getNCGWorklist ();
+    gCompilationUnit->setNCGWorklist (item);
     return 0;
 }
 
 
 /*
- *search globalNCGWorklist to find the jmp/jcc offset address
+ *search the forward jump worklist of gCompilationUnit to find the jmp/jcc offset address
  */
 char* searchNCGWorklist(int blockId) {
-    NCGWorklist* ptr = globalNCGWorklist;
+    NCGWorklist* ptr = gCompilationUnit->getNCGWorklist ();
     unsigned instSize;
 
     while (ptr != NULL) {
@@ -933,7 +918,7 @@ int insertMapWorklist(s4 BCOffset, s4 NCGOffset, int isStartOfPC) {
 }
 #endif
 /*!
-\brief insert an entry to methodDataWorklist
+\brief insert an entry to the data worklist of gCompilationUnit
 
 This function is used by bytecode FILL_ARRAY_DATA, PACKED_SWITCH, SPARSE_SWITCH
 */
@@ -949,7 +934,7 @@ int insertDataWorklist(s4 relativePC, char* codePtr1) {
     item->offsetPC = offsetPC;
     item->codePtr = codePtr1;
     item->codePtr2 = stream; //jump_reg for switch
-    DataWorklist* ptr = methodDataWorklist;
+    DataWorklist* ptr = gCompilationUnit->getDataWorklist ();
     DataWorklist* prev_ptr = NULL;
     while(ptr != NULL) {
         int tmpPC = ptr->offsetPC + ptr->relativePC;
@@ -964,17 +949,17 @@ int insertDataWorklist(s4 relativePC, char* codePtr1) {
     if(prev_ptr != NULL) {
         prev_ptr->nextItem = item;
     }
-    else methodDataWorklist = item;
+    else gCompilationUnit->setDataWorklist (item);
     item->nextItem = ptr;
     return 0;
 }
 
 /*!
-\brief work on globalNCGWorklist
+\brief work on the forward jump worklist of gCompilationUnit
 
 */
 int performNCGWorklist() {
-    NCGWorklist* ptr = globalNCGWorklist;
+    NCGWorklist* ptr = gCompilationUnit->getNCGWorklist ();
     while(ptr != NULL) {
         int tmpNCG = getLabelOffset (ptr->relativePC);
         ALOGV("Perform NCG worklist: @ %p target block %d target NCG %x",
@@ -984,18 +969,18 @@ int performNCGWorklist() {
         unsigned instSize = encoder_get_inst_size(ptr->codePtr);
         relativeNCG -= instSize;
         updateJumpInst(ptr->codePtr, ptr->size, relativeNCG);
-        globalNCGWorklist = ptr->nextItem;
+        gCompilationUnit->setNCGWorklist (ptr->nextItem);
         free(ptr);
-        ptr = globalNCGWorklist;
+        ptr = gCompilationUnit->getNCGWorklist ();
     }
     return 0;
 }
 void freeNCGWorklist() {
-    NCGWorklist* ptr = globalNCGWorklist;
+    NCGWorklist* ptr = gCompilationUnit->getNCGWorklist ();
     while(ptr != NULL) {
-        globalNCGWorklist = ptr->nextItem;
+        gCompilationUnit->setNCGWorklist (ptr->nextItem);
         free(ptr);
-        ptr = globalNCGWorklist;
+        ptr = gCompilationUnit->getNCGWorklist ();
     }
 }
 
@@ -1019,10 +1004,10 @@ int getRelativeNCGForSwitch(int targetPC, char* codeInst) {
 }
 
 /*!
-\brief work on methodDataWorklist
+\brief work on the data worklist of gCompilationUnit
 */
 int performDataWorklist(void) {
-    DataWorklist* ptr = methodDataWorklist;
+    DataWorklist* ptr = gCompilationUnit->getDataWorklist ();
     if(ptr == NULL) return 0;
 
     char* codeCacheEnd = ((char *) gDvmJit.codeCache) + gDvmJit.codeCacheSize - CODE_CACHE_PADDING;
@@ -1048,9 +1033,9 @@ int performDataWorklist(void) {
         if (gDvmJit.codeCacheFull == true) {
             // We are out of code cache space. Skip writing data/code to
             //   code cache. Simply free the item.
-            methodDataWorklist = ptr->nextItem;
+            gCompilationUnit->setDataWorklist (ptr->nextItem);
             free(ptr);
-            ptr = methodDataWorklist;
+            ptr = gCompilationUnit->getDataWorklist ();
         }
 
         switch (INST_INST(tmpInst)) {
@@ -1119,18 +1104,18 @@ int performDataWorklist(void) {
         }
 
         //remove the item
-        methodDataWorklist = ptr->nextItem;
+        gCompilationUnit->setDataWorklist (ptr->nextItem);
         free(ptr);
-        ptr = methodDataWorklist;
+        ptr = gCompilationUnit->getDataWorklist ();
     }
     return 0;
 }
 void freeDataWorklist() {
-    DataWorklist* ptr = methodDataWorklist;
+    DataWorklist* ptr = gCompilationUnit->getDataWorklist ();
     while(ptr != NULL) {
-        methodDataWorklist = ptr->nextItem;
+        gCompilationUnit->setDataWorklist (ptr->nextItem);
         free(ptr);
-        ptr = methodDataWorklist;
+        ptr = gCompilationUnit->getDataWorklist ();
     }
 }
 
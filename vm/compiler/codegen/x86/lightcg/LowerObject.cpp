@@ -22,6 +22,11 @@
 #include "Lower.h"
 #include "NcgAot.h"
 #include "enc_wrapper.h"
+#ifdef WITH_TLA
+#include "alloc/HeapBitmap.h"
+#include "alloc/HeapSource.h"
+#include "alloc/ThreadLocalHeap.h"
+#endif
 
 extern void markCard_filled(int tgtAddrReg, bool isTgtPhysical, int scratchReg, bool isScratchPhysical);
 
@@ -250,8 +255,9 @@ int monitor_enter_nohelper(int vA, const MIR *mir) {
     }
 
     /////////////////////////////
-    //inline the simple case with JIT
-    //simple case is thin lock, held by no-one.
+    //inline the simple cases with JIT
+    //simple cases are a biased lock reserved for this thread, and a thin
+    //lock held by no-one
 
     //backup the self pointer and Oject for native implementation
     //which will be passed to dvmLockObject() as parameter
@@ -261,24 +267,69 @@ int monitor_enter_nohelper(int vA, const MIR *mir) {
     //get the Obj->lock
     move_mem_to_reg(OpndSize_32, offsetof(Object, lock), 1, false, 2, false);
 
-    //if it is the simple case, the object lock should contain all 0s except the hash_state bits
+    //get self->threadId
+    move_mem_to_reg(OpndSize_32, offsetof(Thread, threadId), 3, false, 3, false);
+    alu_binary_imm_reg(OpndSize_32, shl_opc, LW_LOCK_OWNER_SHIFT, 3, false);
+
+    if (gDvm.biasedLocking == true) {
+        //a lock biased to this thread in the current epoch of the class matches
+        //threadId | epoch | LW_BIASED once the hash state and the count are masked
+        //off, a stale bias is left to the VM
+        move_reg_to_reg(OpndSize_32, 2, false, 6, false);
+        alu_binary_imm_reg(OpndSize_32, and_opc,
+                ~((LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT) |
+                  (LW_LOCK_COUNT_MASK << LW_LOCK_COUNT_SHIFT)), 6, false);
+        move_mem_to_reg(OpndSize_32, offsetof(Object, clazz), 1, false, 7, false);
+        move_mem_to_reg(OpndSize_32, OFFSETOF_MEMBER(ClassObject, biasEpoch), 7, false, 7, false);
+        alu_binary_imm_reg(OpndSize_32, or_opc, (int)LW_BIASED, 7, false);
+        alu_binary_reg_reg(OpndSize_32, or_opc, 3, false, 7, false);
+    }
+
+    //if it is the simple thin case, the object lock should contain all 0s except the hash_state bits
     //save the value to EAX, which will be used for CMPXCHG
-    alu_binary_imm_reg(OpndSize_32, and_opc, (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT), 2, false);
     move_reg_to_reg(OpndSize_32, 2, false, PhysicalReg_EAX, true);
+    alu_binary_imm_reg(OpndSize_32, and_opc, (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT), PhysicalReg_EAX, true);
 
-    //get self->threadId
-    move_mem_to_reg(OpndSize_32, offsetof(Thread, threadId), 3, false, 3, false);
+    //remember the state of register before comditional_jump
+    rememberState(1);
+
+    if (gDvm.biasedLocking == true) {
+        compare_reg_reg(7, false, 6, false);
+        conditional_jump(Condition_NE, ".monitor_enter_thin", true);
+
+        //reserved for us: bump the hold count with a plain store, leaving
+        //the last count values to the VM, which unbiases the lock
+        alu_binary_imm_reg(OpndSize_32, add_opc, 1 << LW_LOCK_COUNT_SHIFT, 2, false);
+        move_reg_to_reg(OpndSize_32, 2, false, 6, false);
+        alu_binary_imm_reg(OpndSize_32, and_opc, LW_LOCK_COUNT_MASK << LW_LOCK_COUNT_SHIFT, 6, false);
+        compare_imm_reg(OpndSize_32, LW_LOCK_COUNT_MASK << LW_LOCK_COUNT_SHIFT, 6, false);
+        conditional_jump(Condition_E, ".call_monitor_native_implementation", true);
+        move_reg_to_mem(OpndSize_32, 2, false, offsetof(Object, lock), 1, false);
+        unconditional_jump(".call_monitor_native_done", true);
+
+        if (insertLabel(".monitor_enter_thin", true) == -1) {
+           return -1;
+        }
+        //bias the new lock to this thread unless the class stopped biasing
+        move_mem_to_reg(OpndSize_32, offsetof(Object, clazz), 1, false, 6, false);
+        compare_imm_mem(OpndSize_32, BIAS_REVOKE_THRESHOLD,
+                OFFSETOF_MEMBER(ClassObject, biasRevocations), 6, false);
+        conditional_jump(Condition_AE, ".monitor_enter_cas", true);
+        alu_binary_imm_reg(OpndSize_32, or_opc,
+                (int)(LW_BIASED | (1 << LW_LOCK_COUNT_SHIFT)), 3, false);
+        alu_binary_mem_reg(OpndSize_32, or_opc,
+                OFFSETOF_MEMBER(ClassObject, biasEpoch), 6, false, 3, false);
+        if (insertLabel(".monitor_enter_cas", true) == -1) {
+           return -1;
+        }
+    }
 
     //generate the new lock
-    alu_binary_imm_reg(OpndSize_32, shl_opc, LW_LOCK_OWNER_SHIFT, 3, false);
-    alu_binary_reg_reg(OpndSize_32, or_opc, 2, false, 3, false);
+    alu_binary_reg_reg(OpndSize_32, or_opc, PhysicalReg_EAX, true, 3, false);
 
     //add the lock to Object using cmpxchg, if it is simple case, EAX value should be same as Object->lock
     compareAndExchange(OpndSize_32, 3, false, offsetof(Object, lock), 1, false);
 
-    //remember the state of register before comditional_jump
-    rememberState(1);
-
     //if successful added lock, jump to the end of this function
     conditional_jump(Condition_Z, ".call_monitor_native_done", true);
 
@@ -418,7 +469,12 @@ int op_monitor_exit(const MIR * mir) {
         rememberState(1);
 
         //locked by other thread or fat lock or recursive lock, jump to call the native functions
-        conditional_jump(Condition_NE, "j_call_dvmUnlockObject", true);
+        //a biased lock is checked separately
+        if (gDvm.biasedLocking == true) {
+            conditional_jump(Condition_NE, ".unlock_object_biased", true);
+        } else {
+            conditional_jump(Condition_NE, "j_call_dvmUnlockObject", true);
+        }
 
         //create the new words(32bit) for obj->lock, it only contains the hash bits of original obj->lock
         alu_binary_imm_reg(OpndSize_32, and_opc, (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT), 6, false);
@@ -428,6 +484,37 @@ int op_monitor_exit(const MIR * mir) {
 
         //jump to the end of the function
         unconditional_jump(".unlock_object_done", true);
+
+        if (gDvm.biasedLocking == true) {
+            if (insertLabel(".unlock_object_biased", true) == -1) {
+               return -1;
+            }
+            //a lock biased to this thread matches threadId | LW_BIASED once the
+            //hash state, the epoch and the count are masked off
+            move_reg_to_reg(OpndSize_32, 6, false, 5, false);
+            alu_binary_imm_reg(OpndSize_32, and_opc,
+                    ~((LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT) |
+                      (LW_BIAS_EPOCH_MASK << LW_BIAS_EPOCH_SHIFT) |
+                      (LW_LOCK_COUNT_MASK << LW_LOCK_COUNT_SHIFT)), 5, false);
+            alu_binary_imm_reg(OpndSize_32, or_opc, (int)LW_BIASED, 4, false);
+            compare_reg_reg(4, false, 5, false);
+            conditional_jump(Condition_NE, "j_call_dvmUnlockObject", true);
+
+            //a zero count means it isn't held, leave the exception to the VM
+            move_reg_to_reg(OpndSize_32, 6, false, 5, false);
+            alu_binary_imm_reg(OpndSize_32, and_opc, LW_LOCK_COUNT_MASK << LW_LOCK_COUNT_SHIFT, 5, false);
+            compare_imm_reg(OpndSize_32, 0, 5, false);
+            conditional_jump(Condition_E, "j_call_dvmUnlockObject", true);
+
+            //drop a hold with a plain store, only a revocation can race it
+            //and that suspends this thread first; once a stale bias drops to
+            //zero another thread may take it over, but x86 doesn't reorder
+            //stores so the critical section is visible by then
+            alu_binary_imm_reg(OpndSize_32, sub_opc, 1 << LW_LOCK_COUNT_SHIFT, 6, false);
+            move_reg_to_mem(OpndSize_32, 6, false, offsetof(Object, lock), 7, false);
+            unconditional_jump(".unlock_object_done", true);
+        }
+
         if (insertLabel("j_call_dvmUnlockObject", true) == -1) {
            return -1;
         }
@@ -523,6 +610,23 @@ int op_array_length(const MIR * mir) {
 #define P_GPR_2 PhysicalReg_ECX
 #define P_GPR_3 PhysicalReg_ESI
 
+/**
+ * @brief Whether new-instance bump allocates inline from the thread's buffer
+ * @param mir bytecode representation
+ * @return true when op_new_instance emits the inline fast path
+ */
+bool isNewInstanceInlined(const MIR * mir) {
+#if defined(WITH_JIT) && defined(WITH_TLA)
+    ClassObject *classPtr =
+          (currentMethod->clazz->pDvmDex->pResClasses[mir->dalvikInsn.vB]);
+    return (gDvm.gcHeap->tlhSource != NULL) && (classPtr != NULL) &&
+        (IS_CLASS_FLAG_SET(classPtr, CLASS_ISFINALIZABLE) == false) &&
+        (classPtr->objectSize <= TLBUFFER_MAX_ALLOC_SIZE);
+#else
+    return false;
+#endif
+}
+
 /**
  * @brief Generate native code for bytecode new-instance
  * @param mir bytecode representation
@@ -596,6 +700,52 @@ int op_new_instance(const MIR * mir) {
         handlePotentialException(
                                            Condition_NE, Condition_E,
                                            2, "common_throw_message");
+#endif
+#if defined(WITH_JIT) && defined(WITH_TLA)
+        /*
+         * Bump allocate from the thread's buffer when it has room, see
+         * ThreadLocalHeap.cpp.  The buffer is cleared, so only the header
+         * words, the class and the live bit are written.
+         */
+        bool inlineAlloc = isNewInstanceInlined(mir);
+        if (inlineAlloc == true) {
+            int need = TLBUFFER_CHUNKSIZE(classPtr->objectSize);
+            HeapBitmap *liveBits = dvmHeapSourceGetLiveBits();
+
+            get_self_pointer(7, false);
+            move_mem_to_reg(OpndSize_32, OFFSETOF_MEMBER(Thread, tlBufferTop), 7, false, 8, false);
+            load_effective_addr(need, 8, false, 9, false);
+            //limit is NULL when compiled code must not allocate inline, so any
+            //newTop above it (unsigned) goes to the slow path
+            compare_mem_reg(OpndSize_32, OFFSETOF_MEMBER(Thread, tlBufferLimit), 7, false, 9, false);
+            rememberState(1);
+            conditional_jump(Condition_A, ".new_instance_slow", true);
+            move_reg_to_mem(OpndSize_32, 9, false, OFFSETOF_MEMBER(Thread, tlBufferTop), 7, false);
+            alu_binary_imm_mem(OpndSize_32, add_opc, 1, OFFSETOF_MEMBER(Thread, tlBufferCount), 7, false);
+            //header: chunk size and owning buffer
+            move_imm_to_mem(OpndSize_32, need, 0, 8, false);
+            move_mem_to_reg(OpndSize_32, OFFSETOF_MEMBER(Thread, tlBufferHeader), 7, false, 10, false);
+            move_reg_to_mem(OpndSize_32, 10, false, 4, 8, false);
+            load_effective_addr(TLBUFFER_HEADER_SIZE, 8, false, PhysicalReg_EAX, true);
+            move_imm_to_mem(OpndSize_32, (int)classPtr, OFFSETOF_MEMBER(Object, clazz), PhysicalReg_EAX, true);
+            //live bit: no other thread writes the buffer's bitmap words
+            load_effective_addr(TLBUFFER_HEADER_SIZE - (int)liveBits->base, 8, false, 11, false);
+            move_reg_to_reg(OpndSize_32, 11, false, PhysicalReg_ECX, true);
+            alu_binary_imm_reg(OpndSize_32, shr_opc, 3, PhysicalReg_ECX, true);
+            move_imm_to_reg(OpndSize_32, (int)0x80000000, 12, false);
+            alu_binary_reg_reg(OpndSize_32, shr_opc, PhysicalReg_ECX, true, 12, false);
+            alu_binary_imm_reg(OpndSize_32, shr_opc, 8, 11, false);
+            //bits moves between the bitmaps at each GC, reload it
+            move_imm_to_reg(OpndSize_32, (int)&liveBits->bits, 10, false);
+            move_mem_to_reg(OpndSize_32, 0, 10, false, 10, false);
+            load_effective_addr_scale(10, false, 11, false, 4, 10, false);
+            alu_binary_reg_mem(OpndSize_32, or_opc, 12, false, 0, 10, false);
+            rememberState(2);
+            unconditional_jump(".new_instance_done", true);
+            if (insertLabel(".new_instance_slow", true) == -1)
+                return -1;
+            goToState(1);
+        }
 #endif
         //prepare to call dvmAllocObject, inputs: resolved class & flag ALLOC_DONT_TRACK
         load_effective_addr(-8, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
@@ -613,7 +763,22 @@ int op_new_instance(const MIR * mir) {
         //return value of dvmAllocObject is in %eax
         //if return value is null, throw exception
         compare_imm_reg(OpndSize_32, 0, PhysicalReg_EAX, true);
-#if defined(WITH_JIT)
+#if defined(WITH_JIT) && defined(WITH_TLA)
+        if (inlineAlloc == true) {
+            conditional_jump(Condition_NE, ".new_instance_allocated", true);
+            //jump to dvmJitToExceptionThrown
+            scratchRegs[0] = PhysicalReg_SCRATCH_4;
+            jumpToExceptionThrown(3/*exception number*/);
+            if (insertLabel(".new_instance_allocated", true) == -1)
+                return -1;
+            transferToState(2);
+        } else {
+            conditional_jump(Condition_NE, ".new_instance_done", true);
+            //jump to dvmJitToExceptionThrown
+            scratchRegs[0] = PhysicalReg_SCRATCH_4;
+            jumpToExceptionThrown(3/*exception number*/);
+        }
+#elif defined(WITH_JIT)
         conditional_jump(Condition_NE, ".new_instance_done", true);
         //jump to dvmJitToExceptionThrown
         scratchRegs[0] = PhysicalReg_SCRATCH_4;
@@ -48,4 +48,8 @@ extern "C" const Method *dvmJitToPatchPredictedChain(const Method *method,
                                           Thread *self,
                                           PredictedChainingCell *cell,
                                           const ClassObject *clazz);
+extern "C" const Method *dvmJitToPatchPolymorphicChain(const Method *method,
+                                          Thread *self,
+                                          PredictedChainingCell *cell,
+                                          const ClassObject *clazz);
 #endif /*_DALVIK_NCG_HELPER*/
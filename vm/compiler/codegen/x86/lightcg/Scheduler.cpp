@@ -389,6 +389,11 @@ MachineModelEntry atomMachineModel[Mnemonic_Count*6] = {
 
     {INVP,INVN},{INVP,INVN},{INVP,INVN},{INVP,INVN},{INVP,INVN},{INVP,INVN}, //SHUFPS
     {INVP,INVN},{INVP,INVN},{INVP,INVN},{INVP,INVN},{INVP,INVN},{INVP,INVN}, //MOVAPS
+    {INVP,INVN},{INVP,INVN},{INVP,INVN},{EITHER_PORT,1},{BOTH_PORTS,3},{BOTH_PORTS,3}, //MOVDQU
+    {INVP,INVN},{INVP,INVN},{INVP,INVN},{PORT1,5},{BOTH_PORTS,5},{INVP,INVN}, //ADDPS
+    {INVP,INVN},{INVP,INVN},{INVP,INVN},{PORT1,5},{BOTH_PORTS,5},{INVP,INVN}, //SUBPS
+    {INVP,INVN},{INVP,INVN},{INVP,INVN},{BOTH_PORTS,5},{BOTH_PORTS,5},{INVP,INVN}, //MULPS
+    {INVP,INVN},{INVP,INVN},{INVP,INVN},{BOTH_PORTS,70},{BOTH_PORTS,70},{INVP,INVN}, //DIVPS
 };
 
 //! \brief Get issue port for mnemonic with no operands
@@ -524,7 +529,7 @@ inline const char * getUseDefEntryType(UseDefEntryType type) {
 //! \brief Returns true if mnemonic is a variant of MOV including XCHG.
 inline bool isMoveMnemonic(Mnemonic m) {
     return (m == Mnemonic_MOV || m == Mnemonic_MOVQ || m == Mnemonic_MOVSD || m == Mnemonic_MOVSS || m == Mnemonic_MOVZX
-            || m == Mnemonic_MOVSX || m == Mnemonic_MOVAPD || m == Mnemonic_MOVDQA || m == Mnemonic_MOVD || m == Mnemonic_XCHG);
+            || m == Mnemonic_MOVSX || m == Mnemonic_MOVAPD || m == Mnemonic_MOVDQA || m == Mnemonic_MOVDQU || m == Mnemonic_MOVD || m == Mnemonic_XCHG);
 }
 
 //! \brief Returns true if mnemonic is used for comparisons.
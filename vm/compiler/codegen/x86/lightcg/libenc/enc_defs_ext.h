@@ -353,6 +353,11 @@ Mnemonic_PEXTRD,   //!< Extract a doubleword integer value from xmm
 Mnemonic_MOVDQA,   //!< Move aligned double quadword
 Mnemonic_SHUFPS,   //!< Shuffle single words
 Mnemonic_MOVAPS,   //!< Move aligned single word
+Mnemonic_MOVDQU,   //!< Move unaligned double quadword
+Mnemonic_ADDPS,    //!< Add packed single-precision floating-point values
+Mnemonic_SUBPS,    //!< Subtract packed single-precision floating-point values
+Mnemonic_MULPS,    //!< Multiply packed single-precision floating-point values
+Mnemonic_DIVPS,    //!< Divide packed single-precision floating-point values
 
 //
 Mnemonic_Count
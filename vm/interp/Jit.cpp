@@ -519,6 +519,9 @@ void dvmJitStats()
              gDvmJit.icPatchInit, gDvmJit.icPatchRejected,
              gDvmJit.icPatchLockFree, gDvmJit.icPatchQueued,
              gDvmJit.icPatchDropped);
+        ALOGD("JIT: Polymorphic IC: %u entries per site, %d entries added, "
+             "%d megamorphic misses", gDvmJit.polymorphicCacheSize,
+             gDvmJit.icPatchPolymorphic, gDvmJit.icPatchMegamorphic);
 
         ALOGD("JIT: Invoke: %d mono, %d poly, %d native, %d return",
              gDvmJit.invokeMonomorphic, gDvmJit.invokePolymorphic,
@@ -526,6 +529,10 @@ void dvmJitStats()
         ALOGD("JIT: Inline: %d mgetter, %d msetter, %d pgetter, %d psetter",
              gDvmJit.invokeMonoGetterInlined, gDvmJit.invokeMonoSetterInlined,
              gDvmJit.invokePolyGetterInlined, gDvmJit.invokePolySetterInlined);
+        ALOGD("JIT: Value numbering: %d redundant instructions, %d loads",
+             gDvmJit.valueNumberingReplaced, gDvmJit.valueNumberingReplacedLoads);
+        ALOGD("JIT: Escape analysis: %d allocations replaced",
+             gDvmJit.escapeAnalysisReplaced);
         ALOGD("JIT: Total compilation time: %llu ms", gDvmJit.jitTime / 1000);
         ALOGD("JIT: Avg unit compilation time: %llu us",
              gDvmJit.numCompilations == 0 ? 0 :
@@ -1037,6 +1044,19 @@ JitEntry *dvmJitFindEntry(const u2* pc, bool isMethodEntry)
     return NULL;
 }
 
+/*
+ * Find or create the JitTable slot of the trace starting at pc. Returns NULL
+ * if the table is full.
+ */
+JitEntry *dvmJitReserveTraceEntry(const u2* pc)
+{
+    dvmLockMutex(&gDvmJit.tableLock);
+    JitEntry *slot = lookupAndAdd(pc, true /* lock */,
+                                  false /* method entry */);
+    dvmUnlockMutex(&gDvmJit.tableLock);
+    return slot;
+}
+
 /*
  * Walk through the JIT profile table and find the corresponding JIT code, in
  * the specified format (ie trace vs method). This routine needs to be fast.
@@ -1277,8 +1297,16 @@ void dvmJitCheckTraceRequest(Thread* self)
          */
         if (self->jitState == kJitTSelectRequest ||
             self->jitState == kJitTSelectRequestHot) {
-            if (dvmJitFindEntry(self->interpSave.pc, false)) {
-                /* In progress - nothing do do */
+            JitEntry *entry = dvmJitFindEntry(self->interpSave.pc, false);
+            if (entry != NULL) {
+                /*
+                 * In progress - nothing do do, but let the compiler know the
+                 * trace is still hot if its work order has not been served.
+                 */
+                if (entry->codeAddress == NULL) {
+                    dvmCompilerRaiseWorkPriority(self->interpSave.pc,
+                                                 kWorkOrderTrace);
+                }
                self->jitState = kJitDone;
             } else {
                 /* the method lookupAndAdd may take some time to grab the lock
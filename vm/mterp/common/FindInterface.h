@@ -29,6 +29,19 @@ extern "C" {
 INLINE Method* dvmFindInterfaceMethodInCache(ClassObject* thisClass,
     u4 methodIdx, const Method* method, DvmDex* methodClassDex)
 {
+    /*
+     * Once the interface method is resolved, the interface method table of
+     * the class usually holds the answer without touching the shared cache.
+     */
+    const Method* absMethod = dvmDexGetResolvedMethod(methodClassDex, methodIdx);
+    if (absMethod != NULL) {
+        const InterfaceMethodTableEntry* entry =
+            &thisClass->imtable[dvmGetImtSlot(absMethod)];
+        assert(thisClass->imtable != NULL);
+        if (entry->interfaceMethod == absMethod)
+            return entry->method;
+    }
+
 #define ATOMIC_CACHE_CALC \
     dvmInterpFindInterfaceMethod(thisClass, methodIdx, method, methodClassDex)
 #define ATOMIC_CACHE_NULL_ALLOWED false
@@ -274,6 +274,12 @@ MTERP_OFFSET(offClassObject_status,     ClassObject, status, 44)
 MTERP_OFFSET(offClassObject_super,      ClassObject, super, 72)
 MTERP_OFFSET(offClassObject_vtableCount, ClassObject, vtableCount, 112)
 MTERP_OFFSET(offClassObject_vtable,     ClassObject, vtable, 116)
+MTERP_OFFSET(offClassObject_imtable,    ClassObject, imtable, 136)
+
+/* InterfaceMethodTableEntry fields */
+MTERP_OFFSET(offImtEntry_interfaceMethod, InterfaceMethodTableEntry, interfaceMethod, 0)
+MTERP_OFFSET(offImtEntry_method,        InterfaceMethodTableEntry, method, 4)
+MTERP_SIZEOF(sizeofImtEntry,            InterfaceMethodTableEntry, 8)
 
 #if defined(WITH_JIT)
 MTERP_CONSTANT(kJitNot,                 0)
@@ -317,6 +323,10 @@ MTERP_CONSTANT(ACC_INTERFACE,       0x0200)
 MTERP_CONSTANT(ACC_ABSTRACT,        0x0400)
 MTERP_CONSTANT(CLASS_ISFINALIZABLE, 1<<31)
 
+/* interface method table hashing */
+MTERP_CONSTANT(IMT_HASH_MULTIPLIER, 0x9e3779b1)
+MTERP_CONSTANT(IMT_HASH_SHIFT,      27)
+
 /* flags for dvmMalloc */
 MTERP_CONSTANT(ALLOC_DONT_TRACK,    0x01)
 
@@ -292,6 +292,10 @@ static void preloadDexCachesStringsVisitor(void* addr, u4 threadId, RootType typ
     free(newStr);
 }
 
+static void preloadDexCachesLiteralVisitor(StringObject** strPtr, void* arg) {
+    preloadDexCachesStringsVisitor(strPtr, 0, ROOT_INTERNED_STRING, arg);
+}
+
 // Based on dvmResolveString.
 static void preloadDexCachesResolveString(DvmDex* pDvmDex,
                                           uint32_t stringIdx,
@@ -493,14 +497,7 @@ static void Dalvik_dalvik_system_VMRuntime_preloadDexCaches(const u4* args, JVal
     StringTable strings;
     if (kPreloadDexCachesStrings) {
         dvmLockMutex(&gDvm.internLock);
-        dvmHashTableLock(gDvm.literalStrings);
-        for (int i = 0; i < gDvm.literalStrings->tableSize; ++i) {
-            HashEntry *entry = &gDvm.literalStrings->pEntries[i];
-            if (entry->data != NULL && entry->data != HASH_TOMBSTONE) {
-                preloadDexCachesStringsVisitor(&entry->data, 0, ROOT_INTERNED_STRING, &strings);
-            }
-        }
-        dvmHashTableUnlock(gDvm.literalStrings);
+        dvmVisitInternedStrings(false, preloadDexCachesLiteralVisitor, &strings);
         dvmUnlockMutex(&gDvm.internLock);
     }
 
@@ -129,7 +129,7 @@ static void
     const u4* args, JValue* pResult)
 {
     UNUSED_PARAMETER(args);
-    RETURN_BOOLEAN(gDvm.allocRecords != NULL);
+    RETURN_BOOLEAN(gDvm.allocTrackerEnabled);
 }
 
 /*
@@ -33,6 +33,23 @@ static int strcmpCount(const char* str1, const char* str2)
     }
 }
 
+/*
+ * Get the class loader that access checks see for "clazz".  When dexopt
+ * checks access to a class from another DEX file that isn't bound for the
+ * bootstrap class path, it has the current thread pretend the class came
+ * from a different loader.  (The classes are shared by the dexopt worker
+ * threads, so it can't change the class itself.)
+ */
+static const Object* getAccessLoader(const ClassObject* clazz)
+{
+    if (gDvm.optimizing) {
+        Thread* self = dvmThreadSelf();
+        if (self != NULL && self->dexOptForeignClass == clazz)
+            return (const Object*) 0xdead3333;
+    }
+    return clazz->classLoader;
+}
+
 /*
  * Returns "true" if the two classes are in the same runtime package.
  */
@@ -43,7 +60,7 @@ bool dvmInSamePackage(const ClassObject* class1, const ClassObject* class2)
         return true;
 
     /* class loaders must match */
-    if (class1->classLoader != class2->classLoader)
+    if (getAccessLoader(class1) != getAccessLoader(class2))
         return false;
 
     /*
@@ -374,6 +374,7 @@ static ClassObject* createArrayClass(const char* descriptor, Object* loader)
                       (Object *)gDvm.classJavaLangObject);
     newClass->vtableCount = gDvm.classJavaLangObject->vtableCount;
     newClass->vtable = gDvm.classJavaLangObject->vtable;
+    newClass->imtable = gDvm.classJavaLangObject->imtable;
     newClass->primitiveType = PRIM_NOT;
     dvmSetFieldObject((Object *)newClass,
                       OFFSETOF_MEMBER(ClassObject, elementClass),
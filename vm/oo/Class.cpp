@@ -21,9 +21,15 @@
 
 #define LOG_CLASS_LOADING 0
 
+/* count class table lookups for dvmCheckClassTablePerf() */
+#define CLASS_TABLE_STATS 0
+
 #include "Dalvik.h"
 #include "libdex/DexClass.h"
 #include "analysis/Optimize.h"
+#if defined(WITH_JIT)
+#include "compiler/JitWarmCache.h"
+#endif
 
 #include <stdlib.h>
 #include <stddef.h>
@@ -188,9 +194,19 @@ static void computeRefOffsets(ClassObject* clazz);
 static void freeMethodInnards(Method* meth);
 static bool createVtable(ClassObject* clazz);
 static bool createIftable(ClassObject* clazz);
+static bool createImtable(ClassObject* clazz);
 static bool insertMethodStubs(ClassObject* clazz);
 static bool computeFieldOffsets(ClassObject* clazz);
 static void throwEarlierClassFailure(ClassObject* clazz, const char* descriptor = 0);
+static bool createClassTable(void);
+static void freeClassTable(void);
+
+/*
+ * Interface method table shared by the classes that do not need one of
+ * their own.  Every slot is empty, so lookups always fall through to the
+ * interface cache.
+ */
+static InterfaceMethodTableEntry gEmptyImtable[IMT_SIZE];
 
 #if LOG_CLASS_LOADING
 /*
@@ -350,6 +366,7 @@ static bool createPrimitiveType(PrimitiveType primitiveType, ClassObject** pClas
     newClass->descriptorAlloc = NULL;
     newClass->descriptor = descriptor;
     newClass->super = NULL;
+    newClass->imtable = gEmptyImtable;
     newClass->status = CLASS_INITIALIZED;
 
     /* don't need to set newClass->objectSize */
@@ -414,8 +431,8 @@ bool dvmClassStartup()
         return false;
     }
 
-    gDvm.loadedClasses =
-        dvmHashTableCreate(256, (HashFreeFunc) dvmFreeClassInnards);
+    if (!createClassTable())
+        return false;
 
     gDvm.pBootLoaderAlloc = dvmLinearAllocCreate(NULL);
     if (gDvm.pBootLoaderAlloc == NULL)
@@ -468,8 +485,7 @@ bool dvmClassStartup()
 void dvmClassShutdown()
 {
     /* discard all system-loaded classes */
-    dvmHashTableFree(gDvm.loadedClasses);
-    gDvm.loadedClasses = NULL;
+    freeClassTable();
 
     /* discard primitive classes created for arrays */
     dvmFreeClassInnards(gDvm.typeVoid);
@@ -931,12 +947,289 @@ bail:
  * ===========================================================================
  */
 
-/* search for these criteria in the Class hash table */
-struct ClassMatchCriteria {
-    const char* descriptor;
-    Object*     loader;
+/*
+ * The class table.
+ *
+ * Classes are kept in one open addressing table, hashed on descriptor.
+ * Each class has a "defining" slot keyed on its defining loader, and
+ * dvmAddInitiatingLoader() adds an "initiating" slot for every other loader
+ * the class was found through, so a lookup only has to match the hash, the
+ * loader and the descriptor of each slot it probes.  The slots for one
+ * loader act as that loader's index; there are no loader lists to scan.
+ *
+ * Lookups probe the table without taking a lock.  gDvm.classTableLock
+ * serializes insertions, removals, growth, and the initiating loader
+ * lists.  A slot is published by a release store of its class pointer
+ * after the rest of it has been written.  A published slot never goes
+ * back to empty, and a removed slot stays a tombstone until the next
+ * growth rather than being reused, so the hash and loader a reader sees
+ * always belong to the class it read, and a probe sequence seen by a
+ * reader can only get longer.
+ *
+ * Growth copies the live slots into a new array and publishes it; readers
+ * may still be probing the old arrays.  The GC frees the old arrays while
+ * all threads are suspended, which can't happen in the middle of a lookup
+ * by a running thread.  Threads that aren't running, like the JIT compiler
+ * thread, aren't stopped by the suspension, so their lookups take the lock.
+ */
+
+#define kClassTableInitialSize  512     /* must be a power of two */
+#define kClassTombstone         ((ClassObject*) HASH_TOMBSTONE)
+
+struct ClassTableEntry {
+    ClassObject* volatile clazz;    /* NULL if never used */
+    Object*         loader;         /* defining or initiating loader */
+    u4              hash;           /* dvmComputeUtf8Hash(descriptor) */
+    u4              initiating;     /* loader isn't the defining loader */
+};
+
+struct ClassTable {
+    size_t          mask;           /* number of slots - 1 */
+    size_t          used;           /* published slots, tombstones included */
+    size_t          live;           /* slots holding a class */
+    size_t          numClasses;     /* defining slots */
+    ClassTable*     retired;        /* arrays replaced since the last GC */
+    ClassTableEntry entries[1];
 };
 
+#if CLASS_TABLE_STATS
+/*
+ * Lookup statistics for dvmCheckClassTablePerf().  They're updated without
+ * synchronization, so they're approximate when lookups race.
+ */
+static struct {
+    u4 lookups;
+    u4 hits;
+    u4 probes;
+} gClassTableStats;
+#endif
+
+static ClassTable* allocClassTable(size_t size)
+{
+    assert((size & (size - 1)) == 0);
+    ClassTable* table = (ClassTable*) calloc(1,
+            offsetof(ClassTable, entries) + size * sizeof(ClassTableEntry));
+    if (table != NULL) {
+        table->mask = size - 1;
+    }
+    return table;
+}
+
+static void freeClassTables(ClassTable* table)
+{
+    while (table != NULL) {
+        ClassTable* next = table->retired;
+        free(table);
+        table = next;
+    }
+}
+
+static bool createClassTable()
+{
+    dvmInitMutex(&gDvm.classTableLock);
+    gDvm.classTable = allocClassTable(kClassTableInitialSize);
+    return gDvm.classTable != NULL;
+}
+
+/* Frees the table and the classes it defines. */
+static void freeClassTable()
+{
+    ClassTable* table = gDvm.classTable;
+    if (table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i <= table->mask; i++) {
+        ClassTableEntry* entry = &table->entries[i];
+        if (entry->clazz != NULL && entry->clazz != kClassTombstone &&
+            !entry->initiating) {
+            dvmFreeClassInnards(entry->clazz);
+        }
+    }
+    freeClassTables(table);
+    gDvm.classTable = NULL;
+    dvmDestroyMutex(&gDvm.classTableLock);
+}
+
+static ClassTable* currentClassTable()
+{
+    return (ClassTable*) android_atomic_acquire_load(
+            (volatile int32_t*) &gDvm.classTable);
+}
+
+/*
+ * Finds the class "loader" sees as "descriptor", either as its defining
+ * or as an initiating loader.  Safe without the lock; the table always
+ * has empty slots, which end every probe.  Adds the number of slots
+ * probed to *pProbes.
+ */
+static ClassObject* findClassEntry(ClassTable* table, u4 hash,
+    const char* descriptor, const Object* loader, u4* pProbes)
+{
+    u4 probes = 0;
+    ClassObject* found = NULL;
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask) {
+        ClassTableEntry* entry = &table->entries[i];
+        ClassObject* clazz = (ClassObject*) android_atomic_acquire_load(
+                (volatile int32_t*) &entry->clazz);
+        probes++;
+        if (clazz == NULL) {
+            break;
+        }
+        if (clazz != kClassTombstone && entry->hash == hash &&
+            entry->loader == loader &&
+            strcmp(clazz->descriptor, descriptor) == 0) {
+            found = clazz;
+            break;
+        }
+    }
+    *pProbes += probes;
+    return found;
+}
+
+/*
+ * Like findClassEntry, on the current table, for callers that don't hold
+ * the lock.  A running thread can't be suspended for GC in the middle of
+ * the probe, so the array it reads stays allocated; other threads take
+ * the lock to keep the GC from freeing a replaced array under them.
+ * Before the main thread is attached there's only one thread.
+ */
+static ClassObject* lookupClassEntry(u4 hash, const char* descriptor,
+    const Object* loader, u4* pProbes)
+{
+    Thread* self = dvmThreadSelf();
+    if (self == NULL || self->status == THREAD_RUNNING) {
+        return findClassEntry(currentClassTable(), hash, descriptor, loader,
+                pProbes);
+    }
+
+    dvmLockMutex(&gDvm.classTableLock);
+    ClassObject* found = findClassEntry(gDvm.classTable, hash, descriptor,
+            loader, pProbes);
+    dvmUnlockMutex(&gDvm.classTableLock);
+    return found;
+}
+
+/*
+ * Fills the first never used slot; the caller holds the lock or owns the
+ * table.  Tombstones aren't reused: a reader may have read the class of
+ * the old slot, and would pair it with the new hash and loader.
+ */
+static void putClassEntry(ClassTable* table, u4 hash, ClassObject* clazz,
+    Object* loader, bool initiating)
+{
+    ClassTableEntry* entry;
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask) {
+        entry = &table->entries[i];
+        if (entry->clazz == NULL) {
+            break;
+        }
+    }
+    table->used++;
+    table->live++;
+    if (!initiating) {
+        table->numClasses++;
+    }
+    entry->hash = hash;
+    entry->loader = loader;
+    entry->initiating = initiating;
+    android_atomic_release_store((int32_t) clazz,
+            (volatile int32_t*) &entry->clazz);
+}
+
+/*
+ * Makes room for one more slot, keeping the load (tombstones included)
+ * under 3/4.  The new array drops the tombstones and is sized for the
+ * live slots.  Returns false on allocation failure.  Holds the lock.
+ */
+static bool ensureClassTableRoom()
+{
+    ClassTable* table = gDvm.classTable;
+    size_t size = table->mask + 1;
+    if ((table->used + 1) * 4 < size * 3) {
+        return true;
+    }
+
+    size_t newSize = size;
+    while ((table->live + 1) * 2 >= newSize) {
+        newSize *= 2;
+    }
+    ClassTable* newTable = allocClassTable(newSize);
+    if (newTable == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        ClassTableEntry* entry = &table->entries[i];
+        if (entry->clazz != NULL && entry->clazz != kClassTombstone) {
+            putClassEntry(newTable, entry->hash, entry->clazz, entry->loader,
+                entry->initiating);
+        }
+    }
+    newTable->retired = table;
+    android_atomic_release_store((int32_t) newTable,
+            (volatile int32_t*) &gDvm.classTable);
+    return true;
+}
+
+/*
+ * Free the class table arrays replaced by growth.  Call with all threads
+ * suspended, so that no running thread is probing; the lock keeps out the
+ * lookups of the threads that aren't running.
+ */
+void dvmGcReleaseRetiredClassTables()
+{
+    dvmLockMutex(&gDvm.classTableLock);
+    ClassTable* table = gDvm.classTable;
+    if (table != NULL && table->retired != NULL) {
+        freeClassTables(table->retired);
+        table->retired = NULL;
+    }
+    dvmUnlockMutex(&gDvm.classTableLock);
+}
+
+/*
+ * Call "func" on each loaded class, with the table locked, until it
+ * returns nonzero.  Returns the nonzero value, or 0 if it saw every class.
+ * Same contract as dvmHashForeach().
+ */
+int dvmClassTableForeach(HashForeachFunc func, void* arg)
+{
+    int result = 0;
+
+    dvmLockMutex(&gDvm.classTableLock);
+    ClassTable* table = gDvm.classTable;
+    for (size_t i = 0; i <= table->mask; i++) {
+        ClassTableEntry* entry = &table->entries[i];
+        if (entry->clazz != NULL && entry->clazz != kClassTombstone &&
+            !entry->initiating) {
+            result = (*func)(entry->clazz, arg);
+            if (result != 0) {
+                break;
+            }
+        }
+    }
+    dvmUnlockMutex(&gDvm.classTableLock);
+    return result;
+}
+
+/*
+ * Calls the visitor with the address of each loaded class.  Only the
+ * defining slots are visited; the GC doesn't move classes, so the
+ * initiating slots never need updating.
+ */
+void dvmVisitLoadedClasses(LoadedClassVisitor* visitor, void* arg)
+{
+    dvmLockMutex(&gDvm.classTableLock);
+    ClassTable* table = gDvm.classTable;
+    for (size_t i = 0; i <= table->mask; i++) {
+        ClassTableEntry* entry = &table->entries[i];
+        if (entry->clazz != NULL && entry->clazz != kClassTombstone &&
+            !entry->initiating) {
+            (*visitor)((ClassObject**) &entry->clazz, arg);
+        }
+    }
+    dvmUnlockMutex(&gDvm.classTableLock);
+}
+
 #define kInitLoaderInc  4       /* must be power of 2 */
 
 static InitiatingLoaderList *dvmGetInitiatingLoaderList(ClassObject* clazz)
@@ -954,12 +1247,10 @@ static InitiatingLoaderList *dvmGetInitiatingLoaderList(ClassObject* clazz)
 /*
  * Determine if "loader" appears in clazz' initiating loader list.
  *
- * The class hash table lock must be held when calling here, since
- * it's also used when updating a class' initiating loader list.
- *
- * TODO: switch to some sort of lock-free data structure so we don't have
- * to grab the lock to do a lookup.  Among other things, this would improve
- * the speed of compareDescriptorClasses().
+ * The class table lock must be held when calling here, since it's also
+ * used when updating a class' initiating loader list.  Callers that
+ * don't hold it can ask dvmLookupClass() instead, which finds the
+ * initiating slot without locking.
  */
 bool dvmLoaderInInitiatingList(const ClassObject* clazz, const Object* loader)
 {
@@ -991,12 +1282,13 @@ bool dvmLoaderInInitiatingList(const ClassObject* clazz, const Object* loader)
 
 /*
  * Add "loader" to clazz's initiating loader set, unless it's the defining
- * class loader.
+ * class loader, and give it a slot in the class table so that lookups
+ * through "loader" find clazz directly.
  *
- * In the common case this will be a short list, so we don't need to do
- * anything too fancy here.
+ * Classes are usually found through the same loaders over and over, so
+ * check for the slot without locking first.
  *
- * This locks gDvm.loadedClasses for synchronization, so don't hold it
+ * This locks gDvm.classTableLock for synchronization, so don't hold it
  * when calling here.
  */
 void dvmAddInitiatingLoader(ClassObject* clazz, Object* loader)
@@ -1004,18 +1296,28 @@ void dvmAddInitiatingLoader(ClassObject* clazz, Object* loader)
     if (loader != clazz->classLoader) {
         assert(loader != NULL);
 
+        u4 hash = dvmComputeUtf8Hash(clazz->descriptor);
+        u4 probes = 0;
+        if (lookupClassEntry(hash, clazz->descriptor, loader,
+                &probes) == clazz) {
+            return;
+        }
+
         LOGVV("Adding %p to '%s' init list", loader, clazz->descriptor);
-        dvmHashTableLock(gDvm.loadedClasses);
+        dvmLockMutex(&gDvm.classTableLock);
 
         /*
-         * Make sure nobody snuck in.  The penalty for adding twice is
-         * pretty minor, and probably outweighs the O(n^2) hit for
-         * checking before every add, so we may not want to do this.
+         * Make sure nobody snuck in while we weren't holding the lock.
          */
-        //if (dvmLoaderInInitiatingList(clazz, loader)) {
-        //    ALOGW("WOW: simultaneous add of initiating class loader");
-        //    goto bail_unlock;
-        //}
+        ClassObject* existing = findClassEntry(gDvm.classTable, hash,
+            clazz->descriptor, loader, &probes);
+        if (existing != NULL) {
+            if (existing != clazz) {
+                ALOGW("Loader %p already sees a different '%s'",
+                    loader, clazz->descriptor);
+            }
+            goto bail_unlock;
+        }
 
         /*
          * The list never shrinks, so we just keep a count of the
@@ -1025,88 +1327,41 @@ void dvmAddInitiatingLoader(ClassObject* clazz, Object* loader)
          * The pointer is initially NULL, so we *do* want to call realloc
          * when count==0.
          */
-        InitiatingLoaderList *loaderList = dvmGetInitiatingLoaderList(clazz);
-        if ((loaderList->initiatingLoaderCount & (kInitLoaderInc-1)) == 0) {
-            Object** newList;
-
-            newList = (Object**) realloc(loaderList->initiatingLoaders,
-                        (loaderList->initiatingLoaderCount + kInitLoaderInc)
-                         * sizeof(Object*));
-            if (newList == NULL) {
-                /* this is mainly a cache, so it's not the EotW */
-                assert(false);
-                goto bail_unlock;
+        {
+            InitiatingLoaderList *loaderList =
+                dvmGetInitiatingLoaderList(clazz);
+            if ((loaderList->initiatingLoaderCount & (kInitLoaderInc-1)) == 0) {
+                Object** newList;
+
+                newList = (Object**) realloc(loaderList->initiatingLoaders,
+                            (loaderList->initiatingLoaderCount + kInitLoaderInc)
+                             * sizeof(Object*));
+                if (newList == NULL) {
+                    /* this is mainly a cache, so it's not the EotW */
+                    assert(false);
+                    goto bail_unlock;
+                }
+                loaderList->initiatingLoaders = newList;
             }
-            loaderList->initiatingLoaders = newList;
+            loaderList->initiatingLoaders[loaderList->initiatingLoaderCount++] =
+                loader;
+        }
 
-            //ALOGI("Expanded init list to %d (%s)",
-            //    loaderList->initiatingLoaderCount+kInitLoaderInc,
-            //    clazz->descriptor);
+        /* the slot is a cache too; without it lookups fall back to loading */
+        if (ensureClassTableRoom()) {
+            putClassEntry(gDvm.classTable, hash, clazz, loader, true);
         }
-        loaderList->initiatingLoaders[loaderList->initiatingLoaderCount++] =
-            loader;
 
 bail_unlock:
-        dvmHashTableUnlock(gDvm.loadedClasses);
+        dvmUnlockMutex(&gDvm.classTableLock);
     }
 }
 
 /*
- * (This is a dvmHashTableLookup callback.)
- *
- * Entries in the class hash table are stored as { descriptor, d-loader }
- * tuples.  If the hashed class descriptor matches the requested descriptor,
- * and the hashed defining class loader matches the requested class
- * loader, we're good.  If only the descriptor matches, we check to see if the
- * loader is in the hashed class' initiating loader list.  If so, we
- * can return "true" immediately and skip some of the loadClass melodrama.
- *
- * The caller must lock the hash table before calling here.
- *
- * Returns 0 if a matching entry is found, nonzero otherwise.
- */
-static int hashcmpClassByCrit(const void* vclazz, const void* vcrit)
-{
-    const ClassObject* clazz = (const ClassObject*) vclazz;
-    const ClassMatchCriteria* pCrit = (const ClassMatchCriteria*) vcrit;
-    bool match;
-
-    match = (strcmp(clazz->descriptor, pCrit->descriptor) == 0 &&
-             (clazz->classLoader == pCrit->loader ||
-              (pCrit->loader != NULL &&
-               dvmLoaderInInitiatingList(clazz, pCrit->loader)) ));
-    //if (match)
-    //    ALOGI("+++ %s %p matches existing %s %p",
-    //        pCrit->descriptor, pCrit->loader,
-    //        clazz->descriptor, clazz->classLoader);
-    return !match;
-}
-
-/*
- * Like hashcmpClassByCrit, but passing in a fully-formed ClassObject
- * instead of a ClassMatchCriteria.
- */
-static int hashcmpClassByClass(const void* vclazz, const void* vaddclazz)
-{
-    const ClassObject* clazz = (const ClassObject*) vclazz;
-    const ClassObject* addClazz = (const ClassObject*) vaddclazz;
-    bool match;
-
-    match = (strcmp(clazz->descriptor, addClazz->descriptor) == 0 &&
-             (clazz->classLoader == addClazz->classLoader ||
-              (addClazz->classLoader != NULL &&
-               dvmLoaderInInitiatingList(clazz, addClazz->classLoader)) ));
-    return !match;
-}
-
-/*
- * Search through the hash table to find an entry with a matching descriptor
- * and an initiating class loader that matches "loader".
+ * Search the class table for a class with a matching descriptor whose
+ * defining or initiating class loader is "loader".
  *
- * The table entries are hashed on descriptor only, because they're unique
- * on *defining* class loader, not *initiating* class loader.  This isn't
- * great, because it guarantees we will have to probe when multiple
- * class loaders are used.
+ * This doesn't take a lock; see the notes on the class table above.
  *
  * Note this does NOT try to load a class; it just finds a class that
  * has already been loaded.
@@ -1121,21 +1376,25 @@ static int hashcmpClassByClass(const void* vclazz, const void* vaddclazz)
 ClassObject* dvmLookupClass(const char* descriptor, Object* loader,
     bool unprepOkay)
 {
-    ClassMatchCriteria crit;
-    void* found;
+    ClassObject* found;
     u4 hash;
 
-    crit.descriptor = descriptor;
-    crit.loader = loader;
     hash = dvmComputeUtf8Hash(descriptor);
 
     LOGVV("threadid=%d: dvmLookupClass searching for '%s' %p",
         dvmThreadSelf()->threadId, descriptor, loader);
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    found = dvmHashTableLookup(gDvm.loadedClasses, hash, &crit,
-                hashcmpClassByCrit, false);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+#if CLASS_TABLE_STATS
+    found = lookupClassEntry(hash, descriptor, loader,
+                &gClassTableStats.probes);
+    gClassTableStats.lookups++;
+    if (found != NULL) {
+        gClassTableStats.hits++;
+    }
+#else
+    u4 probes = 0;
+    found = lookupClassEntry(hash, descriptor, loader, &probes);
+#endif
 
     /*
      * The class has been added to the hash table but isn't ready for use.
@@ -1145,83 +1404,123 @@ ClassObject* dvmLookupClass(const char* descriptor, Object* loader,
      * here, but this is an extremely rare case, and it's simpler to have
      * the wait-for-class code centralized.
      */
-    if (found && !unprepOkay && !dvmIsClassLinked((ClassObject*)found)) {
+    if (found && !unprepOkay && !dvmIsClassLinked(found)) {
         ALOGV("Ignoring not-yet-ready %s, using slow path",
-            ((ClassObject*)found)->descriptor);
+            found->descriptor);
         found = NULL;
     }
 
-    return (ClassObject*) found;
+    return found;
 }
 
 /*
  * Add a new class to the hash table.
  *
- * The class is considered "new" if it doesn't match on both the class
- * descriptor and the defining class loader.
- *
- * TODO: we should probably have separate hash tables for each
- * ClassLoader. This could speed up dvmLookupClass and
- * other common operations. It does imply a VM-visible data structure
- * for each ClassLoader object with loaded classes, which we don't
- * have yet.
+ * The class is considered "new" if its defining loader doesn't already
+ * see a class with the same descriptor, either as the defining or as an
+ * initiating loader.
  */
 bool dvmAddClassToHash(ClassObject* clazz)
 {
-    void* found;
+    ClassObject* found;
     u4 hash;
+    u4 probes = 0;
 
     hash = dvmComputeUtf8Hash(clazz->descriptor);
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    found = dvmHashTableLookup(gDvm.loadedClasses, hash, clazz,
-                hashcmpClassByClass, true);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmLockMutex(&gDvm.classTableLock);
+    found = findClassEntry(gDvm.classTable, hash, clazz->descriptor,
+                clazz->classLoader, &probes);
+    if (found == NULL) {
+        if (!ensureClassTableRoom()) {
+            dvmUnlockMutex(&gDvm.classTableLock);
+            ALOGE("Unable to grow the class table");
+            dvmAbort();
+        }
+        putClassEntry(gDvm.classTable, hash, clazz, clazz->classLoader,
+            false);
+        found = clazz;
+    }
+    dvmUnlockMutex(&gDvm.classTableLock);
 
     ALOGV("+++ dvmAddClassToHash '%s' %p (isnew=%d) --> %p",
         clazz->descriptor, clazz->classLoader,
-        (found == (void*) clazz), clazz);
-
-    //dvmCheckClassTablePerf();
+        (found == clazz), clazz);
 
     /* can happen if two threads load the same class simultaneously */
-    return (found == (void*) clazz);
-}
-
-#if 0
-/*
- * Compute hash value for a class.
- */
-u4 hashcalcClass(const void* item)
-{
-    return dvmComputeUtf8Hash(((const ClassObject*) item)->descriptor);
+    return (found == clazz);
 }
 
 /*
- * Check the performance of the "loadedClasses" hash table.
+ * Check the performance of the class table: how full it is, how well
+ * lookups hit, and how long the probe sequences are.
  */
 void dvmCheckClassTablePerf()
 {
-    dvmHashTableLock(gDvm.loadedClasses);
-    dvmHashTableProbeCount(gDvm.loadedClasses, hashcalcClass,
-        hashcmpClassByClass);
-    dvmHashTableUnlock(gDvm.loadedClasses);
-}
+    dvmLockMutex(&gDvm.classTableLock);
+    ClassTable* table = gDvm.classTable;
+    size_t size = table->mask + 1;
+    size_t totalProbe = 0, maxProbe = 0;
+    for (size_t i = 0; i < size; i++) {
+        ClassTableEntry* entry = &table->entries[i];
+        if (entry->clazz == NULL || entry->clazz == kClassTombstone) {
+            continue;
+        }
+        size_t probe = ((i - entry->hash) & table->mask) + 1;
+        totalProbe += probe;
+        if (probe > maxProbe) {
+            maxProbe = probe;
+        }
+    }
+    ALOGD("Class table: %d classes, %d initiating slots, %d/%d slots used",
+        (int) table->numClasses, (int) (table->live - table->numClasses),
+        (int) table->used, (int) size);
+    ALOGD("Class table: probe avg %.2f max %d",
+        table->live != 0 ? (double) totalProbe / table->live : 0.0,
+        (int) maxProbe);
+    dvmUnlockMutex(&gDvm.classTableLock);
+
+#if CLASS_TABLE_STATS
+    u4 lookups = gClassTableStats.lookups;
+    ALOGD("Class table: %u lookups, %u hits (%.1f%%), %.2f probes/lookup",
+        lookups, gClassTableStats.hits,
+        lookups != 0 ? gClassTableStats.hits * 100.0 / lookups : 0.0,
+        lookups != 0 ? (double) gClassTableStats.probes / lookups : 0.0);
 #endif
+}
 
 /*
- * Remove a class object from the hash table.
+ * Remove a class object from the hash table, along with any initiating
+ * slots that were added for it.
  */
 static void removeClassFromHash(ClassObject* clazz)
 {
     ALOGV("+++ removeClassFromHash '%s'", clazz->descriptor);
 
     u4 hash = dvmComputeUtf8Hash(clazz->descriptor);
+    bool removed = false;
+
+    dvmLockMutex(&gDvm.classTableLock);
+    ClassTable* table = gDvm.classTable;
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask) {
+        ClassTableEntry* entry = &table->entries[i];
+        if (entry->clazz == NULL) {
+            break;
+        }
+        if (entry->clazz == clazz) {
+            if (!entry->initiating) {
+                table->numClasses--;
+                removed = true;
+            }
+            table->live--;
+            android_atomic_release_store((int32_t) kClassTombstone,
+                    (volatile int32_t*) &entry->clazz);
+        }
+    }
+    dvmUnlockMutex(&gDvm.classTableLock);
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    if (!dvmHashTableRemove(gDvm.loadedClasses, hash, clazz))
+    if (!removed)
         ALOGW("Hash table remove failed on class '%s'", clazz->descriptor);
-    dvmHashTableUnlock(gDvm.loadedClasses);
 }
 
 
@@ -2048,6 +2347,13 @@ void dvmFreeClassInnards(ClassObject* clazz)
         NULL_AND_LINEAR_FREE(clazz->vtable);
     }
 
+    /* the shared empty imtable is not allocated per class */
+    if (clazz->imtable == gEmptyImtable) {
+        clazz->imtable = NULL;
+    } else {
+        NULL_AND_LINEAR_FREE(clazz->imtable);
+    }
+
     clazz->descriptor = NULL;
     NULL_AND_FREE(clazz->descriptorAlloc);
 
@@ -2850,6 +3156,12 @@ bool dvmLinkClass(ClassObject* clazz)
     if (!createIftable(clazz))
         goto bail;
 
+    /*
+     * Hash the interface methods for invoke-interface.
+     */
+    if (!createImtable(clazz))
+        goto bail;
+
     /*
      * Insert special-purpose "stub" method implementations.
      */
@@ -3531,6 +3843,72 @@ bail:
 }
 
 
+/*
+ * Create the interface method table of "clazz" from its iftable.
+ *
+ * Each interface method goes in the slot it hashes to.  Slots claimed by
+ * two different interface methods are left empty: invoke-interface then
+ * takes the slower interface cache path for both, which is always correct.
+ * Interfaces and abstract classes never appear as the class of a receiver,
+ * so they get the shared empty table.
+ */
+static bool createImtable(ClassObject* clazz)
+{
+    InterfaceMethodTableEntry* imtable;
+    u4 conflicts = 0;
+    int methodCount = 0;
+    int i, j;
+
+    assert(IMT_SIZE <= 32);     // conflicts is a bit vector
+
+    clazz->imtable = gEmptyImtable;
+    if (dvmIsInterfaceClass(clazz) || dvmIsAbstractClass(clazz))
+        return true;
+
+    for (i = 0; i < clazz->iftableCount; i++)
+        methodCount += clazz->iftable[i].clazz->virtualMethodCount;
+    if (methodCount == 0)
+        return true;
+
+    imtable = (InterfaceMethodTableEntry*) dvmLinearAlloc(clazz->classLoader,
+                sizeof(InterfaceMethodTableEntry) * IMT_SIZE);
+    if (imtable == NULL)
+        return false;
+    memset(imtable, 0, sizeof(InterfaceMethodTableEntry) * IMT_SIZE);
+
+    for (i = 0; i < clazz->iftableCount; i++) {
+        const InterfaceEntry* entry = &clazz->iftable[i];
+        const ClassObject* iface = entry->clazz;
+
+        for (j = 0; j < iface->virtualMethodCount; j++) {
+            const Method* interfaceMethod = &iface->virtualMethods[j];
+            int vtableIndex = entry->methodIndexArray[j];
+            u4 slot = dvmGetImtSlot(interfaceMethod);
+
+            assert(vtableIndex >= 0 && vtableIndex < clazz->vtableCount);
+            if ((conflicts & (1 << slot)) != 0 ||
+                imtable[slot].interfaceMethod == interfaceMethod)
+            {
+                continue;
+            }
+            if (imtable[slot].interfaceMethod != NULL) {
+                LOGVV("IMT conflict in %s slot %d", clazz->descriptor, slot);
+                imtable[slot].interfaceMethod = NULL;
+                imtable[slot].method = NULL;
+                conflicts |= 1 << slot;
+                continue;
+            }
+            imtable[slot].interfaceMethod = interfaceMethod;
+            imtable[slot].method = clazz->vtable[vtableIndex];
+        }
+    }
+
+    dvmLinearReadOnly(clazz->classLoader, imtable);
+    clazz->imtable = imtable;
+    return true;
+}
+
+
 /*
  * Provide "stub" implementations for methods without them.
  *
@@ -3977,8 +4355,6 @@ static void initSFields(ClassObject* clazz)
  * Determine whether "descriptor" yields the same class object in the
  * context of clazz1 and clazz2.
  *
- * The caller must hold gDvm.loadedClasses.
- *
  * Returns "true" if they match.
  */
 static bool compareDescriptorClasses(const char* descriptor,
@@ -4003,7 +4379,8 @@ static bool compareDescriptorClasses(const char* descriptor,
      * The initiating loader test should catch the majority of cases
      * (in particular, the zillions of references to String/Object).
      *
-     * Unfortunately we're still stuck grabbing a mutex to do the lookup.
+     * The class table has a slot for each initiating loader, so the test
+     * is a lock-free table lookup.
      *
      * For this to work, the superclass/interface should be the first
      * argument, so that way if it's from the bootstrap loader this test
@@ -4013,9 +4390,8 @@ static bool compareDescriptorClasses(const char* descriptor,
     bool isInit = false;
     if(result1 != NULL)
     {
-        dvmHashTableLock(gDvm.loadedClasses);
-        isInit = dvmLoaderInInitiatingList(result1, clazz2->classLoader);
-        dvmHashTableUnlock(gDvm.loadedClasses);
+        isInit = (dvmLookupClass(descriptor, clazz2->classLoader, true) ==
+                  result1);
     }
 
     if (isInit) {
@@ -4312,6 +4688,9 @@ bool dvmInitClass(ClassObject* clazz)
 #if LOG_CLASS_LOADING
     bool initializedByUs = false;
 #endif
+#if defined(WITH_JIT)
+    bool initSucceeded = false;
+#endif
 
     Thread* self = dvmThreadSelf();
     const Method* method;
@@ -4571,6 +4950,9 @@ noverify:
         dvmLockObject(self, (Object*) clazz);
         clazz->status = CLASS_INITIALIZED;
         LOGVV("Initialized class: %s", clazz->descriptor);
+#if defined(WITH_JIT)
+        initSucceeded = true;
+#endif
 
         /*
          * Update alloc counters.  TODO: guard with mutex.
@@ -4601,6 +4983,12 @@ bail_unlock:
 
     dvmUnlockObject(self, (Object*) clazz);
 
+#if defined(WITH_JIT)
+    /* Compile the warm-start traces of the class now that it can run */
+    if (initSucceeded)
+        dvmJitWarmCacheClassInitialized(clazz);
+#endif
+
     return (clazz->status != CLASS_ERROR);
 }
 
@@ -4681,7 +5069,7 @@ void dvmSetRegisterMap(Method* method, const RegisterMap* pMap)
 }
 
 /*
- * dvmHashForeach callback.  A nonzero return value causes foreach to
+ * dvmClassTableForeach callback.  A nonzero return value causes foreach to
  * bail out.
  */
 static int findClassCallback(void* vclazz, void* arg)
@@ -4708,10 +5096,7 @@ ClassObject* dvmFindLoadedClass(const char* descriptor)
 {
     int result;
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    result = dvmHashForeach(gDvm.loadedClasses, findClassCallback,
-            (void*) descriptor);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    result = dvmClassTableForeach(findClassCallback, (void*) descriptor);
 
     return (ClassObject*) result;
 }
@@ -4739,7 +5124,7 @@ Object* dvmGetSystemClassLoader()
 
 
 /*
- * This is a dvmHashForeach callback.
+ * This is a dvmClassTableForeach callback.
  */
 static int dumpClass(void* vclazz, void* varg)
 {
@@ -4874,9 +5259,7 @@ void dvmDumpClass(const ClassObject* clazz, int flags)
  */
 void dvmDumpAllClasses(int flags)
 {
-    dvmHashTableLock(gDvm.loadedClasses);
-    dvmHashForeach(gDvm.loadedClasses, dumpClass, (void*) flags);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmClassTableForeach(dumpClass, (void*) flags);
 }
 
 /*
@@ -4885,9 +5268,9 @@ void dvmDumpAllClasses(int flags)
 int dvmGetNumLoadedClasses()
 {
     int count;
-    dvmHashTableLock(gDvm.loadedClasses);
-    count = dvmHashTableNumEntries(gDvm.loadedClasses);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmLockMutex(&gDvm.classTableLock);
+    count = gDvm.classTable->numClasses;
+    dvmUnlockMutex(&gDvm.classTableLock);
     return count;
 }
 
@@ -4897,7 +5280,7 @@ int dvmGetNumLoadedClasses()
 void dvmDumpLoaderStats(const char* msg)
 {
     ALOGV("VM stats (%s): cls=%d/%d meth=%d ifld=%d sfld=%d linear=%d",
-        msg, gDvm.numLoadedClasses, dvmHashTableNumEntries(gDvm.loadedClasses),
+        msg, gDvm.numLoadedClasses, (int) gDvm.classTable->numClasses,
         gDvm.numDeclaredMethods, gDvm.numDeclaredInstFields,
         gDvm.numDeclaredStaticFields, gDvm.pBootLoaderAlloc->curOffset);
 #ifdef COUNT_PRECISE_METHODS
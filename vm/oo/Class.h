@@ -145,6 +145,20 @@ bool dvmAddClassToHash(ClassObject* clazz);
 void dvmAddInitiatingLoader(ClassObject* clazz, Object* loader);
 bool dvmLoaderInInitiatingList(const ClassObject* clazz, const Object* loader);
 
+/*
+ * Iterate over the loaded classes.  dvmClassTableForeach() holds the table
+ * lock and stops when "func" returns nonzero, like dvmHashForeach().
+ */
+int dvmClassTableForeach(HashForeachFunc func, void* arg);
+typedef void LoadedClassVisitor(ClassObject** clazzPtr, void* arg);
+void dvmVisitLoadedClasses(LoadedClassVisitor* visitor, void* arg);
+
+/*
+ * Free the class table arrays replaced since the last GC.  Call with all
+ * threads suspended.
+ */
+void dvmGcReleaseRetiredClassTables(void);
+
 /*
  * Update method's "nativeFunc" and "insns".  If "insns" is NULL, the
  * current method->insns value is not changed.
@@ -176,6 +190,7 @@ void dvmSetBootPathExtraDex(DvmDex* pDvmDex);
 void dvmDumpClass(const ClassObject* clazz, int flags);
 void dvmDumpAllClasses(int flags);
 void dvmDumpLoaderStats(const char* msg);
+void dvmCheckClassTablePerf(void);
 int  dvmGetNumLoadedClasses();
 
 /* flags for dvmDumpClass / dvmDumpAllClasses */
@@ -190,6 +190,30 @@ struct InterfaceEntry {
     int*            methodIndexArray;
 };
 
+/*
+ * Used for imtable in ClassObject.  An interface method hashes to a single
+ * slot; the slot holds the concrete method implementing it in the class, or
+ * a NULL interfaceMethod when no interface method (or more than one) hashed
+ * there.
+ */
+struct InterfaceMethodTableEntry {
+    /* abstract interface method, as resolved by the calling dex file */
+    const Method*   interfaceMethod;
+
+    /* method invoked for interfaceMethod on instances of the class */
+    Method*         method;
+};
+
+/*
+ * Number of entries of an interface method table, as a power of two.  The
+ * slot of an interface method comes from Fibonacci hashing its address,
+ * which the interpreters and the JIT compute the same way.
+ */
+#define IMT_SIZE_SHIFT      5
+#define IMT_SIZE            (1 << IMT_SIZE_SHIFT)
+#define IMT_HASH_MULTIPLIER 0x9e3779b1
+#define IMT_HASH_SHIFT      (32 - IMT_SIZE_SHIFT)
+
 
 
 /*
@@ -453,6 +477,15 @@ struct ClassObject : Object {
     int             ifviPoolCount;
     int*            ifviPool;
 
+    /*
+     * Interface method table (imtable), IMT_SIZE entries hashed by
+     * interface method.  Lets invoke-interface find the target without
+     * scanning iftable.  Classes that cannot be instantiated, or implement
+     * no interface methods, share an empty table, so this is never null
+     * once the class is linked.
+     */
+    InterfaceMethodTableEntry* imtable;
+
     /* instance fields
      *
      * These describe the layout of the contents of a DataObject-compatible
@@ -471,6 +504,12 @@ struct ClassObject : Object {
     /* bitmap of offsets of ifields */
     u4 refOffsets;
 
+    /* biases on instances revoked so far; see BIAS_REVOKE_THRESHOLD */
+    u4 biasRevocations;
+
+    /* bias epoch of new locks, in its lock word position; see Sync.h */
+    u4 biasEpoch;
+
     /* source file name, if known */
     const char*     sourceFile;
 
@@ -751,6 +790,13 @@ INLINE bool dvmIsVolatileField(const Field* field) {
     return (field->accessFlags & ACC_VOLATILE) != 0;
 }
 
+/*
+ * Return the interface method table slot of an interface method.
+ */
+INLINE u4 dvmGetImtSlot(const Method* interfaceMethod) {
+    return ((u4) interfaceMethod * IMT_HASH_MULTIPLIER) >> IMT_HASH_SHIFT;
+}
+
 INLINE bool dvmIsInterfaceClass(const ClassObject* clazz) {
     return (clazz->accessFlags & ACC_INTERFACE) != 0;
 }
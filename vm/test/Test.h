@@ -23,5 +23,8 @@
 bool dvmTestHash(void);
 bool dvmTestAtomicSpeed(void);
 bool dvmTestIndirectRefTable(void);
+#if defined(WITH_JIT) && defined(ARCH_IA32)
+bool dvmTestGlobalValueNumbering(void);
+#endif
 
 #endif  // DALVIK_TEST_TEST_H_
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test the redundant load elimination of the global value numbering pass.
+ *
+ * Each case builds one basic block in SSA form by hand, runs the pass on
+ * it, and checks whether the last load was turned into a move from the
+ * register of the first one.
+ */
+#include "Dalvik.h"
+#include "compiler/CompilerIR.h"
+#include "compiler/Dataflow.h"
+#include "compiler/GlobalValueNumbering.h"
+
+#ifndef NDEBUG
+
+#define kMaxRegs    8
+#define kMaxMIRs    8
+
+/*
+ * A basic block of at most kMaxMIRs instructions.  Every virtual register
+ * is defined at most once, so SSA register n is simply vn.  Like the ones
+ * from the arena, the MIRs are just zeroed memory.
+ */
+struct TestBlock {
+    CompilationUnit cUnit;
+    BasicBlock bb;
+    GrowableList ssaToDalvikMap;
+    intptr_t ssaToDalvik[kMaxRegs];
+    MIR* lastDef[kMaxRegs];
+    u8 mirs[kMaxMIRs][(sizeof(MIR) + sizeof(u8) - 1) / sizeof(u8)];
+    SSARepresentation ssaReps[kMaxMIRs];
+    int uses[kMaxMIRs][3];
+    MIR* defWhere[kMaxMIRs][3];
+    int defs[kMaxMIRs][1];
+    int numMIRs;
+};
+
+static void initBlock(TestBlock* block)
+{
+    memset(block, 0, sizeof(*block));
+    for (int i = 0; i < kMaxRegs; i++) {
+        block->ssaToDalvik[i] = ENCODE_REG_SUB(i, 0);
+    }
+    block->ssaToDalvikMap.numAllocated = kMaxRegs;
+    block->ssaToDalvikMap.numUsed = kMaxRegs;
+    block->ssaToDalvikMap.elemList = block->ssaToDalvik;
+
+    block->bb.blockType = kDalvikByteCode;
+
+    CompilationUnit* cUnit = &block->cUnit;
+    cUnit->ssaToDalvikMap = &block->ssaToDalvikMap;
+    cUnit->numSSARegs = kMaxRegs;
+    cUnit->entryBlock = &block->bb;
+}
+
+/*
+ * Append "opcode vA, vB, vC" to the block, with its uses and definition
+ * taken from the dataflow attributes of the opcode.
+ */
+static MIR* addMIR(TestBlock* block, Opcode opcode, u4 vA, u4 vB, u4 vC)
+{
+    assert(block->numMIRs < kMaxMIRs);
+    int idx = block->numMIRs++;
+    MIR* mir = (MIR*) block->mirs[idx];
+    SSARepresentation* ssaRep = &block->ssaReps[idx];
+    long long dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+
+    mir->dalvikInsn.opcode = opcode;
+    mir->dalvikInsn.vA = vA;
+    mir->dalvikInsn.vB = vB;
+    mir->dalvikInsn.vC = vC;
+    mir->offset = idx;
+    mir->bb = &block->bb;
+    mir->ssaRep = ssaRep;
+
+    ssaRep->uses = block->uses[idx];
+    ssaRep->defWhere = block->defWhere[idx];
+    ssaRep->defs = block->defs[idx];
+    u4 operands[3] = { vA, vB, vC };
+    long long useFlags[3] = { DF_UA, DF_UB, DF_UC };
+    for (int i = 0; i < 3; i++) {
+        if ((dfAttributes & useFlags[i]) != 0) {
+            ssaRep->uses[ssaRep->numUses] = operands[i];
+            ssaRep->defWhere[ssaRep->numUses] = block->lastDef[operands[i]];
+            ssaRep->numUses++;
+        }
+    }
+    if ((dfAttributes & DF_DA) != 0) {
+        ssaRep->defs[ssaRep->numDefs++] = vA;
+        block->lastDef[vA] = mir;
+    }
+
+    if (block->bb.lastMIRInsn != NULL) {
+        block->bb.lastMIRInsn->next = mir;
+        mir->prev = block->bb.lastMIRInsn;
+    } else {
+        block->bb.firstMIRInsn = mir;
+    }
+    block->bb.lastMIRInsn = mir;
+    return mir;
+}
+
+/*
+ * Run the pass and check that "load" was replaced by a move from vSource,
+ * or left alone if vSource is -1.
+ */
+static bool checkLoad(TestBlock* block, const MIR* load, int vSource,
+    const char* what)
+{
+    Opcode opcode = load->dalvikInsn.opcode;
+
+    dvmCompilerGlobalValueNumbering(&block->cUnit, NULL);
+
+    bool reused = load->dalvikInsn.opcode == OP_MOVE ||
+                  load->dalvikInsn.opcode == OP_MOVE_OBJECT;
+    if (vSource < 0 ? reused || load->dalvikInsn.opcode != opcode
+                    : !reused || load->dalvikInsn.vB != (u4) vSource) {
+        ALOGE("GVN test '%s': load %s, expected it %s", what,
+            reused ? "reused" : "kept",
+            vSource < 0 ? "kept" : "reused");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Instance field loads through the same object: v0 is the object.
+ */
+static bool fieldTest()
+{
+    TestBlock block;
+    MIR* load;
+
+    /* iget v1, v0 / iget v2, v0: the second load is v1 */
+    initBlock(&block);
+    addMIR(&block, OP_IGET_QUICK, 1, 0, 8);
+    load = addMIR(&block, OP_IGET_QUICK, 2, 0, 8);
+    if (!checkLoad(&block, load, 1, "repeated field load")) {
+        return false;
+    }
+
+    /* a store to the same field in between clobbers the first load */
+    initBlock(&block);
+    addMIR(&block, OP_IGET_QUICK, 1, 0, 8);
+    addMIR(&block, OP_IPUT_QUICK, 3, 0, 8);
+    load = addMIR(&block, OP_IGET_QUICK, 2, 0, 8);
+    if (!checkLoad(&block, load, -1, "field store in between")) {
+        return false;
+    }
+
+    /* a store to another field doesn't */
+    initBlock(&block);
+    addMIR(&block, OP_IGET_QUICK, 1, 0, 8);
+    addMIR(&block, OP_IPUT_QUICK, 3, 0, 12);
+    load = addMIR(&block, OP_IGET_QUICK, 2, 0, 8);
+    if (!checkLoad(&block, load, 1, "other field store in between")) {
+        return false;
+    }
+
+    /* another thread may write the field while we wait for the monitor */
+    initBlock(&block);
+    addMIR(&block, OP_IGET_QUICK, 1, 0, 8);
+    addMIR(&block, OP_MONITOR_ENTER, 0, 0, 0);
+    load = addMIR(&block, OP_IGET_QUICK, 2, 0, 8);
+    if (!checkLoad(&block, load, -1, "monitor-enter in between")) {
+        return false;
+    }
+
+    initBlock(&block);
+    addMIR(&block, OP_IGET_QUICK, 1, 0, 8);
+    addMIR(&block, OP_MONITOR_EXIT, 0, 0, 0);
+    load = addMIR(&block, OP_IGET_QUICK, 2, 0, 8);
+    if (!checkLoad(&block, load, -1, "monitor-exit in between")) {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Array loads: v0 is the array, v4 and v5 hold the constants 1 and 2,
+ * and v6 an unknown index.
+ */
+static bool arrayTest()
+{
+    TestBlock block;
+    MIR* load;
+
+    /* aget v1, v0[1] / aget v2, v0[1]: the second load is v1 */
+    initBlock(&block);
+    addMIR(&block, OP_CONST_4, 4, 1, 0);
+    addMIR(&block, OP_AGET, 1, 0, 4);
+    load = addMIR(&block, OP_AGET, 2, 0, 4);
+    if (!checkLoad(&block, load, 1, "repeated array load")) {
+        return false;
+    }
+
+    /* a store at an unknown index may write the same element */
+    initBlock(&block);
+    addMIR(&block, OP_CONST_4, 4, 1, 0);
+    addMIR(&block, OP_AGET, 1, 0, 4);
+    addMIR(&block, OP_APUT, 3, 0, 6);
+    load = addMIR(&block, OP_AGET, 2, 0, 4);
+    if (!checkLoad(&block, load, -1, "array store at unknown index")) {
+        return false;
+    }
+
+    /* a store at another constant index of the same array doesn't */
+    initBlock(&block);
+    addMIR(&block, OP_CONST_4, 4, 1, 0);
+    addMIR(&block, OP_CONST_4, 5, 2, 0);
+    addMIR(&block, OP_AGET, 1, 0, 4);
+    addMIR(&block, OP_APUT, 3, 0, 5);
+    load = addMIR(&block, OP_AGET, 2, 0, 4);
+    if (!checkLoad(&block, load, 1, "array store at other index")) {
+        return false;
+    }
+
+    /* but at the same index of another array register, it may */
+    initBlock(&block);
+    addMIR(&block, OP_CONST_4, 4, 1, 0);
+    addMIR(&block, OP_AGET, 1, 0, 4);
+    addMIR(&block, OP_APUT, 3, 7, 4);
+    load = addMIR(&block, OP_AGET, 2, 0, 4);
+    if (!checkLoad(&block, load, -1, "store through another array")) {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Some quick tests.
+ */
+bool dvmTestGlobalValueNumbering()
+{
+    if (!fieldTest()) {
+        ALOGE("GVN field load test failed");
+        return false;
+    }
+
+    if (!arrayTest()) {
+        ALOGE("GVN array load test failed");
+        return false;
+    }
+
+    return true;
+}
+
+#endif /*NDEBUG*/